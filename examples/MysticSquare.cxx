@@ -367,13 +367,17 @@ struct GUI {
 };
 
 void Click::handle(GC::Mouse) {
-  Sleep(100);
-  int pos = gui->squarePos[squareID];
-  if (gui->areAdjacent(pos, gui->emptySquare)) {
-    gui->moveToEmptySquare(squareID, pos);
-  } else {
-    gui->moveMultiple(pos);
-  }
+  GUI *board = gui;
+  int square = squareID;
+  // Waits without holding up the window
+  gui->canv->after(100, [board, square]() {
+    int pos = board->squarePos[square];
+    if (board->areAdjacent(pos, board->emptySquare)) {
+      board->moveToEmptySquare(square, pos);
+    } else {
+      board->moveMultiple(pos);
+    }
+  });
 }
 
 // Handles arrow key presses
@@ -382,8 +386,11 @@ struct ArrowKey : GC::EventHandler {
   GUI *gui;
   ArrowKey(GUI *gui, Direction key) : direction(key), gui(gui) {}
   virtual void handle(GC::Mouse) override {
-    Sleep(100);
-    gui->moveSquare(direction);
+    GUI *board = gui;
+    Direction key = direction;
+    gui->canv->after(100, [board, key]() {
+      board->moveSquare(key);
+    });
   }
 };
 
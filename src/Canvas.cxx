@@ -69,7 +69,186 @@ void Canvas::noMaximize() {
 }
 
 void Canvas::sleep(int millSecs) {
-  Sleep(millSecs);
+  DWORD start = GetTickCount();
+  MSG message;
+  while (true) {
+    DWORD elapsed = GetTickCount() - start;
+    if ((millSecs <= 0) || (elapsed >= static_cast<DWORD>(millSecs))) {
+      return;
+    }
+    MsgWaitForMultipleObjects(0, NULL, FALSE, millSecs - elapsed, QS_ALLINPUT);
+    while (PeekMessage(&message, NULL, 0, 0, PM_REMOVE)) {
+      if (message.message == WM_QUIT) {
+        // Left for loop() to end on
+        PostQuitMessage(static_cast<int>(message.wParam));
+        return;
+      }
+      TranslateMessage(&message);
+      DispatchMessage(&message);
+    }
+  }
+}
+
+namespace {
+
+//! Orders a heap of Canvas::Deferred with the earliest deadline on top
+template<typename Deferred>
+bool isLater(const Deferred &first, const Deferred &second) {
+  // The difference copes with GetTickCount() wrapping around
+  int difference = static_cast<int>(first.due - second.due);
+  return (difference > 0) || ((difference == 0) && (first.id > second.id));
+}
+
+//! The shape as the pick raster sees it, inside the box it's filed under in
+//! the shape index
+GS::PickItem pickItem(GS::Shape *shape) {
+  float border = shape->penSize / 2.0f + 1.0f;
+  Vec::Vec2D topLeft = shape->topLeftCoord();
+  Vec::Vec2D bottomRight = shape->bottomRightCoord();
+  return {shape->shapeID, topLeft.x - border, topLeft.y - border,
+          bottomRight.x + border, bottomRight.y + border, shape};
+}
+
+//! Returns __true__ if the shape's bounding box is exactly the one given
+bool sameBounds(GS::Shape *shape, const Vec::Vec2D &topLeft,
+                const Vec::Vec2D &bottomRight) {
+  Vec::Vec2D top = shape->topLeftCoord();
+  Vec::Vec2D bottom = shape->bottomRightCoord();
+  return (top.x == topLeft.x) && (top.y == topLeft.y) &&
+         (bottom.x == bottomRight.x) && (bottom.y == bottomRight.y);
+}
+
+}
+
+ThreadPool &Canvas::workers() {
+  if (!pool) {
+    pool.reset(new ThreadPool());
+  }
+  return *pool;
+}
+
+void Canvas::parallelism(int threads) {
+  parallelThreads = std::max(threads, 0);
+  if ((threads > 1) && (workers().size() < threads - 1)) {
+    pool.reset(new ThreadPool(threads - 1));
+  }
+}
+
+int Canvas::parallelism() {
+  return parallelThreads;
+}
+
+int Canvas::chunksFor(size_t count) {
+  if ((count < PARALLEL_ITEMS) || (parallelThreads == 1)) {
+    return 1;
+  }
+  int threads = parallelThreads ? parallelThreads : workers().size() + 1;
+  // A few chunks a thread so that a slow chunk doesn't hold the rest up
+  size_t chunks = std::min(count / CHUNK_ITEMS, threads * size_t(4));
+  return std::max(static_cast<int>(chunks), 1);
+}
+
+std::shared_ptr<std::atomic<bool>> Canvas::taskToken(int shapeID) {
+  if (shapeID == -1) {
+    return std::make_shared<std::atomic<bool>>(false);
+  }
+  auto &token = taskTokens[shapeID];
+  if (!token) {
+    token = std::make_shared<std::atomic<bool>>(false);
+  }
+  return token;
+}
+
+void Canvas::cancelTasks(int shapeID) {
+  auto found = taskTokens.find(shapeID);
+  if (found != taskTokens.end()) {
+    found->second->store(true);
+    taskTokens.erase(found);
+  }
+}
+
+int Canvas::scheduleAfter(int millSecs, std::function<void()> func) {
+  int id = ++deferredCount;
+  DWORD due = tickCount() + std::max(millSecs, 0);
+  deferred.push_back({due, id, std::move(func)});
+  std::push_heap(deferred.begin(), deferred.end(), isLater<Deferred>);
+  if (deferred.front().id == id) {
+    armAfterTimer();
+  }
+  return id;
+}
+
+int Canvas::scheduleIdle(std::function<void()> func) {
+  int id = ++deferredCount;
+  idleCalls.push_back({0, id, std::move(func)});
+  return id;
+}
+
+bool Canvas::afterCancel(int id) {
+  for (Deferred &call : deferred) {
+    if ((call.id == id) && call.func) {
+      // Dropped when it reaches the top of the heap
+      call.func = nullptr;
+      return true;
+    }
+  }
+  for (auto iter = idleCalls.begin(); iter != idleCalls.end(); iter++) {
+    if (iter->id == id) {
+      idleCalls.erase(iter);
+      return true;
+    }
+  }
+  return false;
+}
+
+void Canvas::armAfterTimer() {
+  if (!winHandle) {
+    // Set by init()
+    return;
+  }
+  if (deferred.empty()) {
+    KillTimer(winHandle, AFTER_TIMER);
+    return;
+  }
+  int remaining = static_cast<int>(deferred.front().due - tickCount());
+  SetTimer(winHandle, AFTER_TIMER, std::max(remaining, 0), NULL);
+}
+
+void Canvas::runAfter() {
+  // The calls scheduled by these ones wait for the next round, even with no
+  // delay, so that a call rescheduling itself can't starve the window
+  DWORD now = tickCount();
+  std::vector<Deferred> due;
+  while (!deferred.empty() &&
+         (static_cast<int>(deferred.front().due - now) <= 0)) {
+    std::pop_heap(deferred.begin(), deferred.end(), isLater<Deferred>);
+    due.push_back(std::move(deferred.back()));
+    deferred.pop_back();
+  }
+  bool ran = false;
+  for (const Deferred &call : due) {
+    if (call.func) {
+      call.func();
+      ran = true;
+    }
+  }
+  armAfterTimer();
+  if (ran) {
+    InvalidateRect(winHandle, NULL, TRUE);
+  }
+}
+
+bool Canvas::runIdle() {
+  if (idleCalls.empty()) {
+    return false;
+  }
+  std::vector<Deferred> calls;
+  calls.swap(idleCalls);
+  for (const Deferred &call : calls) {
+    call.func();
+  }
+  InvalidateRect(winHandle, NULL, TRUE);
+  return true;
 }
 
 GS::ShapeType Canvas::shapeType(int id) {
@@ -81,59 +260,70 @@ GS::ShapeType Canvas::shapeType(int id) {
   return GS::INVALID_SHAPE;
 }
 
-bool Canvas::addHandler(Event event, const std::string &keyStr) {
+bool Canvas::addHandler(Event event, int key) {
   if (event.eventType == INVALID_EVENT) {
     return false;
   }
-  int key = virtualKeys[keyStr];
-  if (key) {
-    if ((key != VK_LBUTTON) && (key != VK_RBUTTON) && (key != VK_MBUTTON)) {
-      // Only set the key if it's a keyboard event.
-      // VK_LBUTTON = 1; VK_RBUTTON = 2; VK_MBUTTON = 4
-      event.keyToHandle = key;
+  if (isKeyEvent(event.eventType)) {
+    if ((key <= 0) || (key >= KEY_CODES)) {
+      return false;
     }
+    event.keyToHandle = key;
+    keyEvents[key].push_back(event);
+  } else {
     events[event.eventType].push_back(event);
   }
-  return key;
+  return true;
 }
 
-bool Canvas::unbind(const std::string &eventString,
-                    int shapeID) {
-  std::string keyStr("");
-  EventType type = parseEventString(eventString, &keyStr);
-  std::vector<Event>::iterator iter = events[type].begin();
-  bool handlerExists = false;
-  while (iter != events[type].end()) {
-    if (events[type].size() == 0) {
-      break;
-    }
-    if (iter->shapeID == shapeID) {
-      events[type].erase(iter++);
-      handlerExists = true;
-      continue;
+std::vector<Event> *Canvas::handlersFor(const EventDesc &desc) {
+  if (desc.type == INVALID_EVENT) {
+    return NULL;
+  }
+  if (isKeyEvent(desc.type)) {
+    if ((desc.key <= 0) || (desc.key >= KEY_CODES)) {
+      return NULL;
     }
-    ++iter;
+    return &keyEvents[desc.key];
   }
-  return handlerExists;
+  return &events[desc.type];
+}
+
+bool Canvas::unbind(const std::string &eventString,
+                    int shapeID) {
+  return unbind(parseEvent(eventString), shapeID);
 }
 
 bool Canvas::unbind(const std::string &eventString,
                     const std::string &tag) {
-  std::string keyStr("");
-  EventType type = parseEventString(eventString, &keyStr);
-  std::vector<Event>::iterator iter = events[type].begin();
-  bool handlerExists = false;
-  while (iter != events[type].end()) {
-    if (events[type].size() == 0) {
-      break;
-    }
-    if (iter->shapeTag == tag) {
-      events[type].erase(iter++);
-      handlerExists = true;
-      continue;
-    }
-    ++iter;
+  return unbind(parseEvent(eventString), tag);
+}
+
+bool Canvas::unbind(const EventDesc &desc, int shapeID) {
+  std::vector<Event> *handlers = handlersFor(desc);
+  if (!handlers) {
+    return false;
+  }
+  auto bound = [&](const Event & event) {
+    return (event.eventType == desc.type) && (event.shapeID == shapeID);
+  };
+  auto last = std::remove_if(handlers->begin(), handlers->end(), bound);
+  bool handlerExists = last != handlers->end();
+  handlers->erase(last, handlers->end());
+  return handlerExists;
+}
+
+bool Canvas::unbind(const EventDesc &desc, const std::string &tag) {
+  std::vector<Event> *handlers = handlersFor(desc);
+  if (!handlers) {
+    return false;
   }
+  auto bound = [&](const Event & event) {
+    return (event.eventType == desc.type) && (event.shapeTag == tag);
+  };
+  auto last = std::remove_if(handlers->begin(), handlers->end(), bound);
+  bool handlerExists = last != handlers->end();
+  handlers->erase(last, handlers->end());
   return handlerExists;
 }
 
@@ -146,15 +336,30 @@ bool Canvas::trackMouse() {
   return TrackMouseEvent(&tme);
 }
 
-bool Canvas::callHandlers(EventType type, int key) {
+bool Canvas::callHandlers(EventType type, const Mouse &mouse, int key) {
+  logEvent(type, mouse, key);
   bool called = false;
-  for (const Event &event : events[type]) {
-    // Keyboard event
+  if (isKeyEvent(type)) {
+    if ((key <= 0) || (key >= KEY_CODES)) {
+      return false;
+    }
+    // Run from a copy as a handler may bind or unbind handlers, itself
+    // or through the ones run while it sleeps
+    const std::vector<Event> handlers = keyEvents[key];
+    for (const Event &event : handlers) {
+      if (event.eventType == type) {
+        runHandler(event, mouse);
+        called = true;
+      }
+    }
+    return called;
+  }
+  const std::vector<Event> handlers = events[type];
+  for (const Event &event : handlers) {
     int id = event.shapeID;
     std::string tag = event.shapeTag;
     if ((type == TIMER) && (event.timerID == key)) {
-      Mouse mouse(winHandle);
-      event.handler->handle(mouse);
+      runHandler(event, mouse);
       called = true;
     } else if ((type == LEFT_CLICK) ||
                (type == CTRL_LEFT_CLICK) ||
@@ -162,123 +367,53 @@ bool Canvas::callHandlers(EventType type, int key) {
                (type == RIGHT_CLICK) ||
                (type == HOVER) ||
                (type == WHEEL_ROLL) ||
-               (type == WHEEL_CLICK)) {
-      int delta = key;
-      Mouse mouse(winHandle, delta);
+               (type == WHEEL_CLICK) ||
+               (type == MOTION) ||
+               (type == LEFT_DRAG) ||
+               (type == RIGHT_DRAG) ||
+               (type == LEFT_RELEASE) ||
+               (type == RIGHT_RELEASE)) {
       if ((id == -1) && (tag == "")) {
         // An unbound mouse event handler.
-        event.handler->handle(mouse);
+        runHandler(event, mouse);
         called = true;
         continue;
       }
-      // Mouse event
-      auto shapeList_ = shapeList;
-      for (const auto &shape : shapeList_) {
-        int xPos = mouse.x();
-        int yPos = mouse.y();
-        if (((shape->shapeID == id)) ||
-            ((shape->hasTag(tag)))) {
-          if (shape->pointInShape(xPos, yPos)) {
-            event.handler->handle(mouse);
-            called = true;
+      // Mouse event. Find all the shapes under the cursor before calling the
+      // handler since it may change them.
+      float x = canvasX(mouse.x());
+      float y = canvasY(mouse.y());
+      int xPos = static_cast<int>(std::floor(x + 0.5f));
+      int yPos = static_cast<int>(std::floor(y + 0.5f));
+      auto isTarget = [&](GS::Shape * shape) {
+        return (shape->shapeID == id) ||
+               (event.shapeTags && shape->hasTag(*event.shapeTags));
+      };
+      int hits = 0;
+      bool isDrag = (type == LEFT_DRAG) || (type == RIGHT_DRAG) ||
+                    (type == LEFT_RELEASE) || (type == RIGHT_RELEASE);
+      if (isDrag && dragging) {
+        // Stays on the shape the drag started on without picking again
+        hits = dragTarget && isTarget(dragTarget);
+      } else if (picking) {
+        GS::Shape *shape = pickedShape(mouse.x(), mouse.y());
+        hits = shape && isTarget(shape);
+      } else {
+        shapeIndex.query(GS::Box(x, y, x, y), [&](GS::Shape * shape) {
+          if (isTarget(shape) && shape->pointInView(xPos, yPos, viewZoom)) {
+            hits++;
           }
-        }
+        });
+      }
+      for (int i = 0; i < hits; i++) {
+        runHandler(event, mouse);
+        called = true;
       }
-    } else if (event.keyToHandle == key) {
-      Mouse mouse(winHandle);
-      event.handler->handle(mouse);
-      called = true;
     }
   }
   return called;
 }
 
-EventType Canvas::parseEventString(std::string eventString,
-                                   std::string *keyString) {
-  int length = eventString.length();
-  if ((eventString.front() != '<') || (eventString.back() != '>')) {
-    return INVALID_EVENT;
-  }
-  eventString = eventString.substr(1, length - 2);
-  eventString += '-'; // Hack needed for the last token to be extracted
-  std::string modifiers[3];
-  std::string str = "";
-  int i = 0;
-  for (char ch : eventString) {
-    if (ch == '-') {
-      modifiers[i] = str;
-      str = "";
-      i++;
-    } else {
-      str = str + (char)tolower(ch);
-    }
-  }
-  std::string first = modifiers[0];
-  std::string second = modifiers[1];
-  std::string third = modifiers[2];
-  std::string temp;
-  if (((second == "ctrl") && ((first == "shift") || (first == "mouse"))) ||
-      (second == "alt")) {
-    // It's easier to handle an ALT key combination in a WM_SYSKEYUP message
-    // than in any other message using GetKeyState(VK_MENU)
-    // This part turns a string like "<Ctrl-Alt-Q>" to "<Alt-Ctrl-Q>"
-    temp = first;
-    first = second;
-    second = temp;
-  }
-  if (first == "timer") {
-    *keyString = "<timer>";
-    return TIMER;
-  } else if (first == "hover") {
-    *keyString = "<hover>";
-    return HOVER;
-  } else if (first == "ctrl") {
-    if ((third == "1") && (second == "mouse")) {
-      // <Ctrl-Mouse-1>
-      *keyString = "<1>";
-      return CTRL_LEFT_CLICK;
-    } else if (second == "shift") {
-      // <Ctrl-Shift-Q>
-      *keyString = third;
-      return CTRL_SHIFT_KEY;
-    } else {
-      // <Ctrl-Q>
-      *keyString = second;
-      return CTRL_KEY;
-    }
-  } else if (first == "alt") {
-    if ((third == "1") && (second == "mouse")) {
-      // <Alt-Mouse-1>
-      *keyString = "<1>";
-      return ALT_LEFT_CLICK;
-    } else if (second == "shift") {
-      // <Alt-Shift-Q>
-      *keyString = third;
-      return ALT_SHIFT_KEY;
-    } else {
-      // <Alt-Q>
-      *keyString = second;
-      return ALT_KEY;
-    }
-  } else if ((first == "mouse") && (second == "1") && (third == "")) {
-    *keyString = "<1>";
-    return LEFT_CLICK;
-  } else if ((first == "mouse") && (second == "2") && (third == "")) {
-    *keyString = "<2>";
-    return RIGHT_CLICK;
-  } else if ((first == "wheel") && (second == "roll") && (third == "")) {
-    *keyString = "<3>";
-    return WHEEL_ROLL;
-  } else if ((first == "key") && (third == "")) {
-    *keyString = second;
-    return BARE_KEY;
-  } else if ((first == "wheel") && (second == "click") && (third == "")) {
-    *keyString = "<3>";
-    return WHEEL_CLICK;
-  }
-  return INVALID_EVENT;
-}
-
 bool Canvas::isVisible(int shapeID) {
   for (const auto &shape : shapeList) {
     if (shape->shapeID == shapeID) {
@@ -290,9 +425,11 @@ bool Canvas::isVisible(int shapeID) {
 
 bool Canvas::hideShape(const std::string &tagName, bool visible) {
   bool foundAny = false;
+  auto expression = GS::compileTags(tagName);
   for (const auto &shape : shapeList) {
-    if (shape->hasTag(tagName)) {
+    if (shape->hasTag(*expression)) {
       shape->visibility(visible);
+      damagePick(shape.get());
       foundAny = true;
     }
   }
@@ -303,6 +440,7 @@ bool Canvas::hideShape(int shapeID, bool visible) {
   for (const auto &shape : shapeList) {
     if (shape->shapeID == shapeID) {
       shape->visibility(visible);
+      damagePick(shape.get());
       return true;
     }
   }
@@ -319,9 +457,11 @@ bool Canvas::showShape(const std::string &tagName) {
 
 bool Canvas::moveShape(const std::string &shapeTag, int xAmount, int yAmount) {
   bool foundAny = false;
+  auto expression = GS::compileTags(shapeTag);
   for (auto shape : shapeList) {
-    if (shape->hasTag(shapeTag)) {
+    if (shape->hasTag(*expression)) {
       shape->move(xAmount, yAmount);
+      reindex(shape.get());
       foundAny = true;
     }
   }
@@ -332,6 +472,66 @@ bool Canvas::moveShape(int shapeID, int xAmount, int yAmount) {
   for (const auto &shape : shapeList) {
     if (shape->shapeID == shapeID) {
       shape->move(xAmount, yAmount);
+      reindex(shape.get());
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Canvas::scale(const std::string &tagName,
+                   float originX,
+                   float originY,
+                   float xScale,
+                   float yScale) {
+  bool foundAny = false;
+  auto expression = GS::compileTags(tagName);
+  for (const auto &shape : shapeList) {
+    if (shape->hasTag(*expression)) {
+      shape->scale(originX, originY, xScale, yScale);
+      reindex(shape.get());
+      foundAny = true;
+    }
+  }
+  return foundAny;
+}
+
+bool Canvas::scale(int shapeID,
+                   float originX,
+                   float originY,
+                   float xScale,
+                   float yScale) {
+  for (const auto &shape : shapeList) {
+    if (shape->shapeID == shapeID) {
+      shape->scale(originX, originY, xScale, yScale);
+      reindex(shape.get());
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Canvas::rotate(const std::string &tagName,
+                    float centerX,
+                    float centerY,
+                    float angle) {
+  bool foundAny = false;
+  auto expression = GS::compileTags(tagName);
+  for (const auto &shape : shapeList) {
+    if (shape->hasTag(*expression)) {
+      shape->rotate(centerX, centerY, angle);
+      reindex(shape.get());
+      foundAny = true;
+    }
+  }
+  return foundAny;
+}
+
+bool Canvas::rotate(int shapeID, float centerX, float centerY, float angle) {
+  for (const auto &shape : shapeList) {
+    if (shape->shapeID == shapeID) {
+      shape->rotate(centerX, centerY, angle);
+      reindex(shape.get());
       return true;
     }
   }
@@ -350,54 +550,643 @@ void Canvas::resizeWindow(int width, int height) {
                SWP_NOZORDER | SWP_NOACTIVATE);
 }
 
-void Canvas::moveWindow(int newX, int newY) {
-  POINT currSize = windowSize();
-  SetWindowPos(winHandle, 0, newX, newY, currSize.x, currSize.y,
-               SWP_NOZORDER | SWP_NOACTIVATE);
+void Canvas::moveWindow(int newX, int newY) {
+  POINT currSize = windowSize();
+  SetWindowPos(winHandle, 0, newX, newY, currSize.x, currSize.y,
+               SWP_NOZORDER | SWP_NOACTIVATE);
+}
+
+POINT Canvas::windowSize() {
+  RECT rect;
+  GetWindowRect(winHandle, &rect);
+  return {std::abs(rect.left - rect.right),
+          std::abs(rect.top - rect.bottom)
+         };
+}
+
+std::vector<int> Canvas::findEnclosed(int x1,
+                                      int y1,
+                                      int x2,
+                                      int y2,
+                                      CoordSpace space) {
+  std::vector<int> items;
+  forEachEnclosed(x1, y1, x2, y2, [&items](ShapeRef shape) {
+    items.push_back(shape.id());
+  }, space);
+  return items;
+}
+
+std::vector<int> Canvas::findOverlapping(int x1,
+                                         int y1,
+                                         int x2,
+                                         int y2,
+                                         CoordSpace space) {
+  std::vector<int> items;
+  forEachOverlapping(x1, y1, x2, y2, [&items](ShapeRef shape) {
+    items.push_back(shape.id());
+  }, space);
+  return items;
+}
+
+std::vector<int> Canvas::findClosest(int x,
+                                     int y,
+                                     float halo,
+                                     CoordSpace space) {
+  std::vector<GS::Neighbour> neighbours;
+  nearestShapes(x, y, 1, halo, FLT_MAX, space, &neighbours);
+  std::vector<int> items;
+  for (const GS::Neighbour &neighbour : neighbours) {
+    items.push_back(neighbour.shape->shapeID);
+  }
+  return items;
+}
+
+std::vector<int> Canvas::findNearest(int x,
+                                     int y,
+                                     int count,
+                                     float maxDistance,
+                                     CoordSpace space) {
+  std::vector<GS::Neighbour> neighbours;
+  nearestShapes(x, y, count, 0.0f, maxDistance, space, &neighbours);
+  std::vector<int> items;
+  for (const GS::Neighbour &neighbour : neighbours) {
+    items.push_back(neighbour.shape->shapeID);
+  }
+  return items;
+}
+
+int Canvas::pick(int x, int y, CoordSpace space) {
+  int xWindow = (space == WINDOW_COORDS) ? x : windowX(x);
+  int yWindow = (space == WINDOW_COORDS) ? y : windowY(y);
+  if (picking && (xWindow >= 0) && (yWindow >= 0) &&
+      (xWindow < pickBuffer.width()) && (yWindow < pickBuffer.height())) {
+    GS::Shape *shape = pickedShape(xWindow, yWindow);
+    return shape ? shape->shapeID : -1;
+  }
+  GS::Shape *shape = topmostShape(x, y, space);
+  return shape ? shape->shapeID : -1;
+}
+
+GS::Shape *Canvas::topmostShape(int x, int y, CoordSpace space) {
+  GS::Box point = canvasRegion(x, y, x, y, space);
+  int xPos = static_cast<int>(std::floor(point.x1 + 0.5f));
+  int yPos = static_cast<int>(std::floor(point.y1 + 0.5f));
+  GS::Shape *topmost = NULL;
+  shapeIndex.query(point, [&](GS::Shape * shape) {
+    if ((!topmost || (shape->stackOrder > topmost->stackOrder)) &&
+        shape->isShown() && shape->pointInView(xPos, yPos, viewZoom)) {
+      topmost = shape;
+    }
+  });
+  return topmost;
+}
+
+void Canvas::queueMotion(const Mouse &mouse) {
+  if (events[MOTION].empty() && events[LEFT_DRAG].empty() &&
+      events[RIGHT_DRAG].empty()) {
+    lastMotion = {mouse.x(), mouse.y()};
+    return;
+  }
+  pendingMotion = mouse;
+  hasPendingMotion = true;
+  DWORD elapsed = tickCount() - lastMotionTime;
+  if (elapsed >= MOTION_INTERVAL) {
+    flushMotion();
+  } else {
+    // Replaces the timer if one is already waiting
+    SetTimer(winHandle, MOTION_TIMER, MOTION_INTERVAL - elapsed, NULL);
+  }
+}
+
+bool Canvas::flushMotion() {
+  if (!hasPendingMotion) {
+    return false;
+  }
+  hasPendingMotion = false;
+  if (!replaying) {
+    KillTimer(winHandle, MOTION_TIMER);
+  }
+  Mouse mouse = pendingMotion;
+  mouse.addMotion(mouse.x() - lastMotion.x, mouse.y() - lastMotion.y);
+  lastMotion = {mouse.x(), mouse.y()};
+  lastMotionTime = tickCount();
+  bool called = callHandlers(MOTION, mouse);
+  if (mouse.isHeld(LEFT_BUTTON_HELD)) {
+    called |= callHandlers(LEFT_DRAG, mouse);
+  }
+  if (mouse.isHeld(RIGHT_BUTTON_HELD)) {
+    called |= callHandlers(RIGHT_DRAG, mouse);
+  }
+  if (called) {
+    InvalidateRect(winHandle, NULL, TRUE);
+  }
+  return called;
+}
+
+void Canvas::beginDrag(const Mouse &mouse) {
+  flushMotion();
+  lastMotion = {mouse.x(), mouse.y()};
+  if (!dragging) {
+    dragTarget = topmostShape(mouse.x(), mouse.y(), WINDOW_COORDS);
+    dragging = true;
+    // A replay doesn't take the mouse from the window it runs next to
+    if (!replaying) {
+      SetCapture(winHandle);
+    }
+  }
+}
+
+DWORD Canvas::tickCount() {
+  return replaying ? replayClock : GetTickCount();
+}
+
+void Canvas::runHandler(const Event &event, const Mouse &mouse) {
+  if (!replaying) {
+    event.handler->handle(mouse);
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  event.handler->handle(mouse);
+  std::chrono::duration<double, std::micro> taken =
+    std::chrono::steady_clock::now() - start;
+  handlerTime += taken.count();
+}
+
+void Canvas::logEvent(EventType type, const Mouse &mouse, int key) {
+  if (!recorder.isOpen() || replaying) {
+    return;
+  }
+  LoggedEvent event;
+  event.time = GetTickCount() - recordStart;
+  event.type = type;
+  event.key = key;
+  event.x = mouse.x();
+  event.y = mouse.y();
+  event.xRoot = mouse.xRoot();
+  event.yRoot = mouse.yRoot();
+  event.dx = mouse.dx();
+  event.dy = mouse.dy();
+  event.wheelDelta = mouse.delta();
+  event.state = mouse.held();
+  recorder.write(event);
+}
+
+bool Canvas::startRecording(const std::string &path) {
+  recordStart = GetTickCount();
+  return recorder.open(path);
+}
+
+void Canvas::stopRecording() {
+  recorder.close();
+}
+
+bool Canvas::replay(const std::string &path,
+                    std::vector<EventTiming> *timings) {
+  std::vector<LoggedEvent> log;
+  if (!readEventLog(path, &log)) {
+    timings->clear();
+    return false;
+  }
+  replay(log, timings);
+  return true;
+}
+
+void Canvas::replay(const std::vector<LoggedEvent> &log,
+                    std::vector<EventTiming> *timings) {
+  timings->clear();
+  replaying = true;
+  for (const LoggedEvent &event : log) {
+    if ((event.type < 0) || (event.type >= INVALID_EVENT)) {
+      continue;
+    }
+    EventType type = static_cast<EventType>(event.type);
+    Mouse mouse({event.x, event.y}, {event.xRoot, event.yRoot}, event.state,
+                event.wheelDelta);
+    mouse.addMotion(event.dx, event.dy);
+    replayClock = event.time;
+    handlerTime = 0;
+    EventTiming timing;
+    timing.event = event;
+    auto start = std::chrono::steady_clock::now();
+    // A press starts a drag the way WM_LBUTTONDOWN does so that the drag
+    // handlers see the same target
+    if ((type == LEFT_CLICK) || (type == CTRL_LEFT_CLICK) ||
+        (type == ALT_LEFT_CLICK) || (type == RIGHT_CLICK)) {
+      beginDrag(mouse);
+    }
+    if ((type == LEFT_RELEASE) || (type == RIGHT_RELEASE)) {
+      timing.called = endDrag(type, mouse);
+    } else {
+      timing.called = callHandlers(type, mouse, event.key);
+    }
+    std::chrono::duration<double, std::micro> taken =
+      std::chrono::steady_clock::now() - start;
+    timing.dispatch = taken.count();
+    timing.handlers = handlerTime;
+    timings->push_back(timing);
+  }
+  replaying = false;
+}
+
+int Canvas::postShape(GS::Shape *newShape) {
+  int id = newShape->shapeID;
+  post([newShape](Canvas & canvas) {
+    canvas.addShape(newShape);
+  });
+  return id;
+}
+
+void Canvas::wake() {
+  // Orders the caller's push before the load. init() does the opposite, so a
+  // command pushed while the window is created is seen by one of the two.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  HWND window = commandWindow.load();
+  if (window && !woken.exchange(true)) {
+    PostMessage(window, COMMAND_MESSAGE, 0, 0);
+  }
+}
+
+int Canvas::runCommands() {
+  // Cleared first so a post made while the batch runs sends a message
+  woken.store(false);
+  bool complete = true;
+  int count = commands.drain(&complete);
+  if (!complete) {
+    // Posted while the batch ran, or a thread is half way through a post.
+    // Left for the next message so that the window keeps responding.
+    wake();
+  }
+  if (count) {
+    InvalidateRect(winHandle, NULL, TRUE);
+  }
+  return count;
+}
+
+void Canvas::touch(GS::Shape *shape) {
+  shape->revision++;
+  sceneDirty = true;
+  snapshotDirty = true;
+}
+
+void Canvas::renderThread(bool enabled) {
+  if (enabled == renderer.isRunning()) {
+    return;
+  }
+  published.clear();
+  sceneDirty = true;
+  if (enabled) {
+    HBRUSH background = reinterpret_cast<HBRUSH>(
+                          GetClassLongPtr(winHandle, GCLP_HBRBACKGROUND));
+    renderer.start(winHandle, background);
+  } else {
+    renderer.stop();
+  }
+  InvalidateRect(winHandle, NULL, TRUE);
+}
+
+bool Canvas::renderThread() {
+  return renderer.isRunning();
+}
+
+void Canvas::publishScene() {
+  std::unique_ptr<Scene> scene(new Scene);
+  RECT client;
+  GetClientRect(winHandle, &client);
+  scene->width = client.right - client.left;
+  scene->height = client.bottom - client.top;
+  scene->viewX = viewX;
+  scene->viewY = viewY;
+  scene->viewZoom = viewZoom;
+  scene->shapes.reserve(shapeList.size());
+  // Only the changed items get new copies. The entries of removed items are
+  // dropped by unindexShape().
+  for (const auto &shape : shapeList) {
+    PublishedShape &entry = published[shape->shapeID];
+    if (!entry.copy || (entry.revision != shape->revision)) {
+      std::shared_ptr<GS::Shape> copy = shape->clone();
+      if (entry.copy) {
+        // Scenes are drawn in the order they're published, so the new copy
+        // carries on from the old one's caches
+        copy->reuseCaches(*entry.copy);
+      }
+      entry = {shape->revision, copy};
+    }
+    scene->shapes.push_back(entry.copy);
+  }
+  renderer.publish(std::move(scene));
+  sceneDirty = false;
+}
+
+void Canvas::snapshots(bool enabled) {
+  if (enabled == snapshotting) {
+    return;
+  }
+  snapshotting = enabled;
+  snapshotPublisher.clear();
+  if (enabled) {
+    snapshotDirty = true;
+    publishSnapshot();
+  } else {
+    std::atomic_store(&latestSnapshot, std::shared_ptr<const Snapshot>());
+  }
+}
+
+bool Canvas::snapshots() {
+  return snapshotting;
+}
+
+std::shared_ptr<const Snapshot> Canvas::snapshot() const {
+  return std::atomic_load(&latestSnapshot);
+}
+
+void Canvas::publishSnapshot() {
+  if (!snapshotting || !snapshotDirty) {
+    return;
+  }
+  std::atomic_store(&latestSnapshot,
+                    snapshotPublisher.publish(shapeList, ++snapshotCount));
+  snapshotDirty = false;
+}
+
+bool Canvas::endDrag(EventType release, const Mouse &mouse) {
+  flushMotion();
+  bool called = callHandlers(release, mouse);
+  if (!(mouse.held() & (LEFT_BUTTON_HELD | RIGHT_BUTTON_HELD))) {
+    dragging = false;
+    dragTarget = NULL;
+    if (!replaying) {
+      ReleaseCapture();
+    }
+  }
+  return called;
+}
+
+void Canvas::pickingMode(bool enabled) {
+  if (enabled && !picking) {
+    RECT client = {0, 0, 0, 0};
+    GetClientRect(winHandle, &client);
+    pickBuffer.resize(client.right - client.left, client.bottom - client.top);
+  } else if (!enabled) {
+    pickBuffer.resize(0, 0);
+  }
+  picking = enabled;
+}
+
+bool Canvas::pickingMode() {
+  return picking;
+}
+
+GS::Shape *Canvas::pickedShape(int x, int y) {
+  GS::PickView view = {viewX, viewY, viewZoom};
+  if (pickBuffer.isDamaged()) {
+    std::vector<GS::Shape *> shapes;
+    pickBuffer.update(view,
+    [&](float x1, float y1, float x2, float y2,
+    std::vector<GS::PickItem> *items) {
+      shapes.clear();
+      regionShapes(GS::Box(x1, y1, x2, y2), &shapes);
+      for (GS::Shape *shape : shapes) {
+        if (shape->isShown()) {
+          items->push_back(pickItem(shape));
+        }
+      }
+    },
+    [this](const GS::PickItem & item, const float *xs, const float *ys,
+    int count, unsigned char *inside) {
+      return static_cast<GS::Shape *>(item.item)->pointsInView(xs, ys, count,
+             viewZoom, inside);
+    });
+  }
+  int id = pickBuffer.at(x, y);
+  if (id == GS::PickBuffer::NO_SHAPE) {
+    return NULL;
+  }
+  // The shape was picked from the ones filed under the pixel so only those
+  // need to be looked at
+  float xCanvas = canvasX(x);
+  float yCanvas = canvasY(y);
+  GS::Shape *picked = NULL;
+  shapeIndex.query(GS::Box(xCanvas, yCanvas, xCanvas, yCanvas),
+  [&](GS::Shape * shape) {
+    if (shape->shapeID == id) {
+      picked = shape;
+    }
+  });
+  return picked;
+}
+
+void Canvas::damagePick(GS::Shape *shape) {
+  touch(shape);
+  if (picking) {
+    pickBuffer.damage(pickItem(shape), GS::PickView {viewX, viewY, viewZoom});
+  }
+}
+
+void Canvas::damageView(float oldX, float oldY, float oldZoom) {
+  sceneDirty = true;
+  if (!picking) {
+    return;
+  }
+  float dx = (viewX - oldX) * viewZoom;
+  float dy = (viewY - oldY) * viewZoom;
+  int columns = static_cast<int>(std::floor(dx + 0.5f));
+  int rows = static_cast<int>(std::floor(dy + 0.5f));
+  // A pixel then still maps to the canvas point it did before the move
+  const float TOLERANCE = 1e-3f;
+  if ((viewZoom == oldZoom) && (std::abs(dx - columns) < TOLERANCE) &&
+      (std::abs(dy - rows) < TOLERANCE)) {
+    pickBuffer.scroll(columns, rows);
+  } else {
+    pickBuffer.damageAll();
+  }
+}
+
+void Canvas::nearestShapes(int x,
+                           int y,
+                           int count,
+                           float halo,
+                           float maxDistance,
+                           CoordSpace space,
+                           std::vector<GS::Neighbour> *neighbours) {
+  GS::Box region = canvasRegion(x, y, x, y, space);
+  Vec::Vec2D point(region.x1, region.y1);
+  if (space == WINDOW_COORDS) {
+    // Distances are in pixels on the screen
+    halo /= viewZoom;
+    maxDistance /= viewZoom;
+  }
+  shapeIndex.nearest(point, count, halo, maxDistance,
+  [&point](GS::Shape * shape) {
+    return shape->distanceTo(point.x, point.y);
+  }, neighbours);
+}
+
+void Canvas::regionShapes(const GS::Box &region,
+                          std::vector<GS::Shape *> *shapes) {
+  shapeIndex.query(region, [shapes](GS::Shape * shape) {
+    shapes->push_back(shape);
+  });
+  auto below = [](const GS::Shape * first, const GS::Shape * second) {
+    return first->stackOrder < second->stackOrder;
+  };
+  std::sort(shapes->begin(), shapes->end(), below);
+}
+
+GS::Box Canvas::canvasRegion(int x1, int y1, int x2, int y2, CoordSpace space) {
+  if (space == WINDOW_COORDS) {
+    return {canvasX(x1), canvasY(y1), canvasX(x2), canvasY(y2)};
+  }
+  return {static_cast<float>(x1), static_cast<float>(y1),
+          static_cast<float>(x2), static_cast<float>(y2)};
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~[ View ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+float Canvas::canvasX(int windowX) {
+  return viewX + windowX / viewZoom;
+}
+
+float Canvas::canvasY(int windowY) {
+  return viewY + windowY / viewZoom;
+}
+
+int Canvas::windowX(float canvasX) {
+  return static_cast<int>(std::floor((canvasX - viewX) * viewZoom + 0.5f));
+}
+
+int Canvas::windowY(float canvasY) {
+  return static_cast<int>(std::floor((canvasY - viewY) * viewZoom + 0.5f));
+}
+
+GS::Box Canvas::visibleRegion() {
+  RECT client = {0, 0, 0, 0};
+  GetClientRect(winHandle, &client);
+  return canvasRegion(client.left, client.top, client.right, client.bottom,
+                      WINDOW_COORDS);
+}
+
+void Canvas::clampView() {
+  if (!hasScrollRegion) {
+    return;
+  }
+  GS::Box visible = visibleRegion();
+  float width = visible.x2 - visible.x1;
+  float height = visible.y2 - visible.y1;
+  if (width >= scrollBox.x2 - scrollBox.x1) {
+    viewX = scrollBox.x1;
+  } else {
+    viewX = std::max(scrollBox.x1, std::min(viewX, scrollBox.x2 - width));
+  }
+  if (height >= scrollBox.y2 - scrollBox.y1) {
+    viewY = scrollBox.y1;
+  } else {
+    viewY = std::max(scrollBox.y1, std::min(viewY, scrollBox.y2 - height));
+  }
+}
+
+void Canvas::scrollRegion(GS::Box region) {
+  float oldX = viewX, oldY = viewY, oldZoom = viewZoom;
+  scrollBox = region;
+  hasScrollRegion = true;
+  clampView();
+  damageView(oldX, oldY, oldZoom);
+  InvalidateRect(winHandle, NULL, TRUE);
+}
+
+GS::Box Canvas::scrollRegion() {
+  if (hasScrollRegion) {
+    return scrollBox;
+  }
+  return BBox(std::vector<std::string> {"all"});
+}
+
+void Canvas::xview(float fraction) {
+  GS::Box region = scrollRegion();
+  if (region.x2 < region.x1) {
+    // No items to scroll over
+    return;
+  }
+  float oldX = viewX, oldY = viewY, oldZoom = viewZoom;
+  viewX = region.x1 + fraction * (region.x2 - region.x1);
+  clampView();
+  damageView(oldX, oldY, oldZoom);
+  InvalidateRect(winHandle, NULL, TRUE);
+}
+
+float Canvas::xview() {
+  GS::Box region = scrollRegion();
+  float width = region.x2 - region.x1;
+  return (width > 0.0f) ? (viewX - region.x1) / width : 0.0f;
+}
+
+void Canvas::yview(float fraction) {
+  GS::Box region = scrollRegion();
+  if (region.y2 < region.y1) {
+    // No items to scroll over
+    return;
+  }
+  float oldX = viewX, oldY = viewY, oldZoom = viewZoom;
+  viewY = region.y1 + fraction * (region.y2 - region.y1);
+  clampView();
+  damageView(oldX, oldY, oldZoom);
+  InvalidateRect(winHandle, NULL, TRUE);
 }
 
-POINT Canvas::windowSize() {
-  RECT rect;
-  GetWindowRect(winHandle, &rect);
-  return {std::abs(rect.left - rect.right),
-          std::abs(rect.top - rect.bottom)
-         };
+float Canvas::yview() {
+  GS::Box region = scrollRegion();
+  float height = region.y2 - region.y1;
+  return (height > 0.0f) ? (viewY - region.y1) / height : 0.0f;
 }
 
-std::vector<int> Canvas::findEnclosed(int x1, int y1, int x2, int y2) {
-  std::vector<int> items;
-  for (const auto &shape : shapeList) {
-    if (shape->shapeInRegion(Vec::Vec2D(x1, y1), Vec::Vec2D(x2, y2))) {
-      items.push_back(shape->shapeID);
-    }
-  }
-  return items;
+void Canvas::pan(int xAmount, int yAmount) {
+  float oldX = viewX, oldY = viewY, oldZoom = viewZoom;
+  viewX += xAmount / viewZoom;
+  viewY += yAmount / viewZoom;
+  clampView();
+  damageView(oldX, oldY, oldZoom);
+  InvalidateRect(winHandle, NULL, TRUE);
 }
 
-std::vector<int> Canvas::findOverlapping(int x1, int y1, int x2, int y2) {
-  std::vector<int> items;
-  for (const auto &shape : shapeList) {
-    if (shape->overlapsWithRegion(Vec::Vec2D(x1, y1), Vec::Vec2D(x2, y2))) {
-      items.push_back(shape->shapeID);
-    }
+void Canvas::zoom(float factor, int x, int y) {
+  if (factor <= 0.0f) {
+    return;
   }
-  return items;
+  float oldX = viewX, oldY = viewY, oldZoom = viewZoom;
+  float anchorX = canvasX(x);
+  float anchorY = canvasY(y);
+  viewZoom *= factor;
+  viewX = anchorX - x / viewZoom;
+  viewY = anchorY - y / viewZoom;
+  clampView();
+  damageView(oldX, oldY, oldZoom);
+  InvalidateRect(winHandle, NULL, TRUE);
+}
+
+float Canvas::zoom() {
+  return viewZoom;
 }
 
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
 std::vector<int> Canvas::findAll() {
   return findWithTag("all");
 }
 
 std::vector<int> Canvas::findWithTag(const std::string &tag) {
   std::vector<int> items;
+  auto expression = GS::compileTags(tag);
   for (const auto &shape : shapeList) {
-    if (shape->hasTag(tag)) {
+    if (shape->hasTag(*expression)) {
       items.push_back(shape->shapeID);
     }
   }
   return items;
 }
 
+ShapeRange Canvas::withTag(const std::string &tag) {
+  return ShapeRange(this, &shapeList, GS::compileTags(tag));
+}
+
 std::vector<std::string> Canvas::getTags(int id) {
   for (const auto &shape : shapeList) {
     if (shape->shapeID == id) {
@@ -459,6 +1248,7 @@ bool Canvas::coords(int shapeID, const std::vector<POINT> &newCoords) {
   for (const auto &shape : shapeList) {
     if (shape->shapeID == shapeID) {
       shape->changeCoords(newCoords);
+      reindex(shape.get());
       return true;
     }
   }
@@ -515,12 +1305,100 @@ bool Canvas::raiseShape(int first, int second) {
   for (auto iter = shapeList.begin(); iter != shapeList.end(); iter++) {
     if ((*iter)->shapeID == second) {
       shapeList.insert(++iter, shape);
+      restack();
+      damagePick(shape.get());
       return true;
     }
   }
   return false;
 }
 
+int Canvas::group(const std::vector<int> &shapeIDs) {
+  std::vector<std::shared_ptr<GS::Shape>> children;
+  auto topmost = shapeList.end();
+  for (auto iter = shapeList.begin(); iter != shapeList.end(); iter++) {
+    int id = (*iter)->shapeID;
+    if (std::find(shapeIDs.begin(), shapeIDs.end(), id) != shapeIDs.end()) {
+      children.push_back(*iter);
+      topmost = iter;
+    }
+  }
+  return group(children, topmost);
+}
+
+int Canvas::group(const std::string &tagName) {
+  std::vector<std::shared_ptr<GS::Shape>> children;
+  auto topmost = shapeList.end();
+  auto expression = GS::compileTags(tagName);
+  for (auto iter = shapeList.begin(); iter != shapeList.end(); iter++) {
+    if ((*iter)->hasTag(*expression)) {
+      children.push_back(*iter);
+      topmost = iter;
+    }
+  }
+  return group(children, topmost);
+}
+
+int Canvas::group(const std::vector<std::shared_ptr<GS::Shape>> &children,
+                  std::vector<std::shared_ptr<GS::Shape>>::iterator topmost) {
+  if (children.empty()) {
+    return -1;
+  }
+  std::shared_ptr<GS::Shape> newGroup(new GS::Group(children));
+  for (const auto &child : children) {
+    unindexShape(child.get());
+    cancelTasks(child->shapeID);
+  }
+  // The group takes the place of its topmost child in the display list
+  *topmost = newGroup;
+  auto isChild = [&](const std::shared_ptr<GS::Shape> &shape) {
+    return std::find(children.begin(), children.end(), shape) != children.end();
+  };
+  shapeList.erase(std::remove_if(shapeList.begin(), shapeList.end(), isChild),
+                  shapeList.end());
+  restack();
+  indexShape(newGroup.get());
+  return newGroup->shapeID;
+}
+
+bool Canvas::ungroup(int groupID) {
+  for (auto iter = shapeList.begin(); iter != shapeList.end(); iter++) {
+    if (((*iter)->shapeID != groupID) || ((*iter)->shapeType != GS::GROUP)) {
+      continue;
+    }
+    auto oldGroup = std::static_pointer_cast<GS::Group>(*iter);
+    unindexShape(oldGroup.get());
+    cancelTasks(groupID);
+    iter = shapeList.erase(iter);
+    shapeList.insert(iter, oldGroup->children.begin(), oldGroup->children.end());
+    restack();
+    for (const auto &child : oldGroup->children) {
+      indexShape(child.get());
+    }
+    return true;
+  }
+  return false;
+}
+
+std::vector<int> Canvas::children(int groupID) {
+  std::vector<int> items;
+  for (const auto &shape : shapeList) {
+    if ((shape->shapeID == groupID) && (shape->shapeType == GS::GROUP)) {
+      for (const auto &child : static_cast<GS::Group *>(shape.get())->children) {
+        items.push_back(child->shapeID);
+      }
+    }
+  }
+  return items;
+}
+
+void Canvas::restack() {
+  stackCounter = 0;
+  for (const auto &shape : shapeList) {
+    shape->stackOrder = stackCounter++;
+  }
+}
+
 bool Canvas::lowerShape(const std::string &others, int target) {
   std::vector<int> shapes = findWithTag(others);
   bool res = false;
@@ -577,53 +1455,26 @@ bool Canvas::title(const char *title) {
 }
 
 GS::Box Canvas::BBox(const std::vector<std::string> &tags) {
-  float smallestX = FLT_MAX,
-        smallestY = FLT_MAX;
-  float largestX = -FLT_MAX,
-        largestY = -FLT_MAX;
-  for (const auto &shape : shapeList) {
-    auto tagMatches = [&shape](const std::string & tag) {
-      if (shape->hasTag(tag)) {
+  std::vector<std::shared_ptr<const GS::TagExpression>> expressions;
+  for (const std::string &tag : tags) {
+    expressions.push_back(GS::compileTags(tag));
+  }
+  return boundingBox([&expressions](GS::Shape * shape) {
+    for (const auto &expression : expressions) {
+      if (shape->hasTag(*expression)) {
+        // The shape has at least one of the tags
         return true;
       }
-      return false;
-    };
-    if (std::any_of(tags.begin(), tags.end(), tagMatches)) {
-      // The shape has at least one of the tags
-      Vec::Vec2D topPoint(shape->topLeftCoord());
-      Vec::Vec2D bottomPoint(shape->bottomRightCoord());
-      smallestX = (topPoint.x < smallestX) ? topPoint.x : smallestX;
-      smallestY = (topPoint.y < smallestY) ? topPoint.y : smallestY;
-      largestX = (bottomPoint.x > largestX) ? bottomPoint.x : largestX;
-      largestY = (bottomPoint.y > largestY) ? bottomPoint.y : largestY;
     }
-  }
-  return {smallestX, smallestY, largestX, largestY};
+    return false;
+  });
 }
 
 GS::Box Canvas::BBox(const std::vector<int> &shapes) {
-  float smallestX = FLT_MAX,
-        smallestY = FLT_MAX;
-  float largestX = -FLT_MAX,
-        largestY = -FLT_MAX;
-  for (const auto &shape : shapeList) {
-    auto hasID = [&shape](int id) {
-      if (shape->shapeID == id) {
-        return true;
-      }
-      return false;
-    };
-    if (std::any_of(shapes.begin(), shapes.end(), hasID)) {
-      // The shape has at least one of the tags
-      Vec::Vec2D topPoint(shape->topLeftCoord());
-      Vec::Vec2D bottomPoint(shape->bottomRightCoord());
-      smallestX = (topPoint.x < smallestX) ? topPoint.x : smallestX;
-      smallestY = (topPoint.y < smallestY) ? topPoint.y : smallestY;
-      largestX = (bottomPoint.x > largestX) ? bottomPoint.x : largestX;
-      largestY = (bottomPoint.y > largestY) ? bottomPoint.y : largestY;
-    }
-  }
-  return {smallestX, smallestY, largestX, largestY};
+  return boundingBox([&shapes](GS::Shape * shape) {
+    return std::find(shapes.begin(), shapes.end(),
+                     shape->shapeID) != shapes.end();
+  });
 }
 
 GS::Box Canvas::BBox(int shapeID) {
@@ -654,16 +1505,58 @@ bool Canvas::killConsole() {
 
 int Canvas::addShape(GS::Shape *newShape) {
   std::shared_ptr<GS::Shape> newShape_(newShape);
-  for (const auto &shape : shapeList) {
-    if (GS::areEqual(shape, newShape_) &&
-        (shape->shapeType != GS::TEXT)) {
-      return -1;
-    }
-  }
+  // Equal shapes have the same bounding box so only those sharing a point
+  // with it need to be compared.
+  Vec::Vec2D topLeft = newShape->topLeftCoord();
+  Vec::Vec2D bottomRight = newShape->bottomRightCoord();
+  GS::Box region(topLeft.x, topLeft.y, bottomRight.x, bottomRight.y);
+  bool exists = false;
+  shapeIndex.query(region, [&](GS::Shape * shape) {
+    exists = exists || ((shape->shapeType != GS::TEXT) &&
+                        (shape->shapeType != GS::SERIES) &&
+                        (shape->shapeType != GS::POINT_CLOUD) &&
+                        (shape->shapeType != GS::INSTANCES) &&
+                        (shape->shapeType != GS::GROUP) &&
+                        GS::areEqual(shape, newShape));
+  });
+  if (exists) {
+    return -1;
+  }
+  newShape->stackOrder = stackCounter++;
   shapeList.push_back(newShape_);
+  indexShape(newShape);
   return newShape->shapeID;
 }
 
+void Canvas::reindex(GS::Shape *shape) {
+  // The pixels where the shape was, as filed in the index, and where it's now
+  GS::Box bounds;
+  if (picking && shapeIndex.bounds(shape, &bounds)) {
+    pickBuffer.damage(windowX(bounds.x1) - 1, windowY(bounds.y1) - 1,
+                      windowX(bounds.x2) + 1, windowY(bounds.y2) + 1);
+  }
+  shapeIndex.update(shape);
+  damagePick(shape);
+}
+
+void Canvas::indexShape(GS::Shape *shape) {
+  if (shape->shapeType == GS::SERIES) {
+    seriesByID[shape->shapeID] = static_cast<GS::Series *>(shape);
+  }
+  shapeIndex.insert(shape);
+  damagePick(shape);
+}
+
+void Canvas::unindexShape(GS::Shape *shape) {
+  if (shape == dragTarget) {
+    dragTarget = NULL;
+  }
+  damagePick(shape);
+  shapeIndex.remove(shape);
+  seriesByID.erase(shape->shapeID);
+  published.erase(shape->shapeID);
+}
+
 // ~~~~~~~~~~~~~~~~~~~~~[ Tagging methods ]~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 bool Canvas::tagAbove(const std::string &tagName, int shapeID) {
@@ -691,43 +1584,63 @@ bool Canvas::tagAll(const std::string &tagName) {
   return tagAbove(tagName, -1);
 }
 
-bool Canvas::tagEnclosed(const std::string &tagName, GS::Box region) {
-  return tagEnclosed(tagName, region.x1, region.y1, region.x2, region.y2);
+bool Canvas::tagEnclosed(const std::string &tagName, GS::Box region,
+                         CoordSpace space) {
+  return tagEnclosed(tagName, region.x1, region.y1, region.x2, region.y2,
+                     space);
 }
 
 bool Canvas::tagEnclosed(const std::string &tagName,
                          int x1,
                          int y1,
                          int x2,
-                         int y2) {
-  bool foundAny = false;
-  for (const auto &shape : shapeList) {
-    POINT topLeft = {x1, y1};
-    POINT bottomRight = {x2, y2};
-    if (shape->shapeInRegion(topLeft, bottomRight)) {
-      foundAny = true;
-      shape->addTag(tagName);
-    }
-  }
-  return foundAny;
+                         int y2,
+                         CoordSpace space) {
+  return tagRegion(tagName, x1, y1, x2, y2, space, true);
 }
 
-bool Canvas::tagOverlapping(const std::string &tagName, GS::Box region) {
-  return tagOverlapping(tagName, region.x1, region.y1, region.x2, region.y2);
+bool Canvas::tagOverlapping(const std::string &tagName, GS::Box region,
+                            CoordSpace space) {
+  return tagOverlapping(tagName, region.x1, region.y1, region.x2, region.y2,
+                        space);
 }
 
 bool Canvas::tagOverlapping(const std::string &tagName,
                             int x1,
                             int y1,
                             int x2,
-                            int y2) {
+                            int y2,
+                            CoordSpace space) {
+  return tagRegion(tagName, x1, y1, x2, y2, space, false);
+}
+
+bool Canvas::tagRegion(const std::string &tagName,
+                       int x1,
+                       int y1,
+                       int x2,
+                       int y2,
+                       CoordSpace space,
+                       bool enclosed) {
+  GS::Box region = canvasRegion(x1, y1, x2, y2, space);
+  Vec::Vec2D topLeft(region.x1, region.y1);
+  Vec::Vec2D bottomRight(region.x2, region.y2);
+  std::vector<GS::Shape *> shapes;
+  regionShapes(region, &shapes);
+  // The tests are split among threads, the tagging is left to this one
+  std::vector<char> selected(shapes.size());
+  forChunks(shapes.size(), chunksFor(shapes.size()),
+  [&](int, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      selected[i] = enclosed ?
+                    shapes[i]->shapeInRegion(topLeft, bottomRight) :
+                    shapes[i]->overlapsWithRegion(topLeft, bottomRight);
+    }
+  });
   bool foundAny = false;
-  for (const auto &shape : shapeList) {
-    POINT topLeft = {x1, y1};
-    POINT bottomRight = {x2, y2};
-    if (shape->overlapsWithRegion(topLeft, bottomRight)) {
+  for (size_t i = 0; i < shapes.size(); i++) {
+    if (selected[i]) {
       foundAny = true;
-      shape->addTag(tagName);
+      shapes[i]->addTag(tagName);
     }
   }
   return foundAny;
@@ -735,8 +1648,9 @@ bool Canvas::tagOverlapping(const std::string &tagName,
 
 bool Canvas::tagWithTag(const std::string &tagName, const std::string &newTag) {
   bool foundAny = true;
+  auto expression = GS::compileTags(tagName);
   for (const auto &shape : shapeList) {
-    if (shape->hasTag(tagName)) {
+    if (shape->hasTag(*expression)) {
       shape->addTag(newTag);
       foundAny = true;
     }
@@ -754,23 +1668,18 @@ bool Canvas::tagWithTag(int shapeID, const std::string &newTag) {
   return false;
 }
 
-bool Canvas::tagClosest(const std::string &newTag, int x, int y) {
-  float leastDistance = 1.0e6; // Dummy value
-  std::shared_ptr<GS::Shape> closestShape(nullptr);
-  Vec::Vec2D closestPoint;
-  for (const auto &shape : shapeList) {
-    closestPoint = shape->closestPointTo(x, y);
-    float distance = closestPoint.magnitude(x, y);
-    if (distance < leastDistance) {
-      leastDistance = distance;
-      closestShape = shape;
-    }
-  }
-  if (closestShape) {
-    closestShape->addTag(newTag);
-    return true;
+bool Canvas::tagClosest(const std::string &newTag,
+                        int x,
+                        int y,
+                        float halo,
+                        CoordSpace space) {
+  std::vector<GS::Neighbour> neighbours;
+  nearestShapes(x, y, 1, halo, FLT_MAX, space, &neighbours);
+  if (neighbours.empty()) {
+    return false;
   }
-  return false;
+  neighbours[0].shape->addTag(newTag);
+  return true;
 }
 
 bool Canvas::deleteTag(int shapeID, const std::string &tagToDelete) {
@@ -788,9 +1697,11 @@ bool Canvas::deleteTag(int shapeID, const std::string &tagToDelete) {
 
 bool Canvas::penSize(const std::string &tagName, int width) {
   bool foundAny = false;
+  auto expression = GS::compileTags(tagName);
   for (const auto &shape : shapeList) {
-    if (shape->hasTag(tagName)) {
+    if (shape->hasTag(*expression)) {
       shape->penSize = width;
+      reindex(shape.get());
       foundAny = true;
     }
   }
@@ -801,6 +1712,7 @@ bool Canvas::penSize(int shapeID, int width) {
   for (const auto &shape : shapeList) {
     if (shape->shapeID == shapeID) {
       shape->penSize = width;
+      reindex(shape.get());
       return true;
     }
   }
@@ -821,15 +1733,7 @@ bool Canvas::penColor(const std::string &tagName, int red, int green, int blue)
 }
 
 bool Canvas::penColor(const std::string &tagName, std::string colorString) {
-  colorString = Colors::hexValue(colorString);
-  bool foundAny = false;
-  for (const auto &shape : shapeList) {
-    if (shape->hasTag(tagName)) {
-      shape->setPenColor(colorString);
-      foundAny = true;
-    }
-  }
-  return foundAny;
+  return colorTagged(tagName, Colors::hexValue(colorString), false);
 }
 
 bool Canvas::penColor(int shapeID, int red, int green, int blue) {
@@ -841,6 +1745,7 @@ bool Canvas::penColor(int shapeID, std::string colorString) {
   for (const auto &shape : shapeList) {
     if (shape->shapeID == shapeID) {
       shape->setPenColor(colorString);
+      touch(shape.get());
       return true;
     }
   }
@@ -857,9 +1762,11 @@ std::string Canvas::getText(int shapeID) {
 }
 
 void Canvas::setText(const std::string &tagName, const std::string &text) {
+  auto expression = GS::compileTags(tagName);
   for (const auto &shape : shapeList) {
-    if (shape->hasTag(tagName)) {
+    if (shape->hasTag(*expression)) {
       shape->setText(text);
+      reindex(shape.get());
     }
   }
 }
@@ -868,6 +1775,7 @@ void Canvas::setText(int shapeID, const std::string &text) {
   for (const auto &shape : shapeList) {
     if (shape->shapeID == shapeID) {
       shape->setText(text);
+      reindex(shape.get());
     }
   }
 }
@@ -895,6 +1803,7 @@ bool Canvas::setFont(int shapeID,
       prop.family = fontFamily;
       prop.size = size;
       shape->setFontAttr(prop);
+      reindex(shape.get());
       return true;
     }
   }
@@ -906,12 +1815,14 @@ bool Canvas::setFont(const std::string &tag,
                      int size,
                      const std::string &fontFamily) {
   bool foundAny = false;
+  auto expression = GS::compileTags(tag);
   for (const auto &shape : shapeList) {
-    if (shape->hasTag(tag)) {
+    if (shape->hasTag(*expression)) {
       GS::FontAttr prop = parseFont(fontStyle);
       prop.family = fontFamily;
       prop.size = size;
       shape->setFontAttr(prop);
+      reindex(shape.get());
       foundAny = true;
     }
   }
@@ -931,6 +1842,7 @@ bool Canvas::borderStyle(int shapeID, GS::BorderStyle style) {
   for (const auto &shape : shapeList) {
     if (shape->shapeID == shapeID) {
       shape->borderStyle(style);
+      touch(shape.get());
       return true;
     }
   }
@@ -948,10 +1860,12 @@ GS::BorderStyle Canvas::borderStyle(int shapeID) {
 
 bool Canvas::borderStyle(const std::string &tag, GS::BorderStyle style) {
   bool foundAny = false;
+  auto expression = GS::compileTags(tag);
   for (const auto &shape : shapeList) {
-    if (shape->hasTag(tag)) {
+    if (shape->hasTag(*expression)) {
       foundAny = true;
       shape->borderStyle(style);
+      touch(shape.get());
     }
   }
   return foundAny;
@@ -972,11 +1886,34 @@ bool Canvas::fillColor(const std::string &tagName, int red, int green, int blue)
 
 bool Canvas::fillColor(const std::string &tagName, std::string colorStr) {
   colorStr.erase(std::remove(colorStr.begin(), colorStr.end(), ' '), colorStr.end());
-  colorStr = Colors::hexValue(colorStr);
+  return colorTagged(tagName, Colors::hexValue(colorStr), true);
+}
+
+bool Canvas::colorTagged(const std::string &tagName,
+                         const std::string &color,
+                         bool fill) {
+  // Compiled once here. Compiling takes a lock the threads would fight over.
+  auto expression = GS::compileTags(tagName);
+  std::vector<std::vector<GS::Shape *>> changed(chunksFor(shapeList.size()));
+  forChunks(shapeList.size(), changed.size(),
+  [&](int chunk, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      GS::Shape *shape = shapeList[i].get();
+      if (!shape->hasTag(*expression)) {
+        continue;
+      }
+      if (fill) {
+        shape->setFillColor(color);
+      } else {
+        shape->setPenColor(color);
+      }
+      changed[chunk].push_back(shape);
+    }
+  });
   bool foundAny = false;
-  for (const auto &shape : shapeList) {
-    if (shape->hasTag(tagName)) {
-      shape->setFillColor(colorStr);
+  for (const auto &shapes : changed) {
+    for (GS::Shape *shape : shapes) {
+      touch(shape);
       foundAny = true;
     }
   }
@@ -992,44 +1929,212 @@ bool Canvas::fillColor(int shapeID, std::string colorString) {
   for (const auto &shape : shapeList) {
     if (shape->shapeID == shapeID) {
       shape->setFillColor(colorString);
+      touch(shape.get());
       return true;
     }
   }
   return false;
 }
 
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~[ ShapeRef ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+int ShapeRef::id() const {
+  return shape->shapeID;
+}
+
+GS::ShapeType ShapeRef::type() const {
+  return shape->shapeType;
+}
+
+GS::Shape *ShapeRef::get() const {
+  return shape;
+}
+
+bool ShapeRef::hasTag(const std::string &tag) const {
+  return shape->hasTag(tag);
+}
+
+void ShapeRef::addTag(const std::string &tag) {
+  shape->addTag(tag);
+}
+
+void ShapeRef::removeTag(const std::string &tag) {
+  shape->removeTag(tag);
+}
+
+GS::Box ShapeRef::BBox() const {
+  Vec::Vec2D topLeft = shape->topLeftCoord();
+  Vec::Vec2D bottomRight = shape->bottomRightCoord();
+  return {topLeft.x, topLeft.y, bottomRight.x, bottomRight.y};
+}
+
+std::vector<POINT> ShapeRef::coords() const {
+  return shape->coords();
+}
+
+void ShapeRef::coords(const std::vector<POINT> &newCoords) {
+  shape->changeCoords(newCoords);
+  canvas->reindex(shape);
+}
+
+void ShapeRef::move(int xAmount, int yAmount) {
+  shape->move(xAmount, yAmount);
+  canvas->reindex(shape);
+}
+
+void ShapeRef::scale(float originX, float originY, float xScale, float yScale) {
+  shape->scale(originX, originY, xScale, yScale);
+  canvas->reindex(shape);
+}
+
+void ShapeRef::rotate(float centerX, float centerY, float angle) {
+  shape->rotate(centerX, centerY, angle);
+  canvas->reindex(shape);
+}
+
+std::string ShapeRef::fillColor() const {
+  return shape->getFillColor();
+}
+
+void ShapeRef::fillColor(std::string colorString) {
+  shape->setFillColor(Colors::hexValue(colorString));
+  canvas->touch(shape);
+}
+
+std::string ShapeRef::penColor() const {
+  return shape->getPenColor();
+}
+
+void ShapeRef::penColor(std::string colorString) {
+  shape->setPenColor(Colors::hexValue(colorString));
+  canvas->touch(shape);
+}
+
+void ShapeRef::penSize(int width) {
+  shape->penSize = width;
+  canvas->reindex(shape);
+}
+
+void ShapeRef::visibility(bool visible) {
+  shape->visibility(visible);
+  canvas->damagePick(shape);
+}
+
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-int Mouse::delta() {
+//! Returns the MouseState flags of the keys held down now
+static unsigned heldKeys() {
+  unsigned state = 0;
+  state |= shiftKeyDown() ? SHIFT_HELD : 0;
+  state |= ctrlKeyDown() ? CTRL_HELD : 0;
+  state |= altKeyDown() ? ALT_HELD : 0;
+  state |= (GetKeyState(VK_LBUTTON) & 0x8000) ? LEFT_BUTTON_HELD : 0;
+  state |= (GetKeyState(VK_RBUTTON) & 0x8000) ? RIGHT_BUTTON_HELD : 0;
+  state |= (GetKeyState(VK_MBUTTON) & 0x8000) ? MIDDLE_BUTTON_HELD : 0;
+  return state;
+}
+
+Mouse::Mouse(HWND winHandle, int wheelDelta_) {
+  GetCursorPos(&screen);
+  client = screen;
+  ScreenToClient(winHandle, &client);
+  wheelDelta = wheelDelta_;
+  state = heldKeys();
+}
+
+Mouse::Mouse(int x, int y, unsigned state_, int wheelDelta_) {
+  client = {x, y};
+  screen = client;
+  state = state_;
+  wheelDelta = wheelDelta_;
+}
+
+Mouse::Mouse(POINT client_, POINT screen_, unsigned state_, int wheelDelta_) {
+  client = client_;
+  screen = screen_;
+  state = state_;
+  wheelDelta = wheelDelta_;
+}
+
+Mouse Mouse::fromMessage(HWND winHandle, unsigned message, WPARAM wParam,
+                         LPARAM lParam) {
+  bool isWheel = (message == WM_MOUSEWHEEL);
+  if (!isWheel && ((message < WM_MOUSEMOVE) || (message > WM_MBUTTONDBLCLK)) &&
+      (message != WM_MOUSEHOVER)) {
+    return Mouse(winHandle);
+  }
+  // The coordinates are signed, a window can be partly off-screen
+  POINT point = {static_cast<short>(LOWORD(lParam)),
+                 static_cast<short>(HIWORD(lParam))
+                };
+  POINT client = point;
+  POINT screen = point;
+  int wheelDelta = 0;
+  if (isWheel) {
+    // Wheel messages come in screen coordinates
+    ScreenToClient(winHandle, &client);
+    wheelDelta = static_cast<short>(HIWORD(wParam)) / WHEEL_DELTA;
+  } else {
+    ClientToScreen(winHandle, &screen);
+  }
+  unsigned keys = LOWORD(wParam);
+  unsigned state = 0;
+  state |= (keys & MK_SHIFT) ? SHIFT_HELD : 0;
+  state |= (keys & MK_CONTROL) ? CTRL_HELD : 0;
+  state |= altKeyDown() ? ALT_HELD : 0;
+  state |= (keys & MK_LBUTTON) ? LEFT_BUTTON_HELD : 0;
+  state |= (keys & MK_RBUTTON) ? RIGHT_BUTTON_HELD : 0;
+  state |= (keys & MK_MBUTTON) ? MIDDLE_BUTTON_HELD : 0;
+  return Mouse(client, screen, state, wheelDelta);
+}
+
+int Mouse::delta() const {
   return wheelDelta;
 }
 
-int Mouse::xRoot() {
-  GetCursorPos(&cursorCoord);
-  return cursorCoord.x;
+int Mouse::xRoot() const {
+  return screen.x;
+}
+
+int Mouse::yRoot() const {
+  return screen.y;
+}
+
+int Mouse::y() const {
+  return client.y;
+}
+
+int Mouse::x() const {
+  return client.x;
+}
+
+unsigned Mouse::held() const {
+  return state;
+}
+
+bool Mouse::isHeld(unsigned flags) const {
+  return (state & flags) == flags;
 }
 
-int Mouse::yRoot() {
-  GetCursorPos(&cursorCoord);
-  return cursorCoord.y;
+int Mouse::dx() const {
+  return motion.x;
 }
 
-int Mouse::y() {
-  GetCursorPos(&cursorCoord);
-  ScreenToClient(winHandle, &cursorCoord);
-  return cursorCoord.y;
+int Mouse::dy() const {
+  return motion.y;
 }
 
-int Mouse::x() {
-  GetCursorPos(&cursorCoord);
-  ScreenToClient(winHandle, &cursorCoord);
-  return cursorCoord.x;
+void Mouse::addMotion(int xAmount, int yAmount) {
+  motion.x += xAmount;
+  motion.y += yAmount;
 }
 
 bool Canvas::removeShape(int shapeID) {
   bool foundAny = false;
   auto hasID = [&](const std::shared_ptr<GS::Shape> &shape) {
     if (shape->shapeID == shapeID) {
+      unindexShape(shape.get());
+      cancelTasks(shape->shapeID);
       foundAny = true;
       return true;
     }
@@ -1042,8 +2147,11 @@ bool Canvas::removeShape(int shapeID) {
 
 bool Canvas::removeShape(const std::string &tagName) {
   bool foundAny = false;
+  auto expression = GS::compileTags(tagName);
   auto hasTag = [&](const std::shared_ptr<GS::Shape> &shape) {
-    if (shape->hasTag(tagName)) {
+    if (shape->hasTag(*expression)) {
+      unindexShape(shape.get());
+      cancelTasks(shape->shapeID);
       foundAny = true;
       return true;
     }
@@ -1127,6 +2235,217 @@ int Canvas::polygon(const std::vector<POINT> &polyCoords) {
   return addShape(poly);
 }
 
+int Canvas::series(int x1, int y1, int x2, int y2, int capacity) {
+  fixBBoxCoord(&x1, &y1, &x2, &y2);
+  GS::Series *series(new GS::Series(x1, y1, x2, y2, capacity));
+  return addShape(series);
+}
+
+GS::Series *Canvas::findSeries(int shapeID) {
+  auto series = seriesByID.find(shapeID);
+  return (series != seriesByID.end()) ? series->second : NULL;
+}
+
+void Canvas::refreshShape(GS::Shape *shape) {
+  touch(shape);
+  Vec::Vec2D topLeft = shape->topLeftCoord();
+  Vec::Vec2D bottomRight = shape->bottomRightCoord();
+  int border = shape->penSize / 2 + 1;
+  RECT rect = {windowX(topLeft.x) - border, windowY(topLeft.y) - border,
+               windowX(bottomRight.x) + border, windowY(bottomRight.y) + border
+              };
+  InvalidateRect(winHandle, &rect, FALSE);
+}
+
+void Canvas::refreshInstance(GS::Instances *item, int index) {
+  touch(item);
+  GS::Box box = item->instanceBox(index);
+  int border = item->penSize / 2 + 1;
+  RECT rect = {windowX(box.x1) - border, windowY(box.y1) - border,
+               windowX(box.x2) + border, windowY(box.y2) + border
+              };
+  InvalidateRect(winHandle, &rect, FALSE);
+  if (picking) {
+    float padding = item->penSize / 2.0f + 1.0f;
+    pickBuffer.damage(GS::PickItem {item->shapeID, box.x1 - padding,
+                                    box.y1 - padding, box.x2 + padding,
+                                    box.y2 + padding, item},
+                      GS::PickView {viewX, viewY, viewZoom});
+  }
+}
+
+bool Canvas::append(int shapeID, float x, float y) {
+  GS::Series *series = findSeries(shapeID);
+  if (!series) {
+    return false;
+  }
+  series->append(x, y);
+  refreshShape(series);
+  return true;
+}
+
+bool Canvas::append(int shapeID, const std::vector<Vec::Vec2D> &samples) {
+  GS::Series *series = findSeries(shapeID);
+  if (!series) {
+    return false;
+  }
+  series->append(samples);
+  refreshShape(series);
+  return true;
+}
+
+bool Canvas::seriesRange(int shapeID, float low, float high) {
+  GS::Series *series = findSeries(shapeID);
+  if (!series) {
+    return false;
+  }
+  series->valueRange(low, high);
+  refreshShape(series);
+  return true;
+}
+
+bool Canvas::seriesSpan(int shapeID, float span) {
+  GS::Series *series = findSeries(shapeID);
+  if (!series) {
+    return false;
+  }
+  series->timeSpan(span);
+  refreshShape(series);
+  return true;
+}
+
+int Canvas::pointCloud(const std::vector<float> &xs,
+                       const std::vector<float> &ys,
+                       int markerSize) {
+  GS::PointCloud *cloud(new GS::PointCloud(xs, ys, markerSize));
+  return addShape(cloud);
+}
+
+GS::PointCloud *Canvas::findPointCloud(int shapeID) {
+  for (const auto &shape : shapeList) {
+    if ((shape->shapeID == shapeID) &&
+        (shape->shapeType == GS::POINT_CLOUD)) {
+      return static_cast<GS::PointCloud *>(shape.get());
+    }
+  }
+  return NULL;
+}
+
+bool Canvas::pointColors(int shapeID, const std::vector<COLORREF> &colors) {
+  GS::PointCloud *cloud = findPointCloud(shapeID);
+  if (!cloud || !cloud->pointColors(colors)) {
+    return false;
+  }
+  refreshShape(cloud);
+  return true;
+}
+
+int Canvas::pickPoint(int shapeID, int x, int y, CoordSpace space) {
+  GS::PointCloud *cloud = findPointCloud(shapeID);
+  if (!cloud) {
+    return -1;
+  }
+  GS::Box point = canvasRegion(x, y, x, y, space);
+  return cloud->pickPoint(point.x1, point.y1, cloud->pickRadius(viewZoom));
+}
+
+GS::Instances *Canvas::findInstances(int shapeID) {
+  for (const auto &shape : shapeList) {
+    if ((shape->shapeID == shapeID) && (shape->shapeType == GS::INSTANCES)) {
+      return static_cast<GS::Instances *>(shape.get());
+    }
+  }
+  return NULL;
+}
+
+int Canvas::instances(int shapeID) {
+  for (auto iter = shapeList.begin(); iter != shapeList.end(); iter++) {
+    std::shared_ptr<GS::Shape> shape = *iter;
+    if (shape->shapeID != shapeID) {
+      continue;
+    }
+    switch (shape->shapeType) {
+      case GS::POLYGON:
+      case GS::LINE:
+      case GS::RECTANGLE:
+      case GS::OVAL:
+      case GS::CIRCLE:
+      case GS::LINE_ARC:
+        break;
+      default:
+        return -1;
+    }
+    unindexShape(shape.get());
+    cancelTasks(shapeID);
+    shapeList.erase(iter);
+    refreshShape(shape.get());
+    return addShape(new GS::Instances(shape));
+  }
+  return -1;
+}
+
+int Canvas::addInstance(int shapeID, float x, float y, float scale,
+                        COLORREF color) {
+  GS::Instances *item = findInstances(shapeID);
+  if (!item) {
+    return -1;
+  }
+  int index = item->add(GS::Instance {x, y, scale, color});
+  reindex(item);
+  refreshShape(item);
+  return index;
+}
+
+bool Canvas::placeInstance(int shapeID, int index, float x, float y,
+                           float scale) {
+  GS::Instances *item = findInstances(shapeID);
+  if (!item || (index < 0) ||
+      (index >= static_cast<int>(item->instances.size()))) {
+    return false;
+  }
+  Vec::Vec2D topLeft = item->topLeftCoord();
+  Vec::Vec2D bottomRight = item->bottomRightCoord();
+  // Repaint where the instance was and where it is now
+  refreshInstance(item, index);
+  item->place(index, x, y, scale);
+  refreshInstance(item, index);
+  // An instance moving inside the item's box leaves it filed where it was
+  if (!sameBounds(item, topLeft, bottomRight)) {
+    reindex(item);
+  }
+  return true;
+}
+
+bool Canvas::placeInstances(int shapeID, int first,
+                            const std::vector<GS::Instance> &placements) {
+  GS::Instances *item = findInstances(shapeID);
+  if (!item) {
+    return false;
+  }
+  Vec::Vec2D topLeft = item->topLeftCoord();
+  Vec::Vec2D bottomRight = item->bottomRightCoord();
+  refreshShape(item);
+  if (!item->place(first, placements)) {
+    return false;
+  }
+  if (!sameBounds(item, topLeft, bottomRight)) {
+    reindex(item);
+  } else {
+    damagePick(item);
+  }
+  refreshShape(item);
+  return true;
+}
+
+int Canvas::pickInstance(int shapeID, int x, int y, CoordSpace space) {
+  GS::Instances *item = findInstances(shapeID);
+  if (!item) {
+    return -1;
+  }
+  GS::Box point = canvasRegion(x, y, x, y, space);
+  return item->pickInstance(point.x1, point.y1);
+}
+
 int Canvas::init(HINSTANCE hInstance, int cmdShow_) {
   // The resource object file must be linked with the program for the icon to show.
   windowClassEx.cbSize        = sizeof(WNDCLASSEX);
@@ -1170,17 +2489,35 @@ int Canvas::init(HINSTANCE hInstance, int cmdShow_) {
     return 0;
   }
 
+  // Calls made with after() before there was a window
+  armAfterTimer();
+  // Commands posted before there was a window
+  commandWindow.store(winHandle);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!commands.empty()) {
+    wake();
+  }
   return 1;
 }
 
 int Canvas::loop() {
   ShowWindow(winHandle, cmdShow);
-  while (GetMessage(&windowMessage, NULL, 0, 0) > 0) {
-    TranslateMessage(&windowMessage);
-    DispatchMessage(&windowMessage);
+  while (true) {
+    while (PeekMessage(&windowMessage, NULL, 0, 0, PM_REMOVE)) {
+      if (windowMessage.message == WM_QUIT) {
+        killConsole();
+        return static_cast<int>(windowMessage.wParam);
+      }
+      TranslateMessage(&windowMessage);
+      DispatchMessage(&windowMessage);
+    }
+    // Nothing left to handle. The idle calls may queue more messages.
+    bool ranIdle = runIdle();
+    publishSnapshot();
+    if (!ranIdle) {
+      WaitMessage();
+    }
   }
-  killConsole();
-  return static_cast<int>(windowMessage.wParam);
 }
 
 LRESULT PASCAL Canvas::windowProcedure(HWND winHandle,
@@ -1202,7 +2539,10 @@ LRESULT PASCAL Canvas::windowProcedure(HWND winHandle,
       return DefWindowProc(winHandle, windowMessage, wParam, lParam);
     }
   } else {
-    return instance->handleMessage(winHandle, windowMessage, wParam, lParam);
+    LRESULT result = instance->handleMessage(winHandle, windowMessage, wParam,
+                                             lParam);
+    instance->publishSnapshot();
+    return result;
   }
 }
 
@@ -1213,62 +2553,119 @@ LRESULT CALLBACK Canvas::handleMessage(const HWND &winHandle,
   switch (windowMessage) {
     case WM_CREATE:
       break;
+    case WM_SIZE: {
+      sceneDirty = true;
+      if (picking) {
+        pickBuffer.resize(LOWORD(lParam), HIWORD(lParam));
+      }
+    }
+    break;
     case WM_PAINT: {
       PAINTSTRUCT paintStruct;
       HDC paintDC = BeginPaint(winHandle, &paintStruct);
-      for (const auto &shape : shapeList) {
-        HPEN oldPen, newPen;
-        HBRUSH oldBrush, newBrush;
-        COLORREF penColor = Colors::hexToColorRef(shape->getPenColor());
-        newPen = CreatePen(shape->borderStyle(), shape->penSize, penColor);
-        oldPen = static_cast<HPEN>(SelectObject(paintDC, newPen));
-        std::string fillColor_ = shape->getFillColor();
-        if (fillColor_ == "") {
-          // Don't fill the shape
-          newBrush = static_cast<HBRUSH>(GetStockObject(NULL_BRUSH));
-        } else {
-          COLORREF fillColor = Colors::hexToColorRef(fillColor_);
-          newBrush = CreateSolidBrush(fillColor);
+      if (renderer.isRunning()) {
+        // Shows the last frame. The one for the changes made since follows
+        // with a FRAME_MESSAGE.
+        if (sceneDirty) {
+          publishScene();
+        }
+        renderer.blit(paintDC, paintStruct.rcPaint);
+        EndPaint(winHandle, &paintStruct);
+        break;
+      }
+      // Map canvas coordinates to the window and only visit the shapes in
+      // the part of the view that needs repainting.
+      XFORM transform = {viewZoom, 0.0f, 0.0f, viewZoom,
+                         -viewX * viewZoom, -viewY * viewZoom
+                        };
+      SetGraphicsMode(paintDC, GM_ADVANCED);
+      SetWorldTransform(paintDC, &transform);
+      RECT damaged = paintStruct.rcPaint;
+      visibleShapes.clear();
+      regionShapes(canvasRegion(damaged.left, damaged.top, damaged.right,
+                                damaged.bottom, WINDOW_COORDS),
+                   &visibleShapes);
+      for (GS::Shape *shape : visibleShapes) {
+        if (!shape->isShown()) {
+          continue;
+        }
+        Vec::Vec2D topLeft = shape->topLeftCoord();
+        Vec::Vec2D bottomRight = shape->bottomRightCoord();
+        GS::paintShape(paintDC, shape);
+        if ((topLeft != shape->topLeftCoord()) ||
+            (bottomRight != shape->bottomRightCoord())) {
+          // Text only knows its real extent once it has been drawn
+          reindex(shape);
         }
-        oldBrush = static_cast<HBRUSH>(SelectObject(paintDC, newBrush));
-        shape->draw(paintDC); // Draw the shape/object
-        SelectObject(paintDC, oldBrush);
-        DeleteObject(newBrush);
-        SelectObject(paintDC, oldPen);
-        DeleteObject(newPen);
       }
       EndPaint(winHandle, &paintStruct);
     }
     break;
     case WM_TIMER: {
+      if (wParam == MOTION_TIMER) {
+        flushMotion();
+        break;
+      }
+      if (wParam == AFTER_TIMER) {
+        runAfter();
+        break;
+      }
+      runCommands();
       // wParam in this case is the timer ID
-      callHandlers(TIMER, wParam);
+      callHandlers(TIMER, Mouse(winHandle), wParam);
       KillTimer(winHandle, wParam);
       InvalidateRect(winHandle, NULL, TRUE);
     }
     break;
     case WM_MOUSEMOVE: {
       trackMouse();
+      queueMotion(Mouse::fromMessage(winHandle, windowMessage, wParam, lParam));
+    }
+    break;
+    case WM_LBUTTONUP: {
+      Mouse mouse = Mouse::fromMessage(winHandle, windowMessage, wParam, lParam);
+      if (endDrag(LEFT_RELEASE, mouse)) {
+        InvalidateRect(winHandle, NULL, TRUE);
+      }
+    }
+    break;
+    case WM_RBUTTONUP: {
+      Mouse mouse = Mouse::fromMessage(winHandle, windowMessage, wParam, lParam);
+      if (endDrag(RIGHT_RELEASE, mouse)) {
+        InvalidateRect(winHandle, NULL, TRUE);
+      }
+    }
+    break;
+    case WM_CAPTURECHANGED: {
+      // Another window took the mouse, the drag can't go on
+      if (reinterpret_cast<HWND>(lParam) != winHandle) {
+        dragging = false;
+        dragTarget = NULL;
+      }
     }
     break;
     case WM_MOUSEHOVER: {
-      callHandlers(HOVER);
+      callHandlers(HOVER, Mouse::fromMessage(winHandle, windowMessage, wParam,
+                                             lParam));
     }
     break;
     case WM_MBUTTONDOWN: {
-      if (callHandlers(WHEEL_CLICK)) {
+      Mouse mouse = Mouse::fromMessage(winHandle, windowMessage, wParam, lParam);
+      if (callHandlers(WHEEL_CLICK, mouse)) {
         InvalidateRect(winHandle, NULL, TRUE);
       }
     }
     break;
     case WM_LBUTTONDOWN: {
       bool called = false;
-      if (ctrlKeyDown()) {
-        called |= callHandlers(CTRL_LEFT_CLICK);
-      } else if (altKeyDown()) {
-        called |= callHandlers(ALT_LEFT_CLICK);
+      Mouse mouse = Mouse::fromMessage(winHandle, windowMessage, wParam, lParam);
+      beginDrag(mouse);
+      if (mouse.isHeld(CTRL_HELD)) {
+        called |= callHandlers(CTRL_LEFT_CLICK, mouse);
+      } else if (mouse.isHeld(ALT_HELD)) {
+        called |= callHandlers(ALT_LEFT_CLICK, mouse);
       } else {
-        called |= callHandlers(LEFT_CLICK);
+        called |= callHandlers(LEFT_CLICK, mouse);
       }
       if (called) {
         InvalidateRect(winHandle, NULL, TRUE);
@@ -1276,14 +2673,16 @@ LRESULT CALLBACK Canvas::handleMessage(const HWND &winHandle,
     }
     break;
     case WM_RBUTTONDOWN: {
-      if (callHandlers(RIGHT_CLICK)) {
+      Mouse mouse = Mouse::fromMessage(winHandle, windowMessage, wParam, lParam);
+      beginDrag(mouse);
+      if (callHandlers(RIGHT_CLICK, mouse)) {
         InvalidateRect(winHandle, NULL, TRUE);
       }
     }
     break;
     case WM_MOUSEWHEEL: {
-      int wheelDelta = static_cast<short>(HIWORD(wParam));
-      if (callHandlers(WHEEL_ROLL, wheelDelta / WHEEL_DELTA)) {
+      Mouse mouse = Mouse::fromMessage(winHandle, windowMessage, wParam, lParam);
+      if (callHandlers(WHEEL_ROLL, mouse, mouse.delta())) {
         InvalidateRect(winHandle, NULL, TRUE);
       }
       return 0;
@@ -1300,9 +2699,10 @@ LRESULT CALLBACK Canvas::handleMessage(const HWND &winHandle,
     break;
     case WM_SYSKEYDOWN: {
       bool called = false;
-      called |= callHandlers(ALT_KEY, wParam);
-      if (shiftKeyDown()) {
-        called |= callHandlers(ALT_SHIFT_KEY, wParam);
+      Mouse mouse(winHandle);
+      called |= callHandlers(ALT_KEY, mouse, wParam);
+      if (mouse.isHeld(SHIFT_HELD)) {
+        called |= callHandlers(ALT_SHIFT_KEY, mouse, wParam);
       }
       if (called) {
         InvalidateRect(winHandle, NULL, TRUE);
@@ -1311,21 +2711,38 @@ LRESULT CALLBACK Canvas::handleMessage(const HWND &winHandle,
     break;
     case WM_KEYDOWN: {
       bool called = false;
-      called |= callHandlers(BARE_KEY, wParam);
-      if (shiftKeyDown() && ctrlKeyDown()) {
-        called |= callHandlers(CTRL_SHIFT_KEY, wParam);
-      } else if (ctrlKeyDown()) {
-        called |= callHandlers(CTRL_KEY, wParam);
+      Mouse mouse(winHandle);
+      called |= callHandlers(BARE_KEY, mouse, wParam);
+      if (mouse.isHeld(SHIFT_HELD | CTRL_HELD)) {
+        called |= callHandlers(CTRL_SHIFT_KEY, mouse, wParam);
+      } else if (mouse.isHeld(CTRL_HELD)) {
+        called |= callHandlers(CTRL_KEY, mouse, wParam);
       }
       if (called) {
         InvalidateRect(winHandle, NULL, TRUE);
       }
     }
     break;
+    case COMMAND_MESSAGE: {
+      runCommands();
+    }
+    break;
+    case Renderer::FRAME_MESSAGE: {
+      InvalidateRect(winHandle, NULL, FALSE);
+    }
+    break;
+    case WM_ERASEBKGND: {
+      if (renderer.isRunning()) {
+        // The frame covers the whole window
+        return 1;
+      }
+      return DefWindowProc(winHandle, windowMessage, wParam, lParam);
+    }
     case WM_CLOSE:
       DestroyWindow(winHandle);
       break;
     case WM_DESTROY:
+      renderer.stop();
       PostQuitMessage(0);
       break;
     default:
@@ -17,12 +17,32 @@
 #include <vector>
 #include <algorithm>
 #include <memory>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <type_traits>
 #include "./Colors.h"
 #include "./Vec2D.h"
 #include "./Shapes.h"
+#include "./SpatialGrid.h"
+#include "./PickBuffer.h"
+#include "./EventLog.h"
+#include "./CommandQueue.h"
+#include "./Renderer.h"
+#include "./Snapshot.h"
+#include "./ThreadPool.h"
 #include "./logo.h"
 #include "./VirtualKeys.h"
 
+#if defined(__has_include)
+#if __has_include(<coroutine>) && (__cplusplus >= 202002L)
+#include <coroutine>
+//! Defined when Canvas::delay() can be awaited in a coroutine
+#define GDICANVAS_COROUTINES
+#endif
+#endif
+
 namespace GS = GShape;
 
 /*!
@@ -35,7 +55,7 @@ namespace GCanvas {
  * \enum EventType
  * \brief Lists all events handled in the canvas.
  *
- * The event strings will be parsed by in Canvas::parseEventString
+ * The event strings are parsed by parseEvent()
  */
 enum EventType {
   //! specified as `<timer>`
@@ -54,6 +74,16 @@ enum EventType {
   WHEEL_CLICK,
   //! specified as `<Wheel-Spin>`
   WHEEL_ROLL,
+  //! specified as `<Motion>`, the mouse moved
+  MOTION,
+  //! specified as `<B1-Motion>`, the mouse moved with the left button held
+  LEFT_DRAG,
+  //! specified as `<B2-Motion>`, the mouse moved with the right button held
+  RIGHT_DRAG,
+  //! specified as `<ButtonRelease-1>`
+  LEFT_RELEASE,
+  //! specified as `<ButtonRelease-2>`
+  RIGHT_RELEASE,
   //! Unmodified key press, e.g `<Key-Q>`
   BARE_KEY,
   //! e.g `<Alt-W>`
@@ -68,32 +98,236 @@ enum EventType {
   INVALID_EVENT
 };
 
+/*!
+ * \enum MouseState
+ * \brief The modifier keys and buttons held down during a mouse event. The
+ * values can be or-ed together.
+ */
+enum MouseState {
+  SHIFT_HELD = 1,
+  CTRL_HELD = 2,
+  ALT_HELD = 4,
+  LEFT_BUTTON_HELD = 8,
+  RIGHT_BUTTON_HELD = 16,
+  MIDDLE_BUTTON_HELD = 32
+};
+
+/*!
+ * \struct EventDesc
+ * \brief An event string taken apart by parseEvent(): the kind of event, the
+ * modifier keys and the key.
+ *
+ * Binding with a descriptor skips parsing the string, e.g for handlers bound
+ * over and over. From C++14 on it can be made at compile time.
+ * \code
+ *   constexpr GC::EventDesc save = GC::parseEvent("<Ctrl-S>");
+ *   canv.bind(save, Save());
+ * \endcode
+ */
+struct EventDesc {
+  EventType type;
+  //! The modifier keys as the MouseState flags SHIFT_HELD, CTRL_HELD, ALT_HELD
+  unsigned modifiers;
+  //! Virtual key code of the key or button, 1 for events without one
+  int key;
+};
+
+//! Returns \b true for the events filed under a key, BARE_KEY to CTRL_SHIFT_KEY
+constexpr bool isKeyEvent(EventType type) {
+  return (type == BARE_KEY) || (type == ALT_KEY) || (type == ALT_SHIFT_KEY) ||
+         (type == CTRL_KEY) || (type == CTRL_SHIFT_KEY);
+}
+
+/*!
+ * \brief Takes apart the event string in the first \p length characters of
+ * \p spec, e.g `<Ctrl-Shift-A>`. \see EventType for the accepted strings.
+ *
+ * The modifiers may come in any order and case is ignored. The type is
+ * INVALID_EVENT if the string isn't an event or names no known key.
+ */
+GDICANVAS_CONSTEXPR EventDesc parseEvent(const char *spec, size_t length) {
+  EventDesc desc = {INVALID_EVENT, 0, 1};
+  if ((length < 3) || (spec[0] != '<') || (spec[length - 1] != '>')) {
+    return desc;
+  }
+  // The words between the dashes, no more than two besides the modifiers
+  const char *words[5] = {};
+  size_t sizes[5] = {};
+  int count = 0;
+  size_t start = 1;
+  for (size_t i = 1; i < length; i++) {
+    if ((spec[i] != '-') && (i != length - 1)) {
+      continue;
+    }
+    if (count == 5) {
+      return desc;
+    }
+    words[count] = spec + start;
+    sizes[count] = i - start;
+    count++;
+    start = i + 1;
+  }
+  unsigned modifiers = 0;
+  int first = 0;
+  for (; first < count - 1; first++) {
+    const char *word = words[first];
+    size_t size = sizes[first];
+    unsigned flag = sameName(word, size, "ctrl") ? CTRL_HELD :
+                    sameName(word, size, "alt") ? ALT_HELD :
+                    sameName(word, size, "shift") ? SHIFT_HELD : 0;
+    if (!flag) {
+      break;
+    }
+    if (modifiers & flag) {
+      return desc;
+    }
+    modifiers |= flag;
+  }
+  desc.modifiers = modifiers;
+  const char *word = words[first];
+  size_t size = sizes[first];
+  if (count - first == 1) {
+    if (!modifiers && sameName(word, size, "timer")) {
+      desc.type = TIMER;
+    } else if (!modifiers && sameName(word, size, "hover")) {
+      desc.type = HOVER;
+    } else if (!modifiers && sameName(word, size, "motion")) {
+      desc.type = MOTION;
+    } else {
+      desc.key = virtualKey(word, size);
+      desc.type = !desc.key ? INVALID_EVENT :
+                  (modifiers == CTRL_HELD) ? CTRL_KEY :
+                  (modifiers == (CTRL_HELD | SHIFT_HELD)) ? CTRL_SHIFT_KEY :
+                  (modifiers == ALT_HELD) ? ALT_KEY :
+                  (modifiers == (ALT_HELD | SHIFT_HELD)) ? ALT_SHIFT_KEY :
+                  INVALID_EVENT;
+    }
+    return desc;
+  }
+  if (count - first != 2) {
+    return desc;
+  }
+  const char *next = words[first + 1];
+  size_t nextSize = sizes[first + 1];
+  if (sameName(word, size, "mouse") && sameName(next, nextSize, "1")) {
+    desc.key = VK_LBUTTON;
+    desc.type = (modifiers == 0) ? LEFT_CLICK :
+                (modifiers == CTRL_HELD) ? CTRL_LEFT_CLICK :
+                (modifiers == ALT_HELD) ? ALT_LEFT_CLICK : INVALID_EVENT;
+    return desc;
+  }
+  if (modifiers) {
+    return desc;
+  }
+  if (sameName(word, size, "key")) {
+    desc.key = virtualKey(next, nextSize);
+    desc.type = desc.key ? BARE_KEY : INVALID_EVENT;
+  } else if (sameName(word, size, "mouse") && sameName(next, nextSize, "2")) {
+    desc.key = VK_RBUTTON;
+    desc.type = RIGHT_CLICK;
+  } else if (sameName(word, size, "wheel") &&
+             sameName(next, nextSize, "roll")) {
+    desc.key = VK_MBUTTON;
+    desc.type = WHEEL_ROLL;
+  } else if (sameName(word, size, "wheel") &&
+             sameName(next, nextSize, "click")) {
+    desc.key = VK_MBUTTON;
+    desc.type = WHEEL_CLICK;
+  } else if (sameName(next, nextSize, "motion") &&
+             (sameName(word, size, "b1") || sameName(word, size, "b2"))) {
+    desc.type = sameName(word, size, "b1") ? LEFT_DRAG : RIGHT_DRAG;
+  } else if (sameName(word, size, "buttonrelease") &&
+             (sameName(next, nextSize, "1") || sameName(next, nextSize, "2"))) {
+    desc.key = sameName(next, nextSize, "1") ? VK_LBUTTON : VK_RBUTTON;
+    desc.type = (desc.key == VK_LBUTTON) ? LEFT_RELEASE : RIGHT_RELEASE;
+  }
+  return desc;
+}
+
+//! \overload parseEvent(const char*, size_t)
+template<size_t N>
+GDICANVAS_CONSTEXPR EventDesc parseEvent(const char (&spec)[N]) {
+  return parseEvent(spec, N - 1);
+}
+
+//! \overload parseEvent(const char*, size_t)
+inline EventDesc parseEvent(const std::string &spec) {
+  return parseEvent(spec.c_str(), spec.length());
+}
+
 /*!
  * \class Mouse
  *
- * \brief Contains methods used to query the cursor position
+ * \brief The cursor position, wheel roll and held keys at the time of an event.
+ *
+ * The values are taken once, from the window message when there's one, so
+ * every handler called for an event sees the same position even if the cursor
+ * moves while they run.
+ *
+ * \code
+ *   // A left click at (10, 20) with CTRL held, e.g for a test
+ *   GC::Mouse mouse(10, 20, GC::CTRL_HELD | GC::LEFT_BUTTON_HELD);
+ *   handler.handle(mouse);
+ * \endcode
  */
 class Mouse {
-    POINT cursorCoord;
-    HWND winHandle;
+    //! Cursor position from top left of window
+    POINT client;
+    //! Cursor position from top left of screen
+    POINT screen;
     //! Indicates the direction of the wheel roll. Either -1 or 1
     int wheelDelta = 0;
+    //! MouseState flags
+    unsigned state = 0;
+    //! Distance moved since the last motion event
+    POINT motion = {0, 0};
   public:
-    explicit Mouse(HWND winHandle_, int wheelDelta_ = 0) {
-      winHandle = winHandle_;
-      wheelDelta = wheelDelta_;
-    }
+    //! Reads the cursor position and the held keys as they are now
+    explicit Mouse(HWND winHandle, int wheelDelta_ = 0);
+
+    /*!
+     * \brief A mouse at window coordinate `(x, y)` with the MouseState flags
+     * in \p state. The screen position is taken to be the same.
+     */
+    Mouse(int x, int y, unsigned state_ = 0, int wheelDelta_ = 0);
+
+    //! A mouse at \p client in the window and \p screen on the screen
+    Mouse(POINT client_, POINT screen_, unsigned state_ = 0,
+          int wheelDelta_ = 0);
+
+    /*!
+     * \brief Decodes the position and held keys of a mouse message from its
+     * parameters. Other messages read the cursor like Mouse(HWND, int).
+     */
+    static Mouse fromMessage(HWND winHandle, unsigned message, WPARAM wParam,
+                             LPARAM lParam);
 
     //! Returns the wheel roll's direction
-    int delta();
+    int delta() const;
 
     //! Cursor position from top left of screen
-    int xRoot();
-    int yRoot();
+    int xRoot() const;
+    int yRoot() const;
 
     //! Cursor position from top left of window
-    int x();
-    int y();
+    int x() const;
+    int y() const;
+
+    //! Returns the MouseState flags
+    unsigned held() const;
+
+    //! Returns \b true if all the MouseState flags in \p flags are set
+    bool isHeld(unsigned flags) const;
+
+    /*!
+     * \brief Returns the distance moved since the last motion event, in window
+     * pixels. It's the sum of all the moves merged into the event.
+     */
+    int dx() const;
+    int dy() const;
+
+    //! Adds to the distance returned by dx() and dy()
+    void addMotion(int xAmount, int yAmount);
 };
 
 /*!
@@ -122,6 +356,8 @@ struct Event {
   int shapeID = -1;
   int timerID = -1;
   std::string shapeTag = "";
+  //! shapeTag compiled when the handler is bound
+  std::shared_ptr<const GS::TagExpression> shapeTags;
   std::shared_ptr<EventHandler> handler = std::shared_ptr<EventHandler>(nullptr);
   EventType eventType = INVALID_EVENT;
   Event(EventHandler *functor, EventType type) :
@@ -130,6 +366,137 @@ struct Event {
   }
 };
 
+/*!
+ * \enum CoordSpace
+ * \brief The coordinate system a point passed to a query is in.
+ *
+ * The two are the same until the view is panned or zoomed.
+ * \see Canvas::zoom
+ */
+enum CoordSpace {
+  //! Canvas coordinates, the ones the shapes are created with
+  CANVAS_COORDS,
+  //! Coordinates relative to the window's client area, e.g Mouse::x()
+  WINDOW_COORDS
+};
+
+class Canvas;
+
+/*!
+ * \class ShapeRef
+ * \brief A handle to a shape passed to the visitors and ranges of Canvas.
+ *
+ * Its methods work on the shape directly instead of looking it up by id again,
+ * so a "find then change" loop visits each shape once. The handle is only
+ * valid until the shape is deleted.
+ *
+ * \code
+ *   canv.forEachOverlapping(0, 0, 100, 100, [](GC::ShapeRef shape) {
+ *     shape.fillColor("red");
+ *   });
+ * \endcode
+ */
+class ShapeRef {
+  public:
+    ShapeRef(Canvas *canvas_, GS::Shape *shape_) :
+      canvas(canvas_), shape(shape_) {}
+
+    int id() const;
+    GS::ShapeType type() const;
+
+    //! The shape itself, for reading anything the handle doesn't cover
+    GS::Shape *get() const;
+
+    //! \see GS::Shape::hasTag
+    bool hasTag(const std::string &tag) const;
+    void addTag(const std::string &tag);
+    void removeTag(const std::string &tag);
+
+    GS::Box BBox() const;
+    std::vector<POINT> coords() const;
+    void coords(const std::vector<POINT> &newCoords);
+
+    void move(int xAmount, int yAmount);
+    void scale(float originX, float originY, float xScale, float yScale);
+    void rotate(float centerX, float centerY, float angle);
+
+    std::string fillColor() const;
+    void fillColor(std::string colorString);
+    std::string penColor() const;
+    void penColor(std::string colorString);
+    void penSize(int width);
+    void visibility(bool visible);
+
+  private:
+    Canvas *canvas;
+    GS::Shape *shape;
+};
+
+/*!
+ * \class ShapeRange
+ * \brief The shapes with a tag, found lazily as the range is iterated.
+ * \see Canvas::withTag
+ */
+class ShapeRange {
+  public:
+    class iterator {
+      public:
+        iterator(const ShapeRange *range_, size_t index_) :
+          range(range_), index(index_) {
+          skip();
+        }
+
+        ShapeRef operator*() const {
+          return ShapeRef(range->canvas, (*range->shapes)[index].get());
+        }
+
+        iterator &operator++() {
+          index++;
+          skip();
+          return *this;
+        }
+
+        bool operator!=(const iterator &other) const {
+          return index != other.index;
+        }
+
+        bool operator==(const iterator &other) const {
+          return index == other.index;
+        }
+
+      private:
+        //! Moves to the next shape that has the tag
+        void skip() {
+          size_t count = range->shapes->size();
+          while ((index < count) &&
+                 !range->expression->matches((*range->shapes)[index]->tagBits)) {
+            index++;
+          }
+        }
+
+        const ShapeRange *range;
+        size_t index;
+    };
+
+    ShapeRange(Canvas *canvas_,
+               const std::vector<std::shared_ptr<GS::Shape>> *shapes_,
+               std::shared_ptr<const GS::TagExpression> expression_) :
+      canvas(canvas_), shapes(shapes_), expression(expression_) {}
+
+    iterator begin() const {
+      return iterator(this, 0);
+    }
+
+    iterator end() const {
+      return iterator(this, shapes->size());
+    }
+
+  private:
+    Canvas *canvas;
+    const std::vector<std::shared_ptr<GS::Shape>> *shapes;
+    std::shared_ptr<const GS::TagExpression> expression;
+};
+
 //! Checks if any of the shift keys have been pressed
 bool shiftKeyDown();
 
@@ -139,6 +506,10 @@ bool ctrlKeyDown();
 //! Checks if any of the alternate keys(ALT) have been pressed
 bool altKeyDown();
 
+//! The type returned by a task passed to Canvas::submit()
+template<typename Task>
+using TaskResult = decltype(std::declval<Task &>()());
+
 /*!
  * \class Canvas
  * \brief Main Canvas class.
@@ -156,26 +527,34 @@ class Canvas {
     //! Adds \b newTag to all item in the canvas
     bool tagAll(const std::string &newTag);
 
-    //! Adds \b newTag to the item closest to screen coordinate `(x, y)`
-    bool tagClosest(const std::string &newTag, int x, int y);
+    /*!
+     * \brief Adds \b newTag to the item closest to `(x, y)`
+     * \see findClosest
+     */
+    bool tagClosest(const std::string &newTag, int x, int y, float halo = 0.0f,
+                    CoordSpace space = CANVAS_COORDS);
 
     /*!
      * \brief Adds \b newTag to all objects that occur completely within the
      * rectangle whose top left corner is `(x1, y1)` and whose bottom right
      * corner is `(x2,y2)`.
      */
-    bool tagEnclosed(const std::string &newTag, int x1, int y1, int x2, int y2);
+    bool tagEnclosed(const std::string &newTag, int x1, int y1, int x2, int y2,
+                     CoordSpace space = CANVAS_COORDS);
 
-    //! \overload tagEnclosed(const std::string&, int, int, int, int)
-    bool tagEnclosed(const std::string &newTag, GS::Box region);
+    //! \overload tagEnclosed(std::string, int, int, int, int, CoordSpace)
+    bool tagEnclosed(const std::string &newTag, GS::Box region,
+                     CoordSpace space = CANVAS_COORDS);
 
     /*! Adds \b newTag to all elements that share at least one point with the
      * rectangle specified.
      */
-    bool tagOverlapping(const std::string &newTag, int x1, int y1, int x2, int y2);
+    bool tagOverlapping(const std::string &newTag, int x1, int y1, int x2,
+                        int y2, CoordSpace space = CANVAS_COORDS);
 
-    //! \overload tagOverlapping(const std::string&, int, int, int, int)
-    bool tagOverlapping(const std::string &newTag, GS::Box region);
+    //! \overload tagOverlapping(std::string, int, int, int, int, CoordSpace)
+    bool tagOverlapping(const std::string &newTag, GS::Box region,
+                        CoordSpace space = CANVAS_COORDS);
 
     //! Adds \b newTag to the items with the specified \b newTag
     bool tagWithTag(const std::string &tagName, const std::string &newTag);
@@ -218,6 +597,12 @@ class Canvas {
 
     /*!
      * \brief Pause execution for the specified milliseconds
+     *
+     * The window's messages are handled in the meantime so that it keeps
+     * painting and responding. A handler that sleeps can then see other
+     * handlers run, and bind or unbind handlers, before it returns. The
+     * event it handles still goes to the handlers that were bound when it
+     * came. Prefer after(), which doesn't nest.
      */
     void sleep(int millSecs);
 
@@ -236,23 +621,346 @@ class Canvas {
      * \brief Finds all items that occur completely within region
      * `{x1, y1, x2, y2}`
      */
-    std::vector<int> findEnclosed(int x1, int y1, int x2, int y2);
+    std::vector<int> findEnclosed(int x1, int y1, int x2, int y2,
+                                  CoordSpace space = CANVAS_COORDS);
 
     /*!
      * \brief Finds all items that share a point with region `{x1, y1, x2, y2}`
      */
-    std::vector<int> findOverlapping(int x1, int y1, int x2, int y2);
+    std::vector<int> findOverlapping(int x1, int y1, int x2, int y2,
+                                     CoordSpace space = CANVAS_COORDS);
+
+    /*!
+     * \brief Finds the closest item to point `(x, y)`.
+     *
+     * The distance is measured to the edge of the item's outline and is 0
+     * inside items with an interior, \see GS::Shape::closestPointTo. Items
+     * closer than \p halo are taken to touch the point and the topmost of
+     * them wins, like Tk's `find closest`. The halo is in window pixels when
+     * \p space is WINDOW_COORDS.
+     *
+     * Only the parts of the spatial index around the point are searched so
+     * it's quick enough to snap the cursor to on every mouse move.
+     *
+     * \returns The item's id, or nothing if the canvas is empty.
+     */
+    std::vector<int> findClosest(int x, int y, float halo = 0.0f,
+                                 CoordSpace space = CANVAS_COORDS);
+
+    /*!
+     * \brief Finds up to \p count items nearest to point `(x, y)`, nearest
+     * first, leaving out those farther than \p maxDistance.
+     * \see findClosest
+     */
+    std::vector<int> findNearest(int x, int y, int count,
+                                 float maxDistance = FLT_MAX,
+                                 CoordSpace space = CANVAS_COORDS);
+
+    /*!
+     * \brief Returns the id of the topmost visible item under point `(x, y)`
+     * or -1 if there's none.
+     *
+     * In picking mode a point in the window only reads the id raster,
+     * otherwise the items under the point are hit tested.
+     */
+    int pick(int x, int y, CoordSpace space = WINDOW_COORDS);
+
+    /*!
+     * \brief Turns picking mode on or off.
+     *
+     * In picking mode the canvas keeps a GS::PickBuffer with the topmost
+     * item under every pixel of the window. Changes to the items only damage
+     * the pixels they covered and the raster is brought up to date the next
+     * time it's read, so pick() and mouse events cost a lookup no matter how
+     * many items are stacked under the cursor.
+     *
+     * Mouse handlers bound to items then only fire for the topmost item
+     * under the cursor.
+     */
+    void pickingMode(bool enabled);
+
+    //! Returns \b true if picking mode is on
+    bool pickingMode();
+
+    /*!
+     * \brief Moves painting to a thread of its own, or back to the window's
+     * thread. It must be invoked after init.
+     *
+     * On its own thread a slow paint doesn't hold up the event handlers, nor
+     * a slow handler the paint. The window publishes a Scene with copies of
+     * the items whenever they changed and a GC::Renderer draws the newest one
+     * into a back buffer that's copied to the window when done. Only the
+     * items that changed since the last scene are copied again.
+     *
+     * \note The extent of a text item is then only estimated since it isn't
+     * drawn on the window's thread. \see GS::Text::estimateBBoxCoords
+     */
+    void renderThread(bool enabled);
+
+    //! Returns \b true if painting is done on its own thread
+    bool renderThread();
+
+    /*!
+     * \brief Turns snapshots for other threads on or off.
+     *
+     * While they're on, the window publishes a Snapshot of the items at the
+     * end of every message that changed them, and snapshot() hands out the
+     * newest one. Only the items changed since the last snapshot are copied.
+     */
+    void snapshots(bool enabled);
+
+    //! Returns \b true if snapshots are being published
+    bool snapshots();
+
+    /*!
+     * \brief Returns the newest Snapshot, or NULL if snapshots are off.
+     *
+     * Safe to call from any thread. It never waits on the window's thread and
+     * the snapshot stays valid for as long as it's held.
+     */
+    std::shared_ptr<const Snapshot> snapshot() const;
+
+    /*!
+     * \brief Publishes a Snapshot of the items now if they changed since the
+     * last one. Only needed for changes made outside the message loop, e.g
+     * before loop() is called.
+     */
+    void publishSnapshot();
+
+    /*!
+     * \brief Starts writing every event handed to the handlers to the file at
+     * \p path, replacing its contents. Returns \b false if it can't be opened.
+     *
+     * The log holds the event type, key, mouse position and wheel delta with
+     * the time since the recording started. It can be fed back with replay().
+     * \see EventLogWriter
+     */
+    bool startRecording(const std::string &path);
+
+    //! Stops the recording and closes the file
+    void stopRecording();
+
+    /*!
+     * \brief Hands the events in a log to the handlers again, without a
+     * window, and measures them.
+     *
+     * The events are handed out back to back with the canvas clock set to the
+     * time they were recorded, so the result doesn't depend on how long they
+     * took. The handlers must be bound the same way and the scene should be
+     * the one the log was recorded against. The drags are rebuilt without
+     * capturing the mouse, so a replay can run while the window is shown.
+     *
+     * \param[in] path A log written by startRecording()
+     * \param[out] timings How long every event took, in the order replayed.
+     * \return \b false if the log can't be read
+     *
+     * \code
+     *   std::vector<GC::EventTiming> timings;
+     *   canvas.replay("session.gcir", &timings);
+     *   for (const GC::EventTiming &timing : timings) {
+     *     printf("%u %.1f %.1f\n", timing.event.time, timing.dispatch,
+     *            timing.handlers);
+     *   }
+     * \endcode
+     */
+    bool replay(const std::string &path, std::vector<EventTiming> *timings);
+
+    //! Replays events already read with readEventLog()
+    void replay(const std::vector<LoggedEvent> &log,
+                std::vector<EventTiming> *timings);
+
+    /*!
+     * \brief Queues a change to the canvas from any thread.
+     *
+     * The canvas isn't safe to touch from more than one thread. Other threads
+     * post the change instead and it's run on the window's thread, as
+     * `command(canvas)`, with the others queued since the last batch. The
+     * window is woken up with a single message per batch and repainted once
+     * the batch is done. Commands posted by one thread run in the order they
+     * were posted.
+     *
+     * Posted commands are only picked up by the window after init().
+     * Otherwise they wait for runCommands().
+     *
+     * \code
+     *   // On a worker thread
+     *   canv.post([id](GC::Canvas &canvas) {
+     *     canvas.moveShape(id, 5, 0);
+     *     canvas.fillColor(id, "red");
+     *     canvas.tagWithTag(id, "stale");
+     *   });
+     * \endcode
+     */
+    template<typename FunctorType>
+    void post(FunctorType command) {
+      commands.push([this, command]() {
+        command(*this);
+      });
+      wake();
+    }
+
+    /*!
+     * \brief Adds a shape created on another thread. Returns its id, which
+     * can be used in the commands posted after it straight away.
+     *
+     * The canvas takes ownership of the shape. The id goes unused if an equal
+     * shape is already there.
+     *
+     * \code
+     *   int id = canv.postShape(new GS::Rect(10, 10, 50, 50));
+     *   canv.post([id](GC::Canvas &canvas) {
+     *     canvas.fillColor(id, "blue");
+     *   });
+     * \endcode
+     */
+    int postShape(GS::Shape *newShape);
+
+    /*!
+     * \brief Runs the commands posted so far. Returns the number run.
+     *
+     * Commands posted while they run are left for the next call, which the
+     * window makes once it has handled the messages queued before.
+     */
+    int runCommands();
 
     /*!
-     * \brief Finds the closest item to pixel `(X, Y)`
+     * \brief Runs \p task on a worker thread and hands its result to
+     * \p continuation on the window's thread.
+     *
+     * Heavy work such as a layout or loading a file then doesn't hold up the
+     * window. The continuation is posted like post() does, so the results
+     * finished since the window last looked are handed out together and the
+     * window is repainted once. The task mustn't touch the canvas, the
+     * continuation is where the items are changed.
+     *
+     * With a \p shapeID, taking the item off the canvas cancels the work:
+     * the task is dropped if it hasn't started and the continuation if it
+     * hasn't run. That's removing it, grouping it or turning it into an
+     * instanced item, all of which leave the id unused.
+     *
+     * The workers are started by the first call. Called from the window's
+     * thread.
+     *
+     * \code
+     *   canv.submit([]() {
+     *     return loadPoints("track.csv");
+     *   }, [&canv, id](const std::vector<POINT> &points) {
+     *     canv.coords(id, points);
+     *   }, id);
+     * \endcode
      */
-    std::vector<int> findClosest(int x, int y);
+    template<typename Task, typename Continuation>
+    typename std::enable_if<!std::is_void<TaskResult<Task>>::value>::type
+    submit(Task task, Continuation continuation, int shapeID = -1) {
+      typedef TaskResult<Task> Result;
+      std::shared_ptr<std::atomic<bool>> cancelled = taskToken(shapeID);
+      workers().run([this, task, continuation, cancelled]() mutable {
+        if (*cancelled) {
+          return;
+        }
+        std::shared_ptr<Result> result = std::make_shared<Result>(task());
+        post([continuation, result, cancelled](Canvas &) {
+          if (!*cancelled) {
+            continuation(std::move(*result));
+          }
+        });
+      });
+    }
+
+    //! \overload submit(Task, Continuation, int) for a task with no result
+    template<typename Task, typename Continuation>
+    typename std::enable_if<std::is_void<TaskResult<Task>>::value>::type
+    submit(Task task, Continuation continuation, int shapeID = -1) {
+      std::shared_ptr<std::atomic<bool>> cancelled = taskToken(shapeID);
+      workers().run([this, task, continuation, cancelled]() mutable {
+        if (*cancelled) {
+          return;
+        }
+        task();
+        post([continuation, cancelled](Canvas &) {
+          if (!*cancelled) {
+            continuation();
+          }
+        });
+      });
+    }
+
+    /*!
+     * \brief Sets the most threads the operations that go over the whole
+     * scene split their work across, the window's thread included.
+     *
+     * Recolouring, tagging or taking the bounding box of a large number of
+     * items is split into chunks run on the submit() workers, and the results
+     * are put together in display list order so they're the same as with one
+     * thread. Scenes with fewer than PARALLEL_ITEMS items stay on the window's
+     * thread. 1 keeps all of them there and 0, the default, uses every worker.
+     *
+     * Starts more workers if there are too few, after waiting for the ones
+     * running to finish their tasks.
+     */
+    void parallelism(int threads);
+
+    //! Returns the thread limit set with parallelism()
+    int parallelism();
+
+    //! Scenes with fewer items than this aren't split among threads
+    static const size_t PARALLEL_ITEMS = 4096;
 
     /*!
      * \brief Finds all items with the specified tag.
      */
     std::vector<int> findWithTag(const std::string &tag);
 
+    /*!
+     * \brief Calls \p func with a ShapeRef for each item that shares a point
+     * with region `{x1, y1, x2, y2}`, from the bottom of the display list up.
+     *
+     * Same as findOverlapping() without building a list of ids. \p func may
+     * change the shapes but mustn't add or delete any.
+     */
+    template<typename Function>
+    void forEachOverlapping(int x1, int y1, int x2, int y2, Function func,
+                            CoordSpace space = CANVAS_COORDS) {
+      forEachInRegion(x1, y1, x2, y2, func, space, false);
+    }
+
+    //! Same as findEnclosed() but calls \p func for each item
+    //! \see forEachOverlapping
+    template<typename Function>
+    void forEachEnclosed(int x1, int y1, int x2, int y2, Function func,
+                         CoordSpace space = CANVAS_COORDS) {
+      forEachInRegion(x1, y1, x2, y2, func, space, true);
+    }
+
+    /*!
+     * \brief Calls \p func with a ShapeRef for each item the tag expression
+     * selects, in display list order.
+     * \see forEachOverlapping
+     */
+    template<typename Function>
+    void forEachWithTag(const std::string &tag, Function func) {
+      auto expression = GS::compileTags(tag);
+      for (size_t i = 0; i < shapeList.size(); i++) {
+        if (expression->matches(shapeList[i]->tagBits)) {
+          func(ShapeRef(this, shapeList[i].get()));
+        }
+      }
+    }
+
+    /*!
+     * \brief Returns the items with the tag as a range to loop over. Nothing
+     * is looked up until the loop gets to it.
+     *
+     * \code
+     *   for (GC::ShapeRef shape : canv.withTag("piece&&!captured")) {
+     *     shape.move(0, 10);
+     *   }
+     * \endcode
+     *
+     * The loop mustn't add or delete shapes.
+     */
+    ShapeRange withTag(const std::string &tag);
+
     /*!
      * \brief Returns all the specified shape's tags
      *
@@ -267,6 +975,39 @@ class Canvas {
     //! \overload moveShape(const std::string, int, int)
     bool moveShape(int shapeID, int xAmount, int yAmount);
 
+    /*!
+     * \brief Scales all the shapes with the tag relative to
+     * `(originX, originY)`, like Tk's `scale` command.
+     *
+     * \code
+     *   canv.scale("all", 0, 0, 2.0f, 2.0f); // Zoom in on the top left corner
+     * \endcode
+     * \see GS::Shape::scale for how the different shapes respond
+     */
+    bool scale(const std::string &tagName,
+               float originX,
+               float originY,
+               float xScale,
+               float yScale);
+
+    //! \overload scale(const std::string&, float, float, float, float)
+    bool scale(int shapeID, float originX, float originY,
+               float xScale, float yScale);
+
+    /*!
+     * \brief Rotates all the shapes with the tag anticlockwise by \p angle
+     * degrees around `(centerX, centerY)`
+     *
+     * \see GS::Shape::rotate
+     */
+    bool rotate(const std::string &tagName,
+                float centerX,
+                float centerY,
+                float angle);
+
+    //! \overload rotate(const std::string&, float, float, float)
+    bool rotate(int shapeID, float centerX, float centerY, float angle);
+
     //! Makes the shape invisible by not redrawing it
     bool hideShape(const std::string &tagName, bool visible = false);
 
@@ -308,25 +1049,42 @@ class Canvas {
     bool bind(const std::string &eventString,
               FunctorType funcType,
               int shapeID) {
-      std::string keyStr("");
-      EventType type = parseEventString(eventString, &keyStr);
+      return bind(parseEvent(eventString), funcType, shapeID);
+    }
+
+    //! \overload bind(std::string, FunctorType, int)
+    template<typename FunctorType>
+    bool bind(const std::string &eventString,
+              FunctorType funcType,
+              const std::string &tagName = "") {
+      return bind(parseEvent(eventString), funcType, tagName);
+    }
+
+    //! \overload bind(std::string, FunctorType, int)
+    template<typename FunctorType>
+    bool bind(const EventDesc &desc, FunctorType funcType, int shapeID) {
+      if (desc.type == INVALID_EVENT) {
+        return false;
+      }
       FunctorType *func_ = new FunctorType(funcType);
-      Event event(func_, type);
+      Event event(func_, desc.type);
       event.shapeID = shapeID;
-      return addHandler(event, keyStr);
+      return addHandler(event, desc.key);
     }
 
     //! \overload bind(std::string, FunctorType, int)
     template<typename FunctorType>
-    bool bind(const std::string &eventString,
+    bool bind(const EventDesc &desc,
               FunctorType funcType,
               const std::string &tagName = "") {
-      std::string keyStr("");
-      EventType type = parseEventString(eventString, &keyStr);
+      if (desc.type == INVALID_EVENT) {
+        return false;
+      }
       FunctorType *func_ = new FunctorType(funcType);
-      Event event(func_, type);
+      Event event(func_, desc.type);
       event.shapeTag = tagName;
-      return addHandler(event, keyStr);
+      event.shapeTags = GS::compileTags(tagName);
+      return addHandler(event, desc.key);
     }
 
     /*!
@@ -344,6 +1102,87 @@ class Canvas {
     //! \overload unbind(const std::string, EventHandler, int)
     bool unbind(const std::string &eventString, const std::string &tag = "");
 
+    //! \overload unbind(const std::string, EventHandler, int)
+    bool unbind(const EventDesc &desc, int shapeID);
+
+    //! \overload unbind(const std::string, EventHandler, int)
+    bool unbind(const EventDesc &desc, const std::string &tag = "");
+
+    /*!
+     * \brief Calls \p func, with no arguments, once \p millSecs milliseconds
+     * have passed. Returns an id that can be passed to afterCancel().
+     *
+     * It returns straight away, so input and painting carry on while it
+     * waits. A scripted sequence schedules each step from the one before,
+     * the way Tk's `after` is used:
+     *
+     * \code
+     *   void slide(GC::Canvas *canv, int id, int steps) {
+     *     canv->moveShape(id, 5, 0);
+     *     if (steps > 1) {
+     *       canv->after(16, [ = ]() {
+     *         slide(canv, id, steps - 1);
+     *       });
+     *     }
+     *   }
+     * \endcode
+     *
+     * All the calls share one timer set for the earliest of them.
+     */
+    template<typename FunctorType>
+    int after(int millSecs, FunctorType func) {
+      return scheduleAfter(millSecs, std::function<void()>(func));
+    }
+
+    /*!
+     * \brief Calls \p func, with no arguments, the next time there are no
+     * messages waiting, like Tk's `after idle`. Returns an id that can be
+     * passed to afterCancel().
+     *
+     * The calls are made from loop().
+     */
+    template<typename FunctorType>
+    int afterIdle(FunctorType func) {
+      return scheduleIdle(std::function<void()>(func));
+    }
+
+    //! Cancels a call made with after() or afterIdle() that hasn't run yet
+    bool afterCancel(int id);
+
+#ifdef GDICANVAS_COROUTINES
+    //! The awaitable returned by delay()
+    struct Delay {
+      Canvas *canvas;
+      int millSecs;
+      bool await_ready() const noexcept {
+        return millSecs < 0;
+      }
+      void await_suspend(std::coroutine_handle<> waiting) {
+        canvas->after(millSecs, [waiting]() {
+          waiting.resume();
+        });
+      }
+      void await_resume() const noexcept {}
+    };
+
+    /*!
+     * \brief Suspends a coroutine for \p millSecs milliseconds using after().
+     * Needs C++20.
+     *
+     * \code
+     *   GC::Script slide(GC::Canvas &canv, int id) {
+     *     for (int i = 0; i < 20; i++) {
+     *       canv.moveShape(id, 5, 0);
+     *       co_await canv.delay(16);
+     *     }
+     *   }
+     * \endcode
+     */
+    Delay delay(int millSecs) {
+      return Delay {this, millSecs};
+    }
+#endif
+
     //! Add a timer event. The function will be called once.
     template<typename FunctorType>
     bool timer(int millSecs, FunctorType func) {
@@ -352,7 +1191,7 @@ class Canvas {
       FunctorType *func_ = new FunctorType(func);
       Event event(func_, TIMER);
       event.timerID = timerID;
-      return addHandler(event, "<timer>");
+      return addHandler(event, 1);
     }
 
     //! Returns the shape type of the shape with the specified id.
@@ -467,6 +1306,125 @@ class Canvas {
      */
     int polygon(const std::vector<POINT> &lineCoords);
 
+    /*!
+     * \brief Creates a streaming line plot in the box `(x1, y1, x2, y2)`
+     *
+     * \p capacity is the number of samples kept. By default the x values are
+     * taken to be sample numbers and the last \p capacity of them are shown.
+     *
+     * \code
+     *   int plot = canv.series(10, 10, 610, 210, 10000);
+     *   canv.seriesRange(plot, -1.0f, 1.0f);
+     *   canv.append(plot, time, value);
+     * \endcode
+     *
+     * \see GS::Series
+     */
+    int series(int x1, int y1, int x2, int y2, int capacity = 4096);
+
+    /*!
+     * \brief Appends a sample to the series and repaints only the series' box
+     *
+     * \returns __false__ If \p shapeID isn't a series
+     */
+    bool append(int shapeID, float x, float y);
+
+    //! \overload append(int, float, float)
+    bool append(int shapeID, const std::vector<Vec::Vec2D> &samples);
+
+    //! Changes the values shown at the bottom and top edges of the series' box
+    bool seriesRange(int shapeID, float low, float high);
+
+    //! Changes the range of x values visible in the series' box
+    bool seriesSpan(int shapeID, float span);
+
+    /*!
+     * \brief Creates a single shape holding all the points, drawn as square
+     * markers \p markerSize pixels wide.
+     *
+     * Far cheaper than a shape per point when there are thousands of them.
+     *
+     * \see GS::PointCloud
+     */
+    int pointCloud(const std::vector<float> &xs,
+                   const std::vector<float> &ys,
+                   int markerSize = 3);
+
+    /*!
+     * \brief Gives every point in the cloud its own colour
+     *
+     * \returns __false__ If \p shapeID isn't a point cloud or there isn't a
+     * colour for every point. An empty vector restores the shape's colour.
+     */
+    bool pointColors(int shapeID, const std::vector<COLORREF> &colors);
+
+    /*!
+     * \brief Returns the index of the cloud's point under `(x, y)` or -1 if
+     * there's none.
+     *
+     * The point is matched if it's within the marker drawn for it.
+     */
+    int pickPoint(int shapeID, int x, int y,
+                  CoordSpace space = CANVAS_COORDS);
+
+    /*!
+     * \brief Turns the shape into the geometry of an instanced item and
+     * returns the item's id. The shape is taken off the canvas.
+     *
+     * The shape's coordinates become relative to each instance's position.
+     * Only polygons, lines, rectangles, ovals, circles and arcs can be used.
+     *
+     * \code
+     *   int turtle = canv.polygon({{0, -10}, {8, 10}, {0, 5}, {-8, 10}});
+     *   int herd = canv.instances(turtle);
+     *   for (int i = 0; i < 5000; i++) {
+     *     canv.addInstance(herd, rand() % 800, rand() % 600);
+     *   }
+     * \endcode
+     *
+     * \returns -1 If the shape doesn't exist or can't be instanced
+     * \see GS::Instances
+     */
+    int instances(int shapeID);
+
+    /*!
+     * \brief Draws the item's geometry once more at `(x, y)`.
+     *
+     * \param[in] color The fill colour. CLR_INVALID uses the item's fill.
+     * \returns The instance's index or -1 if \p shapeID isn't instanced.
+     */
+    int addInstance(int shapeID, float x, float y, float scale = 1.0f,
+                    COLORREF color = CLR_INVALID);
+
+    /*!
+     * \brief Moves and resizes an instance.
+     *
+     * Only the instance's old and new places are repainted and picked again.
+     * The item is only filed again in the spatial index if its bounding box
+     * changed.
+     */
+    bool placeInstance(int shapeID, int index, float x, float y,
+                       float scale = 1.0f);
+
+    /*!
+     * \brief Changes the instances from \p first on to \p placements, colours
+     * included, e.g to move a whole herd each frame.
+     *
+     * The item is repainted and filed again in the spatial index once for
+     * all of them.
+     * \returns __false__ If \p shapeID isn't instanced or some of the
+     * instances don't exist
+     */
+    bool placeInstances(int shapeID, int first,
+                        const std::vector<GS::Instance> &placements);
+
+    /*!
+     * \brief Returns the index of the topmost instance under `(x, y)` or -1
+     * if there's none.
+     */
+    int pickInstance(int shapeID, int x, int y,
+                     CoordSpace space = CANVAS_COORDS);
+
     /*! Moves the item with id \p first above the item with id \p second in the
      * display list
      *
@@ -476,6 +1434,42 @@ class Canvas {
      */
     bool raiseShape(int first, int second);
 
+    /*!
+     * \brief Puts the shapes into a new group and returns the group's id.
+     *
+     * The group takes the place of the topmost shape in the display list.
+     * Moving, hiding, recolouring or deleting the group does the same to all
+     * of its shapes. The shapes are only reachable through the group until
+     * ungroup() is called. Groups can be grouped as well.
+     *
+     * \code
+     *   int tile = canv.rectangle(10, 10, 60, 60);
+     *   int label = canv.text(30, 25, "7");
+     *   int piece = canv.group({tile, label});
+     *   canv.moveShape(piece, 50, 0);
+     * \endcode
+     *
+     * \returns -1 If none of the shapes was found
+     */
+    int group(const std::vector<int> &shapeIDs);
+
+    //! \overload group(const std::vector<int>&)
+    int group(const std::string &tagName);
+
+    //! \overload group(const std::vector<int>&)
+    int group(std::initializer_list<int> shapeIDs) {
+      return group(std::vector<int>(shapeIDs));
+    }
+
+    /*!
+     * \brief Puts the group's shapes back on the canvas in its place and
+     * removes the group.
+     */
+    bool ungroup(int groupID);
+
+    //! Returns the ids of the shapes in the group, bottom first
+    std::vector<int> children(int groupID);
+
     /*!
      * \brief Moves all the items with the specified tag above the shape with
      * tag id \p target
@@ -696,6 +1690,75 @@ class Canvas {
      */
     int loop();
 
+    /*!
+     * \brief Limits panning and scrolling to the region, in canvas
+     * coordinates. Tk's `-scrollregion`.
+     */
+    void scrollRegion(GS::Box region);
+
+    /*!
+     * \brief Returns the scroll region, or the bounding box of all the items
+     * if none has been set. That's {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX}
+     * when there are no items.
+     */
+    GS::Box scrollRegion();
+
+    /*!
+     * \brief Scrolls horizontally so that \p fraction of the scroll region is
+     * off-screen to the left. Tk's `xview moveto`.
+     *
+     * Does nothing if the scroll region is empty, i.e there's no region set
+     * and no items.
+     */
+    void xview(float fraction);
+
+    //! Returns the fraction of the scroll region off-screen to the left
+    float xview();
+
+    //! Scrolls vertically. \see xview(float)
+    void yview(float fraction);
+
+    //! Returns the fraction of the scroll region off-screen at the top
+    float yview();
+
+    //! Pans the view by the specified number of window pixels
+    void pan(int xAmount, int yAmount);
+
+    /*!
+     * \brief Multiplies the zoom by \p factor keeping the canvas point under
+     * window coordinate `(x, y)` in place.
+     *
+     * \code
+     *   struct Zoom : GC::EventHandler {
+     *     GC::Canvas *canv;
+     *     explicit Zoom(GC::Canvas *canv) : canv(canv) {}
+     *     void handle(GC::Mouse mouse) {
+     *       canv->zoom(mouse.delta() > 0 ? 1.25f : 0.8f, mouse.x(), mouse.y());
+     *     }
+     *   };
+     *   canv.bind("<Wheel-Roll>", Zoom(&canv));
+     * \endcode
+     */
+    void zoom(float factor, int x, int y);
+
+    //! Returns the current zoom. 1 means a canvas unit is a window pixel.
+    float zoom();
+
+    //! Converts a window x-coordinate to a canvas one. Tk's `canvasx`.
+    float canvasX(int windowX);
+
+    //! Converts a window y-coordinate to a canvas one. Tk's `canvasy`.
+    float canvasY(int windowY);
+
+    //! Converts a canvas x-coordinate to a window one
+    int windowX(float canvasX);
+
+    //! Converts a canvas y-coordinate to a window one
+    int windowY(float canvasY);
+
+    //! Returns the part of the canvas visible in the window
+    GS::Box visibleRegion();
+
     //! Returns the window's dimensions. `x` is width and `y` length
     POINT windowSize();
 
@@ -740,6 +1803,8 @@ class Canvas {
     HWND handle();
 
   private:
+    friend class ShapeRef;
+
     Canvas(const Canvas &);
     Canvas &operator=(const Canvas &);
 
@@ -753,33 +1818,17 @@ class Canvas {
     void refreshWindow();
 
     //! Calls all the functions in the events map that have the same event
-    //! type and handle the same key.
-    bool callHandlers(EventType type, int key = 0);
+    //! type and handle the same key. They all get the same \p mouse.
+    bool callHandlers(EventType type, const Mouse &mouse, int key = 0);
 
     /*!
-     * \brief Parses the event string and adds the event to the events map.
-     *
-     * The string must start and end with an angle bracket.
-     *
-     * Event's like \b <Ctrl-Shift-Q> and \b <Shift-Ctrl-Q> are considered to
-     * be same.
-     *
-     * \see EventType for accepted format.
-     *
-     * \param[in] eventString The event specifier, in angle brackets.
-     * \param[out] keyString A variable to hold the key. The key will be used to
-     * lookup the keycode. The variable will be empty on invalid event string.
-     *
-     * \code
-     *   std::string keyStr;
-     *   parseEventString("<Ctrl-Shift-A>", keyStr); // Returns CTRL_SHIFT_KEY
-     *   std::cout << keyStr; "A"
-     * \endcode
-     *
+     * \brief Files the handler under its event type, or under \p key for the
+     * keyboard events. Returns \b false if the event isn't valid.
      */
-    EventType parseEventString(std::string eventString, std::string *keyString);
+    bool addHandler(Event event, int key);
 
-    bool addHandler(Event event, const std::string &keyStr);
+    //! Returns the handlers \p desc would be filed under
+    std::vector<Event> *handlersFor(const EventDesc &desc);
 
     // Makes the program listen for mouse move messages. Needed for <hover> event
     bool trackMouse();
@@ -790,6 +1839,221 @@ class Canvas {
      */
     int addShape(GS::Shape *newShape);
 
+    //! Updates the spatial index after the shape's bounding box changed
+    void reindex(GS::Shape *shape);
+
+    //! Adds the shape to the spatial index
+    void indexShape(GS::Shape *shape);
+
+    //! Removes the shape from the spatial index
+    void unindexShape(GS::Shape *shape);
+
+    //! Marks the pixels under the shape to be picked again
+    void damagePick(GS::Shape *shape);
+
+    /*!
+     * \brief Marks the window to be picked again after the view changed from
+     * the one at (\p oldX, \p oldY) and \p oldZoom.
+     *
+     * If the view only moved by whole pixels, e.g after pan(), the pick raster
+     * is scrolled and only the strips that came into view are picked again.
+     */
+    void damageView(float oldX, float oldY, float oldZoom);
+
+    //! Returns the topmost shape at the window pixel using the id raster
+    GS::Shape *pickedShape(int x, int y);
+
+    //! Returns the topmost visible shape containing the point
+    GS::Shape *topmostShape(int x, int y, CoordSpace space);
+
+    /*!
+     * \brief Keeps the latest mouse move for the motion handlers. They're
+     * called at most once every MOTION_INTERVAL milliseconds, with the moves
+     * in between merged into one.
+     */
+    void queueMotion(const Mouse &mouse);
+
+    //! Hands the queued mouse move, if any, to the motion handlers
+    bool flushMotion();
+
+    //! Captures the mouse and remembers the shape the drag started on
+    void beginDrag(const Mouse &mouse);
+
+    //! Calls the \p release handlers and ends the drag once no button is held
+    bool endDrag(EventType release, const Mouse &mouse);
+
+    //! Returns the recorded time while replaying and GetTickCount() otherwise
+    DWORD tickCount();
+
+    //! Calls the handler, timing it while replaying
+    void runHandler(const Event &event, const Mouse &mouse);
+
+    //! Writes the event to the log if recording
+    void logEvent(EventType type, const Mouse &mouse, int key);
+
+    //! Asks the window to run the posted commands unless it's already asked
+    void wake();
+
+    //! Starts the worker threads used by submit() if they aren't running
+    ThreadPool &workers();
+
+    //! Returns the flag that cancels the work submitted for the item
+    std::shared_ptr<std::atomic<bool>> taskToken(int shapeID);
+
+    //! Cancels the work submitted for the item
+    void cancelTasks(int shapeID);
+
+    //! Adds a call for after()
+    int scheduleAfter(int millSecs, std::function<void()> func);
+
+    //! Adds a call for afterIdle()
+    int scheduleIdle(std::function<void()> func);
+
+    //! Sets AFTER_TIMER to go off at the earliest deadline
+    void armAfterTimer();
+
+    //! Makes the after() calls whose deadline has passed
+    void runAfter();
+
+    //! Makes the afterIdle() calls queued so far. Returns \b true if any ran.
+    bool runIdle();
+
+    /*!
+     * \brief Marks the shape as changed since the last scene and snapshot
+     * were published.
+     *
+     * Every method that changes how an item looks or where it is must call
+     * it, itself or through reindex() or damagePick(). The copies the render
+     * thread and the snapshots hold are otherwise kept.
+     */
+    void touch(GS::Shape *shape);
+
+    //! Hands the render thread a snapshot of the items and the view
+    void publishScene();
+
+    //! Renumbers GS::Shape::stackOrder after the display list is reordered
+    void restack();
+
+    //! Replaces \p topmost with a group of the shapes and removes the rest
+    int group(const std::vector<std::shared_ptr<GS::Shape>> &children,
+              std::vector<std::shared_ptr<GS::Shape>>::iterator topmost);
+
+    /*!
+     * \brief Fills \p shapes with the shapes whose bounding box shares a point
+     * with the region, in display list order.
+     */
+    void regionShapes(const GS::Box &region, std::vector<GS::Shape *> *shapes);
+
+    //! Converts the region to canvas coordinates
+    GS::Box canvasRegion(int x1, int y1, int x2, int y2, CoordSpace space);
+
+    //! Fills \p neighbours with the items nearest to the point
+    //! \see GS::SpatialGrid::nearest
+    void nearestShapes(int x, int y, int count, float halo, float maxDistance,
+                       CoordSpace space, std::vector<GS::Neighbour> *neighbours);
+
+    //! Shared by forEachOverlapping and forEachEnclosed
+    template<typename Function>
+    void forEachInRegion(int x1, int y1, int x2, int y2, Function func,
+                         CoordSpace space, bool enclosed) {
+      GS::Box region = canvasRegion(x1, y1, x2, y2, space);
+      Vec::Vec2D topLeft(region.x1, region.y1);
+      Vec::Vec2D bottomRight(region.x2, region.y2);
+      // Taken out of the member so a nested query gets its own
+      std::vector<GS::Shape *> shapes;
+      shapes.swap(queryShapes);
+      regionShapes(region, &shapes);
+      for (GS::Shape *shape : shapes) {
+        bool selected = enclosed ? shape->shapeInRegion(topLeft, bottomRight) :
+                        shape->overlapsWithRegion(topLeft, bottomRight);
+        if (selected) {
+          func(ShapeRef(this, shape));
+        }
+      }
+      shapes.clear();
+      queryShapes.swap(shapes);
+    }
+
+    //! Returns the number of chunks forChunks() should split \p count items into
+    int chunksFor(size_t count);
+
+    /*!
+     * \brief Calls `func(chunk, begin, end)` for each of the \p chunks
+     * consecutive ranges covering `[0, count)`, on the workers when there's
+     * more than one. \p func is called from several threads at once and must
+     * only change the items in its range.
+     */
+    template<typename Function>
+    void forChunks(size_t count, int chunks, Function func) {
+      if (chunks <= 1) {
+        func(0, 0, count);
+        return;
+      }
+      workers().parallelFor(chunks, [count, chunks, &func](int chunk) {
+        func(chunk, count * chunk / chunks, count * (chunk + 1) / chunks);
+      }, parallelThreads);
+    }
+
+    /*!
+     * \brief Returns the box around the items for which `selected(shape)`
+     * returns \b true, or {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX} if none do.
+     */
+    template<typename Predicate>
+    GS::Box boundingBox(Predicate selected) {
+      GS::Box none(FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX);
+      std::vector<GS::Box> boxes(chunksFor(shapeList.size()), none);
+      forChunks(shapeList.size(), boxes.size(),
+      [this, &boxes, &selected](int chunk, size_t begin, size_t end) {
+        GS::Box &box = boxes[chunk];
+        for (size_t i = begin; i < end; i++) {
+          GS::Shape *shape = shapeList[i].get();
+          if (!selected(shape)) {
+            continue;
+          }
+          Vec::Vec2D topPoint(shape->topLeftCoord());
+          Vec::Vec2D bottomPoint(shape->bottomRightCoord());
+          box.x1 = std::min(topPoint.x, box.x1);
+          box.y1 = std::min(topPoint.y, box.y1);
+          box.x2 = std::max(bottomPoint.x, box.x2);
+          box.y2 = std::max(bottomPoint.y, box.y2);
+        }
+      });
+      for (const GS::Box &box : boxes) {
+        none.x1 = std::min(box.x1, none.x1);
+        none.y1 = std::min(box.y1, none.y1);
+        none.x2 = std::max(box.x2, none.x2);
+        none.y2 = std::max(box.y2, none.y2);
+      }
+      return none;
+    }
+
+    //! Does tagEnclosed() and tagOverlapping()
+    bool tagRegion(const std::string &tagName, int x1, int y1, int x2, int y2,
+                   CoordSpace space, bool enclosed);
+
+    //! Does fillColor() and penColor() for the items with the tag
+    bool colorTagged(const std::string &tagName, const std::string &color,
+                     bool fill);
+
+    //! Keeps the view within the scroll region
+    void clampView();
+
+    //! Returns the series with that id or NULL if there isn't one
+    GS::Series *findSeries(int shapeID);
+
+    //! Returns the point cloud with that id or NULL if there isn't one
+    GS::PointCloud *findPointCloud(int shapeID);
+
+    //! Returns the instanced item with that id or NULL if there isn't one
+    GS::Instances *findInstances(int shapeID);
+
+    //! Repaints only the part of the window covered by the shape
+    void refreshShape(GS::Shape *shape);
+
+    //! Repaints and picks again only the part of the window covered by one
+    //! of the item's instances
+    void refreshInstance(GS::Instances *item, int index);
+
     int timerCount = 0;
     int cmdShow = SW_SHOWNORMAL;
     int winHeight = 700;
@@ -802,13 +2066,133 @@ class Canvas {
     unsigned windowStyle = WS_CAPTION | WS_SYSMENU | WS_THICKFRAME |
                            WS_MAXIMIZEBOX | WS_MINIMIZEBOX;
     WNDCLASSEX windowClassEx;
-    HWND winHandle;
+    HWND winHandle = NULL;
     HINSTANCE winInst = GetModuleHandle(NULL);
     MSG windowMessage;
     std::map<EventType, std::vector<Event>> events;
+    // The keyboard event handlers by virtual key code, so a key press only
+    // looks at the handlers for that key
+    static const int KEY_CODES = 256;
+    std::vector<Event> keyEvents[KEY_CODES];
     std::vector<std::shared_ptr<GS::Shape>> shapeList;
+    // Finds the shapes in a region without visiting all of shapeList
+    GS::SpatialGrid shapeIndex;
+    // Reused by WM_PAINT to hold the shapes in the damaged region
+    std::vector<GS::Shape *> visibleShapes;
+    // Reused by the region visitors
+    std::vector<GS::Shape *> queryShapes;
+    // The series on the canvas, by id, for findSeries(). Streaming calls
+    // append() over and over. Kept by indexShape() and unindexShape().
+    std::unordered_map<int, GS::Series *> seriesByID;
+    int stackCounter = 0;
+    // Canvas coordinate at the window's top left corner and the zoom
+    float viewX = 0.0f;
+    float viewY = 0.0f;
+    float viewZoom = 1.0f;
+    GS::Box scrollBox;
+    bool hasScrollRegion = false;
+    // The topmost shape under every pixel, only kept in picking mode
+    GS::PickBuffer pickBuffer;
+    bool picking = false;
+    // The shortest time between two motion events, about a frame
+    static const int MOTION_INTERVAL = 16;
+    // Flushes queued mouse moves. Out of the range used by timer().
+    static const UINT_PTR MOTION_TIMER = static_cast<UINT_PTR>(-1);
+    Mouse pendingMotion = Mouse(0, 0);
+    bool hasPendingMotion = false;
+    // Where the cursor was at the last motion event and when
+    POINT lastMotion = {0, 0};
+    DWORD lastMotionTime = 0;
+    // Drag events go to the shape the drag started on while the mouse is
+    // captured, wherever the cursor is
+    bool dragging = false;
+    GS::Shape *dragTarget = NULL;
+    EventLogWriter recorder;
+    DWORD recordStart = 0;
+    // Set while replay() runs. The clock is then the replayed event's time.
+    bool replaying = false;
+    DWORD replayClock = 0;
+    double handlerTime = 0;
+    // Sent to the window when commands are posted
+    static const unsigned COMMAND_MESSAGE = WM_APP;
+    CommandQueue commands;
+    // Set while a COMMAND_MESSAGE is on its way so that a burst of posts sends
+    // only one
+    std::atomic<bool> woken{false};
+    // winHandle for wake(), which runs on the posting threads. Set once the
+    // window exists.
+    std::atomic<HWND> commandWindow{NULL};
+    // Paints snapshots of the items on its own thread when turned on
+    Renderer renderer;
+    // Set when the items or the view changed since the last scene
+    bool sceneDirty = true;
+    // The copy of every item in the last scene and the revision copied. Only
+    // the changed items' entries are updated when a scene is published.
+    struct PublishedShape {
+      unsigned revision;
+      std::shared_ptr<GS::Shape> copy;
+    };
+    std::unordered_map<int, PublishedShape> published;
+    // Set while snapshots are published
+    bool snapshotting = false;
+    // Set when the items changed since the last snapshot
+    bool snapshotDirty = true;
+    // Keeps the copies in the last snapshot. Kept apart from the scene's
+    // copies since the render thread updates those as it draws.
+    SnapshotPublisher snapshotPublisher;
+    // Only swapped with the atomic shared_ptr functions
+    std::shared_ptr<const Snapshot> latestSnapshot;
+    unsigned long snapshotCount = 0;
+    // A call waiting in after() or afterIdle()
+    struct Deferred {
+      DWORD due;
+      int id;
+      std::function<void()> func;
+    };
+    // The after() calls, a heap with the earliest deadline on top
+    std::vector<Deferred> deferred;
+    // The afterIdle() calls, oldest first
+    std::vector<Deferred> idleCalls;
+    int deferredCount = 0;
+    // Goes off at the earliest after() deadline
+    static const UINT_PTR AFTER_TIMER = MOTION_TIMER - 1;
+    // Set when an item with work submitted for it is removed
+    std::unordered_map<int, std::shared_ptr<std::atomic<bool>>> taskTokens;
+    // The most threads the whole scene operations use, 0 for no limit
+    int parallelThreads = 0;
+    // The fewest items handed to a thread by forChunks()
+    static const size_t CHUNK_ITEMS = 1024;
+    // Runs the submit() tasks. Declared last so the workers stop first.
+    std::unique_ptr<ThreadPool> pool;
 };
 
+
+#ifdef GDICANVAS_COROUTINES
+/*!
+ * \struct Script
+ * \brief The return type of a coroutine that scripts a sequence on the
+ * canvas with Canvas::delay(). It starts running when called and frees itself
+ * when it finishes.
+ */
+struct Script {
+  struct promise_type {
+    Script get_return_object() {
+      return {};
+    }
+    std::suspend_never initial_suspend() noexcept {
+      return {};
+    }
+    std::suspend_never final_suspend() noexcept {
+      return {};
+    }
+    void return_void() {}
+    void unhandled_exception() {
+      std::terminate();
+    }
+  };
+};
+#endif
+
 }
 
 namespace GC = GCanvas;
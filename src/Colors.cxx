@@ -1,5 +1,11 @@
 #include "Colors.h"
 
+#ifndef _WIN32
+#include <strings.h>
+// strcmpi() is only in the Windows C runtime
+#define strcmpi strcasecmp
+#endif
+
 using namespace Colors;
 
 //! Scraped from rgb.txt files bundled with python(pynche), vim, R and FLTK.
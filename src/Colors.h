@@ -10,7 +10,7 @@
 //! The total number of colornames available
 #define COLORNAMES 538
 
-#include <windows.h>
+#include "./Platform.h"
 #include <string>
 #include <cstring>
 #include <cstdio>
@@ -0,0 +1,53 @@
+/*!
+ * \file CommandQueue.cxx
+ */
+
+#include "./CommandQueue.h"
+
+using namespace GCanvas;
+
+CommandQueue::CommandQueue() {
+  tail = new Node;
+  head.store(tail);
+}
+
+CommandQueue::~CommandQueue() {
+  while (tail) {
+    Node *next = tail->next.load();
+    delete tail;
+    tail = next;
+  }
+}
+
+void CommandQueue::push(Command command) {
+  Node *node = new Node;
+  node->command = std::move(command);
+  Node *previous = head.exchange(node, std::memory_order_acq_rel);
+  // Until this store the consumer sees the queue end at previous
+  previous->next.store(node, std::memory_order_release);
+}
+
+int CommandQueue::drain(bool *complete) {
+  // Only the commands pushed before the call are run, so producers that keep
+  // up with the consumer can't keep it here
+  Node *last = head.load(std::memory_order_acquire);
+  int count = 0;
+  while (tail != last) {
+    Node *next = tail->next.load(std::memory_order_acquire);
+    if (!next) {
+      break; // A producer is half way through its push
+    }
+    // The node becomes the spent one in front of the queue
+    Command command = std::move(next->command);
+    delete tail;
+    tail = next;
+    command();
+    count++;
+  }
+  *complete = (head.load(std::memory_order_acquire) == tail);
+  return count;
+}
+
+bool CommandQueue::empty() const {
+  return head.load(std::memory_order_acquire) == tail;
+}
@@ -0,0 +1,67 @@
+/*!
+ * \file CommandQueue.h
+ * \brief A queue any thread can push work into and one thread runs.
+ */
+
+#ifndef CommandQueue_H_
+#define CommandQueue_H_
+
+#include <atomic>
+#include <functional>
+
+namespace GCanvas {
+
+/*!
+ * \class CommandQueue
+ * \brief A lock free queue with many producers and a single consumer.
+ *
+ * push() may be called from any thread at the same time. drain() must only be
+ * called from one thread, the one the commands are meant to run on. Commands
+ * pushed by the same thread run in the order they were pushed.
+ *
+ * The queue is a linked list the producers append to with one atomic exchange,
+ * so a push never waits on the consumer or on the other producers.
+ */
+class CommandQueue {
+  public:
+    typedef std::function<void()> Command;
+
+    CommandQueue();
+    ~CommandQueue();
+
+    //! Appends the command. Safe to call from any thread.
+    void push(Command command);
+
+    /*!
+     * \brief Runs the commands queued when it's called. Returns the number
+     * run.
+     *
+     * Commands pushed while they run, including by the commands themselves,
+     * are left for the next drain. So is a producer caught half way through
+     * a push, along with the commands after its own. \p complete is set to
+     * \b false if anything is left.
+     */
+    int drain(bool *complete);
+
+    //! Returns \b true if there's nothing to run. Only exact on the consumer.
+    bool empty() const;
+
+  private:
+    struct Node {
+      std::atomic<Node *> next;
+      Command command;
+      Node() : next(nullptr) {}
+    };
+
+    CommandQueue(const CommandQueue &);
+    CommandQueue &operator=(const CommandQueue &);
+
+    // The node pushed last. Producers swap themselves in here.
+    std::atomic<Node *> head;
+    // A spent node in front of the next command, only touched by the consumer
+    Node *tail;
+};
+
+}
+
+#endif
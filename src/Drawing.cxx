@@ -0,0 +1,459 @@
+/*!
+ * \file Drawing.cxx
+ * \brief The GDI half of the shapes. Only built on Windows, the rest of
+ * Shapes.cxx builds anywhere.
+ */
+
+#include "./Shapes.h"
+
+using namespace GShape;
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~[ Free functions ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+float GShape::drawingZoom(HDC paintDC) {
+  XFORM transform;
+  if (!GetWorldTransform(paintDC, &transform)) {
+    return 1.0f;
+  }
+  float determinant = transform.eM11 * transform.eM22 -
+                      transform.eM12 * transform.eM21;
+  return std::sqrt(std::fabs(determinant));
+}
+
+void GShape::paintShape(HDC paintDC, Shape *shape) {
+  HPEN oldPen, newPen;
+  HBRUSH oldBrush, newBrush;
+  COLORREF penColor = Colors::hexToColorRef(shape->getPenColor());
+  newPen = CreatePen(shape->borderStyle(), shape->penSize, penColor);
+  oldPen = static_cast<HPEN>(SelectObject(paintDC, newPen));
+  std::string fillColor_ = shape->getFillColor();
+  if (fillColor_ == "") {
+    // Don't fill the shape
+    newBrush = static_cast<HBRUSH>(GetStockObject(NULL_BRUSH));
+  } else {
+    COLORREF fillColor = Colors::hexToColorRef(fillColor_);
+    newBrush = CreateSolidBrush(fillColor);
+  }
+  oldBrush = static_cast<HBRUSH>(SelectObject(paintDC, newBrush));
+  shape->draw(paintDC); // Draw the shape/object
+  SelectObject(paintDC, oldBrush);
+  DeleteObject(newBrush);
+  SelectObject(paintDC, oldPen);
+  DeleteObject(newPen);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~[ Polygon ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Poly::draw(HDC paintDC) {
+  if (!isShown()) {
+    return;
+  }
+  // Vertices closer together than half a pixel can't be told apart
+  float tolerance = DetailLevels::MIN_TOLERANCE / drawingZoom(paintDC);
+  const std::vector<POINT> &vertices = detailLevels.select(polyCoords,
+                                       tolerance);
+  Polygon(paintDC, vertices.data(), vertices.size());
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~[ Rectangle ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Rect::draw(HDC paintDC) {
+  if (!isShown()) {
+    return;
+  }
+  Rectangle(paintDC, topLeft.x, topLeft.y, bottomRight.x, bottomRight.y);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~[ Text ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Text::createFont(HFONT *font) {
+  FontAttr fontProp = getFontAttr();
+  HDC hDC = GetDC(NULL);
+  LONG fontHeight = -MulDiv(fontProp.size, GetDeviceCaps(hDC, LOGPIXELSY), 72);
+  ReleaseDC(NULL, hDC);
+  *font = CreateFont(fontHeight, 0, 0, 0, fontProp.bold, fontProp.italic,
+                     fontProp.underline, fontProp.strikeout, DEFAULT_CHARSET,
+                     OUT_OUTLINE_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY,
+                     VARIABLE_PITCH, fontProp.family.c_str());
+}
+
+POINT Text::textArea(HDC paintDC) {
+  SIZE size;
+  std::string text_ = getText();
+  GetTextExtentPoint32(paintDC, text_.c_str(), text_.length(), &size);
+  return {size.cx, size.cy};
+}
+
+void Text::draw(HDC paintDC) {
+  if (!isShown()) {
+    return;
+  }
+  HFONT font;
+  createFont(&font);
+  SelectObject(paintDC, font);
+  POINT dim = textArea(paintDC);
+  int x1 = static_cast<int>(start.x);
+  int y1 = static_cast<int>(start.y);
+  int x2 = x1 + dim.x;
+  int y2 = y1 + dim.y;
+  if (width != 0) {
+    x2 = x1 + width;
+  }
+
+  // Update the bounding box's coordinates with the correct values according to
+  // the current font.
+  topLeft = {x1, y1};
+  bottomRight = {x2, y2};
+
+  RECT textRegion = {x1, y1, x2, y2};
+  SetTextColor(paintDC, Colors::hexToColorRef(getPenColor()));
+  std::string fillColor_ = getFillColor();
+  if (fillColor_ != "") {
+    SetBkColor(paintDC, Colors::hexToColorRef(fillColor_));
+  } else {
+    SetBkMode(paintDC, TRANSPARENT);
+  }
+  std::string text_ = getText();
+  int format =  DT_NOCLIP | DT_SINGLELINE | DT_WORD_ELLIPSIS;
+  DrawText(paintDC, text_.c_str(), -1, &textRegion, format);
+  DeleteObject(font);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~[ Oval ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Oval::draw(HDC paintDC) {
+  if (!isShown()) {
+    return;
+  }
+  Ellipse(paintDC, topLeft.x, topLeft.y, bottomRight.x, bottomRight.y);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~[ Circle ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Circle::draw(HDC paintDC) {
+  if (!isShown()) {
+    return;
+  }
+  updateBBoxCoords();
+  Ellipse(paintDC, topLeft.x, topLeft.y, bottomRight.x, bottomRight.y);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~[ Line ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Line::draw(HDC paintDC) {
+  if (!isShown()) {
+    return;
+  }
+  float tolerance = DetailLevels::MIN_TOLERANCE / drawingZoom(paintDC);
+  const std::vector<POINT> &points = detailLevels.select(lineCoords, tolerance);
+  Polyline(paintDC, points.data(), points.size());
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~[ Arc ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void LineArc::draw(HDC paintDC) {
+  if (!isShown()) {
+    return;
+  }
+  int x1 = topLeft.x;
+  int y1 = topLeft.y;
+  int x2 = bottomRight.x;
+  int y2 = bottomRight.y;
+  Vec::Vec2D start(startPoint());
+  Vec::Vec2D end(endPoint());
+  switch (arcType) {
+    case PIE:
+      Pie(paintDC, x1, y1, x2, y2, start.x, start.y, end.x, end.y);
+      break;
+    case CHORD:
+      Chord(paintDC, x1, y1, x2, y2, start.x, start.y, end.x, end.y);
+      break;
+    case ARC:
+      Arc(paintDC, x1, y1, x2, y2, start.x, start.y, end.x, end.y);
+      break;
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~[ Series ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Series::StripCache::release() {
+  if (dc) {
+    SelectObject(dc, oldBitmap);
+    DeleteObject(bitmap);
+    DeleteDC(dc);
+  }
+  dc = NULL;
+  bitmap = NULL;
+  oldBitmap = NULL;
+  isValid = false;
+}
+
+void Series::drawColumns(long long first,
+                         long long last,
+                         long long firstVisible,
+                         double columnWidth) {
+  StripCache &cache = *strip;
+  RECT strip = {static_cast<LONG>(first - firstVisible), 0,
+                static_cast<LONG>(last - firstVisible + 1), cache.height
+               };
+  std::string fillColor = getFillColor();
+  if (fillColor.empty()) {
+    FillRect(cache.dc, &strip, static_cast<HBRUSH>(GetStockObject(WHITE_BRUSH)));
+  } else {
+    HBRUSH brush = CreateSolidBrush(Colors::hexToColorRef(fillColor));
+    FillRect(cache.dc, &strip, brush);
+    DeleteObject(brush);
+  }
+  float range = (high != low) ? (high - low) : 1.0f;
+  float rows = cache.height - 1;
+  auto row = [&](float y) {
+    float pixel = (high - y) * rows / range;
+    pixel = std::max(-rows, std::min(pixel, 2.0f * rows));
+    return static_cast<LONG>(pixel + 0.5f);
+  };
+  auto columnOf = [&](float x) {
+    return static_cast<long long>(std::floor(x / columnWidth));
+  };
+  std::vector<POINT> points;
+  points.reserve(4 * (last - first + 2));
+  int index = lowerBound(first * columnWidth);
+  if (index > 0) {
+    // Join the strip to the part of the plot that's already drawn
+    Vec::Vec2D previous = sample(index - 1);
+    long long column = std::max(columnOf(previous.x), firstVisible - 1);
+    points.push_back({static_cast<LONG>(column - firstVisible), row(previous.y)});
+  }
+  long long column = first - 1;
+  LONG x = 0;
+  float firstY = 0.0f, lastY = 0.0f, minY = 0.0f, maxY = 0.0f;
+  auto flush = [&]() {
+    points.push_back({x, row(firstY)});
+    points.push_back({x, row(minY)});
+    points.push_back({x, row(maxY)});
+    points.push_back({x, row(lastY)});
+  };
+  bool hasColumn = false;
+  for (; index < count; index++) {
+    Vec::Vec2D current = sample(index);
+    long long currentColumn = columnOf(current.x);
+    if (currentColumn > last) {
+      break;
+    }
+    if (!hasColumn || (currentColumn != column)) {
+      if (hasColumn) {
+        flush();
+      }
+      hasColumn = true;
+      column = currentColumn;
+      x = static_cast<LONG>(column - firstVisible);
+      firstY = minY = maxY = current.y;
+    }
+    minY = std::min(minY, current.y);
+    maxY = std::max(maxY, current.y);
+    lastY = current.y;
+  }
+  if (hasColumn) {
+    flush();
+  }
+  if (points.size() > 1) {
+    Polyline(cache.dc, points.data(), points.size());
+  }
+}
+
+void Series::draw(HDC paintDC) {
+  if (!isShown()) {
+    return;
+  }
+  // The cache is kept in device pixels so the box is mapped by hand
+  XFORM transform = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+  GetWorldTransform(paintDC, &transform);
+  int left = std::floor(topLeft.x * transform.eM11 + transform.eDx + 0.5f);
+  int top = std::floor(topLeft.y * transform.eM22 + transform.eDy + 0.5f);
+  int right = std::floor(bottomRight.x * transform.eM11 + transform.eDx + 0.5f);
+  int bottom = std::floor(bottomRight.y * transform.eM22 + transform.eDy + 0.5f);
+  int width = right - left;
+  int height = bottom - top;
+  if ((width <= 0) || (height <= 0)) {
+    return;
+  }
+  double columnWidth = span / width;
+  float lastX = (count > 0) ? sample(count - 1).x : startX;
+  float rightX = std::max(lastX, startX + span);
+  long long lastColumn = std::floor(rightX / columnWidth);
+  long long firstVisible = lastColumn - width + 1;
+  if (!strip) {
+    strip = std::make_shared<StripCache>();
+  }
+  StripCache &cache = *strip;
+  // A cache drawn from more samples than this copy has belongs to a newer one
+  if (!cache.isValid || (cache.width != width) || (cache.height != height) ||
+      (cache.penSize != penSize) || (cache.penColor != getPenColor()) ||
+      (cache.fillColor != getFillColor()) || (cache.layout != layout) ||
+      (cache.drawn > appended)) {
+    cache.release();
+    cache.dc = CreateCompatibleDC(paintDC);
+    cache.bitmap = CreateCompatibleBitmap(paintDC, width, height);
+    cache.oldBitmap = SelectObject(cache.dc, cache.bitmap);
+    cache.width = width;
+    cache.height = height;
+    cache.penSize = penSize;
+    cache.penColor = getPenColor();
+    cache.fillColor = getFillColor();
+    cache.layout = layout;
+    cache.lastColumn = firstVisible - 1;
+    cache.drawn = -1;
+    cache.isValid = true;
+  }
+  if (cache.drawn != appended) {
+    HGDIOBJ oldPen = SelectObject(cache.dc, GetCurrentObject(paintDC, OBJ_PEN));
+    long long shift = lastColumn - cache.lastColumn;
+    if (shift >= width) {
+      drawColumns(firstVisible, lastColumn, firstVisible, columnWidth);
+    } else {
+      if (shift > 0) {
+        // Scroll the cached plot and only draw the columns exposed. The last
+        // column drawn before may have gained samples so it's redrawn too.
+        BitBlt(cache.dc, 0, 0, width - shift, height, cache.dc, shift, 0,
+               SRCCOPY);
+      }
+      drawColumns(std::max(cache.lastColumn, firstVisible), lastColumn,
+                  firstVisible, columnWidth);
+    }
+    SelectObject(cache.dc, oldPen);
+    cache.lastColumn = lastColumn;
+    cache.drawn = appended;
+  }
+  ModifyWorldTransform(paintDC, NULL, MWT_IDENTITY);
+  BitBlt(paintDC, left, top, width, height, cache.dc, 0, 0, SRCCOPY);
+  SetWorldTransform(paintDC, &transform);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~[ PointCloud ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void PointCloud::draw(HDC paintDC) {
+  if (!isShown() || xs.empty()) {
+    return;
+  }
+  // Bin in device pixels so the marker size doesn't change with the zoom
+  XFORM transform = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+  GetWorldTransform(paintDC, &transform);
+  ModifyWorldTransform(paintDC, NULL, MWT_IDENTITY);
+  RECT clip;
+  if (GetClipBox(paintDC, &clip) <= NULLREGION) {
+    SetWorldTransform(paintDC, &transform);
+    return;
+  }
+  // The bins are cells of a grid fixed to the device, not to the clip box,
+  // so that a point lands in the same bin however the window is repainted.
+  // They cover every marker that reaches into the clip box.
+  float half = markerSize / 2.0f;
+  float left = std::floor((clip.left - half) / markerSize) * markerSize;
+  float top = std::floor((clip.top - half) / markerSize) * markerSize;
+  int binColumns = int(std::ceil((clip.right + half - left) / markerSize));
+  int binRows = int(std::ceil((clip.bottom + half - top) / markerSize));
+  const COLORREF EMPTY = 0xFFFFFFFF;
+  bins.assign(binColumns * binRows, EMPTY);
+  std::string color = getFillColor().empty() ? getPenColor() : getFillColor();
+  COLORREF shapeColor = Colors::hexToColorRef(color);
+  int points = xs.size();
+  bool hasColors = !colors.empty();
+  for (int i = 0; i < points; i++) {
+    float binX = (xs[i] * transform.eM11 + transform.eDx - left) / markerSize;
+    float binY = (ys[i] * transform.eM22 + transform.eDy - top) / markerSize;
+    if ((binX < 0.0f) || (binY < 0.0f) || (binX >= binColumns) ||
+        (binY >= binRows)) {
+      continue;
+    }
+    bins[int(binY) * binColumns + int(binX)] = hasColors ? colors[i]
+        : shapeColor;
+  }
+  HGDIOBJ oldBrush = SelectObject(paintDC, GetStockObject(DC_BRUSH));
+  COLORREF currentColor = EMPTY;
+  for (int row = 0; row < binRows; row++) {
+    for (int column = 0; column < binColumns; column++) {
+      COLORREF binColor = bins[row * binColumns + column];
+      if (binColor == EMPTY) {
+        continue;
+      }
+      if (binColor != currentColor) {
+        SetDCBrushColor(paintDC, binColor);
+        currentColor = binColor;
+      }
+      int x = int(left) + column * markerSize;
+      int y = int(top) + row * markerSize;
+      PatBlt(paintDC, x, y, markerSize, markerSize, PATCOPY);
+    }
+  }
+  SelectObject(paintDC, oldBrush);
+  SetWorldTransform(paintDC, &transform);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~[ Instances ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Instances::draw(HDC paintDC) {
+  if (!isShown()) {
+    return;
+  }
+  XFORM transform = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+  GetWorldTransform(paintDC, &transform);
+  // The clip box is in canvas coordinates since the world transform is set
+  RECT clip;
+  if (GetClipBox(paintDC, &clip) <= NULLREGION) {
+    return;
+  }
+  HGDIOBJ shapeBrush = GetCurrentObject(paintDC, OBJ_BRUSH);
+  HGDIOBJ dcBrush = GetStockObject(DC_BRUSH);
+  int count = instances.size();
+  for (int i = 0; i < count; i++) {
+    Box box = instanceBox(i);
+    if ((box.x2 < clip.left) || (box.x1 > clip.right) ||
+        (box.y2 < clip.top) || (box.y1 > clip.bottom)) {
+      continue;
+    }
+    const Instance &instance = instances[i];
+    if (instance.color == CLR_INVALID) {
+      SelectObject(paintDC, shapeBrush);
+    } else {
+      SelectObject(paintDC, dcBrush);
+      SetDCBrushColor(paintDC, instance.color);
+    }
+    XFORM placement = {instance.scale, 0.0f, 0.0f, instance.scale,
+                       instance.x, instance.y
+                      };
+    ModifyWorldTransform(paintDC, &placement, MWT_LEFTMULTIPLY);
+    geometry->draw(paintDC);
+    SetWorldTransform(paintDC, &transform);
+  }
+  SelectObject(paintDC, shapeBrush);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~[ Group ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Group::draw(HDC paintDC) {
+  if (!isShown()) {
+    return;
+  }
+  RECT clip;
+  if (GetClipBox(paintDC, &clip) <= NULLREGION) {
+    return;
+  }
+  bool boundsChanged = false;
+  for (const auto &child : children) {
+    Vec::Vec2D childTop = child->topLeftCoord();
+    Vec::Vec2D childBottom = child->bottomRightCoord();
+    float border = child->penSize / 2.0f + 1.0f;
+    if ((childBottom.x + border < clip.left) ||
+        (childTop.x - border > clip.right) ||
+        (childBottom.y + border < clip.top) ||
+        (childTop.y - border > clip.bottom)) {
+      continue;
+    }
+    paintShape(paintDC, child.get());
+    // Text only knows its real extent once it has been drawn
+    boundsChanged = boundsChanged || (childTop != child->topLeftCoord()) ||
+                    (childBottom != child->bottomRightCoord());
+  }
+  if (boundsChanged) {
+    updateBBoxCoords();
+  }
+}
@@ -0,0 +1,119 @@
+/*!
+ * \file EventLog.cxx
+ */
+
+#include "./EventLog.h"
+
+using namespace GCanvas;
+
+namespace {
+
+const char MAGIC[4] = {'G', 'C', 'I', 'R'};
+
+void put(unsigned char **out, uint32_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    *(*out)++ = static_cast<unsigned char>(value >> (8 * i));
+  }
+}
+
+uint32_t get(const unsigned char **in, int bytes) {
+  uint32_t value = 0;
+  for (int i = 0; i < bytes; i++) {
+    value |= static_cast<uint32_t>(*(*in)++) << (8 * i);
+  }
+  return value;
+}
+
+//! Reads a signed 16 bit number
+int getShort(const unsigned char **in) {
+  return static_cast<int16_t>(get(in, 2));
+}
+
+}
+
+const int EventLogWriter::RECORD_SIZE;
+const int EventLogWriter::VERSION;
+
+EventLogWriter::~EventLogWriter() {
+  close();
+}
+
+bool EventLogWriter::open(const std::string &path) {
+  close();
+  file.open(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+  unsigned char header[6];
+  unsigned char *out = header + 4;
+  std::copy(MAGIC, MAGIC + 4, header);
+  put(&out, VERSION, 2);
+  file.write(reinterpret_cast<char *>(header), sizeof(header));
+  return file.good();
+}
+
+void EventLogWriter::close() {
+  if (file.is_open()) {
+    file.close();
+  }
+}
+
+bool EventLogWriter::isOpen() const {
+  return file.is_open();
+}
+
+void EventLogWriter::write(const LoggedEvent &event) {
+  // Window positions and distances fit in 16 bits, keys and timer ids don't
+  unsigned char record[RECORD_SIZE];
+  unsigned char *out = record;
+  put(&out, event.time, 4);
+  put(&out, event.type, 1);
+  put(&out, event.state, 1);
+  put(&out, event.wheelDelta, 2);
+  put(&out, event.key, 4);
+  put(&out, event.x, 2);
+  put(&out, event.y, 2);
+  put(&out, event.xRoot, 2);
+  put(&out, event.yRoot, 2);
+  put(&out, event.dx, 2);
+  put(&out, event.dy, 2);
+  file.write(reinterpret_cast<char *>(record), RECORD_SIZE);
+}
+
+bool GCanvas::readEventLog(const std::string &path,
+                           std::vector<LoggedEvent> *events) {
+  events->clear();
+  std::ifstream file(path, std::ios::binary);
+  unsigned char header[6];
+  if (!file.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+      !std::equal(MAGIC, MAGIC + 4, header)) {
+    return false;
+  }
+  const unsigned char *in = header + 4;
+  if (static_cast<int>(get(&in, 2)) != EventLogWriter::VERSION) {
+    return false;
+  }
+  unsigned char record[EventLogWriter::RECORD_SIZE];
+  while (file.read(reinterpret_cast<char *>(record), sizeof(record))) {
+    in = record;
+    LoggedEvent event;
+    event.time = get(&in, 4);
+    event.type = get(&in, 1);
+    event.state = get(&in, 1);
+    event.wheelDelta = getShort(&in);
+    event.key = static_cast<int32_t>(get(&in, 4));
+    event.x = getShort(&in);
+    event.y = getShort(&in);
+    event.xRoot = getShort(&in);
+    event.yRoot = getShort(&in);
+    event.dx = getShort(&in);
+    event.dy = getShort(&in);
+    events->push_back(event);
+  }
+  // A record cut short means the file was damaged
+  if (file.gcount() != 0) {
+    events->clear();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,90 @@
+/*!
+ * \file EventLog.h
+ * \brief A compact binary log of the events handed to the handlers, used to
+ * replay a session without a window.
+ */
+
+#ifndef EventLog_H_
+#define EventLog_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace GCanvas {
+
+/*!
+ * \struct LoggedEvent
+ * \brief One event as it was handed to the handlers.
+ *
+ * `type` is a GCanvas::EventType and `key` the virtual key or timer id passed
+ * along with it. The positions are in window pixels.
+ */
+struct LoggedEvent {
+  //! Milliseconds since the recording started
+  uint32_t time = 0;
+  int type = 0;
+  int key = 0;
+  int x = 0;
+  int y = 0;
+  int xRoot = 0;
+  int yRoot = 0;
+  //! Distance moved since the last motion event
+  int dx = 0;
+  int dy = 0;
+  int wheelDelta = 0;
+  //! GCanvas::MouseState flags
+  unsigned state = 0;
+};
+
+/*!
+ * \struct EventTiming
+ * \brief How long a replayed event took.
+ */
+struct EventTiming {
+  LoggedEvent event;
+  //! Microseconds spent handing the event out, handlers and hit tests included
+  double dispatch = 0;
+  //! Microseconds spent in the handlers alone
+  double handlers = 0;
+  //! \b true if any handler was called
+  bool called = false;
+};
+
+/*!
+ * \class EventLogWriter
+ * \brief Appends events to a log file.
+ *
+ * The file starts with the bytes `GCIR` and a 16 bit version, followed by
+ * RECORD_SIZE bytes per event. All numbers are little endian.
+ */
+class EventLogWriter {
+  public:
+    //! Bytes taken by one event in the file
+    static const int RECORD_SIZE = 24;
+    static const int VERSION = 1;
+
+    ~EventLogWriter();
+
+    //! Truncates the file and writes the header. Returns \b false on failure.
+    bool open(const std::string &path);
+    //! Flushes and closes the file
+    void close();
+    bool isOpen() const;
+    void write(const LoggedEvent &event);
+
+  private:
+    std::ofstream file;
+};
+
+/*!
+ * \brief Reads a log written by EventLogWriter. Returns \b false if the file
+ * can't be read or isn't a log, in which case \p events is left empty.
+ */
+bool readEventLog(const std::string &path, std::vector<LoggedEvent> *events);
+
+}
+
+#endif
@@ -0,0 +1,196 @@
+/*!
+ * \file PickBuffer.cxx
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "./PickBuffer.h"
+
+using namespace GShape;
+
+namespace {
+
+/*!
+ * Narrows the pixels from \p first to \p last down to those whose canvas
+ * coordinate, `origin + pixel / zoom`, lies within [\p low, \p high]. \p last
+ * ends up below \p first when there are none.
+ */
+void pixelRange(float low, float high, float origin, float zoom,
+                int *first, int *last) {
+  auto toCanvas = [origin, zoom](int pixel) {
+    return origin + pixel / zoom;
+  };
+  // A guess that's put right below, worked out in double so that a shape far
+  // off the window doesn't overflow an int
+  double start = std::floor((double(low) - origin) * zoom);
+  double end = std::ceil((double(high) - origin) * zoom);
+  int from = static_cast<int>(std::min(std::max(start, double(*first)),
+                                       double(*last) + 1.0));
+  int to = static_cast<int>(std::max(std::min(end, double(*last)),
+                                     double(*first) - 1.0));
+  while ((from > *first) && (toCanvas(from - 1) >= low)) {
+    from--;
+  }
+  while ((from <= *last) && (toCanvas(from) < low)) {
+    from++;
+  }
+  while ((to < *last) && (toCanvas(to + 1) <= high)) {
+    to++;
+  }
+  while ((to >= *first) && (toCanvas(to) > high)) {
+    to--;
+  }
+  *first = from;
+  *last = to;
+}
+
+}
+
+const int PickBuffer::NO_SHAPE;
+const int PickBuffer::MAX_DAMAGED;
+
+void PickBuffer::resize(int width, int height) {
+  columns = std::max(width, 0);
+  rows = std::max(height, 0);
+  ids.assign(columns * rows, NO_SHAPE);
+  damageAll();
+}
+
+int PickBuffer::width() const {
+  return columns;
+}
+
+int PickBuffer::height() const {
+  return rows;
+}
+
+void PickBuffer::damage(int x1, int y1, int x2, int y2) {
+  Damage rect = {std::max(x1, 0), std::max(y1, 0),
+                 std::min(x2, columns - 1), std::min(y2, rows - 1)
+                };
+  if ((rect.x1 > rect.x2) || (rect.y1 > rect.y2)) {
+    return;
+  }
+  for (Damage &other : damaged) {
+    if ((rect.x1 <= other.x2 + 1) && (other.x1 <= rect.x2 + 1) &&
+        (rect.y1 <= other.y2 + 1) && (other.y1 <= rect.y2 + 1)) {
+      // Touching rectangles are filled as one
+      other = {std::min(rect.x1, other.x1), std::min(rect.y1, other.y1),
+               std::max(rect.x2, other.x2), std::max(rect.y2, other.y2)
+              };
+      return;
+    }
+  }
+  if (damaged.size() >= MAX_DAMAGED) {
+    for (const Damage &other : damaged) {
+      rect = {std::min(rect.x1, other.x1), std::min(rect.y1, other.y1),
+              std::max(rect.x2, other.x2), std::max(rect.y2, other.y2)
+             };
+    }
+    damaged.clear();
+  }
+  damaged.push_back(rect);
+}
+
+void PickBuffer::damage(const PickItem &item, const PickView &view) {
+  int x1 = 0, y1 = 0;
+  int x2 = columns - 1, y2 = rows - 1;
+  pixelRange(item.x1, item.x2, view.x, view.zoom, &x1, &x2);
+  pixelRange(item.y1, item.y2, view.y, view.zoom, &y1, &y2);
+  damage(x1, y1, x2, y2);
+}
+
+void PickBuffer::damageAll() {
+  damaged.clear();
+  damage(0, 0, columns - 1, rows - 1);
+}
+
+void PickBuffer::scroll(int dx, int dy) {
+  if ((std::abs(dx) >= columns) || (std::abs(dy) >= rows)) {
+    damageAll();
+    return;
+  }
+  if (dx || dy) {
+    int width = columns - std::abs(dx);
+    int fromX = std::max(dx, 0);
+    int toX = std::max(-dx, 0);
+    // Rows are moved in the order that doesn't overwrite a row still to be read
+    int first = std::max(-dy, 0);
+    int last = rows - 1 - std::max(dy, 0);
+    int step = (dy > 0) ? 1 : -1;
+    if (step < 0) {
+      std::swap(first, last);
+    }
+    for (int y = first; y != last + step; y += step) {
+      std::memmove(&ids[y * columns + toX], &ids[(y + dy) * columns + fromX],
+                   width * sizeof(int));
+    }
+  }
+  std::vector<Damage> rects;
+  rects.swap(damaged);
+  for (const Damage &rect : rects) {
+    damage(rect.x1 - dx, rect.y1 - dy, rect.x2 - dx, rect.y2 - dy);
+  }
+  // The strips that came into view
+  if (dx > 0) {
+    damage(columns - dx, 0, columns - 1, rows - 1);
+  } else if (dx < 0) {
+    damage(0, 0, -dx - 1, rows - 1);
+  }
+  if (dy > 0) {
+    damage(0, rows - dy, columns - 1, rows - 1);
+  } else if (dy < 0) {
+    damage(0, 0, columns - 1, -dy - 1);
+  }
+}
+
+bool PickBuffer::isDamaged() const {
+  return !damaged.empty();
+}
+
+int PickBuffer::at(int x, int y) const {
+  if ((x < 0) || (y < 0) || (x >= columns) || (y >= rows)) {
+    return NO_SHAPE;
+  }
+  return ids[y * columns + x];
+}
+
+void PickBuffer::fill(const Damage &rect, const PickView &view, CoverTest test,
+                      void *covers) {
+  for (int y = rect.y1; y <= rect.y2; y++) {
+    int *row = &ids[y * columns];
+    std::fill(row + rect.x1, row + rect.x2 + 1, NO_SHAPE);
+  }
+  // Items come bottom to top so the topmost one is written last
+  for (const PickItem &item : items) {
+    int x1 = rect.x1, x2 = rect.x2;
+    int y1 = rect.y1, y2 = rect.y2;
+    pixelRange(item.x1, item.x2, view.x, view.zoom, &x1, &x2);
+    pixelRange(item.y1, item.y2, view.y, view.zoom, &y1, &y2);
+    int count = x2 - x1 + 1;
+    if ((count <= 0) || (y1 > y2)) {
+      continue;
+    }
+    // Rounded like the mouse position is before it's hit tested
+    xs.resize(count);
+    ys.resize(count);
+    inside.resize(count);
+    for (int i = 0; i < count; i++) {
+      xs[i] = std::floor(view.x + (x1 + i) / view.zoom + 0.5f);
+    }
+    for (int y = y1; y <= y2; y++) {
+      std::fill(ys.begin(), ys.end(), std::floor(view.y + y / view.zoom + 0.5f));
+      if (!test(covers, item, xs.data(), ys.data(), count, inside.data())) {
+        continue;
+      }
+      int *row = &ids[y * columns + x1];
+      for (int i = 0; i < count; i++) {
+        if (inside[i]) {
+          row[i] = item.id;
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,162 @@
+/*!
+ * \file PickBuffer.h
+ * \brief An offscreen raster of shape ids used to find the shape under a pixel
+ * without testing every shape there.
+ *
+ * Doesn't depend on the shapes or the WinAPI, so it builds and is tested
+ * anywhere.
+ */
+
+#ifndef PickBuffer_H_
+#define PickBuffer_H_
+
+#include <vector>
+
+namespace GShape {
+
+/*!
+ * \struct PickView
+ * \brief Maps a window pixel to the canvas the same way GC::Canvas::canvasX()
+ * and GC::Canvas::canvasY() do: `canvas = origin + window / zoom`.
+ */
+struct PickView {
+  float x;
+  float y;
+  float zoom;
+};
+
+/*!
+ * \struct PickItem
+ * \brief What the raster needs to know about a shape.
+ */
+struct PickItem {
+  int id;
+  //! The canvas box outside of which the item covers no pixel, e.g the
+  //! shape's bounding box grown by half its pen size
+  float x1, y1, x2, y2;
+  //! Handed back to the cover test, e.g the shape itself
+  void *item;
+};
+
+/*!
+ * \class PickBuffer
+ * \brief Holds the id of the topmost visible shape under every pixel of the
+ * window.
+ *
+ * A pixel is filled by asking the items around it, bottom to top, whether they
+ * cover the pixel's canvas point, rounded like the mouse position is before
+ * it's hit tested. For shapes the test is their own Shape::pointsInShape(), so
+ * the raster agrees with the tests used to dispatch mouse events. It needs no
+ * device context, so it can be filled without a window. Only the damaged
+ * rectangles are filled again.
+ *
+ * \code
+ *   PickBuffer buffer;
+ *   buffer.resize(700, 700);
+ *   buffer.update(view,
+ *   [&](float x1, float y1, float x2, float y2, std::vector<PickItem> *items) {
+ *     // Fill items with the ones in the region, bottom to top
+ *   },
+ *   [&](const PickItem &item, const float *xs, const float *ys, int count,
+ *       unsigned char *inside) {
+ *     return static_cast<Shape *>(item.item)->pointsInShape(xs, ys, count,
+ *                                                          inside);
+ *   });
+ *   int id = buffer.at(10, 20);
+ * \endcode
+ */
+class PickBuffer {
+  public:
+    //! The id of a pixel no shape covers
+    static const int NO_SHAPE = -1;
+
+    //! Resizes the raster and damages all of it
+    void resize(int width, int height);
+
+    int width() const;
+    int height() const;
+
+    //! Marks the pixels from (x1, y1) to (x2, y2) inclusive to be filled again
+    void damage(int x1, int y1, int x2, int y2);
+
+    //! Marks the pixels under the item's box to be filled again
+    void damage(const PickItem &item, const PickView &view);
+
+    //! Marks the whole raster to be filled again
+    void damageAll();
+
+    /*!
+     * \brief Moves the ids so that pixel `(x, y)` gets the id pixel
+     * `(x + dx, y + dy)` had, e.g after the view was panned by that many
+     * pixels. Only the strips along the edges that came into view, and the
+     * rectangles that were already damaged, are left to be filled again.
+     */
+    void scroll(int dx, int dy);
+
+    //! Returns \b true if some pixels have to be filled again
+    bool isDamaged() const;
+
+    /*!
+     * \brief Fills the damaged pixels again.
+     *
+     * \p itemsIn is called as `itemsIn(x1, y1, x2, y2, &items)` and must fill
+     * `items` with the visible items whose box meets that canvas region,
+     * bottom to top. \p covers is called as
+     * `covers(item, xs, ys, count, inside)` and must set `inside[i]` to 1 if
+     * the item covers point `(xs[i], ys[i])` and to 0 otherwise, returning
+     * the number covered.
+     */
+    template<typename Items, typename Covers>
+    void update(const PickView &view, Items itemsIn, Covers covers) {
+      std::vector<Damage> rects;
+      rects.swap(damaged);
+      for (const Damage &rect : rects) {
+        items.clear();
+        itemsIn(view.x + rect.x1 / view.zoom, view.y + rect.y1 / view.zoom,
+                view.x + rect.x2 / view.zoom, view.y + rect.y2 / view.zoom,
+                &items);
+        fill(rect, view, &callCovers<Covers>, &covers);
+      }
+    }
+
+    //! Returns the id at the pixel or NO_SHAPE. The raster isn't updated.
+    int at(int x, int y) const;
+
+  private:
+    //! A rectangle of pixels, both corners inclusive
+    struct Damage {
+      int x1, y1, x2, y2;
+    };
+
+    typedef int (*CoverTest)(void *covers, const PickItem &item,
+                             const float *xs, const float *ys, int count,
+                             unsigned char *inside);
+
+    //! Lets fill() call update()'s \p covers without being a template
+    template<typename Covers>
+    static int callCovers(void *covers, const PickItem &item, const float *xs,
+                          const float *ys, int count, unsigned char *inside) {
+      return (*static_cast<Covers *>(covers))(item, xs, ys, count, inside);
+    }
+
+    //! Fills the rectangle from the items in `items`
+    void fill(const Damage &rect, const PickView &view, CoverTest test,
+              void *covers);
+
+    //! More rectangles than this are merged into their bounding box
+    static const int MAX_DAMAGED = 16;
+
+    int columns = 0;
+    int rows = 0;
+    std::vector<int> ids;
+    std::vector<Damage> damaged;
+    // Reused by update() and fill()
+    std::vector<PickItem> items;
+    std::vector<float> xs;
+    std::vector<float> ys;
+    std::vector<unsigned char> inside;
+};
+
+}
+
+#endif
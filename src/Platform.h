@@ -0,0 +1,52 @@
+/*!
+ * \file Platform.h
+ * \brief Includes windows.h on Windows and declares the few WinAPI types the
+ * shapes' geometry uses everywhere else.
+ *
+ * Only the drawing needs the WinAPI itself. It's left out of the builds that
+ * don't target Windows, which still get the shapes, their hit tests and the
+ * snapshots, e.g to test them.
+ */
+
+#ifndef Platform_H_
+#define Platform_H_
+
+#ifdef _WIN32
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x501
+#endif
+#include <windows.h>
+#else
+#include <cstdint>
+
+typedef long LONG;
+typedef std::uint8_t BYTE;
+typedef std::uint16_t WORD;
+typedef std::uint32_t DWORD;
+typedef DWORD COLORREF;
+
+typedef struct tagPOINT {
+  LONG x;
+  LONG y;
+} POINT;
+
+typedef struct tagRECT {
+  LONG left;
+  LONG top;
+  LONG right;
+  LONG bottom;
+} RECT;
+
+#define RGB(r, g, b) \
+  ((COLORREF)(((BYTE)(r) | ((WORD)((BYTE)(g)) << 8)) | \
+              (((DWORD)(BYTE)(b)) << 16)))
+#define GetRValue(rgb) ((BYTE)(rgb))
+#define GetGValue(rgb) ((BYTE)(((WORD)(rgb)) >> 8))
+#define GetBValue(rgb) ((BYTE)((rgb) >> 16))
+#define CLR_INVALID 0xFFFFFFFF
+
+//! The default weight of GShape::FontAttr
+#define FW_NORMAL 400
+#endif
+
+#endif
@@ -0,0 +1,193 @@
+/*!
+ * \file Renderer.cxx
+ */
+
+#include "./Renderer.h"
+
+using namespace GCanvas;
+
+const unsigned Renderer::FRAME_MESSAGE;
+
+Renderer::~Renderer() {
+  stop();
+}
+
+void Renderer::start(HWND window_, HBRUSH background_) {
+  stop();
+  window = window_;
+  background = background_;
+  stopping = false;
+  thread = std::thread(&Renderer::run, this);
+}
+
+void Renderer::stop() {
+  if (!thread.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(wakeLock);
+    stopping = true;
+  }
+  wakeUp.notify_one();
+  thread.join();
+  // Nothing reads the scenes and frames any more
+  latest.store(nullptr);
+  current.reset();
+  retired.clear();
+  epochCounter = 0;
+  publishedEpoch.store(0);
+  readerEpoch.store(0);
+  drawnEpoch = 0;
+  frames[0].release();
+  frames[1].release();
+  hasFrame = false;
+}
+
+bool Renderer::isRunning() const {
+  return thread.joinable();
+}
+
+void Renderer::publish(std::unique_ptr<Scene> scene) {
+  scene->epoch = ++epochCounter;
+  latest.store(scene.get());
+  // Stored after `latest` so that a reader that sees this epoch can't be
+  // reading the scene it replaced
+  publishedEpoch.store(scene->epoch);
+  if (current) {
+    retired.push_back(std::move(current));
+  }
+  current = std::move(scene);
+  {
+    std::lock_guard<std::mutex> lock(wakeLock);
+  }
+  wakeUp.notify_one();
+  reclaim();
+}
+
+void Renderer::reclaim() {
+  unsigned long reading = readerEpoch.load();
+  retired.erase(std::remove_if(retired.begin(), retired.end(),
+  [reading](const std::unique_ptr<Scene> &scene) {
+    // A scene is replaced by the one with the next epoch
+    return !reading || (scene->epoch < reading);
+  }), retired.end());
+}
+
+bool Renderer::blit(HDC paintDC, const RECT &area) {
+  std::lock_guard<std::mutex> lock(frameLock);
+  if (!hasFrame) {
+    return false;
+  }
+  const Frame &frame = frames[front];
+  BitBlt(paintDC, area.left, area.top, area.right - area.left,
+         area.bottom - area.top, frame.dc, area.left, area.top, SRCCOPY);
+  return true;
+}
+
+void Renderer::run() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(wakeLock);
+      wakeUp.wait(lock, [this] {
+        return stopping || (publishedEpoch.load() != drawnEpoch);
+      });
+      if (stopping) {
+        return;
+      }
+    }
+    readerEpoch.store(publishedEpoch.load());
+    Scene *scene = latest.load();
+    if (scene && (scene->epoch != drawnEpoch)) {
+      // Only this thread changes `front`, so the back frame can be drawn into
+      // without the lock
+      Frame *back = &frames[1 - front];
+      if (back->resize(scene->width, scene->height)) {
+        draw(scene, back);
+        std::lock_guard<std::mutex> lock(frameLock);
+        front = 1 - front;
+        hasFrame = true;
+      }
+      drawnEpoch = scene->epoch;
+      PostMessage(window, FRAME_MESSAGE, 0, 0);
+    }
+    readerEpoch.store(0);
+  }
+}
+
+void Renderer::draw(Scene *scene, Frame *frame) {
+  XFORM identity = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+  SetGraphicsMode(frame->dc, GM_ADVANCED);
+  SetWorldTransform(frame->dc, &identity);
+  RECT all = {0, 0, frame->width, frame->height};
+  FillRect(frame->dc, &all, background);
+  // Same mapping as the one WM_PAINT uses
+  float zoom = scene->viewZoom;
+  XFORM transform = {zoom, 0.0f, 0.0f, zoom,
+                     -scene->viewX * zoom, -scene->viewY * zoom
+                    };
+  SetWorldTransform(frame->dc, &transform);
+  float left = scene->viewX;
+  float top = scene->viewY;
+  float right = left + scene->width / zoom;
+  float bottom = top + scene->height / zoom;
+  for (const auto &shape : scene->shapes) {
+    if (!shape->isShown()) {
+      continue;
+    }
+    float border = shape->penSize / 2.0f + 1.0f;
+    Vec::Vec2D topLeft = shape->topLeftCoord();
+    Vec::Vec2D bottomRight = shape->bottomRightCoord();
+    if ((topLeft.x - border > right) || (bottomRight.x + border < left) ||
+        (topLeft.y - border > bottom) || (bottomRight.y + border < top)) {
+      continue;
+    }
+    GShape::paintShape(frame->dc, shape.get());
+  }
+  SetWorldTransform(frame->dc, &identity);
+  // GDI batches calls per thread. The window's thread copies the bitmap next.
+  GdiFlush();
+}
+
+bool Renderer::Frame::resize(int width_, int height_) {
+  width_ = std::max(width_, 1);
+  height_ = std::max(height_, 1);
+  if (dc && (width == width_) && (height == height_)) {
+    return true;
+  }
+  release();
+  BITMAPINFO info = {};
+  info.bmiHeader.biSize = sizeof(info.bmiHeader);
+  info.bmiHeader.biWidth = width_;
+  info.bmiHeader.biHeight = -height_; // Top down
+  info.bmiHeader.biPlanes = 1;
+  info.bmiHeader.biBitCount = 32;
+  info.bmiHeader.biCompression = BI_RGB;
+  void *pixels = NULL;
+  dc = CreateCompatibleDC(NULL);
+  bitmap = CreateDIBSection(dc, &info, DIB_RGB_COLORS, &pixels, NULL, 0);
+  if (!dc || !bitmap) {
+    release();
+    return false;
+  }
+  oldBitmap = SelectObject(dc, bitmap);
+  width = width_;
+  height = height_;
+  return true;
+}
+
+void Renderer::Frame::release() {
+  if (dc && oldBitmap) {
+    SelectObject(dc, oldBitmap);
+  }
+  if (dc) {
+    DeleteDC(dc);
+  }
+  if (bitmap) {
+    DeleteObject(bitmap);
+  }
+  dc = NULL;
+  bitmap = NULL;
+  oldBitmap = NULL;
+  width = 0;
+  height = 0;
+}
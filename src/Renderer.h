@@ -0,0 +1,139 @@
+/*!
+ * \file Renderer.h
+ * \brief Paints scene snapshots on a thread of its own.
+ */
+
+#ifndef Renderer_H_
+#define Renderer_H_
+
+#include <windows.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "./Shapes.h"
+
+namespace GCanvas {
+
+/*!
+ * \struct Scene
+ * \brief What the window shows at one moment: copies of the shapes and the
+ * view they're seen through.
+ *
+ * A scene isn't changed once it's published. Its shapes are copies made with
+ * GShape::Shape::clone() and are only touched by the render thread, which is
+ * free to update the caches they keep for drawing. A shape that didn't change is shared with
+ * the scene before it instead of being copied again.
+ */
+struct Scene {
+  //! The shapes, bottom to top
+  std::vector<std::shared_ptr<GShape::Shape>> shapes;
+  //! Canvas coordinate at the window's top left corner
+  float viewX = 0.0f;
+  float viewY = 0.0f;
+  float viewZoom = 1.0f;
+  //! Size of the window's client area
+  int width = 0;
+  int height = 0;
+  //! Set by Renderer::publish(). Later scenes have bigger epochs.
+  unsigned long epoch = 0;
+};
+
+/*!
+ * \class Renderer
+ * \brief Draws the latest published Scene into a back buffer on its own
+ * thread, so painting and the event handlers run side by side.
+ *
+ * The window's thread publishes scenes and copies the last finished frame to
+ * the window. The render thread only draws the newest scene, skipping any
+ * published while it was busy, and posts FRAME_MESSAGE to the window when a
+ * frame is ready. The two frames are swapped under a lock, so the window
+ * never shows a half drawn one.
+ *
+ * Replaced scenes are freed on the window's thread using epochs. The render
+ * thread announces the epoch it saw before it reads the newest scene, so a
+ * scene replaced before that epoch can't be in use. The window's thread frees
+ * those the next time it publishes. Drawing never waits on a free.
+ */
+class Renderer {
+  public:
+    //! Posted to the window when a new frame can be copied
+    static const unsigned FRAME_MESSAGE = WM_APP + 1;
+
+    ~Renderer();
+
+    /*!
+     * \brief Starts the render thread. \p background is the brush the frames
+     * are cleared with, e.g the window class' background brush.
+     */
+    void start(HWND window, HBRUSH background);
+
+    //! Stops the render thread and frees the scenes and frames
+    void stop();
+
+    bool isRunning() const;
+
+    //! Hands a scene to the render thread. Only called from the window's thread.
+    void publish(std::unique_ptr<Scene> scene);
+
+    /*!
+     * \brief Copies the part of the last finished frame under \p area to the
+     * same place in \p paintDC. Returns \b false if no frame is ready yet.
+     */
+    bool blit(HDC paintDC, const RECT &area);
+
+  private:
+    //! An offscreen bitmap and the DC it's selected into
+    struct Frame {
+      HDC dc = NULL;
+      HBITMAP bitmap = NULL;
+      HGDIOBJ oldBitmap = NULL;
+      int width = 0;
+      int height = 0;
+
+      //! Gives the bitmap the size. Returns \b false on failure.
+      bool resize(int width_, int height_);
+      void release();
+    };
+
+    //! The render thread's loop
+    void run();
+
+    //! Draws the scene into the back frame
+    void draw(Scene *scene, Frame *frame);
+
+    //! Frees the replaced scenes the render thread can no longer reach
+    void reclaim();
+
+    HWND window = NULL;
+    HBRUSH background = NULL;
+    std::thread thread;
+    std::mutex wakeLock;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+
+    // The newest scene. The window's thread owns it through `current`.
+    std::atomic<Scene *> latest{nullptr};
+    std::unique_ptr<Scene> current;
+    // Epoch of the newest scene
+    std::atomic<unsigned long> publishedEpoch{0};
+    // Epoch the render thread saw before reading `latest`, 0 while it's idle
+    std::atomic<unsigned long> readerEpoch{0};
+    // Replaced scenes waiting to be freed. Only touched by the window's thread.
+    std::vector<std::unique_ptr<Scene>> retired;
+    unsigned long epochCounter = 0;
+    // Epoch of the scene in the front frame. Only touched by the render thread.
+    unsigned long drawnEpoch = 0;
+
+    // frames[front] is shown, the other one is drawn into
+    Frame frames[2];
+    int front = 0;
+    bool hasFrame = false;
+    std::mutex frameLock;
+};
+
+}
+
+#endif
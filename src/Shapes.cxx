@@ -6,12 +6,14 @@
 
 using namespace GShape;
 
-int Shape::counterID = 0;
+std::atomic<int> Shape::counterID(0);
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~[ Free functions ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-bool GShape::areEqual(const std::shared_ptr<Shape> &first,
-                      const std::shared_ptr<Shape> &second) {
+bool GShape::areEqual(const Shape *first, const Shape *second) {
+  if (first->shapeType != second->shapeType) {
+    return false;
+  }
   std::vector<POINT> vecFirst = first->coords();
   std::vector<POINT> vecSecond = second->coords();
   unsigned points = vecFirst.size();
@@ -23,7 +25,7 @@ bool GShape::areEqual(const std::shared_ptr<Shape> &first,
       return false;
     }
   }
-  return true && (first->shapeType == second->shapeType);
+  return true;
 }
 
 bool GShape::pointInRegion(int xCoord,
@@ -47,10 +49,8 @@ bool GShape::regionsOverlap(const Vec::Vec2D &top1,
                             const Vec::Vec2D &bottom1,
                             const Vec::Vec2D &top2,
                             const Vec::Vec2D &bottom2) {
-  return pointInRegion(top1, top2, bottom2) ||
-         pointInRegion(top2, top2, bottom2) ||
-         pointInRegion(top2, top1, bottom1) ||
-         pointInRegion(top2, top1, bottom1);
+  return (top1.x <= bottom2.x) && (top2.x <= bottom1.x) &&
+         (top1.y <= bottom2.y) && (top2.y <= bottom1.y);
 }
 
 Vec::Vec2D GShape::intersection(const Vec::Vec2D &start1,
@@ -81,12 +81,85 @@ Vec::Vec2D GShape::intersection(const Vec::Vec2D &start1,
   return {xIntersection, yIntersection};
 }
 
-bool linesIntersect(const Vec::Vec2D &start1,
-                    const Vec::Vec2D &end1,
-                    const Vec::Vec2D &start2,
-                    const Vec::Vec2D &end2) {
-  Vec::Vec2D point = intersection(start1, end1, start2, end2);
-  return (point.x == FLT_MAX) && (point.y == FLT_MAX);
+namespace {
+
+//! Twice the signed area of triangle `abc`. 0 if the points are in a line.
+double orientation(double ax, double ay, double bx, double by,
+                   double cx, double cy) {
+  return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+}
+
+//! Returns \b true if `(x, y)`, known to be in line with the segment, is on it
+bool withinExtent(const Vec::Vec2D &start, const Vec::Vec2D &end,
+                  float x, float y) {
+  return (std::min(start.x, end.x) <= x) && (x <= std::max(start.x, end.x)) &&
+         (std::min(start.y, end.y) <= y) && (y <= std::max(start.y, end.y));
+}
+
+}
+
+bool GShape::linesIntersect(const Vec::Vec2D &start1,
+                            const Vec::Vec2D &end1,
+                            const Vec::Vec2D &start2,
+                            const Vec::Vec2D &end2) {
+  double side1 = orientation(start2.x, start2.y, end2.x, end2.y,
+                             start1.x, start1.y);
+  double side2 = orientation(start2.x, start2.y, end2.x, end2.y,
+                             end1.x, end1.y);
+  double side3 = orientation(start1.x, start1.y, end1.x, end1.y,
+                             start2.x, start2.y);
+  double side4 = orientation(start1.x, start1.y, end1.x, end1.y,
+                             end2.x, end2.y);
+  // Each segment's ends are on opposite sides of the other one's line
+  if ((((side1 > 0) && (side2 < 0)) || ((side1 < 0) && (side2 > 0))) &&
+      (((side3 > 0) && (side4 < 0)) || ((side3 < 0) && (side4 > 0)))) {
+    return true;
+  }
+  // An end touches the other segment
+  return ((side1 == 0) && withinExtent(start2, end2, start1.x, start1.y)) ||
+         ((side2 == 0) && withinExtent(start2, end2, end1.x, end1.y)) ||
+         ((side3 == 0) && withinExtent(start1, end1, start2.x, start2.y)) ||
+         ((side4 == 0) && withinExtent(start1, end1, end2.x, end2.y));
+}
+
+bool GShape::segmentOverlapsRegion(const Vec::Vec2D &start,
+                                   const Vec::Vec2D &end,
+                                   const Vec::Vec2D &topLeft,
+                                   const Vec::Vec2D &bottomRight) {
+  // Separating axes: x, y and the normal of the segment
+  if ((std::max(start.x, end.x) < topLeft.x) ||
+      (std::min(start.x, end.x) > bottomRight.x) ||
+      (std::max(start.y, end.y) < topLeft.y) ||
+      (std::min(start.y, end.y) > bottomRight.y)) {
+    return false;
+  }
+  double corners[] = {
+    orientation(start.x, start.y, end.x, end.y, topLeft.x, topLeft.y),
+    orientation(start.x, start.y, end.x, end.y, bottomRight.x, topLeft.y),
+    orientation(start.x, start.y, end.x, end.y, bottomRight.x, bottomRight.y),
+    orientation(start.x, start.y, end.x, end.y, topLeft.x, bottomRight.y)
+  };
+  bool anyAbove = false;
+  bool anyBelow = false;
+  for (double corner : corners) {
+    anyAbove |= corner >= 0.0;
+    anyBelow |= corner <= 0.0;
+  }
+  return anyAbove && anyBelow;
+}
+
+bool GShape::pointInPolygon(float x, float y, const std::vector<POINT> &points) {
+  // Randolph Franklin's crossing test
+  bool inside = false;
+  int vertices = points.size();
+  for (int i = 0, j = vertices - 1; i < vertices; j = i++) {
+    float x1 = points[i].x, y1 = points[i].y;
+    float x2 = points[j].x, y2 = points[j].y;
+    if (((y1 > y) != (y2 > y)) && (x < (x2 - x1) * (y - y1) / (y2 - y1) + x1)) {
+      inside = !inside;
+    }
+  }
+  return inside;
 }
 
 bool GShape::withinLineSegment(const Vec::Vec2D &point,
@@ -106,9 +179,174 @@ bool GShape::withinLineSegment(float x,
   return withinSegment;
 }
 
+Vec::Vec2D GShape::closestInBox(const Vec::Vec2D &point,
+                                const Vec::Vec2D &topLeft,
+                                const Vec::Vec2D &bottomRight) {
+  float x = std::min(std::max(point.x, std::min(topLeft.x, bottomRight.x)),
+                     std::max(topLeft.x, bottomRight.x));
+  float y = std::min(std::max(point.y, std::min(topLeft.y, bottomRight.y)),
+                     std::max(topLeft.y, bottomRight.y));
+  return Vec::Vec2D(x, y);
+}
+
+Vec::Vec2D GShape::closestOnSegment(const Vec::Vec2D &point,
+                                    const Vec::Vec2D &start,
+                                    const Vec::Vec2D &end) {
+  float dx = end.x - start.x;
+  float dy = end.y - start.y;
+  float lengthSquared = dx * dx + dy * dy;
+  if (lengthSquared == 0.0f) {
+    return start;
+  }
+  float t = ((point.x - start.x) * dx + (point.y - start.y) * dy) /
+            lengthSquared;
+  t = std::min(std::max(t, 0.0f), 1.0f);
+  return Vec::Vec2D(start.x + t * dx, start.y + t * dy);
+}
+
+Vec::Vec2D GShape::closestOnOutline(const Vec::Vec2D &point,
+                                    const std::vector<POINT> &points,
+                                    bool closed,
+                                    bool *inside) {
+  int count = points.size();
+  if (inside) {
+    *inside = false;
+  }
+  if (count == 0) {
+    return point;
+  }
+  float x = point.x;
+  float y = point.y;
+  Vec::Vec2D closest(points[0]);
+  float leastDistance = FLT_MAX;
+  bool crossings = false;
+  int segments = closed ? count : count - 1;
+  for (int i = 0; i < std::max(segments, 1); i++) {
+    const POINT &start = points[i];
+    const POINT &end = points[(i + 1) % count];
+    float x1 = start.x, y1 = start.y;
+    float dx = end.x - x1, dy = end.y - y1;
+    float lengthSquared = dx * dx + dy * dy;
+    float t = 0.0f;
+    if (lengthSquared > 0.0f) {
+      t = ((x - x1) * dx + (y - y1) * dy) / lengthSquared;
+      t = std::min(std::max(t, 0.0f), 1.0f);
+    }
+    float nearX = x1 + t * dx - x;
+    float nearY = y1 + t * dy - y;
+    float distance = nearX * nearX + nearY * nearY;
+    if (distance < leastDistance) {
+      leastDistance = distance;
+      closest = Vec::Vec2D(x1 + t * dx, y1 + t * dy);
+    }
+    // Crossing test for the same edge while it's at hand
+    if (((y1 > y) != (end.y > y)) && (x < dx * (y - y1) / dy + x1)) {
+      crossings = !crossings;
+    }
+  }
+  if (inside) {
+    *inside = closed && crossings;
+  }
+  return closest;
+}
+
+namespace {
+
+/*!
+ * Finds the root of Eberly's distance function for an ellipse with radii
+ * `e0 >= e1` and a point `(y0, y1)` in the first quadrant, given as
+ * `z0 = y0 / e0`, `z1 = y1 / e1` and `r0 = (e0 / e1)²`.
+ */
+double ellipseRoot(double r0, double z0, double z1, double g) {
+  double n0 = r0 * z0;
+  double s0 = z1 - 1.0;
+  double s1 = (g < 0.0) ? 0.0 : std::sqrt(n0 * n0 + z1 * z1) - 1.0;
+  double s = 0.0;
+  for (int i = 0; i < 160; i++) {
+    s = (s0 + s1) / 2.0;
+    if ((s == s0) || (s == s1)) {
+      break;
+    }
+    double ratio0 = n0 / (s + r0);
+    double ratio1 = z1 / (s + 1.0);
+    g = ratio0 * ratio0 + ratio1 * ratio1 - 1.0;
+    if (g > 0.0) {
+      s0 = s;
+    } else if (g < 0.0) {
+      s1 = s;
+    } else {
+      break;
+    }
+  }
+  return s;
+}
+
+//! Closest point for `e0 >= e1 > 0` and a point `(y0, y1)` with `y0, y1 >= 0`
+void closestInQuadrant(double e0, double e1, double y0, double y1,
+                       double *x0, double *x1) {
+  if (y1 > 0.0) {
+    if (y0 > 0.0) {
+      double z0 = y0 / e0;
+      double z1 = y1 / e1;
+      double g = z0 * z0 + z1 * z1 - 1.0;
+      if (g != 0.0) {
+        double r0 = (e0 / e1) * (e0 / e1);
+        double s = ellipseRoot(r0, z0, z1, g);
+        *x0 = r0 * y0 / (s + r0);
+        *x1 = y1 / (s + 1.0);
+      } else {
+        *x0 = y0;
+        *x1 = y1;
+      }
+    } else {
+      *x0 = 0.0;
+      *x1 = e1;
+    }
+    return;
+  }
+  double numerator = e0 * y0;
+  double denominator = e0 * e0 - e1 * e1;
+  if (numerator < denominator) {
+    double ratio = numerator / denominator;
+    *x0 = e0 * ratio;
+    *x1 = e1 * std::sqrt(1.0 - ratio * ratio);
+  } else {
+    *x0 = e0;
+    *x1 = 0.0;
+  }
+}
+
+}
+
+Vec::Vec2D GShape::closestOnEllipse(const Vec::Vec2D &point,
+                                    const Vec::Vec2D &center,
+                                    float radiusX,
+                                    float radiusY) {
+  radiusX = std::abs(radiusX);
+  radiusY = std::abs(radiusY);
+  if ((radiusX == 0.0f) || (radiusY == 0.0f)) {
+    // A flat ellipse is a line segment
+    Vec::Vec2D start(center.x - radiusX, center.y - radiusY);
+    Vec::Vec2D end(center.x + radiusX, center.y + radiusY);
+    return closestOnSegment(point, start, end);
+  }
+  double y0 = std::abs(point.x - center.x);
+  double y1 = std::abs(point.y - center.y);
+  double x0, x1;
+  // The solution assumes the longer axis is along x
+  if (radiusX >= radiusY) {
+    closestInQuadrant(radiusX, radiusY, y0, y1, &x0, &x1);
+  } else {
+    closestInQuadrant(radiusY, radiusX, y1, y0, &x1, &x0);
+  }
+  float x = (point.x < center.x) ? center.x - x0 : center.x + x0;
+  float y = (point.y < center.y) ? center.y - x1 : center.y + x1;
+  return Vec::Vec2D(x, y);
+}
+
 Vec::Vec2D GShape::bottomRightCoord(const std::vector<POINT> &coordList) {
   int points = coordList.size();
-  if (points <= 2) {
+  if (points == 0) {
     return {0, 0};
   }
   Vec::Vec2D first(coordList.front());
@@ -124,7 +362,7 @@ Vec::Vec2D GShape::bottomRightCoord(const std::vector<POINT> &coordList) {
 
 Vec::Vec2D GShape::topLeftCoord(const std::vector<POINT> &coordList) {
   int points = coordList.size();
-  if (points <= 2) {
+  if (points == 0) {
     return {0, 0};
   }
   Vec::Vec2D first(coordList.front());
@@ -138,6 +376,354 @@ Vec::Vec2D GShape::topLeftCoord(const std::vector<POINT> &coordList) {
   return {smallestX, smallestY};
 }
 
+// The two kernels below run a single pass over the points with all the
+// trigonometry hoisted out of the loop, keeping the bounding box as they go.
+
+void GShape::scalePoints(std::vector<POINT> *points,
+                         float originX,
+                         float originY,
+                         float xScale,
+                         float yScale,
+                         Vec::Vec2D *topLeft,
+                         Vec::Vec2D *bottomRight) {
+  float xOffset = originX - originX * xScale;
+  float yOffset = originY - originY * yScale;
+  LONG smallestX = LONG_MAX, smallestY = LONG_MAX;
+  LONG largestX = LONG_MIN, largestY = LONG_MIN;
+  for (POINT &point : *points) {
+    point.x = static_cast<LONG>(std::floor(point.x * xScale + xOffset + 0.5f));
+    point.y = static_cast<LONG>(std::floor(point.y * yScale + yOffset + 0.5f));
+    smallestX = std::min(smallestX, point.x);
+    smallestY = std::min(smallestY, point.y);
+    largestX = std::max(largestX, point.x);
+    largestY = std::max(largestY, point.y);
+  }
+  if (!points->empty()) {
+    *topLeft = POINT{smallestX, smallestY};
+    *bottomRight = POINT{largestX, largestY};
+  }
+}
+
+void GShape::rotatePoints(std::vector<POINT> *points,
+                          float centerX,
+                          float centerY,
+                          float angle,
+                          Vec::Vec2D *topLeft,
+                          Vec::Vec2D *bottomRight) {
+  // The y axis points downwards so an anticlockwise rotation on the screen is
+  // a clockwise one in the usual cartesian plane.
+  float radians = angle * PI / 180.0f;
+  float cosine = std::cos(radians);
+  float sine = std::sin(radians);
+  LONG smallestX = LONG_MAX, smallestY = LONG_MAX;
+  LONG largestX = LONG_MIN, largestY = LONG_MIN;
+  for (POINT &point : *points) {
+    float x = point.x - centerX;
+    float y = point.y - centerY;
+    point.x = static_cast<LONG>(std::floor(centerX + x * cosine + y * sine + 0.5f));
+    point.y = static_cast<LONG>(std::floor(centerY - x * sine + y * cosine + 0.5f));
+    smallestX = std::min(smallestX, point.x);
+    smallestY = std::min(smallestY, point.y);
+    largestX = std::max(largestX, point.x);
+    largestY = std::max(largestY, point.y);
+  }
+  if (!points->empty()) {
+    *topLeft = POINT{smallestX, smallestY};
+    *bottomRight = POINT{largestX, largestY};
+  }
+}
+
+void GShape::simplifyPoints(const std::vector<POINT> &points,
+                            float tolerance,
+                            std::vector<POINT> *simplified) {
+  int count = points.size();
+  simplified->clear();
+  if (count < 3) {
+    *simplified = points;
+    return;
+  }
+  // Iterative version so that long tracks don't exhaust the stack
+  std::vector<bool> keep(count, false);
+  keep[0] = keep[count - 1] = true;
+  std::vector<std::pair<int, int>> spans = {{0, count - 1}};
+  double limit = double(tolerance) * tolerance;
+  while (!spans.empty()) {
+    int first = spans.back().first;
+    int last = spans.back().second;
+    spans.pop_back();
+    double startX = points[first].x;
+    double startY = points[first].y;
+    double dx = points[last].x - startX;
+    double dy = points[last].y - startY;
+    double length = dx * dx + dy * dy;
+    double farthest = -1.0;
+    int index = -1;
+    for (int i = first + 1; i < last; i++) {
+      double px = points[i].x - startX;
+      double py = points[i].y - startY;
+      // Distance to the segment, not the infinite line, so that points
+      // behind either end aren't dropped
+      double t = (length > 0.0) ? (px * dx + py * dy) / length : 0.0;
+      t = std::max(0.0, std::min(1.0, t));
+      double ex = px - t * dx;
+      double ey = py - t * dy;
+      double distance = ex * ex + ey * ey;
+      if (distance > farthest) {
+        farthest = distance;
+        index = i;
+      }
+    }
+    if (farthest > limit) {
+      keep[index] = true;
+      spans.push_back({first, index});
+      spans.push_back({index, last});
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    if (keep[i]) {
+      simplified->push_back(points[i]);
+    }
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~[ DetailLevels ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+const int DetailLevels::MIN_POINTS;
+constexpr float DetailLevels::MIN_TOLERANCE;
+const int DetailLevels::MAX_LEVEL;
+
+const std::vector<POINT> &DetailLevels::select(const std::vector<POINT> &points,
+                                               float tolerance) {
+  if ((points.size() < MIN_POINTS) || !(tolerance >= MIN_TOLERANCE)) {
+    return points;
+  }
+  int level = static_cast<int>(std::log2(tolerance / MIN_TOLERANCE));
+  level = std::min(level, MAX_LEVEL);
+  if (level >= static_cast<int>(levels.size())) {
+    levels.resize(level + 1);
+    isBuilt.resize(level + 1, false);
+  }
+  if (!isBuilt[level]) {
+    float levelTolerance = std::ldexp(MIN_TOLERANCE, level);
+    simplifyPoints(points, levelTolerance, &levels[level]);
+    isBuilt[level] = true;
+  }
+  return levels[level];
+}
+
+void DetailLevels::translate(int xAmount, int yAmount) {
+  for (std::vector<POINT> &level : levels) {
+    for (POINT &point : level) {
+      point.x += xAmount;
+      point.y += yAmount;
+    }
+  }
+}
+
+void DetailLevels::clear() {
+  levels.clear();
+  isBuilt.clear();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~[ EdgeSlabs ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+const int EdgeSlabs::MIN_POINTS;
+
+int EdgeSlabs::slabOf(float y) const {
+  int slabs = slabStarts.size() - 1;
+  int slab = static_cast<int>((y - top) * inverseHeight);
+  return std::min(std::max(slab, 0), slabs - 1);
+}
+
+void EdgeSlabs::build(const std::vector<POINT> &points) {
+  int vertices = points.size();
+  top = FLT_MAX;
+  bottom = -FLT_MAX;
+  for (const POINT &point : points) {
+    top = std::min(top, static_cast<float>(point.y));
+    bottom = std::max(bottom, static_cast<float>(point.y));
+  }
+  int slabs = std::max(1, static_cast<int>(std::sqrt(vertices)));
+  inverseHeight = (bottom > top) ? slabs / (bottom - top) : 0.0f;
+  slabStarts.assign(slabs + 1, 0);
+  // Counted first so that the lists can be packed into one vector
+  for (int i = 0, j = vertices - 1; i < vertices; j = i++) {
+    if (points[i].y == points[j].y) {
+      continue; // Horizontal edges are never crossed
+    }
+    float y1 = std::min(points[i].y, points[j].y);
+    float y2 = std::max(points[i].y, points[j].y);
+    for (int slab = slabOf(y1); slab <= slabOf(y2); slab++) {
+      slabStarts[slab + 1]++;
+    }
+  }
+  for (int slab = 0; slab < slabs; slab++) {
+    slabStarts[slab + 1] += slabStarts[slab];
+  }
+  edges.resize(slabStarts[slabs]);
+  std::vector<int> filled(slabStarts.begin(), slabStarts.end() - 1);
+  for (int i = 0, j = vertices - 1; i < vertices; j = i++) {
+    if (points[i].y == points[j].y) {
+      continue;
+    }
+    float y1 = std::min(points[i].y, points[j].y);
+    float y2 = std::max(points[i].y, points[j].y);
+    for (int slab = slabOf(y1); slab <= slabOf(y2); slab++) {
+      edges[filled[slab]++] = i;
+    }
+  }
+  isBuilt = true;
+}
+
+void EdgeSlabs::prepare(const std::vector<POINT> &points) {
+  if (!isBuilt && (static_cast<int>(points.size()) >= MIN_POINTS)) {
+    build(points);
+  }
+}
+
+bool EdgeSlabs::contains(float x, float y, const std::vector<POINT> &points) {
+  int vertices = points.size();
+  if (vertices < MIN_POINTS) {
+    return pointInPolygon(x, y, points);
+  }
+  if (!isBuilt) {
+    build(points);
+  }
+  // No edge spans a row outside [top, bottom)
+  if (!(y >= top) || !(y < bottom)) {
+    return false;
+  }
+  int slab = slabOf(y);
+  bool inside = false;
+  for (int edge = slabStarts[slab]; edge < slabStarts[slab + 1]; edge++) {
+    int i = edges[edge];
+    int j = (i == 0) ? vertices - 1 : i - 1;
+    float x1 = points[i].x, y1 = points[i].y;
+    float x2 = points[j].x, y2 = points[j].y;
+    if (((y1 > y) != (y2 > y)) && (x < (x2 - x1) * (y - y1) / (y2 - y1) + x1)) {
+      inside = !inside;
+    }
+  }
+  return inside;
+}
+
+void EdgeSlabs::crossings(float y, const std::vector<POINT> &points,
+                          std::vector<float> *xs) {
+  xs->clear();
+  int vertices = points.size();
+  int first = 0, last = vertices;
+  bool slabbed = vertices >= MIN_POINTS;
+  if (slabbed) {
+    if (!isBuilt) {
+      build(points);
+    }
+    if (!(y >= top) || !(y < bottom)) {
+      return;
+    }
+    int slab = slabOf(y);
+    first = slabStarts[slab];
+    last = slabStarts[slab + 1];
+  }
+  for (int edge = first; edge < last; edge++) {
+    int i = slabbed ? edges[edge] : edge;
+    int j = (i == 0) ? vertices - 1 : i - 1;
+    float x1 = points[i].x, y1 = points[i].y;
+    float x2 = points[j].x, y2 = points[j].y;
+    if ((y1 > y) != (y2 > y)) {
+      xs->push_back((x2 - x1) * (y - y1) / (y2 - y1) + x1);
+    }
+  }
+  std::sort(xs->begin(), xs->end());
+}
+
+void EdgeSlabs::translate(int xAmount, int yAmount) {
+  // The edges refer to the vertices by index so only the rows shift
+  (void)xAmount;
+  top += yAmount;
+  bottom += yAmount;
+}
+
+void EdgeSlabs::clear() {
+  slabStarts.clear();
+  edges.clear();
+  isBuilt = false;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~[ SegmentTree ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+const int SegmentTree::MIN_POINTS;
+const int SegmentTree::LEAF_SIZE;
+
+SegmentTree::Box SegmentTree::segmentBox(const std::vector<POINT> &points,
+                                         int i) const {
+  const POINT &start = points[i];
+  const POINT &end = points[i + 1];
+  return {std::min(start.x, end.x) - builtPadding,
+          std::min(start.y, end.y) - builtPadding,
+          std::max(start.x, end.x) + builtPadding,
+          std::max(start.y, end.y) + builtPadding};
+}
+
+void SegmentTree::prepare(const std::vector<POINT> &points, float padding) {
+  int segments = static_cast<int>(points.size()) - 1;
+  if ((segments >= MIN_POINTS) && (!isBuilt || (padding != builtPadding))) {
+    build(points, padding);
+  }
+}
+
+void SegmentTree::build(const std::vector<POINT> &points, float padding) {
+  builtPadding = padding;
+  int segments = points.size() - 1;
+  levels.assign(1, std::vector<Box>());
+  for (int first = 0; first < segments; first += LEAF_SIZE) {
+    Box leaf = segmentBox(points, first);
+    int last = std::min(first + LEAF_SIZE, segments);
+    for (int i = first + 1; i < last; i++) {
+      Box box = segmentBox(points, i);
+      leaf = {std::min(leaf.left, box.left), std::min(leaf.top, box.top),
+              std::max(leaf.right, box.right), std::max(leaf.bottom, box.bottom)};
+    }
+    levels[0].push_back(leaf);
+  }
+  while (levels.back().size() > 1) {
+    const std::vector<Box> &below = levels.back();
+    std::vector<Box> level;
+    for (size_t i = 0; i < below.size(); i += 2) {
+      Box box = below[i];
+      if (i + 1 < below.size()) {
+        const Box &next = below[i + 1];
+        box = {std::min(box.left, next.left), std::min(box.top, next.top),
+               std::max(box.right, next.right), std::max(box.bottom, next.bottom)};
+      }
+      level.push_back(box);
+    }
+    levels.push_back(level);
+  }
+  isBuilt = true;
+}
+
+void SegmentTree::translate(int xAmount, int yAmount) {
+  for (std::vector<Box> &level : levels) {
+    for (Box &box : level) {
+      box.left += xAmount;
+      box.right += xAmount;
+      box.top += yAmount;
+      box.bottom += yAmount;
+    }
+  }
+}
+
+void SegmentTree::clear() {
+  levels.clear();
+  isBuilt = false;
+}
+
+//! Brings the angle within [0, 360)
+static float normaliseAngle(float angle) {
+  angle = std::fmod(angle, 360.0f);
+  return (angle < 0.0f) ? angle + 360.0f : angle;
+}
+
 // ~~~~~~~~~~~~~~~~~~~~~~~~~[ Shape Base class ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 /*!
@@ -172,6 +758,7 @@ bool Shape::addTag(const std::string &newTag) {
     }
   }
   tagList.push_back(newTag);
+  tagBits.set(tagID(newTag));
   return true;
 }
 
@@ -181,7 +768,8 @@ void Shape::removeTag(const std::string &tag) {
     return;
   }
   auto iterPos = std::remove(tagList.begin(), tagList.end(), tag);
-  tagList.erase(iterPos);
+  tagList.erase(iterPos, tagList.end());
+  tagBits.reset(tagID(tag));
 }
 
 ShapeType Shape::type() {
@@ -204,36 +792,23 @@ std::string Shape::getPenColor() {
   return penColor;
 }
 
-bool Shape::hasTag(std::string tagName) {
-  for (const std::string &tag : tagList) {
-    if (tag == tagName) {
-      return true;
-    }
-  }
-  return false;
+bool Shape::hasTag(const std::string &tagName) {
+  return compileTags(tagName)->matches(tagBits);
 }
 
-Vec::Vec2D Shape::closestPointTo(int x, int y) {
-  Vec::Vec2D bottomRight = bottomRightCoord();
-  Vec::Vec2D topLeft = topLeftCoord();
-  Vec::Vec2D vector = Vec::Vec2D(bottomRight) - Vec::Vec2D(topLeft);
-  Vec::Vec2D corners[] = {
-    Vec::Vec2D(topLeft),
-    Vec::Vec2D(topLeft) + vector,
-    Vec::Vec2D(bottomRight),
-    Vec::Vec2D(bottomRight) - vector
-  };
-  Vec::Vec2D closestPoint(corners[0]);
-  float distance = corners[0].magnitude(x, y);
-  float leastDistance = distance;
-  for (int i = 0; i < 4; i++) {
-    float distance = corners[i].magnitude(x, y);
-    if (distance > leastDistance) {
-      leastDistance = distance;
-      closestPoint = corners[i];
-    }
-  }
-  return closestPoint;
+bool Shape::hasTag(const TagExpression &expression) {
+  return expression.matches(tagBits);
+}
+
+Vec::Vec2D Shape::closestPointTo(float x, float y) {
+  return closestInBox(Vec::Vec2D(x, y), topLeftCoord(), bottomRightCoord());
+}
+
+float Shape::distanceTo(float x, float y) {
+  Vec::Vec2D closest = closestPointTo(x, y);
+  float dx = closest.x - x;
+  float dy = closest.y - y;
+  return std::max(std::sqrt(dx * dx + dy * dy) - penSize / 2.0f, 0.0f);
 }
 
 int Shape::BBoxHeight() {
@@ -248,11 +823,110 @@ int Shape::BBoxLength() {
   return abs(bottomRight_.x - topLeft_.x) / 2;
 }
 
+void EllipseParams::update(const Vec::Vec2D &topLeft,
+                           const Vec::Vec2D &bottomRight) {
+  if (isSet && (x1 == topLeft.x) && (y1 == topLeft.y) &&
+      (x2 == bottomRight.x) && (y2 == bottomRight.y)) {
+    return;
+  }
+  isSet = true;
+  x1 = topLeft.x;
+  y1 = topLeft.y;
+  x2 = bottomRight.x;
+  y2 = bottomRight.y;
+  centerX = (x1 + x2) / 2.0f;
+  centerY = (y1 + y2) / 2.0f;
+  radiusX = std::abs(x2 - x1) / 2.0f;
+  radiusY = std::abs(y2 - y1) / 2.0f;
+  // A flat ellipse only holds the points on its axis
+  inverseX2 = (radiusX > 0.0f) ? 1.0f / (radiusX * radiusX) : FLT_MAX;
+  inverseY2 = (radiusY > 0.0f) ? 1.0f / (radiusY * radiusY) : FLT_MAX;
+}
+
+int EllipseParams::contains(const float *xs, const float *ys, int count,
+                            unsigned char *inside) const {
+  int total = 0;
+  for (int i = 0; i < count; i++) {
+    float dx = xs[i] - centerX;
+    float dy = ys[i] - centerY;
+    unsigned char isInside = (dx * dx * inverseX2 + dy * dy * inverseY2) <= 1.0f;
+    inside[i] = isInside;
+    total += isInside;
+  }
+  return total;
+}
+
+void ArcParams::update(const EllipseParams &ellipse, float tiltAngle,
+                       float pieSize) {
+  if (isSet && (radiusX == ellipse.radiusX) && (radiusY == ellipse.radiusY) &&
+      (tilt == tiltAngle) && (pie == pieSize)) {
+    return;
+  }
+  isSet = true;
+  radiusX = ellipse.radiusX;
+  radiusY = ellipse.radiusY;
+  tilt = tiltAngle;
+  pie = pieSize;
+  isFull = pieSize >= 360.0f;
+  isReflex = pieSize > 180.0f;
+  float startAngle = tiltAngle * PI / 180.0f;
+  float endAngle = (tiltAngle + pieSize) * PI / 180.0f;
+  startX = std::cos(startAngle);
+  startY = std::sin(startAngle);
+  endX = std::cos(endAngle);
+  endY = std::sin(endAngle);
+  // Where the directions meet the circumference
+  auto reach = [this](float dx, float dy) {
+    float length = std::sqrt(radiusY * radiusY * dx * dx +
+                             radiusX * radiusX * dy * dy);
+    return (length > 0.0f) ? radiusX * radiusY / length : 0.0f;
+  };
+  float startReach = reach(startX, startY);
+  float endReach = reach(endX, endY);
+  chordStartX = startX * startReach;
+  chordStartY = startY * startReach;
+  chordEndX = endX * endReach;
+  chordEndY = endY * endReach;
+  // The middle of the arc decides which side of the chord is filled
+  float middleAngle = (tiltAngle + pieSize / 2.0f) * PI / 180.0f;
+  float middleX = std::cos(middleAngle);
+  float middleY = std::sin(middleAngle);
+  float middleReach = reach(middleX, middleY);
+  float side = (chordEndX - chordStartX) *
+               (middleY * middleReach - chordStartY) -
+               (chordEndY - chordStartY) *
+               (middleX * middleReach - chordStartX);
+  arcSide = (side >= 0.0f) ? 1.0f : -1.0f;
+}
+
 bool Shape::pointInEllipse(int x, int y) {
-  Vec::Vec2D center = BBoxCenter();
-  float a = pow((x - center.x), 2.0f) / pow(BBoxLength(), 2.0f);
-  float b = pow((y - center.y), 2.0f) / pow(BBoxHeight(), 2.0f);
-  return (a + b) <= 1.0f;
+  return ellipse().contains(x, y);
+}
+
+const EllipseParams &Shape::ellipse() {
+  ellipseParams.update(topLeft, bottomRight);
+  return ellipseParams;
+}
+
+int Shape::pointsInShape(const float *xs, const float *ys, int count,
+                         unsigned char *inside) {
+  int total = 0;
+  for (int i = 0; i < count; i++) {
+    inside[i] = pointInShape(std::floor(xs[i] + 0.5f), std::floor(ys[i] + 0.5f));
+    total += inside[i];
+  }
+  return total;
+}
+
+bool Shape::pointInView(int x, int y, float zoom) {
+  (void)zoom;
+  return pointInShape(x, y);
+}
+
+int Shape::pointsInView(const float *xs, const float *ys, int count,
+                        float zoom, unsigned char *inside) {
+  (void)zoom;
+  return pointsInShape(xs, ys, count, inside);
 }
 
 Vec::Vec2D Shape::BBoxCenter() {
@@ -269,6 +943,12 @@ bool Shape::shapeInRegion(const Vec::Vec2D &topLeft_,
          pointInRegion(bottomRight, topLeft_, bottomRight_);
 }
 
+void Shape::prepareQueries() {}
+
+void Shape::reuseCaches(const Shape &older) {
+  (void)older;
+}
+
 bool Shape::pointInShape(const Vec::Vec2D &point) {
   return pointInShape(point.x, point.y);
 }
@@ -283,20 +963,16 @@ bool Shape::regionOverlapsShape(const Vec::Vec2D &topLeft_,
 }
 
 /*!
- * Ellipse overlapping scenarios:
- *    + The rectangular region has at least one of its vertices in the ellipse
- *    + The furthest points in the ellipse's cicumference are inside the region.
+ * Scaling the axes by the radii turns the ellipse into a unit circle and
+ * leaves the region a box, so the two overlap if the point of the region
+ * closest to the center is in the ellipse.
  */
 bool Shape::ellipseOverlapsRegion(const Vec::Vec2D &topLeft_,
                                   const Vec::Vec2D &bottomRight_) {
-  Vec::Vec2D center = BBoxCenter();
-  bool regionOverlaps = regionOverlapsShape(topLeft_, bottomRight_);
-  bool pointsInRegion =
-    pointInRegion(bottomRight.x, center.y, topLeft_, bottomRight_) ||
-    pointInRegion(center.x, bottomRight.y, topLeft_, bottomRight_) ||
-    pointInRegion(topLeft.x, center.y, topLeft_, bottomRight_) ||
-    pointInRegion(center.x, topLeft.y, topLeft_, bottomRight_);
-  return  pointsInRegion || regionOverlaps;
+  const EllipseParams &params = ellipse();
+  float x = std::min(std::max(params.centerX, topLeft_.x), bottomRight_.x);
+  float y = std::min(std::max(params.centerY, topLeft_.y), bottomRight_.y);
+  return params.contains(x, y);
 }
 
 bool Shape::BBoxOverlapsRegion(const Vec::Vec2D &top,
@@ -310,12 +986,9 @@ bool Shape::BBoxOverlapsRegion(const Vec::Vec2D &top,
  * Uses the ellipse formula with `x` as the subject
  */
 ELLIPSE_POINTS Shape::ordinateToCoord(float y) {
-  float a = BBoxLength();
-  float b = BBoxHeight();
-  Vec::Vec2D center = BBoxCenter();
-  y -= center.y;
-  float x = sqrt((a * a) * (1.0f - ((y * y) / (b * b))));
-  y += center.y;
+  const EllipseParams &params = ellipse();
+  float dy = y - params.centerY;
+  float x = params.radiusX * std::sqrt(1.0f - dy * dy * params.inverseY2);
   if (std::isnan(x)) {
     // No valid point found
     return {
@@ -324,8 +997,8 @@ ELLIPSE_POINTS Shape::ordinateToCoord(float y) {
     };
   }
   return {
-    {center.x + x, y},
-    {center.x - x, y}
+    {params.centerX + x, y},
+    {params.centerX - x, y}
   };
 }
 
@@ -333,12 +1006,9 @@ ELLIPSE_POINTS Shape::ordinateToCoord(float y) {
  * Uses the ellipse formula with `y` as the subject
  */
 ELLIPSE_POINTS Shape::abscissaToCoord(float x) {
-  float a = BBoxLength();
-  float b = BBoxHeight();
-  Vec::Vec2D center = BBoxCenter();
-  x -= center.x;
-  float y = sqrt((b * b) * (1.0f - ((x * x) / (a * a))));
-  x += center.x;
+  const EllipseParams &params = ellipse();
+  float dx = x - params.centerX;
+  float y = params.radiusY * std::sqrt(1.0f - dx * dx * params.inverseX2);
   if (std::isnan(y)) {
     // No valid point found
     return {
@@ -347,8 +1017,8 @@ ELLIPSE_POINTS Shape::abscissaToCoord(float x) {
     };
   }
   return {
-    {x, center.y + y},
-    {x, center.y - y}
+    {x, params.centerY + y},
+    {x, params.centerY - y}
   };
 }
 
@@ -358,6 +1028,21 @@ void Shape::move(int xAmount, int yAmount) {
   bottomRight = bottomRight + vector;
 }
 
+void Shape::scale(float originX, float originY, float xScale, float yScale) {
+  // The kernel also swaps the corners when a negative factor flips the shape.
+  std::vector<POINT> corners = {topLeft, bottomRight};
+  scalePoints(&corners, originX, originY, xScale, yScale,
+              &topLeft, &bottomRight);
+}
+
+void Shape::rotate(float centerX, float centerY, float angle) {
+  Vec::Vec2D pivot(centerX, centerY);
+  Vec::Vec2D center = BBoxCenter();
+  Vec::Vec2D newCenter = (center - pivot).rotate(-angle) + pivot;
+  move(static_cast<int>(std::floor(newCenter.x - center.x + 0.5f)),
+       static_cast<int>(std::floor(newCenter.y - center.y + 0.5f)));
+}
+
 std::vector<POINT> Shape::BBoxCoords()  const {
   POINT topLeft_ = static_cast<POINT>(topLeftCoord());
   POINT bottomRight_ = static_cast<POINT>(bottomRightCoord());
@@ -403,49 +1088,74 @@ void Shape::setText(const std::string &text_) {
 
 void Poly::changeCoords(const std::vector<POINT> &coords) {
   polyCoords = coords;
+  detailLevels.clear();
+  edgeSlabs.clear();
+  updateBBoxCoords();
 }
 
-void Poly::draw(HDC paintDC) {
-  if (!isShown()) {
-    return;
-  }
-  int vertices = polyCoords.size();
-  for (int i = 0; i < vertices; i++) {
-    coordinates[i] = polyCoords[i];
-  }
-  Polygon(paintDC, coordinates, vertices);
+void Poly::updateBBoxCoords() {
+  topLeft = ::topLeftCoord(polyCoords);
+  bottomRight = ::bottomRightCoord(polyCoords);
+}
+
+void Poly::scale(float originX, float originY, float xScale, float yScale) {
+  scalePoints(&polyCoords, originX, originY, xScale, yScale,
+              &topLeft, &bottomRight);
+  detailLevels.clear();
+  edgeSlabs.clear();
+}
+
+void Poly::rotate(float centerX, float centerY, float angle) {
+  rotatePoints(&polyCoords, centerX, centerY, angle, &topLeft, &bottomRight);
+  detailLevels.clear();
+  edgeSlabs.clear();
+}
+
+std::shared_ptr<Shape> Poly::clone() const {
+  return std::make_shared<Poly>(*this);
 }
 
 Vec::Vec2D Poly::topLeftCoord() const {
-  return ::topLeftCoord(polyCoords);
+  return topLeft;
 }
 
 Vec::Vec2D Poly::bottomRightCoord() const {
-  return ::bottomRightCoord(polyCoords);
+  return bottomRight;
 }
 
 bool Poly::pointInShape(int x_, int y_) {
-  // Adapted from Randolph Franklin's ray casting algorithm
+  // Randolph Franklin's crossing test, over the edges in the point's slab
   // http:///www.ecse.rpi.edu/Homepages/wrf/Research/Short_Notes/pnpoly.html
-  float x = x_;
-  float y = y_;
-  int index = 0;
-  int vertices = polyCoords.size();
-  while (index < vertices) {
-    POINT point = polyCoords[index];
-    xCoords[index] = point.x;
-    yCoords[index] = point.y;
-    index++;
-  }
-  int i, j, c = 0;
-  for (i = 0, j = vertices - 1; i < vertices; j = i++) {
-    if (((yCoords[i] > y) != (yCoords[j] > y)) &&
-        (x < (xCoords[j] - xCoords[i]) * (y - yCoords[i]) /
-         (yCoords[j] - yCoords[i]) + xCoords[i])) {
-      c = !c;
+  return edgeSlabs.contains(x_, y_, polyCoords);
+}
+
+int Poly::pointsInShape(const float *xs, const float *ys, int count,
+                        unsigned char *inside) {
+  std::vector<float> rowCrossings;
+  int total = 0;
+  for (int first = 0; first < count;) {
+    // The pick raster passes whole rows, so runs of equal y are the norm
+    float y = std::floor(ys[first] + 0.5f);
+    int last = first + 1;
+    while ((last < count) && (std::floor(ys[last] + 0.5f) == y)) {
+      last++;
+    }
+    edgeSlabs.crossings(y, polyCoords, &rowCrossings);
+    for (int i = first; i < last; i++) {
+      float x = std::floor(xs[i] + 0.5f);
+      // Counts the crossings right of the point
+      auto right = std::upper_bound(rowCrossings.begin(),
+                                    rowCrossings.end(), x);
+      inside[i] = (rowCrossings.end() - right) & 1;
+      total += inside[i];
     }
+    first = last;
   }
-  return c;
+  return total;
+}
+
+void Poly::prepareQueries() {
+  edgeSlabs.prepare(polyCoords);
 }
 
 bool Poly::shapeInRegion(const Vec::Vec2D &topLeft,
@@ -461,29 +1171,26 @@ bool Poly::shapeInRegion(const Vec::Vec2D &topLeft,
 
 bool Poly::overlapsWithRegion(const Vec::Vec2D &topLeft,
                               const Vec::Vec2D &bottomRight) {
-  // At least one point has to be within that region.
-  for (const POINT &coord : polyCoords) {
-    Vec::Vec2D vertex = coord;
-    if (pointInRegion(vertex.x, vertex.y, topLeft, bottomRight)) {
+  if (polyCoords.empty() || !BBoxOverlapsRegion(topLeft, bottomRight)) {
+    return false;
+  }
+  int vertices = polyCoords.size();
+  for (int i = 0, j = vertices - 1; i < vertices; j = i++) {
+    if (segmentOverlapsRegion(polyCoords[j], polyCoords[i],
+                              topLeft, bottomRight)) {
       return true;
     }
   }
-  return false || regionOverlapsShape(topLeft, bottomRight);
+  // No edge touches the region so it's either wholly inside the polygon or
+  // wholly outside it
+  return edgeSlabs.contains(topLeft.x, topLeft.y, polyCoords);
 }
 
-Vec::Vec2D Poly::closestPointTo(int x, int y) {
-  // Returns the closest vertex to the specified point.
-  POINT firstPoint = polyCoords[0];
-  Vec::Vec2D closestPoint(firstPoint);
-  float leastDistance = Vec::Vec2D(firstPoint).magnitude(x, y);
-  for (const POINT &coord : polyCoords) {
-    float distance = closestPoint.magnitude(x, y);
-    if (distance < leastDistance) {
-      leastDistance = distance;
-      closestPoint = Vec::Vec2D(coord);
-    }
-  }
-  return closestPoint;
+Vec::Vec2D Poly::closestPointTo(float x, float y) {
+  Vec::Vec2D point(x, y);
+  bool inside = false;
+  Vec::Vec2D closest = closestOnOutline(point, polyCoords, true, &inside);
+  return inside ? point : closest;
 }
 
 std::vector<POINT> Poly::coords() const {
@@ -502,15 +1209,16 @@ void Poly::move(int xAmount, int yAmount) {
     POINT point = polyCoords[i];
     polyCoords[i] = Vec::Vec2D(point) + vector;
   }
+  detailLevels.translate(xAmount, yAmount);
+  edgeSlabs.translate(xAmount, yAmount);
+  topLeft = topLeft + vector;
+  bottomRight = bottomRight + vector;
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~[ Rectangle ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-void Rect::draw(HDC paintDC) {
-  if (!isShown()) {
-    return;
-  }
-  Rectangle(paintDC, topLeft.x, topLeft.y, bottomRight.x, bottomRight.y);
+std::shared_ptr<Shape> Rect::clone() const {
+  return std::make_shared<Rect>(*this);
 }
 
 Vec::Vec2D Rect::topLeftCoord() const {
@@ -529,6 +1237,18 @@ bool Rect::pointInShape(int x, int y) {
   return false;
 }
 
+int Rect::pointsInShape(const float *xs, const float *ys, int count,
+                        unsigned char *inside) {
+  int total = 0;
+  for (int i = 0; i < count; i++) {
+    float x = std::floor(xs[i] + 0.5f), y = std::floor(ys[i] + 0.5f);
+    inside[i] = (x >= topLeft.x) && (y >= topLeft.y) &&
+                (x <= bottomRight.x) && (y <= bottomRight.y);
+    total += inside[i];
+  }
+  return total;
+}
+
 bool Rect::overlapsWithRegion(const Vec::Vec2D &topLeft_,
                               const Vec::Vec2D &bottomRight_) {
   return BBoxOverlapsRegion(topLeft_, bottomRight_);
@@ -536,57 +1256,8 @@ bool Rect::overlapsWithRegion(const Vec::Vec2D &topLeft_,
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~[ Text ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-void Text::createFont(HFONT *font) {
-  FontAttr fontProp = getFontAttr();
-  HDC hDC = GetDC(NULL);
-  LONG fontHeight = -MulDiv(fontProp.size, GetDeviceCaps(hDC, LOGPIXELSY), 72);
-  ReleaseDC(NULL, hDC);
-  *font = CreateFont(fontHeight, 0, 0, 0, fontProp.bold, fontProp.italic,
-                     fontProp.underline, fontProp.strikeout, DEFAULT_CHARSET,
-                     OUT_OUTLINE_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY,
-                     VARIABLE_PITCH, fontProp.family.c_str());
-}
-
-POINT Text::textArea(HDC paintDC) {
-  SIZE size;
-  std::string text_ = getText();
-  GetTextExtentPoint32(paintDC, text_.c_str(), text_.length(), &size);
-  return {size.cx, size.cy};
-}
-
-void Text::draw(HDC paintDC) {
-  if (!isShown()) {
-    return;
-  }
-  HFONT font;
-  createFont(&font);
-  SelectObject(paintDC, font);
-  POINT dim = textArea(paintDC);
-  int x1 = static_cast<int>(start.x);
-  int y1 = static_cast<int>(start.y);
-  int x2 = x1 + dim.x;
-  int y2 = y1 + dim.y;
-  if (width != 0) {
-    x2 = x1 + width;
-  }
-
-  // Update the bounding box's coordinates with the correct values according to
-  // the current font.
-  topLeft = {x1, y1};
-  bottomRight = {x2, y2};
-
-  RECT textRegion = {x1, y1, x2, y2};
-  SetTextColor(paintDC, Colors::hexToColorRef(getPenColor()));
-  std::string fillColor_ = getFillColor();
-  if (fillColor_ != "") {
-    SetBkColor(paintDC, Colors::hexToColorRef(fillColor_));
-  } else {
-    SetBkMode(paintDC, TRANSPARENT);
-  }
-  std::string text_ = getText();
-  int format =  DT_NOCLIP | DT_SINGLELINE | DT_WORD_ELLIPSIS;
-  DrawText(paintDC, text_.c_str(), -1, &textRegion, format);
-  DeleteObject(font);
+std::shared_ptr<Shape> Text::clone() const {
+  return std::make_shared<Text>(*this);
 }
 
 Vec::Vec2D Text::topLeftCoord() const {
@@ -609,15 +1280,45 @@ bool Text::overlapsWithRegion(const Vec::Vec2D &topLeft_,
 void Text::move(int xAmount, int yAmount) {
   Vec::Vec2D vector(xAmount, yAmount);
   start = start + vector;
+  topLeft = topLeft + vector;
+  bottomRight = bottomRight + vector;
+}
+
+void Text::setText(const std::string &text_) {
+  Shape::setText(text_);
+  estimateBBoxCoords();
+}
+
+void Text::setFontAttr(const FontAttr &fontProp) {
+  Shape::setFontAttr(fontProp);
+  estimateBBoxCoords();
+}
+
+void Text::estimateBBoxCoords() {
+  // A point is 4/3 of a pixel on a 96 DPI screen and no character is wider
+  // than it is tall.
+  FontAttr fontProp = getFontAttr();
+  int height = fontProp.size * 2;
+  int length = (width != 0) ? width : getText().length() * height;
+  topLeft = start;
+  bottomRight = start + Vec::Vec2D(length, height);
+}
+
+void Text::scale(float originX, float originY, float xScale, float yScale) {
+  float x = originX + (start.x - originX) * xScale;
+  float y = originY + (start.y - originY) * yScale;
+  move(static_cast<int>(std::floor(x - start.x + 0.5f)),
+       static_cast<int>(std::floor(y - start.y + 0.5f)));
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~[ Oval ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-void Oval::draw(HDC paintDC) {
-  if (!isShown()) {
-    return;
-  }
-  Ellipse(paintDC, topLeft.x, topLeft.y, bottomRight.x, bottomRight.y);
+std::shared_ptr<Shape> Oval::clone() const {
+  return std::make_shared<Oval>(*this);
+}
+
+void Oval::prepareQueries() {
+  ellipse();
 }
 
 Vec::Vec2D Oval::topLeftCoord() const {
@@ -628,10 +1329,33 @@ Vec::Vec2D Oval::bottomRightCoord() const {
   return bottomRight;
 }
 
+Vec::Vec2D Oval::closestPointTo(float x, float y) {
+  Vec::Vec2D point(x, y);
+  Vec::Vec2D topLeft = topLeftCoord();
+  Vec::Vec2D bottomRight = bottomRightCoord();
+  Vec::Vec2D center((topLeft.x + bottomRight.x) / 2.0f,
+                    (topLeft.y + bottomRight.y) / 2.0f);
+  float radiusX = std::abs(bottomRight.x - topLeft.x) / 2.0f;
+  float radiusY = std::abs(bottomRight.y - topLeft.y) / 2.0f;
+  if ((radiusX > 0.0f) && (radiusY > 0.0f)) {
+    float dx = (x - center.x) / radiusX;
+    float dy = (y - center.y) / radiusY;
+    if (dx * dx + dy * dy <= 1.0f) {
+      return point;
+    }
+  }
+  return closestOnEllipse(point, center, radiusX, radiusY);
+}
+
 bool Oval::pointInShape(int x, int y) {
   return pointInEllipse(x, y);
 }
 
+int Oval::pointsInShape(const float *xs, const float *ys, int count,
+                        unsigned char *inside) {
+  return ellipse().contains(xs, ys, count, inside);
+}
+
 bool Oval::overlapsWithRegion(const Vec::Vec2D &topLeft_,
                               const Vec::Vec2D &bottomRight_) {
   return ellipseOverlapsRegion(topLeft_, bottomRight_);
@@ -642,19 +1366,29 @@ bool Oval::overlapsWithRegion(const Vec::Vec2D &topLeft_,
 void Circle::changeCoords(const std::vector<POINT> &coords) {
   center = coords[0];
   radius = coords[1].x;
+  updateBBoxCoords();
 }
 
-void Circle::updateBBoxCoords() {
+void Circle::move(int xAmount, int yAmount) {
+  center = center + Vec::Vec2D(xAmount, yAmount);
+  updateBBoxCoords();
+}
+
+void Circle::scale(float originX, float originY, float xScale, float yScale) {
+  float x = originX + (center.x - originX) * xScale;
+  float y = originY + (center.y - originY) * yScale;
+  center = {std::floor(x + 0.5f), std::floor(y + 0.5f)};
+  radius = static_cast<int>(radius * std::sqrt(std::abs(xScale * yScale)) + 0.5f);
+  updateBBoxCoords();
+}
+
+void Circle::updateBBoxCoords() {
   topLeft = {center.x - radius, center.y - radius};
   bottomRight = {center.x + radius, center.y + radius};
 }
 
-void Circle::draw(HDC paintDC) {
-  if (!isShown()) {
-    return;
-  }
-  updateBBoxCoords();
-  Ellipse(paintDC, topLeft.x, topLeft.y, bottomRight.x, bottomRight.y);
+std::shared_ptr<Shape> Circle::clone() const {
+  return std::make_shared<Circle>(*this);
 }
 
 Vec::Vec2D Circle::bottomRightCoord() const {
@@ -671,6 +1405,27 @@ Vec::Vec2D Circle::topLeftCoord() const {
 
 void Line::changeCoords(const std::vector<POINT> &coords) {
   lineCoords = coords;
+  detailLevels.clear();
+  segmentTree.clear();
+  updateBBoxCoords();
+}
+
+void Line::updateBBoxCoords() {
+  topLeft = ::topLeftCoord(lineCoords);
+  bottomRight = ::bottomRightCoord(lineCoords);
+}
+
+void Line::scale(float originX, float originY, float xScale, float yScale) {
+  scalePoints(&lineCoords, originX, originY, xScale, yScale,
+              &topLeft, &bottomRight);
+  detailLevels.clear();
+  segmentTree.clear();
+}
+
+void Line::rotate(float centerX, float centerY, float angle) {
+  rotatePoints(&lineCoords, centerX, centerY, angle, &topLeft, &bottomRight);
+  detailLevels.clear();
+  segmentTree.clear();
 }
 
 void Line::move(int xAmount, int yAmount) {
@@ -680,17 +1435,14 @@ void Line::move(int xAmount, int yAmount) {
     POINT point = lineCoords[i];
     lineCoords[i] = Vec::Vec2D(point) + vector;
   }
+  detailLevels.translate(xAmount, yAmount);
+  segmentTree.translate(xAmount, yAmount);
+  topLeft = topLeft + vector;
+  bottomRight = bottomRight + vector;
 }
 
-void Line::draw(HDC paintDC) {
-  if (!isShown()) {
-    return;
-  }
-  POINT firstElem = lineCoords.front();
-  MoveToEx(paintDC, firstElem.x, firstElem.y, NULL);
-  for (const POINT &point : lineCoords) {
-    LineTo(paintDC, point.x, point.y);
-  }
+std::shared_ptr<Shape> Line::clone() const {
+  return std::make_shared<Line>(*this);
 }
 
 bool Line::shapeInRegion(const Vec::Vec2D &topLeft, const Vec::Vec2D &bottomRight) {
@@ -725,57 +1477,48 @@ bool Line::pointInLine(const Vec::Vec2D &start,
   return (perpDistance < (1.0f + penSize)) && withinSegment;
 }
 
+Vec::Vec2D Line::closestPointTo(float x, float y) {
+  return closestOnOutline(Vec::Vec2D(x, y), lineCoords, false);
+}
+
+float Line::hitPadding() const {
+  // The perpendicular tolerance plus the slack withinLineSegment() gives past
+  // the ends
+  return std::max(3.0f, 1.0f + penSize) + 1.0f;
+}
+
 bool Line::pointInShape(int x, int y) {
-  int points = lineCoords.size();
-  for (int i = 0; i < points - 1; i++) {
-    Vec::Vec2D start = lineCoords[i];
-    Vec::Vec2D end = lineCoords[i + 1];
-    if (pointInLine(start, end, x, y)) {
-      // Makes sure the point is between the start and end even if it
-      // technically is on the line.
-      return true;
-    }
-  }
-  return false;
+  return segmentTree.query(x, y, x, y, hitPadding(), lineCoords, [&](int i) {
+    return pointInLine(lineCoords[i], lineCoords[i + 1], x, y);
+  });
+}
+
+void Line::prepareQueries() {
+  segmentTree.prepare(lineCoords, hitPadding());
 }
 
 bool Line::overlapsWithRegion(const Vec::Vec2D &topLeft,
                               const Vec::Vec2D &bottomRight) {
-  // The line overlaps with the region if it intersects with at least one side
-  // of the rectangular region or is completely inside it.
-  Vec::Vec2D topRight = {bottomRight.x, topLeft.y};
-  Vec::Vec2D bottomLeft = {topLeft.x, bottomRight.y};
+  if (lineCoords.empty() || !BBoxOverlapsRegion(topLeft, bottomRight)) {
+    return false;
+  }
   int points = lineCoords.size();
-  for (int i = 0; i < points - 1; i++) {
-    Vec::Vec2D start = lineCoords[i];
-    Vec::Vec2D end = lineCoords[i + 1];
-    Vec::Vec2D top = intersection(start, end, topLeft, topRight);
-    Vec::Vec2D bottom = intersection(start, end, bottomLeft, bottomRight);
-    Vec::Vec2D left = intersection(start, end, bottomLeft, topLeft);
-    Vec::Vec2D right = intersection(start, end, bottomRight, topRight);
-    // Test if the intersection point is both in the region and in the line segment
-    bool overlaps = (pointInLine(topLeft, topRight, top.x, top.y) &&
-                     pointInLine(start, end, top.x, top.y)) ||
-                    (pointInLine(bottomLeft, bottomRight, bottom.x, bottom.y) &&
-                     pointInLine(start, end, bottom.x, bottom.y)) ||
-                    (pointInLine(bottomLeft, topLeft, left.x, left.y) &&
-                     pointInLine(start, end, left.x, left.y)) ||
-                    (pointInLine(bottomRight, topRight, right.x, right.y) &&
-                     pointInLine(start, end, right.x, right.y));
-
-    if (overlaps) {
-      return true;
-    }
+  if (points == 1) {
+    return pointInRegion(lineCoords[0], topLeft, bottomRight);
   }
-  return false;
+  return segmentTree.query(topLeft.x, topLeft.y, bottomRight.x, bottomRight.y,
+                           hitPadding(), lineCoords, [&](int i) {
+    return segmentOverlapsRegion(lineCoords[i], lineCoords[i + 1],
+                                 topLeft, bottomRight);
+  });
 }
 
 Vec::Vec2D Line::bottomRightCoord() const {
-  return ::bottomRightCoord(lineCoords);
+  return bottomRight;
 }
 
 Vec::Vec2D Line::topLeftCoord() const {
-  return ::topLeftCoord(lineCoords);
+  return topLeft;
 }
 
 std::vector<POINT> Line::coords() const {
@@ -813,47 +1556,57 @@ Vec::Vec2D LineArc::startPoint() const {
  * ordinateToCoord().
  *
  * And then checks if at least one of the points is both on the arc and in that
- * region.
+ * region. An arc lying wholly inside the region crosses none of its sides, so
+ * the start point is checked first.
  */
 bool LineArc::arcOverlapsRegion(const Vec::Vec2D &topLeft_,
                                 const Vec::Vec2D &bottomRight_) {
+  const EllipseParams &params = ellipse();
+  const ArcParams &arc = sector();
+  auto inRegion = [&](const Vec::Vec2D & point) {
+    return (point.x >= topLeft_.x) && (point.x <= bottomRight_.x) &&
+           (point.y >= topLeft_.y) && (point.y <= bottomRight_.y);
+  };
+  auto onArcInRegion = [&](const Vec::Vec2D & point) {
+    return inRegion(point) &&
+           arc.contains(point.x - params.centerX, params.centerY - point.y);
+  };
+  // An arc that doesn't cross the region's sides is either wholly inside it
+  // or wholly outside it
+  if (inRegion(startPoint())) {
+    return true;
+  }
   // The possible intersection points on the circumference
-  ELLIPSE_POINTS p1 = ordinateToCoord(topLeft_.y);
-  ELLIPSE_POINTS p2 = ordinateToCoord(bottomRight_.y);
-  ELLIPSE_POINTS p3 = abscissaToCoord(topLeft_.x);
-  ELLIPSE_POINTS p4 = abscissaToCoord(bottomRight_.x);
-  return
-    (pointOnArc(p1.first) && pointInRegion(p1.first, topLeft_, bottomRight_)) ||
-    (pointOnArc(p1.second) && pointInRegion(p1.second, topLeft_, bottomRight_)) ||
-    (pointOnArc(p2.first) && pointInRegion(p2.first, topLeft_, bottomRight_)) ||
-    (pointOnArc(p2.second) && pointInRegion(p2.second, topLeft_, bottomRight_)) ||
-    (pointOnArc(p3.first) && pointInRegion(p3.first, topLeft_, bottomRight_)) ||
-    (pointOnArc(p3.second) && pointInRegion(p3.second, topLeft_, bottomRight_)) ||
-    (pointOnArc(p4.first) && pointInRegion(p4.first, topLeft_, bottomRight_)) ||
-    (pointOnArc(p4.second) && pointInRegion(p4.second, topLeft_, bottomRight_));
+  ELLIPSE_POINTS crossings[] = {
+    ordinateToCoord(topLeft_.y),
+    ordinateToCoord(bottomRight_.y),
+    abscissaToCoord(topLeft_.x),
+    abscissaToCoord(bottomRight_.x)
+  };
+  for (const ELLIPSE_POINTS &crossing : crossings) {
+    if (onArcInRegion(crossing.first) || onArcInRegion(crossing.second)) {
+      return true;
+    }
+  }
+  return false;
 }
 
 /*!
  * Works like arcOverlapsRegion() handling the extra case specific to chords
- * where one of the region's vertices goes through the chord's straight line
+ * where the region crosses the chord's straight line
  */
 bool LineArc::chordOverlapsRegion(const Vec::Vec2D &topLeft_,
                                   const Vec::Vec2D &bottomRight_) {
   bool overlapsArc = arcOverlapsRegion(topLeft_, bottomRight_);
   Vec::Vec2D start = startPoint();
   Vec::Vec2D end = endPoint();
-  Vec::Vec2D p1 = {topLeft_.y, bottomRight_.x};
-  Vec::Vec2D p2 = {topLeft_.x, bottomRight_.y};
-  bool anyIntersect = linesIntersect(topLeft_, p1, start, end) ||
-                      linesIntersect(topLeft_, p2, start, end) ||
-                      linesIntersect(bottomRight_, p1, start, end) ||
-                      linesIntersect(bottomRight_, p2, start, end);
-  return overlapsArc || anyIntersect;
+  return overlapsArc ||
+         segmentOverlapsRegion(start, end, topLeft_, bottomRight_);
 }
 
 /*!
  * Works like arcOverlapsRegion() handling the extra case specific to pies
- * where one of the region's vertices goes through the pie's two straight lines
+ * where the region crosses one of the pie's two straight lines
  */
 bool LineArc::pieOverlapsRegion(const Vec::Vec2D &topLeft_,
                                 const Vec::Vec2D &bottomRight_) {
@@ -861,28 +1614,9 @@ bool LineArc::pieOverlapsRegion(const Vec::Vec2D &topLeft_,
   Vec::Vec2D center = BBoxCenter();
   Vec::Vec2D start = startPoint();
   Vec::Vec2D end = endPoint();
-  Vec::Vec2D p1 = {bottomRight_.x, topLeft_.y};
-  Vec::Vec2D p2 = {topLeft_.x, bottomRight_.y};
-  Vec::Vec2D intersections[] = {
-    intersection(topLeft_, p1, start, center),
-    intersection(topLeft_, p1, end, center),
-    intersection(topLeft_, p2, start, center),
-    intersection(topLeft_, p2, end, center),
-    intersection(bottomRight_, p1, start, center),
-    intersection(bottomRight_, p1, end, center),
-    intersection(bottomRight_, p2, start, center),
-    intersection(bottomRight_, p2, end, center)
-  };
-  bool anyIntersect = false;
-  for (int i = 7; i >= 0; i--) {
-    Vec::Vec2D point = intersections[i];
-    // Check if the intersection lies on the pie's borders.
-    bool onBorderLines = withinLineSegment(point, center, start) ||
-                         withinLineSegment(point, center, end);
-    anyIntersect |= (pointInRegion(point, topLeft_, bottomRight_) &&
-                     onBorderLines);
-  }
-  return overlapsArc || anyIntersect;
+  return overlapsArc ||
+         segmentOverlapsRegion(center, start, topLeft_, bottomRight_) ||
+         segmentOverlapsRegion(center, end, topLeft_, bottomRight_);
 }
 
 bool LineArc::overlapsWithRegion(const Vec::Vec2D &topLeft_,
@@ -898,6 +1632,22 @@ bool LineArc::overlapsWithRegion(const Vec::Vec2D &topLeft_,
   return false;
 }
 
+void LineArc::scale(float originX, float originY, float xScale, float yScale) {
+  Shape::scale(originX, originY, xScale, yScale);
+  // A mirrored arc sweeps the same way from the mirrored end angle.
+  if (xScale < 0.0f) {
+    tiltAngle = normaliseAngle(180.0f - tiltAngle - pieSize);
+  }
+  if (yScale < 0.0f) {
+    tiltAngle = normaliseAngle(360.0f - tiltAngle - pieSize);
+  }
+}
+
+void LineArc::rotate(float centerX, float centerY, float angle) {
+  Shape::rotate(centerX, centerY, angle);
+  tiltAngle = normaliseAngle(tiltAngle + angle);
+}
+
 float LineArc::sign(const Vec::Vec2D &p1,
                     const Vec::Vec2D &p2,
                     const Vec::Vec2D &p3) {
@@ -920,49 +1670,167 @@ bool LineArc::pointOnArc(const Vec::Vec2D &point) {
 }
 
 bool LineArc::pointOnArc(int x, int y) {
-  Vec::Vec2D center = BBoxCenter();
-  float a = pow((x - center.x), 2.0f) / pow(BBoxLength(), 2.0f);
-  float b = pow((y - center.y), 2.0f) / pow(BBoxHeight(), 2.0f);
-  float angle = angleFromCoord(x, y);
-  float endAngle = pieSize + tiltAngle;
-  if (endAngle <= 360.0f) {
-    bool withinSector = (angle >= tiltAngle) && (angle <= endAngle);
-    return withinSector && (std::abs(a + b - 1.0f) < 0.02f);
-  } else {
-    // Handle the case where the arc lies on the right center line, one portion
-    // above and another below.
-    endAngle = (endAngle > 360.0f) ? endAngle - 360.0f : endAngle;
-    bool withinSector = (angle >= tiltAngle) || (angle <= endAngle);
-    return withinSector && (std::abs(a + b - 1.0f) < 0.02f);
-  }
+  const EllipseParams &params = ellipse();
+  float dx = x - params.centerX;
+  float dy = params.centerY - y;
+  return (std::abs(params.level(x, y) - 1.0f) < 0.02f) &&
+         sector().contains(dx, dy);
 }
 
 bool LineArc::pointInPie(int x, int y) {
-  float angle = angleFromCoord(x, y);
-  float endAngle = pieSize + tiltAngle;
-  if (endAngle <= 360.0f) {
-    bool withinSector = (angle >= tiltAngle) && (angle <= endAngle);
-    return withinSector && pointInEllipse(x, y);
-  } else {
-    // Handle the case where the pie lies on the right center line, one portion
-    // above and another below.
-    endAngle = (endAngle > 360.0f) ? endAngle - 360.0f : endAngle;
-    bool withinSector = (angle >= tiltAngle) || (angle <= endAngle);
-    return withinSector && pointInEllipse(x, y);
-  }
+  const EllipseParams &params = ellipse();
+  float dx = x - params.centerX;
+  float dy = params.centerY - y;
+  return params.contains(x, y) && sector().contains(dx, dy);
 }
 
 bool LineArc::pointInChord(int x, int y) {
-  Vec::Vec2D point = Vec::Vec2D(x, y);
-  Vec::Vec2D center = Vec::Vec2D(BBoxCenter());
-  Vec::Vec2D tiltPos = coordFromAngle(tiltAngle);
-  Vec::Vec2D endPos = coordFromAngle(tiltAngle + pieSize);
-  bool inTriangle = pointInTriangle(point, center, tiltPos, endPos);
-  if (pieSize > 180.0f) {
-    return pointInPie(x, y) || inTriangle;
-  } else {
-    return pointInPie(x, y) && !inTriangle;
+  const EllipseParams &params = ellipse();
+  float dx = x - params.centerX;
+  float dy = params.centerY - y;
+  return params.contains(x, y) && sector().onArcSide(dx, dy);
+}
+
+const ArcParams &LineArc::sector() {
+  arcParams.update(ellipse(), tiltAngle, pieSize);
+  return arcParams;
+}
+
+void LineArc::prepareQueries() {
+  sector();
+}
+
+int LineArc::pointsInShape(const float *xs, const float *ys, int count,
+                           unsigned char *inside) {
+  const EllipseParams &params = ellipse();
+  const ArcParams &arc = sector();
+  int total = 0;
+  for (int i = 0; i < count; i++) {
+    float level = params.level(xs[i], ys[i]);
+    float dx = xs[i] - params.centerX;
+    float dy = params.centerY - ys[i];
+    bool isInside = false;
+    switch (arcType) {
+      case PIE:
+        isInside = (level <= 1.0f) && arc.contains(dx, dy);
+        break;
+      case CHORD:
+        isInside = (level <= 1.0f) && arc.onArcSide(dx, dy);
+        break;
+      case ARC:
+        isInside = (std::abs(level - 1.0f) < 0.02f) && arc.contains(dx, dy);
+        break;
+    }
+    inside[i] = isInside;
+    total += isInside;
+  }
+  return total;
+}
+
+Vec::Vec2D LineArc::closestPointTo(float x, float y) {
+  Vec::Vec2D point(x, y);
+  float radiusX = std::abs(bottomRight.x - topLeft.x) / 2.0f;
+  float radiusY = std::abs(bottomRight.y - topLeft.y) / 2.0f;
+  if ((radiusX == 0.0f) || (radiusY == 0.0f)) {
+    return Shape::closestPointTo(x, y);
+  }
+  Vec::Vec2D center = BBoxCenter();
+  // The arc is worked out in terms of the ellipse's parameter `t`, the
+  // circumference point being `(cx + rx·cos(t), cy - ry·sin(t))`. It grows
+  // with the angle measured from the center line so the arc is a single range.
+  const double TWO_PI = 2.0 * PI;
+  auto parameterOf = [&](float degrees) {
+    double radians = degrees * PI / 180.0;
+    return std::atan2(radiusX * std::sin(radians), radiusY * std::cos(radians));
+  };
+  auto pointAt = [&](double t) {
+    return Vec::Vec2D(float(center.x + radiusX * std::cos(t)),
+                      float(center.y - radiusY * std::sin(t)));
+  };
+  auto distanceSquared = [&](const Vec::Vec2D &other) {
+    float dx = other.x - x;
+    float dy = other.y - y;
+    return dx * dx + dy * dy;
+  };
+  double start = parameterOf(tiltAngle);
+  double sweep = TWO_PI;
+  if (pieSize < 360.0f) {
+    sweep = std::fmod(parameterOf(tiltAngle + pieSize) - start + 2 * TWO_PI,
+                      TWO_PI);
+  }
+  auto withinSweep = [&](double t) {
+    return std::fmod(t - start + 2 * TWO_PI, TWO_PI) <= sweep;
+  };
+  Vec::Vec2D startPos = pointAt(start);
+  Vec::Vec2D endPos = pointAt(start + sweep);
+  if ((arcType != ARC) && ellipse().contains(x, y)) {
+    float dx = x - center.x;
+    float dy = center.y - y;
+    bool isInside = (arcType == PIE) ? sector().contains(dx, dy) :
+                    sector().onArcSide(dx, dy);
+    if (isInside) {
+      return point;
+    }
+  }
+  Vec::Vec2D closest = closestOnEllipse(point, center, radiusX, radiusY);
+  float dx2 = (closest.x - center.x) / radiusX;
+  float dy2 = (center.y - closest.y) / radiusY;
+  if (!withinSweep(std::atan2(dy2, dx2))) {
+    // The distance along the arc has at most two minima. The other one or an
+    // end is the closest, so bracket it by sampling and then narrow it down.
+    closest = startPos;
+    float leastDistance = distanceSquared(startPos);
+    if (distanceSquared(endPos) < leastDistance) {
+      closest = endPos;
+      leastDistance = distanceSquared(endPos);
+    }
+    const int SAMPLES = 32;
+    double step = sweep / SAMPLES;
+    int nearest = 0;
+    float nearestDistance = FLT_MAX;
+    for (int i = 1; i < SAMPLES; i++) {
+      float distance = distanceSquared(pointAt(start + i * step));
+      if (distance < nearestDistance) {
+        nearestDistance = distance;
+        nearest = i;
+      }
+    }
+    // Golden section search on the two steps around the best sample
+    const double RATIO = 0.6180339887498949;
+    double low = start + (nearest - 1) * step;
+    double high = start + (nearest + 1) * step;
+    for (int i = 0; i < 40; i++) {
+      double t1 = high - RATIO * (high - low);
+      double t2 = low + RATIO * (high - low);
+      if (distanceSquared(pointAt(t1)) < distanceSquared(pointAt(t2))) {
+        high = t2;
+      } else {
+        low = t1;
+      }
+    }
+    Vec::Vec2D refined = pointAt((low + high) / 2.0);
+    if (distanceSquared(refined) < leastDistance) {
+      closest = refined;
+    }
+  }
+  if (sweep == TWO_PI) {
+    return closest;
   }
+  // The straight edges of the pie or chord
+  Vec::Vec2D edges[3];
+  int edgeCount = 0;
+  if (arcType == PIE) {
+    edges[edgeCount++] = closestOnSegment(point, center, startPos);
+    edges[edgeCount++] = closestOnSegment(point, center, endPos);
+  } else if (arcType == CHORD) {
+    edges[edgeCount++] = closestOnSegment(point, startPos, endPos);
+  }
+  for (int i = 0; i < edgeCount; i++) {
+    if (distanceSquared(edges[i]) < distanceSquared(closest)) {
+      closest = edges[i];
+    }
+  }
+  return closest;
 }
 
 bool LineArc::pointInShape(const Vec::Vec2D &point) {
@@ -1000,56 +1868,895 @@ float LineArc::angleFromCoord(float x, float y) {
 }
 
 Vec::Vec2D LineArc::coordFromAngle(float angle) const {
-  float r1 = abs(bottomRight.x - topLeft.x) / 2;
-  float r2 = abs(bottomRight.y - topLeft.y) / 2;
-  Vec::Vec2D center(topLeft.x + r1, topLeft.y + r2);
-  while (angle > 360.0f) {
-    angle -= 360.0f;
+  float radiusX = std::abs(bottomRight.x - topLeft.x) / 2.0f;
+  float radiusY = std::abs(bottomRight.y - topLeft.y) / 2.0f;
+  float radians = angle * PI / 180.0f;
+  float dx = std::cos(radians);
+  float dy = std::sin(radians);
+  // Distance from the center to the circumference in that direction
+  float length = std::sqrt(radiusY * radiusY * dx * dx +
+                           radiusX * radiusX * dy * dy);
+  float reach = (length > 0.0f) ? radiusX * radiusY / length : 0.0f;
+  return Vec::Vec2D((topLeft.x + bottomRight.x) / 2.0f + dx * reach,
+                    (topLeft.y + bottomRight.y) / 2.0f - dy * reach);
+}
+
+std::shared_ptr<Shape> LineArc::clone() const {
+  return std::make_shared<LineArc>(*this);
+}
+
+std::vector<POINT> LineArc::coords() const {
+  std::vector<POINT> coordVector = BBoxCoords();
+  coordVector.push_back(static_cast<POINT>(startPoint()));
+  coordVector.push_back(static_cast<POINT>(endPoint()));
+  return coordVector;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~[ Series ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+const int Series::CHUNK_SIZE;
+
+void Series::append(float x, float y) {
+  if (count == 0) {
+    startX = x;
   }
-  if ((angle != 90.0f) && (angle != 270.0f)) {
-    // Make the given angle be the size of the PIE, not the chunked out part.
-    // XXX: This if-test prevents 270 from being drawn like 90
-    angle = 360.0f - angle;
+  if (chunks.empty() || (int(chunks.back()->size()) == CHUNK_SIZE)) {
+    chunks.push_back(std::make_shared<std::vector<Vec::Vec2D>>());
+    chunks.back()->reserve(CHUNK_SIZE);
   }
-  float radians = angle * PI / 180.0f;
-  // Use ellipse formula to find the ordinate and abscissa given an angle.
-  float x = (r1 * r2) / (sqrt((r2 * r2) + (r1 * r1 * pow(tan(radians), 2.0f))));
-  float y = x * tan(radians);
-  if (((angle > 90.0f) && (angle <= 180.0f)) ||
-      ((angle >= 180.0f) && (angle <= 270.0f))) {
-    // Makes sure angles with the same tangents are drawn correctly.
-    x = -x;
-    y = -y;
+  chunks.back()->push_back(Vec::Vec2D(x, y));
+  appended++;
+  if (count < maxCount) {
+    count++;
+  } else if (++head == CHUNK_SIZE) {
+    chunks.pop_front();
+    head = 0;
+  }
+}
+
+void Series::append(const std::vector<Vec::Vec2D> &newSamples) {
+  for (const Vec::Vec2D &newSample : newSamples) {
+    append(newSample.x, newSample.y);
+  }
+}
+
+Vec::Vec2D Series::sample(int index) const {
+  index += head;
+  return (*chunks[index / CHUNK_SIZE])[index % CHUNK_SIZE];
+}
+
+int Series::capacity() const {
+  return maxCount;
+}
+
+void Series::valueRange(float low_, float high_) {
+  low = low_;
+  high = high_;
+  layout++;
+}
+
+void Series::timeSpan(float span_) {
+  if (span_ > 0.0f) {
+    span = span_;
+    layout++;
   }
-  return Vec::Vec2D(x, y) + center;
 }
 
-void LineArc::draw(HDC paintDC) {
-  if (!isShown()) {
+Vec::Vec2D Series::topLeftCoord() const {
+  return topLeft;
+}
+
+Vec::Vec2D Series::bottomRightCoord() const {
+  return bottomRight;
+}
+
+bool Series::pointInShape(int x, int y) {
+  return pointInRegion(x, y, topLeft, bottomRight);
+}
+
+bool Series::overlapsWithRegion(const Vec::Vec2D &topLeft_,
+                                const Vec::Vec2D &bottomRight_) {
+  return BBoxOverlapsRegion(topLeft_, bottomRight_);
+}
+
+int Series::lowerBound(double x) const {
+  int first = 0;
+  int last = count;
+  while (first < last) {
+    int middle = first + (last - first) / 2;
+    if (sample(middle).x < x) {
+      first = middle + 1;
+    } else {
+      last = middle;
+    }
+  }
+  return first;
+}
+
+std::shared_ptr<Shape> Series::clone() const {
+  std::shared_ptr<Series> copy = std::make_shared<Series>(*this);
+  // Made now so that drawing the copy never changes the pointer, which
+  // reuseCaches() reads from another thread
+  copy->strip = std::make_shared<StripCache>();
+  if (!chunks.empty() && (int(chunks.back()->size()) < CHUNK_SIZE)) {
+    // The only chunk still appended to
+    copy->chunks.back() =
+      std::make_shared<std::vector<Vec::Vec2D>>(*chunks.back());
+  }
+  return copy;
+}
+
+void Series::reuseCaches(const Shape &older) {
+  if (older.shapeType == SERIES) {
+    strip = static_cast<const Series &>(older).strip;
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~[ PointCloud ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void PointCloud::updateBBoxCoords() {
+  if (xs.empty()) {
+    topLeft = bottomRight = Vec::Vec2D(0, 0);
     return;
   }
-  int x1 = topLeft.x;
-  int y1 = topLeft.y;
-  int x2 = bottomRight.x;
-  int y2 = bottomRight.y;
-  Vec::Vec2D start(startPoint());
-  Vec::Vec2D end(endPoint());
-  switch (arcType) {
-    case PIE:
-      Pie(paintDC, x1, y1, x2, y2, start.x, start.y, end.x, end.y);
-      break;
-    case CHORD:
-      Chord(paintDC, x1, y1, x2, y2, start.x, start.y, end.x, end.y);
-      break;
-    case ARC:
-      Arc(paintDC, x1, y1, x2, y2, start.x, start.y, end.x, end.y);
+  auto xRange = std::minmax_element(xs.begin(), xs.end());
+  auto yRange = std::minmax_element(ys.begin(), ys.end());
+  topLeft = Vec::Vec2D(*xRange.first, *yRange.first);
+  bottomRight = Vec::Vec2D(*xRange.second, *yRange.second);
+}
+
+bool PointCloud::pointColors(const std::vector<COLORREF> &colors_) {
+  if (!colors_.empty() && (colors_.size() != xs.size())) {
+    return false;
+  }
+  colors = colors_;
+  return true;
+}
+
+Vec::Vec2D PointCloud::topLeftCoord() const {
+  return topLeft;
+}
+
+Vec::Vec2D PointCloud::bottomRightCoord() const {
+  return bottomRight;
+}
+
+float PointCloud::pickRadius(float zoom) const {
+  return (markerSize / 2.0f + 1.0f) / zoom;
+}
+
+bool PointCloud::pointInShape(int x, int y) {
+  return pointInView(x, y, 1.0f);
+}
+
+bool PointCloud::pointInView(int x, int y, float zoom) {
+  return pickPoint(x, y, pickRadius(zoom)) != -1;
+}
+
+int PointCloud::pointsInView(const float *xs_, const float *ys_, int count,
+                             float zoom, unsigned char *inside) {
+  float radius = pickRadius(zoom);
+  int total = 0;
+  for (int i = 0; i < count; i++) {
+    inside[i] = pickPoint(std::floor(xs_[i] + 0.5f), std::floor(ys_[i] + 0.5f),
+                          radius) != -1;
+    total += inside[i];
+  }
+  return total;
+}
+
+bool PointCloud::overlapsWithRegion(const Vec::Vec2D &topLeft_,
+                                    const Vec::Vec2D &bottomRight_) {
+  if (!BBoxOverlapsRegion(topLeft_, bottomRight_)) {
+    return false;
+  }
+  int points = xs.size();
+  for (int i = 0; i < points; i++) {
+    if (pointInRegion(Vec::Vec2D(xs[i], ys[i]), topLeft_, bottomRight_)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PointCloud::shapeInRegion(const Vec::Vec2D &topLeft_,
+                               const Vec::Vec2D &bottomRight_) {
+  return pointInRegion(topLeft, topLeft_, bottomRight_) &&
+         pointInRegion(bottomRight, topLeft_, bottomRight_);
+}
+
+std::vector<POINT> PointCloud::coords() const {
+  std::vector<POINT> coordVector;
+  int points = xs.size();
+  coordVector.reserve(points);
+  for (int i = 0; i < points; i++) {
+    coordVector.push_back(Vec::Vec2D(xs[i], ys[i]));
+  }
+  return coordVector;
+}
+
+void PointCloud::changeCoords(const std::vector<POINT> &coords) {
+  int points = coords.size();
+  xs.resize(points);
+  ys.resize(points);
+  for (int i = 0; i < points; i++) {
+    xs[i] = coords[i].x;
+    ys[i] = coords[i].y;
+  }
+  if (colors.size() != xs.size()) {
+    colors.clear();
+  }
+  updateBBoxCoords();
+  clearGrid();
+}
+
+void PointCloud::move(int xAmount, int yAmount) {
+  for (float &x : xs) {
+    x += xAmount;
+  }
+  for (float &y : ys) {
+    y += yAmount;
+  }
+  Vec::Vec2D vector(xAmount, yAmount);
+  topLeft = topLeft + vector;
+  bottomRight = bottomRight + vector;
+  // The points keep their cells
+  gridX += xAmount;
+  gridY += yAmount;
+}
+
+void PointCloud::scale(float originX, float originY,
+                       float xScale, float yScale) {
+  int points = xs.size();
+  for (int i = 0; i < points; i++) {
+    xs[i] = originX + (xs[i] - originX) * xScale;
+    ys[i] = originY + (ys[i] - originY) * yScale;
+  }
+  updateBBoxCoords();
+  clearGrid();
+}
+
+void PointCloud::rotate(float centerX, float centerY, float angle) {
+  float radians = angle * PI / 180.0f;
+  float cosine = std::cos(radians);
+  float sine = std::sin(radians);
+  int points = xs.size();
+  for (int i = 0; i < points; i++) {
+    float dx = xs[i] - centerX;
+    float dy = ys[i] - centerY;
+    xs[i] = centerX + dx * cosine + dy * sine;
+    ys[i] = centerY - dx * sine + dy * cosine;
+  }
+  updateBBoxCoords();
+  clearGrid();
+}
+
+void PointCloud::clearGrid() {
+  cellStart.clear();
+  cellPoints.clear();
+  columns = rows = 0;
+}
+
+void PointCloud::buildGrid() {
+  int points = xs.size();
+  float width = bottomRight.x - topLeft.x;
+  float height = bottomRight.y - topLeft.y;
+  // Aim for a handful of points per cell
+  float cells = std::max(points / 4, 1);
+  cellSize = std::sqrt(width * height / cells);
+  if (!(cellSize > 0.0f)) {
+    cellSize = std::max(std::max(width, height) / cells, 1.0f);
+  }
+  gridX = topLeft.x;
+  gridY = topLeft.y;
+  columns = static_cast<int>(width / cellSize) + 1;
+  rows = static_cast<int>(height / cellSize) + 1;
+  // Counting sort of the point indices by cell
+  std::vector<int> cellOf(points);
+  cellStart.assign(columns * rows + 1, 0);
+  for (int i = 0; i < points; i++) {
+    int column = std::min(int((xs[i] - gridX) / cellSize), columns - 1);
+    int row = std::min(int((ys[i] - gridY) / cellSize), rows - 1);
+    cellOf[i] = row * columns + column;
+    cellStart[cellOf[i] + 1]++;
+  }
+  for (int i = 0; i < columns * rows; i++) {
+    cellStart[i + 1] += cellStart[i];
+  }
+  cellPoints.resize(points);
+  std::vector<int> next(cellStart.begin(), cellStart.end() - 1);
+  for (int i = 0; i < points; i++) {
+    cellPoints[next[cellOf[i]]++] = i;
+  }
+}
+
+int PointCloud::pickPoint(float x, float y, float radius) {
+  if (xs.empty()) {
+    return -1;
+  }
+  if (cellStart.empty()) {
+    buildGrid();
+  }
+  int column1 = std::max(int(std::floor((x - radius - gridX) / cellSize)), 0);
+  int row1 = std::max(int(std::floor((y - radius - gridY) / cellSize)), 0);
+  int column2 = std::min(int(std::floor((x + radius - gridX) / cellSize)),
+                         columns - 1);
+  int row2 = std::min(int(std::floor((y + radius - gridY) / cellSize)),
+                      rows - 1);
+  int closest = -1;
+  float leastDistance = radius * radius;
+  for (int row = row1; row <= row2; row++) {
+    for (int column = column1; column <= column2; column++) {
+      int cell = row * columns + column;
+      for (int i = cellStart[cell]; i < cellStart[cell + 1]; i++) {
+        int index = cellPoints[i];
+        float dx = xs[index] - x;
+        float dy = ys[index] - y;
+        float distance = dx * dx + dy * dy;
+        if (distance <= leastDistance) {
+          leastDistance = distance;
+          closest = index;
+        }
+      }
+    }
+  }
+  return closest;
+}
+
+Vec::Vec2D PointCloud::closestPointTo(float x, float y) {
+  if (xs.empty()) {
+    return Shape::closestPointTo(x, y);
+  }
+  if (cellStart.empty()) {
+    buildGrid();
+  }
+  // Widen the search until a point turns up. Once the radius reaches the
+  // farthest corner of the bounding box every point is within it.
+  float farX = std::max(std::abs(x - topLeft.x), std::abs(x - bottomRight.x));
+  float farY = std::max(std::abs(y - topLeft.y), std::abs(y - bottomRight.y));
+  float farthest = std::sqrt(farX * farX + farY * farY);
+  float radius = cellSize;
+  while (true) {
+    int index = pickPoint(x, y, radius);
+    if (index >= 0) {
+      return Vec::Vec2D(xs[index], ys[index]);
+    }
+    if (radius > farthest) {
       break;
+    }
+    radius *= 2.0f;
   }
+  return Shape::closestPointTo(x, y);
 }
 
-std::vector<POINT> LineArc::coords() const {
-  std::vector<POINT> coordVector = BBoxCoords();
-  coordVector.push_back(static_cast<POINT>(startPoint()));
-  coordVector.push_back(static_cast<POINT>(endPoint()));
+std::shared_ptr<Shape> PointCloud::clone() const {
+  return std::make_shared<PointCloud>(*this);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~[ InstanceGrid ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+const int InstanceGrid::MAX_CELLS;
+
+int InstanceGrid::cellOf(float coordinate) const {
+  // Clamped so that far off instances still land in a cell
+  float cell = std::floor(coordinate * inverseSize);
+  const float LIMIT = static_cast<float>(INT_MAX / 4);
+  cell = std::min(std::max(cell, -LIMIT), LIMIT);
+  return static_cast<int>(cell);
+}
+
+unsigned long long InstanceGrid::cellKey(int column, int row) {
+  return (static_cast<unsigned long long>(static_cast<unsigned>(column)) << 32) |
+         static_cast<unsigned>(row);
+}
+
+bool InstanceGrid::span(const Box &box, int *left, int *top, int *right,
+                        int *bottom) const {
+  *left = cellOf(box.x1);
+  *top = cellOf(box.y1);
+  *right = cellOf(box.x2);
+  *bottom = cellOf(box.y2);
+  return (static_cast<long long>(*right - *left) + 1) *
+         (static_cast<long long>(*bottom - *top) + 1) <= MAX_CELLS;
+}
+
+void InstanceGrid::build(const std::vector<Box> &boxes) {
+  clear();
+  double size = 0.0;
+  for (const Box &box : boxes) {
+    size += std::max(box.x2 - box.x1, box.y2 - box.y1);
+  }
+  if (!boxes.empty()) {
+    size /= boxes.size();
+  }
+  inverseSize = 1.0f / std::max(static_cast<float>(size), 1.0f);
+  int count = boxes.size();
+  for (int i = 0; i < count; i++) {
+    insert(i, boxes[i]);
+  }
+  isBuilt = true;
+}
+
+void InstanceGrid::insert(int index, const Box &box) {
+  int left, top, right, bottom;
+  if (!span(box, &left, &top, &right, &bottom)) {
+    oversized.push_back(index);
+    return;
+  }
+  for (int column = left; column <= right; column++) {
+    for (int row = top; row <= bottom; row++) {
+      cells[cellKey(column, row)].push_back(index);
+    }
+  }
+}
+
+void InstanceGrid::remove(int index, const Box &box) {
+  int left, top, right, bottom;
+  if (!span(box, &left, &top, &right, &bottom)) {
+    oversized.erase(std::find(oversized.begin(), oversized.end(), index));
+    return;
+  }
+  for (int column = left; column <= right; column++) {
+    for (int row = top; row <= bottom; row++) {
+      auto cell = cells.find(cellKey(column, row));
+      std::vector<int> &indices = cell->second;
+      indices.erase(std::find(indices.begin(), indices.end(), index));
+      if (indices.empty()) {
+        cells.erase(cell);
+      }
+    }
+  }
+}
+
+void InstanceGrid::clear() {
+  cells.clear();
+  oversized.clear();
+  isBuilt = false;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~[ Instances ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+int Instances::add(const Instance &instance) {
+  instances.push_back(instance);
+  int index = instances.size() - 1;
+  Box box = instanceBox(index);
+  if (index == 0) {
+    topLeft = Vec::Vec2D(box.x1, box.y1);
+    bottomRight = Vec::Vec2D(box.x2, box.y2);
+  } else {
+    topLeft = Vec::Vec2D(std::min(topLeft.x, box.x1),
+                         std::min(topLeft.y, box.y1));
+    bottomRight = Vec::Vec2D(std::max(bottomRight.x, box.x2),
+                             std::max(bottomRight.y, box.y2));
+  }
+  if (grid.built()) {
+    grid.insert(index, box);
+  }
+  return index;
+}
+
+void Instances::relocate(int index, const Instance &instance) {
+  Box before = instanceBox(index);
+  instances[index] = instance;
+  Box after = instanceBox(index);
+  if (grid.built()) {
+    grid.remove(index, before);
+    grid.insert(index, after);
+  }
+  // Only an instance that held an edge of the box can take it in
+  if (((before.x1 <= topLeft.x) && (after.x1 > before.x1)) ||
+      ((before.y1 <= topLeft.y) && (after.y1 > before.y1)) ||
+      ((before.x2 >= bottomRight.x) && (after.x2 < before.x2)) ||
+      ((before.y2 >= bottomRight.y) && (after.y2 < before.y2))) {
+    updateBBoxCoords();
+    return;
+  }
+  topLeft = Vec::Vec2D(std::min(topLeft.x, after.x1),
+                       std::min(topLeft.y, after.y1));
+  bottomRight = Vec::Vec2D(std::max(bottomRight.x, after.x2),
+                           std::max(bottomRight.y, after.y2));
+}
+
+bool Instances::place(int index, float x, float y, float scale) {
+  if ((index < 0) || (index >= static_cast<int>(instances.size()))) {
+    return false;
+  }
+  relocate(index, Instance {x, y, scale, instances[index].color});
+  return true;
+}
+
+bool Instances::place(int first, const std::vector<Instance> &placements) {
+  if ((first < 0) || (first + placements.size() > instances.size())) {
+    return false;
+  }
+  int count = placements.size();
+  for (int i = 0; i < count; i++) {
+    relocate(first + i, placements[i]);
+  }
+  return true;
+}
+
+Box Instances::instanceBox(int index) const {
+  const Instance &instance = instances[index];
+  Vec::Vec2D localTop = geometry->topLeftCoord();
+  Vec::Vec2D localBottom = geometry->bottomRightCoord();
+  float x1 = instance.x + localTop.x * instance.scale;
+  float y1 = instance.y + localTop.y * instance.scale;
+  float x2 = instance.x + localBottom.x * instance.scale;
+  float y2 = instance.y + localBottom.y * instance.scale;
+  return Box(std::min(x1, x2), std::min(y1, y2),
+             std::max(x1, x2), std::max(y1, y2));
+}
+
+void Instances::updateBBoxCoords() {
+  int count = instances.size();
+  if (count == 0) {
+    topLeft = bottomRight = Vec::Vec2D(0, 0);
+    return;
+  }
+  Box bounds = instanceBox(0);
+  for (int i = 1; i < count; i++) {
+    Box box = instanceBox(i);
+    bounds.x1 = std::min(bounds.x1, box.x1);
+    bounds.y1 = std::min(bounds.y1, box.y1);
+    bounds.x2 = std::max(bounds.x2, box.x2);
+    bounds.y2 = std::max(bounds.y2, box.y2);
+  }
+  topLeft = Vec::Vec2D(bounds.x1, bounds.y1);
+  bottomRight = Vec::Vec2D(bounds.x2, bounds.y2);
+}
+
+void Instances::prepareGrid() {
+  if (grid.built()) {
+    return;
+  }
+  std::vector<Box> boxes;
+  int count = instances.size();
+  boxes.reserve(count);
+  for (int i = 0; i < count; i++) {
+    boxes.push_back(instanceBox(i));
+  }
+  grid.build(boxes);
+}
+
+bool Instances::instanceHolds(int index, float x, float y) {
+  Box box = instanceBox(index);
+  const Instance &instance = instances[index];
+  if ((x < box.x1) || (x > box.x2) || (y < box.y1) || (y > box.y2) ||
+      (instance.scale == 0.0f)) {
+    return false;
+  }
+  float localX = (x - instance.x) / instance.scale;
+  float localY = (y - instance.y) / instance.scale;
+  return geometry->pointInShape(std::floor(localX + 0.5f),
+                                std::floor(localY + 0.5f));
+}
+
+int Instances::pickInstance(float x, float y) {
+  prepareGrid();
+  // Later instances are drawn above the earlier ones, so only the ones above
+  // the best found so far are tested
+  int topmost = -1;
+  grid.query(x, y, [&](int index) {
+    if ((index > topmost) && instanceHolds(index, x, y)) {
+      topmost = index;
+    }
+  });
+  return topmost;
+}
+
+Vec::Vec2D Instances::closestPointTo(float x, float y) {
+  Vec::Vec2D point(x, y);
+  Vec::Vec2D closest = Shape::closestPointTo(x, y);
+  float leastDistance = FLT_MAX;
+  int count = instances.size();
+  for (int i = 0; i < count; i++) {
+    const Instance &instance = instances[i];
+    Box box = instanceBox(i);
+    Vec::Vec2D bound = closestInBox(point, Vec::Vec2D(box.x1, box.y1),
+                                    Vec::Vec2D(box.x2, box.y2));
+    float dx = bound.x - x;
+    float dy = bound.y - y;
+    if ((dx * dx + dy * dy >= leastDistance) || (instance.scale == 0.0f)) {
+      continue;
+    }
+    float localX = (x - instance.x) / instance.scale;
+    float localY = (y - instance.y) / instance.scale;
+    Vec::Vec2D local = geometry->closestPointTo(localX, localY);
+    Vec::Vec2D candidate(instance.x + local.x * instance.scale,
+                         instance.y + local.y * instance.scale);
+    dx = candidate.x - x;
+    dy = candidate.y - y;
+    if (dx * dx + dy * dy < leastDistance) {
+      leastDistance = dx * dx + dy * dy;
+      closest = candidate;
+    }
+  }
+  return closest;
+}
+
+Vec::Vec2D Instances::topLeftCoord() const {
+  return topLeft;
+}
+
+Vec::Vec2D Instances::bottomRightCoord() const {
+  return bottomRight;
+}
+
+bool Instances::pointInShape(int x, int y) {
+  return pickInstance(x, y) != -1;
+}
+
+void Instances::prepareQueries() {
+  geometry->prepareQueries();
+  prepareGrid();
+}
+
+bool Instances::overlapsWithRegion(const Vec::Vec2D &topLeft_,
+                                   const Vec::Vec2D &bottomRight_) {
+  int count = instances.size();
+  for (int i = 0; i < count; i++) {
+    Box box = instanceBox(i);
+    if ((box.x2 < topLeft_.x) || (box.x1 > bottomRight_.x) ||
+        (box.y2 < topLeft_.y) || (box.y1 > bottomRight_.y)) {
+      continue;
+    }
+    const Instance &instance = instances[i];
+    if (instance.scale == 0.0f) {
+      continue;
+    }
+    // Take the region to the geometry's coordinates
+    float x1 = (topLeft_.x - instance.x) / instance.scale;
+    float y1 = (topLeft_.y - instance.y) / instance.scale;
+    float x2 = (bottomRight_.x - instance.x) / instance.scale;
+    float y2 = (bottomRight_.y - instance.y) / instance.scale;
+    Vec::Vec2D localTop(std::min(x1, x2), std::min(y1, y2));
+    Vec::Vec2D localBottom(std::max(x1, x2), std::max(y1, y2));
+    if (geometry->overlapsWithRegion(localTop, localBottom)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Instances::shapeInRegion(const Vec::Vec2D &topLeft_,
+                              const Vec::Vec2D &bottomRight_) {
+  return !instances.empty() && pointInRegion(topLeft, topLeft_, bottomRight_) &&
+         pointInRegion(bottomRight, topLeft_, bottomRight_);
+}
+
+std::vector<POINT> Instances::coords() const {
+  std::vector<POINT> coordVector;
+  for (const Instance &instance : instances) {
+    coordVector.push_back(Vec::Vec2D(instance.x, instance.y));
+  }
   return coordVector;
 }
+
+void Instances::changeCoords(const std::vector<POINT> &coords) {
+  int count = std::min(coords.size(), instances.size());
+  for (int i = 0; i < count; i++) {
+    instances[i].x = coords[i].x;
+    instances[i].y = coords[i].y;
+  }
+  grid.clear();
+  updateBBoxCoords();
+}
+
+void Instances::move(int xAmount, int yAmount) {
+  for (Instance &instance : instances) {
+    instance.x += xAmount;
+    instance.y += yAmount;
+  }
+  grid.clear();
+  Vec::Vec2D vector(xAmount, yAmount);
+  topLeft = topLeft + vector;
+  bottomRight = bottomRight + vector;
+}
+
+void Instances::scale(float originX, float originY,
+                      float xScale, float yScale) {
+  float factor = std::sqrt(std::fabs(xScale * yScale));
+  for (Instance &instance : instances) {
+    instance.x = originX + (instance.x - originX) * xScale;
+    instance.y = originY + (instance.y - originY) * yScale;
+    instance.scale *= factor;
+  }
+  grid.clear();
+  updateBBoxCoords();
+}
+
+void Instances::rotate(float centerX, float centerY, float angle) {
+  float radians = angle * PI / 180.0f;
+  float cosine = std::cos(radians);
+  float sine = std::sin(radians);
+  for (Instance &instance : instances) {
+    float dx = instance.x - centerX;
+    float dy = instance.y - centerY;
+    instance.x = centerX + dx * cosine + dy * sine;
+    instance.y = centerY - dx * sine + dy * cosine;
+  }
+  grid.clear();
+  updateBBoxCoords();
+}
+
+std::shared_ptr<Shape> Instances::clone() const {
+  auto copy = std::make_shared<Instances>(*this);
+  copy->geometry = geometry->clone();
+  return copy;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~[ Group ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void Group::updateBBoxCoords() {
+  if (children.empty()) {
+    topLeft = bottomRight = Vec::Vec2D(0, 0);
+    return;
+  }
+  topLeft = Vec::Vec2D(FLT_MAX, FLT_MAX);
+  bottomRight = Vec::Vec2D(-FLT_MAX, -FLT_MAX);
+  for (const auto &child : children) {
+    // The children draw their own outlines, which the group's pen doesn't
+    // cover when it's thinner
+    float border = child->penSize / 2.0f;
+    Vec::Vec2D childTop = child->topLeftCoord();
+    Vec::Vec2D childBottom = child->bottomRightCoord();
+    topLeft = Vec::Vec2D(std::min(topLeft.x, childTop.x - border),
+                         std::min(topLeft.y, childTop.y - border));
+    bottomRight = Vec::Vec2D(std::max(bottomRight.x, childBottom.x + border),
+                             std::max(bottomRight.y, childBottom.y + border));
+  }
+}
+
+Vec::Vec2D Group::topLeftCoord() const {
+  return topLeft;
+}
+
+Vec::Vec2D Group::bottomRightCoord() const {
+  return bottomRight;
+}
+
+Vec::Vec2D Group::closestPointTo(float x, float y) {
+  Vec::Vec2D closestPoint = BBoxCenter();
+  float leastDistance = FLT_MAX;
+  for (const auto &child : children) {
+    Vec::Vec2D point = child->closestPointTo(x, y);
+    float distance = point.magnitude(x, y);
+    if (distance < leastDistance) {
+      leastDistance = distance;
+      closestPoint = point;
+    }
+  }
+  return closestPoint;
+}
+
+bool Group::pointInShape(int x, int y) {
+  if (!pointInRegion(x, y, topLeft, bottomRight)) {
+    return false;
+  }
+  for (const auto &child : children) {
+    if (child->pointInShape(x, y)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Group::pointInView(int x, int y, float zoom) {
+  if (!pointInRegion(x, y, topLeft, bottomRight)) {
+    return false;
+  }
+  for (const auto &child : children) {
+    if (child->pointInView(x, y, zoom)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int Group::pointsInView(const float *xs, const float *ys, int count,
+                        float zoom, unsigned char *inside) {
+  int total = 0;
+  for (int i = 0; i < count; i++) {
+    inside[i] = pointInView(std::floor(xs[i] + 0.5f), std::floor(ys[i] + 0.5f),
+                            zoom);
+    total += inside[i];
+  }
+  return total;
+}
+
+bool Group::overlapsWithRegion(const Vec::Vec2D &topLeft_,
+                               const Vec::Vec2D &bottomRight_) {
+  if (!BBoxOverlapsRegion(topLeft_, bottomRight_)) {
+    return false;
+  }
+  for (const auto &child : children) {
+    if (child->overlapsWithRegion(topLeft_, bottomRight_)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Group::shapeInRegion(const Vec::Vec2D &topLeft_,
+                          const Vec::Vec2D &bottomRight_) {
+  return pointInRegion(topLeft, topLeft_, bottomRight_) &&
+         pointInRegion(bottomRight, topLeft_, bottomRight_);
+}
+
+void Group::changeCoords(const std::vector<POINT> &coords) {
+  if (coords.empty()) {
+    return;
+  }
+  Vec::Vec2D offset = Vec::Vec2D(coords[0]) - topLeft;
+  move(offset.x, offset.y);
+}
+
+void Group::move(int xAmount, int yAmount) {
+  for (const auto &child : children) {
+    child->move(xAmount, yAmount);
+  }
+  Vec::Vec2D vector(xAmount, yAmount);
+  topLeft = topLeft + vector;
+  bottomRight = bottomRight + vector;
+}
+
+void Group::scale(float originX, float originY, float xScale, float yScale) {
+  for (const auto &child : children) {
+    child->scale(originX, originY, xScale, yScale);
+  }
+  updateBBoxCoords();
+}
+
+void Group::rotate(float centerX, float centerY, float angle) {
+  for (const auto &child : children) {
+    child->rotate(centerX, centerY, angle);
+  }
+  updateBBoxCoords();
+}
+
+void Group::setFillColor(std::string fillColor_) {
+  Shape::setFillColor(fillColor_);
+  for (const auto &child : children) {
+    child->setFillColor(fillColor_);
+  }
+}
+
+void Group::setPenColor(std::string penColor_) {
+  Shape::setPenColor(penColor_);
+  for (const auto &child : children) {
+    child->setPenColor(penColor_);
+  }
+}
+
+void Group::prepareQueries() {
+  for (const auto &child : children) {
+    child->prepareQueries();
+  }
+}
+
+void Group::reuseCaches(const Shape &older) {
+  if (older.shapeType != GROUP) {
+    return;
+  }
+  const auto &olderChildren = static_cast<const Group &>(older).children;
+  // The children keep their order, so the older ones are found in one pass
+  size_t next = 0;
+  for (const auto &child : children) {
+    for (size_t i = next; i < olderChildren.size(); i++) {
+      if (olderChildren[i]->shapeID == child->shapeID) {
+        child->reuseCaches(*olderChildren[i]);
+        next = i + 1;
+        break;
+      }
+    }
+  }
+}
+
+std::shared_ptr<Shape> Group::clone() const {
+  auto copy = std::make_shared<Group>(*this);
+  for (auto &child : copy->children) {
+    child = child->clone();
+  }
+  return copy;
+}
@@ -6,20 +6,22 @@
 #ifndef Shapes_H_
 #define Shapes_H_
 
-#define _WIN32_WINNT 0x501
-
-#include <windows.h>
 #include <cstdio>
 #include <algorithm>
 #include <string>
 #include <cmath>
 #include <cfloat>
+#include <climits>
 #include <cassert>
 #include <vector>
+#include <deque>
+#include <unordered_map>
 #include <memory>
+#include <atomic>
+#include "./Platform.h"
 #include "./Vec2D.h"
 #include "./Colors.h"
-#include <wingdi.h>
+#include "./Tags.h"
 
 namespace Vec = Vector;
 
@@ -44,9 +46,7 @@ struct Shape;
 
 //! Returns __true__ if the two shapes are equal. The function is used in
 //! GC::Canvas::addShape
-bool areEqual(const std::shared_ptr<Shape> &first,
-              const std::shared_ptr<Shape> &second
-             );
+bool areEqual(const Shape *first, const Shape *second);
 
 //! Returns \b true if the point is inside the rectangular region.
 bool pointInRegion(int xCoord,
@@ -65,12 +65,278 @@ bool regionsOverlap(const Vec::Vec2D &top1,
                     const Vec::Vec2D &top2,
                     const Vec::Vec2D &bottom2);
 
+/*!
+ * \brief Returns \b true if the two line segments share at least a point.
+ *
+ * Segments that only touch at an end or lie on top of each other count.
+ */
+bool linesIntersect(const Vec::Vec2D &start1,
+                    const Vec::Vec2D &end1,
+                    const Vec::Vec2D &start2,
+                    const Vec::Vec2D &end2);
+
+/*!
+ * \brief Returns \b true if the line segment shares at least a point with the
+ * rectangular region.
+ *
+ * Uses the separating axis test so it only takes a few multiplications and
+ * no divisions: the two miss each other only if they don't overlap along x
+ * or y, or all the region's corners are on one side of the segment's line.
+ */
+bool segmentOverlapsRegion(const Vec::Vec2D &start,
+                           const Vec::Vec2D &end,
+                           const Vec::Vec2D &topLeft,
+                           const Vec::Vec2D &bottomRight);
+
+//! Returns \b true if `(x, y)` is inside the polygon, by the even-odd rule
+bool pointInPolygon(float x, float y, const std::vector<POINT> &points);
+
 //! Returns the top left coordinate in the list of coordinates
 Vec::Vec2D topLeftCoord(const std::vector<POINT> &coords);
 
 //! Returns the bottom right coordinate in the list of coordinates
 Vec::Vec2D bottomRightCoord(const std::vector<POINT> &coords);
 
+/*!
+ * \brief Scales the points relative to `(originX, originY)` in place.
+ *
+ * The bounding box of the transformed points is computed in the same pass and
+ * written to \p topLeft and \p bottomRight.
+ */
+void scalePoints(std::vector<POINT> *points,
+                 float originX,
+                 float originY,
+                 float xScale,
+                 float yScale,
+                 Vec::Vec2D *topLeft,
+                 Vec::Vec2D *bottomRight);
+
+/*!
+ * \brief Rotates the points anticlockwise(as seen on the screen) by \p angle
+ * degrees around `(centerX, centerY)` in place.
+ *
+ * \see scalePoints()
+ */
+void rotatePoints(std::vector<POINT> *points,
+                  float centerX,
+                  float centerY,
+                  float angle,
+                  Vec::Vec2D *topLeft,
+                  Vec::Vec2D *bottomRight);
+
+/*!
+ * \brief Simplifies the polyline using the Douglas-Peucker algorithm.
+ *
+ * Every point dropped is at most \p tolerance away from the simplified line.
+ * The first and last points are always kept.
+ */
+void simplifyPoints(const std::vector<POINT> &points,
+                    float tolerance,
+                    std::vector<POINT> *simplified);
+
+/*!
+ * \class DetailLevels
+ * \brief Caches simplified copies of a long list of points so that it can be
+ * drawn with fewer vertices when zoomed out.
+ *
+ * Level `k` allows an error of `MIN_TOLERANCE * 2^k` in canvas units. The
+ * levels are only built the first time they're needed.
+ */
+class DetailLevels {
+  public:
+    /*!
+     * \brief Returns the coarsest version of \p points whose error is within
+     * \p tolerance. \p points itself is returned when it's already short.
+     */
+    const std::vector<POINT> &select(const std::vector<POINT> &points,
+                                     float tolerance);
+
+    //! Moves the cached points along with the shape
+    void translate(int xAmount, int yAmount);
+
+    //! Discards the cached levels. Called when the points change shape.
+    void clear();
+
+    //! Lists with fewer points than this are always drawn as they are
+    static const int MIN_POINTS = 64;
+
+    //! The error allowed in the finest level
+    static constexpr float MIN_TOLERANCE = 0.5f;
+
+    //! The coarsest level that will be built
+    static const int MAX_LEVEL = 16;
+
+  private:
+    std::vector<std::vector<POINT>> levels;
+    std::vector<bool> isBuilt;
+};
+
+/*!
+ * \class EdgeSlabs
+ * \brief Buckets the edges of a large polygon into horizontal slabs so that
+ * the crossing test only looks at the edges spanning the point's row.
+ *
+ * About `sqrt(n)` slabs of equal height are used, each listing the edges whose
+ * vertical extent meets it. Built the first time a point is tested.
+ */
+class EdgeSlabs {
+  public:
+    //! Same result as pointInPolygon() but only visits one slab's edges
+    bool contains(float x, float y, const std::vector<POINT> &points);
+
+    /*!
+     * \brief Fills \p xs with the sorted x coordinates where the edges cross
+     * row \p y.
+     *
+     * A point on the row is inside when an odd number of them lie to its
+     * right, which gives the same answer as contains() for every point.
+     */
+    void crossings(float y, const std::vector<POINT> &points,
+                   std::vector<float> *xs);
+
+    //! Builds the slabs now if the polygon is large enough to need them
+    void prepare(const std::vector<POINT> &points);
+
+    //! Moves the slabs along with the polygon. The edges keep their indices.
+    void translate(int xAmount, int yAmount);
+
+    //! Discards the slabs. Called when the vertices change.
+    void clear();
+
+    //! Polygons with fewer vertices than this are tested edge by edge
+    static const int MIN_POINTS = 64;
+
+  private:
+    void build(const std::vector<POINT> &points);
+    int slabOf(float y) const;
+
+    //! The first and last rows covered by the slabs
+    float top = 0.0f;
+    float bottom = 0.0f;
+    float inverseHeight = 0.0f;
+    //! The edges of slab `k` are `edges[slabStarts[k]..slabStarts[k + 1])`,
+    //! edge `i` running from vertex `i - 1` to vertex `i`
+    std::vector<int> slabStarts;
+    std::vector<int> edges;
+    bool isBuilt = false;
+};
+
+/*!
+ * \class SegmentTree
+ * \brief A bounding box hierarchy over the segments of a long polyline.
+ *
+ * The leaves box runs of `LEAF_SIZE` consecutive segments and every level above
+ * boxes pairs from the one below, which suits traces whose consecutive points
+ * lie close together. The boxes are grown by the hit tolerance so that a query
+ * only needs the bare point or region. Built the first time it's queried.
+ */
+class SegmentTree {
+  public:
+    /*!
+     * \brief Calls `func(i)` for every segment from `points[i]` to
+     * `points[i + 1]` whose box, grown by \p padding, meets the region. Stops
+     * as soon as \p func returns \b true.
+     *
+     * The hierarchy is rebuilt when \p padding differs from the last one.
+     * \return \b true if \p func returned \b true
+     */
+    template<typename Function>
+    bool query(float left, float top, float right, float bottom, float padding,
+               const std::vector<POINT> &points, Function func) {
+      int segments = static_cast<int>(points.size()) - 1;
+      if (segments < MIN_POINTS) {
+        for (int i = 0; i < segments; i++) {
+          if (func(i)) {
+            return true;
+          }
+        }
+        return false;
+      }
+      if (!isBuilt || (padding != builtPadding)) {
+        build(points, padding);
+      }
+      // Depth first. A level at most doubles the nodes to look at, so the
+      // stack never holds more than one entry per level plus the root.
+      struct Node {
+        int level;
+        int index;
+      } stack[64];
+      int size = 0;
+      stack[size++] = {static_cast<int>(levels.size()) - 1, 0};
+      while (size > 0) {
+        Node node = stack[--size];
+        if (!levels[node.level][node.index].meets(left, top, right, bottom)) {
+          continue;
+        }
+        if (node.level > 0) {
+          int child = node.index * 2;
+          if (child + 1 < static_cast<int>(levels[node.level - 1].size())) {
+            stack[size++] = {node.level - 1, child + 1};
+          }
+          stack[size++] = {node.level - 1, child};
+          continue;
+        }
+        int last = std::min((node.index + 1) * LEAF_SIZE, segments);
+        for (int i = node.index * LEAF_SIZE; i < last; i++) {
+          if (segmentBox(points, i).meets(left, top, right, bottom) &&
+              func(i)) {
+            return true;
+          }
+        }
+      }
+      return false;
+    }
+
+    //! Builds the hierarchy now if the line is long enough to need one
+    void prepare(const std::vector<POINT> &points, float padding);
+
+    //! Moves the boxes along with the line
+    void translate(int xAmount, int yAmount);
+
+    //! Discards the hierarchy. Called when the points change.
+    void clear();
+
+    //! Lines with fewer segments than this are walked segment by segment
+    static const int MIN_POINTS = 64;
+
+    //! The number of segments boxed by a leaf
+    static const int LEAF_SIZE = 8;
+
+  private:
+    struct Box {
+      float left;
+      float top;
+      float right;
+      float bottom;
+
+      bool meets(float left_, float top_, float right_, float bottom_) const {
+        return (left <= right_) && (right >= left_) &&
+               (top <= bottom_) && (bottom >= top_);
+      }
+    };
+
+    //! The padded box of the segment from `points[i]` to `points[i + 1]`
+    Box segmentBox(const std::vector<POINT> &points, int i) const;
+    void build(const std::vector<POINT> &points, float padding);
+
+    //! `levels[0]` holds the leaves, the last level only the root
+    std::vector<std::vector<Box>> levels;
+    float builtPadding = 0.0f;
+    bool isBuilt = false;
+};
+
+#ifdef _WIN32
+//! Returns the scale factor of the world transform selected into the DC
+float drawingZoom(HDC paintDC);
+
+/*!
+ * \brief Draws the shape with its own pen and brush selected into the DC.
+ *
+ * Used by GC::Canvas when painting and by the shapes that draw others.
+ */
+void paintShape(HDC paintDC, Shape *shape);
+#endif
+
 //! Used to identify the shape. It's used in GC::Canvas::shapeType.
 enum ShapeType {
   //! Oval/ellipse
@@ -87,6 +353,14 @@ enum ShapeType {
   LINE,
   //! An arc
   LINE_ARC,
+  //! Streaming line plot
+  SERIES,
+  //! Scatter plot of many points
+  POINT_CLOUD,
+  //! One geometry drawn at many places
+  INSTANCES,
+  //! A group of shapes moved and styled together
+  GROUP,
   //! For indicating errors
   INVALID_SHAPE
 };
@@ -101,6 +375,41 @@ bool withinLineSegment(float x, float y,
                        const Vec::Vec2D &start,
                        const Vec::Vec2D &end);
 
+//! Returns the point of the box closest to \p point, the point itself if it's
+//! inside.
+Vec::Vec2D closestInBox(const Vec::Vec2D &point,
+                        const Vec::Vec2D &topLeft,
+                        const Vec::Vec2D &bottomRight);
+
+//! Returns the point of the line segment closest to \p point
+Vec::Vec2D closestOnSegment(const Vec::Vec2D &point,
+                            const Vec::Vec2D &start,
+                            const Vec::Vec2D &end);
+
+/*!
+ * \brief Returns the point of the outline closest to \p point.
+ *
+ * The outline joins the points in order, and the last one back to the first
+ * if \p closed is set. \p inside, if given, is set to whether the point is
+ * within the closed outline, using the even-odd rule like Poly::pointInShape.
+ */
+Vec::Vec2D closestOnOutline(const Vec::Vec2D &point,
+                            const std::vector<POINT> &points,
+                            bool closed,
+                            bool *inside = NULL);
+
+/*!
+ * \brief Returns the point of the ellipse's circumference closest to \p point.
+ *
+ * Uses David Eberly's bisection on the root of the distance function so it
+ * stays exact for thin ellipses and for points near the center.
+ * \see https://www.geometrictools.com/Documentation/DistancePointEllipseEllipsoid.pdf
+ */
+Vec::Vec2D closestOnEllipse(const Vec::Vec2D &point,
+                            const Vec::Vec2D &center,
+                            float radiusX,
+                            float radiusY);
+
 //! Types of arcs that can be drawn
 enum ArcType {
   //! A pie
@@ -125,6 +434,100 @@ struct ELLIPSE_POINTS {
   Vec::Vec2D second;
 };
 
+/*!
+ * \class EllipseParams
+ * \brief The ellipse inscribed in a bounding box, kept in the form the hit
+ * tests use so that they need neither `pow()` nor the virtual bound calls.
+ *
+ * \see Shape::ellipse
+ */
+struct EllipseParams {
+  float centerX = 0.0f, centerY = 0.0f;
+  float radiusX = 0.0f, radiusY = 0.0f;
+  //! `1 / radiusX²` and `1 / radiusY²`
+  float inverseX2 = 0.0f, inverseY2 = 0.0f;
+
+  //! Recomputes the parameters unless they were made from the same box
+  void update(const Vec::Vec2D &topLeft, const Vec::Vec2D &bottomRight);
+
+  //! The ellipse's equation at the point. Below 1 inside the ellipse.
+  float level(float x, float y) const {
+    float dx = x - centerX;
+    float dy = y - centerY;
+    return dx * dx * inverseX2 + dy * dy * inverseY2;
+  }
+
+  bool contains(float x, float y) const {
+    return level(x, y) <= 1.0f;
+  }
+
+  /*!
+   * \brief Tests \p count points at once. `inside[i]` is set to 1 for the
+   * points inside the ellipse and 0 for the rest.
+   * \returns The number of points inside
+   */
+  int contains(const float *xs, const float *ys, int count,
+               unsigned char *inside) const;
+
+  private:
+    //! The box the parameters were made from
+    float x1 = 0.0f, y1 = 0.0f, x2 = 0.0f, y2 = 0.0f;
+    bool isSet = false;
+};
+
+/*!
+ * \class ArcParams
+ * \brief The sector swept by an arc as direction vectors so that a point can
+ * be placed in it with cross products instead of angles.
+ *
+ * Offsets are from the ellipse's center with y pointing up, so anticlockwise
+ * on the screen is anticlockwise here too.
+ *
+ * \see LineArc::sector
+ */
+struct ArcParams {
+  //! Unit directions of the start and the end of the sweep
+  float startX = 1.0f, startY = 0.0f;
+  float endX = 1.0f, endY = 0.0f;
+  //! The points where the arc starts and ends
+  float chordStartX = 0.0f, chordStartY = 0.0f;
+  float chordEndX = 0.0f, chordEndY = 0.0f;
+  //! Side of the chord the arc bulges out to, 1 or -1
+  float arcSide = 1.0f;
+  //! The sweep is over 180 degrees
+  bool isReflex = false;
+  //! The sweep covers the whole ellipse
+  bool isFull = false;
+
+  //! Recomputes the parameters unless they were made from the same values
+  void update(const EllipseParams &ellipse, float tiltAngle, float pieSize);
+
+  //! Returns \b true if the direction `(dx, dy)` is within the sweep
+  bool contains(float dx, float dy) const {
+    if (isFull) {
+      return true;
+    }
+    float fromStart = startX * dy - startY * dx;
+    float toEnd = dx * endY - dy * endX;
+    if (isReflex) {
+      return (fromStart >= 0.0f) || (toEnd >= 0.0f);
+    }
+    return (fromStart >= 0.0f) && (toEnd >= 0.0f);
+  }
+
+  //! Returns \b true if `(dx, dy)` is on the same side of the chord as the arc
+  bool onArcSide(float dx, float dy) const {
+    float side = (chordEndX - chordStartX) * (dy - chordStartY) -
+                 (chordEndY - chordStartY) * (dx - chordStartX);
+    return isFull || (side * arcSide >= 0.0f);
+  }
+
+  private:
+    //! The values the parameters were made from
+    float radiusX = 0.0f, radiusY = 0.0f, tilt = 0.0f, pie = 0.0f;
+    bool isSet = false;
+};
+
 /*!
  * \enum BorderStyle
  * \brief Shape border/pen style
@@ -185,8 +588,8 @@ class Shape {
     //! Determines whether the shape will be shown/drawn.
     bool isDrawn = true;
 
-    //! Used to assign shape IDs
-    static int counterID;
+    //! Used to assign shape IDs. Shapes may be created on any thread.
+    static std::atomic<int> counterID;
 
     //! Specifies the shape's background color in hex notation
     std::string fillColor = "";
@@ -203,17 +606,20 @@ class Shape {
     //! The string to be displayed in text objects/shapes
     std::string text = "";
 
+    //! \see ellipse()
+    EllipseParams ellipseParams;
+
   public:
     ShapeType shapeType = INVALID_SHAPE;
 
     //! Changes the shape's font attributes
-    void setFontAttr(const FontAttr &fontProp);
+    virtual void setFontAttr(const FontAttr &fontProp);
 
     //! Returns the shape's text
     std::string getText();
 
     //! Changes the shape's text
-    void setText(const std::string &text_);
+    virtual void setText(const std::string &text_);
 
     //! Returns the shape's font attributes
     FontAttr getFontAttr();
@@ -254,15 +660,31 @@ class Shape {
     //! Identifies the shape uniquely
     int shapeID;
 
+    /*!
+     * \brief The shape's position in the canvas' display list. Shapes with a
+     * bigger value are drawn above those with a smaller one.
+     *
+     * It's maintained by GC::Canvas and lets it restore the drawing order of
+     * the shapes returned by a region query.
+     */
+    int stackOrder = 0;
+
+    /*!
+     * \brief Bumped by GC::Canvas every time the shape changes, so that a
+     * copy taken for an earlier scene snapshot can be reused while it's
+     * unchanged.
+     */
+    unsigned revision = 0;
+
     /*!
      * \brief Sets fill color.
      * \param[in] fillColor_ The hex color string. An empty string turns off
      *  filling.
      */
-    void setFillColor(std::string fillColor_);
+    virtual void setFillColor(std::string fillColor_);
 
     //! Sets pen color
-    void setPenColor(std::string penColor_);
+    virtual void setPenColor(std::string penColor_);
 
     //! Returns the shape's pen color
     std::string getPenColor();
@@ -276,8 +698,21 @@ class Shape {
     //! Returns the height of the bounding box
     int BBoxHeight();
 
-    //! Returns \b true if the shape has tag \p tagName
-    bool hasTag(std::string tagName);
+    /*!
+     * \brief Returns \b true if the shape has tag \p tagName.
+     *
+     * \p tagName can also be a tag expression like `a&&!b||c`. It's looked
+     * up with compileTags() on every call, so loops over many shapes should
+     * compile it once and use the overload taking the expression.
+     * \see TagExpression
+     */
+    bool hasTag(const std::string &tagName);
+
+    //! \overload hasTag(const std::string&)
+    bool hasTag(const TagExpression &expression);
+
+    //! The shape's tags as a set of tag ids. Kept in step with tags().
+    TagBits tagBits;
 
     //! Returns a struct `{x, y}` representing the bounding box's center.
     Vec::Vec2D BBoxCenter();
@@ -285,6 +720,24 @@ class Shape {
     //! Returns \b true if the coordinate is within the ellipse's circumference
     bool pointInEllipse(int x, int y);
 
+    /*!
+     * \brief Returns the ellipse inscribed in the bounding box.
+     *
+     * It's worked out again only after the bounding box has changed.
+     */
+    const EllipseParams &ellipse();
+
+    /*!
+     * \brief Tests \p count points at once, setting `inside[i]` to 1 for the
+     * points in the shape and 0 for the rest.
+     *
+     * Shapes with a cheap test, like Oval, override it to check all the
+     * points in one tight loop.
+     * \returns The number of points in the shape
+     */
+    virtual int pointsInShape(const float *xs, const float *ys, int count,
+                              unsigned char *inside);
+
     /*!
      *  \brief Returns \b true if the ellipse shares a point with the region.
      *
@@ -341,11 +794,23 @@ class Shape {
     //! Returns coordinate of the bottom right vertex of the bounding box
     virtual Vec::Vec2D topLeftCoord() const = 0;
 
-    /*! Returns the closest vertex in the shape to coordinate `(x, y)`
+    /*!
+     * \brief Returns the point of the shape closest to `(x, y)`.
      *
-     *  The method is used by Canvas::tagClosest
+     * A point inside a shape with an interior, e.g a rectangle or a pie, is
+     * returned as it is. Lines and arcs only have their outline. The default
+     * treats the shape as its bounding box.
+     *
+     * \see Canvas::findClosest
      */
-    virtual Vec::Vec2D closestPointTo(int x, int y);
+    virtual Vec::Vec2D closestPointTo(float x, float y);
+
+    /*!
+     * \brief Returns the distance from `(x, y)` to the shape.
+     *
+     * Measured to the edge of the pen so it's 0 over a thick outline.
+     */
+    float distanceTo(float x, float y);
 
     //! \overload bool pointInShape(int x1, int y) = 0;
     virtual bool pointInShape(const Vec::Vec2D &point);
@@ -354,6 +819,20 @@ class Shape {
     //! Used in mouse click events.
     virtual bool pointInShape(int x1, int y) = 0;
 
+    /*!
+     * \brief Returns \b true if the point is within the shape as drawn in a
+     * view zoomed by \p zoom.
+     *
+     * Only the parts sized in pixels, like the markers of a PointCloud,
+     * depend on the zoom. The rest of the shapes answer as pointInShape().
+     */
+    virtual bool pointInView(int x, int y, float zoom);
+
+    //! Same as pointsInShape() for a view zoomed by \p zoom
+    //! \see pointInView()
+    virtual int pointsInView(const float *xs, const float *ys, int count,
+                             float zoom, unsigned char *inside);
+
     /*!
      * \brief Returns \b true if the shape shares a point with the region
      * specified.
@@ -369,6 +848,15 @@ class Shape {
     virtual bool shapeInRegion(const Vec::Vec2D &topLeft,
                                const Vec::Vec2D &bottomRight);
 
+    /*!
+     * \brief Builds the structures the hit tests otherwise build on first use.
+     *
+     * The tests then only read the shape, so several threads can run them on
+     * it at once. Used on the copies in a GC::Snapshot.
+     */
+    virtual void prepareQueries();
+
+#ifdef _WIN32
     /*!
      * \brief Responsible for drawing the shapes on the screen using *WinAPI's*
      * *GDI* functions.
@@ -377,6 +865,23 @@ class Shape {
      * The message is handled by Canvas::handleMessage.
      */
     virtual void draw(HDC paintDC) = 0;
+#endif
+
+    /*!
+     * \brief Returns a copy of the shape with the same id. Groups and
+     * instances copy the shapes they hold too, so the copy shares nothing
+     * that can be changed with the original.
+     */
+    virtual std::shared_ptr<Shape> clone() const = 0;
+
+    /*!
+     * \brief Lets a copy take over the drawing caches of an older copy of the
+     * same item, e.g the one in the scene drawn before.
+     *
+     * The two then share the caches, so they must be drawn by the same thread
+     * and the older one never after this one.
+     */
+    virtual void reuseCaches(const Shape &older);
 
     /*!
      * \brief Returns a vector with all the shape's points
@@ -394,6 +899,24 @@ class Shape {
     //! Moves the shape by the specified amount
     virtual void move(int xAmount, int yAmount);
 
+    /*!
+     * \brief Scales the shape's coordinates relative to `(originX, originY)`.
+     *
+     * Shapes described by their bounding box have the two corners scaled.
+     * Negative factors flip the shape.
+     */
+    virtual void scale(float originX, float originY, float xScale, float yScale);
+
+    /*!
+     * \brief Rotates the shape anticlockwise by \p angle degrees around
+     * `(centerX, centerY)`.
+     *
+     * GDI can only draw axis aligned rectangles and ellipses so shapes
+     * described by their bounding box only have their center rotated, through
+     * move(). Their size is kept.
+     */
+    virtual void rotate(float centerX, float centerY, float angle);
+
     //! \see LineArc::coords
     std::vector<POINT> BBoxCoords() const;
 
@@ -402,6 +925,7 @@ class Shape {
     explicit Shape(ShapeType shapeType_) {
       shapeType = shapeType_;
       shapeID = counterID++;
+      tagBits.set(tagID("all"));
     }
 };
 
@@ -411,16 +935,30 @@ class Shape {
  */
 struct Poly : Shape {
   std::vector<POINT> polyCoords;
-  POINT coordinates[1000];
-  float yCoords[1000];
-  float xCoords[1000];
+  //! Simplified outlines used when the polygon is drawn zoomed out
+  DetailLevels detailLevels;
+  //! Speeds up pointInShape() on polygons with many vertices
+  EdgeSlabs edgeSlabs;
   virtual std::vector<POINT> coords() const override;
   virtual Vec::Vec2D bottomRightCoord() const override;
   virtual Vec::Vec2D topLeftCoord() const override;
-  virtual Vec::Vec2D closestPointTo(int x, int y) override;
+  virtual Vec::Vec2D closestPointTo(float x, float y) override;
   virtual bool pointInShape(int x_, int y_) override;
+  //! Works out each row's crossings once for all the points on it
+  virtual int pointsInShape(const float *xs, const float *ys, int count,
+                            unsigned char *inside) override;
+  virtual void prepareQueries() override;
+#ifdef _WIN32
   virtual void draw(HDC paintDC) override;
+#endif
+  virtual std::shared_ptr<Shape> clone() const override;
   virtual void move(int xAmount, int yAmount) override;
+  virtual void scale(float originX, float originY,
+                     float xScale, float yScale) override;
+  virtual void rotate(float centerX, float centerY, float angle) override;
+
+  //! Recomputes the cached bounding box from the vertices
+  void updateBBoxCoords();
 
   virtual bool overlapsWithRegion(const Vec::Vec2D &topLeft,
                                   const Vec::Vec2D &bottomRight) override;
@@ -432,6 +970,7 @@ struct Poly : Shape {
   explicit Poly(const std::vector<POINT> &points) : Shape(POLYGON) {
     addTag("polygon");
     polyCoords = points;
+    updateBBoxCoords();
   }
 };
 
@@ -443,7 +982,12 @@ struct Rect : Shape {
   virtual Vec::Vec2D bottomRightCoord() const override;
   virtual Vec::Vec2D topLeftCoord() const override;
   virtual bool pointInShape(int x, int y) override;
+  virtual int pointsInShape(const float *xs, const float *ys, int count,
+                            unsigned char *inside) override;
+#ifdef _WIN32
   virtual void draw(HDC paintDC) override;
+#endif
+  virtual std::shared_ptr<Shape> clone() const override;
 
   virtual bool overlapsWithRegion(const Vec::Vec2D &topLeft,
                                   const Vec::Vec2D &bottomRight) override;
@@ -488,11 +1032,18 @@ struct Text : Shape {
   virtual Vec::Vec2D topLeftCoord() const override;
   virtual bool pointInShape(int x, int y) override;
 
+#ifdef _WIN32
   //! Returns the size of the text area
   POINT textArea(HDC paintDC);
   void createFont(HFONT *font);
+#endif
   virtual void move(int xAmount, int yAmount) override;
 
+  //! Only the text's anchor is scaled. The font size is left intact.
+  virtual void scale(float originX, float originY,
+                     float xScale, float yScale) override;
+
+#ifdef _WIN32
   /*!
    * \brief Draws the text on the screen.
    *
@@ -501,15 +1052,29 @@ struct Text : Shape {
    *
    */
   virtual void draw(HDC paintDC) override;
+#endif
+  virtual std::shared_ptr<Shape> clone() const override;
 
   virtual bool overlapsWithRegion(const Vec::Vec2D &topLeft,
                                   const Vec::Vec2D &bottomRight) override;
 
+  virtual void setText(const std::string &text_) override;
+  virtual void setFontAttr(const FontAttr &fontProp) override;
+
+  /*!
+   * \brief Gives the text a generous bounding box until draw() measures the
+   * real one.
+   *
+   * The box is used to decide whether the text is visible so it errs on the
+   * big side.
+   */
+  void estimateBBoxCoords();
+
   Text(int x, int y, const std::string &text_, int width_) : Shape(TEXT) {
     addTag("text");
     width = (width_ < 0) ? 0 : width_;
-    setText(text_);
     start = {x, y};
+    setText(text_);
   }
 };
 
@@ -520,8 +1085,16 @@ struct Text : Shape {
 struct Oval : Shape {
   virtual Vec::Vec2D bottomRightCoord() const override;
   virtual Vec::Vec2D topLeftCoord() const override;
+  virtual Vec::Vec2D closestPointTo(float x, float y) override;
   virtual bool pointInShape(int x, int y) override;
+  virtual int pointsInShape(const float *xs, const float *ys, int count,
+                            unsigned char *inside) override;
+#ifdef _WIN32
   virtual void draw(HDC paintDC) override;
+#endif
+  virtual std::shared_ptr<Shape> clone() const override;
+  //! Works out the ellipse parameters
+  virtual void prepareQueries() override;
 
   virtual bool overlapsWithRegion(const Vec::Vec2D &topLeft,
                                   const Vec::Vec2D &bottomRight) override;
@@ -542,7 +1115,10 @@ struct Circle : Oval {
   int radius;
   virtual Vec::Vec2D bottomRightCoord() const override;
   virtual Vec::Vec2D topLeftCoord() const override;
+#ifdef _WIN32
   virtual void draw(HDC paintDC) override;
+#endif
+  virtual std::shared_ptr<Shape> clone() const override;
 
   /*!
    * The first coordinates is taken to be the center and the x-coordinates of
@@ -554,6 +1130,14 @@ struct Circle : Oval {
    */
   void changeCoords(const std::vector<POINT> &coords);
   void updateBBoxCoords();
+  virtual void move(int xAmount, int yAmount) override;
+
+  /*!
+   * The center is scaled like any other point. The radius is multiplied by
+   * the geometric mean of the two factors so that the circle stays a circle.
+   */
+  virtual void scale(float originX, float originY,
+                     float xScale, float yScale) override;
   Circle(int x, int y, int rad) : Oval(x - rad, y - rad, x + rad, y + rad) {
     addTag("circle");
     center = {x, y};
@@ -567,13 +1151,28 @@ struct Circle : Oval {
  */
 struct Line : Shape {
   std::vector<POINT> lineCoords;
+  //! Simplified lines used when the line is drawn zoomed out
+  DetailLevels detailLevels;
+  //! Narrows hit tests on long lines down to the nearby segments
+  SegmentTree segmentTree;
 
   virtual Vec::Vec2D bottomRightCoord() const override;
   virtual Vec::Vec2D topLeftCoord() const override;
+  virtual Vec::Vec2D closestPointTo(float x, float y) override;
+#ifdef _WIN32
   virtual void draw(HDC paintDC) override;
+#endif
+  virtual std::shared_ptr<Shape> clone() const override;
   virtual bool pointInShape(int x, int y) override;
+  virtual void prepareQueries() override;
   virtual std::vector<POINT> coords() const override;
   virtual void move(int xAmount, int yAmount) override;
+  virtual void scale(float originX, float originY,
+                     float xScale, float yScale) override;
+  virtual void rotate(float centerX, float centerY, float angle) override;
+
+  //! Recomputes the cached bounding box from the points
+  void updateBBoxCoords();
 
   virtual bool overlapsWithRegion(const Vec::Vec2D &topLeft,
                                   const Vec::Vec2D &bottomRight) override;
@@ -586,10 +1185,14 @@ struct Line : Shape {
                    float x,
                    float y);
 
+  //! How far from a segment pointInLine() can accept a point
+  float hitPadding() const;
+
   virtual void changeCoords(const std::vector<POINT> &coords) override;
   explicit Line(const std::vector<POINT> &points) : Shape(LINE) {
     addTag("line");
     lineCoords = points;
+    updateBBoxCoords();
   }
 };
 
@@ -639,7 +1242,7 @@ struct LineArc : Shape {
   bool pointInPie(int x, int y);
 
   /*!
-   * \brief Returns \b true if the point is within the pie region.
+   * \brief Returns \b true if the point is within the chord region.
    */
   bool pointInChord(int x, int y);
 
@@ -686,13 +1289,35 @@ struct LineArc : Shape {
 
   virtual Vec::Vec2D bottomRightCoord() const override;
   virtual Vec::Vec2D topLeftCoord() const override;
+
+  //! Only the arc line is considered for ARC, the area for PIE and CHORD.
+  virtual Vec::Vec2D closestPointTo(float x, float y) override;
+
   bool pointInShape(const Vec::Vec2D &point);
   virtual bool pointInShape(int x, int y) override;
+  virtual int pointsInShape(const float *xs, const float *ys, int count,
+                            unsigned char *inside) override;
+
+  //! Returns the sector swept by the arc, worked out again only after the
+  //! bounding box or the angles have changed
+  const ArcParams &sector();
+#ifdef _WIN32
   virtual void draw(HDC paintDC) override;
+#endif
+  virtual std::shared_ptr<Shape> clone() const override;
+  //! Works out the ellipse and the sector
+  virtual void prepareQueries() override;
 
   virtual bool overlapsWithRegion(const Vec::Vec2D &topLeft,
                                   const Vec::Vec2D &bottomRight) override;
 
+  //! Negative factors mirror the start and end angles as well.
+  virtual void scale(float originX, float originY,
+                     float xScale, float yScale) override;
+
+  //! The tilt angle is rotated along with the center.
+  virtual void rotate(float centerX, float centerY, float angle) override;
+
   LineArc(int x1,
           int y1,
           int x2,
@@ -707,6 +1332,252 @@ struct LineArc : Shape {
     topLeft = {x1, y1};
     bottomRight = {x2, y2};
   }
+
+  private:
+    ArcParams arcParams;
+};
+
+/*!
+ * \class Series
+ * \brief An append-only line plot for live data, e.g telemetry.
+ *
+ * The last `capacity()` samples are kept in chunks of CHUNK_SIZE. Appending
+ * only writes to the last chunk and the oldest chunk is dropped once it has
+ * scrolled out, so appending never copies the older samples. The x values
+ * are expected to grow, e.g timestamps, and the plot scrolls to keep the
+ * latest sample at the right edge of the box, showing the last `span` units.
+ *
+ * Every pixel column is drawn as a vertical line from the smallest to the
+ * biggest sample in it, so drawing depends on the width of the box rather
+ * than the number of samples. The plot is cached in a bitmap and after an
+ * append only the columns that scrolled into view are drawn again.
+ *
+ * A copy shares the full chunks with the original, since they never change,
+ * and only copies the last one. The copies the render thread draws also
+ * hand the cached plot on from one scene to the next, \see reuseCaches().
+ */
+struct Series : Shape {
+  //! Number of samples in a chunk
+  static const int CHUNK_SIZE = 1024;
+
+  //! The samples, oldest first starting from `head` in the first chunk
+  std::deque<std::shared_ptr<std::vector<Vec::Vec2D>>> chunks;
+
+  //! Index of the oldest sample in the first chunk
+  int head = 0;
+
+  //! Number of samples kept
+  int count = 0;
+
+  //! Width of the plot in x units
+  float span;
+
+  //! The values at the bottom and top edges of the box
+  float low = 0.0f, high = 1.0f;
+
+  //! x value of the first sample ever appended. The plot starts there.
+  float startX = 0.0f;
+
+  //! Appends a sample, overwriting the oldest one if the buffer is full
+  void append(float x, float y);
+
+  //! \overload append(float, float)
+  void append(const std::vector<Vec::Vec2D> &newSamples);
+
+  //! Returns the sample at \p index where 0 is the oldest sample
+  Vec::Vec2D sample(int index) const;
+
+  //! Returns the number of samples the buffer can hold
+  int capacity() const;
+
+  //! Changes the values shown at the bottom and top edges of the box
+  void valueRange(float low_, float high_);
+
+  //! Changes the width of the plot in x units
+  void timeSpan(float span_);
+
+  virtual Vec::Vec2D bottomRightCoord() const override;
+  virtual Vec::Vec2D topLeftCoord() const override;
+  virtual bool pointInShape(int x, int y) override;
+#ifdef _WIN32
+  virtual void draw(HDC paintDC) override;
+#endif
+  virtual std::shared_ptr<Shape> clone() const override;
+  //! Takes over the older copy's cached plot
+  virtual void reuseCaches(const Shape &older) override;
+
+  virtual bool overlapsWithRegion(const Vec::Vec2D &topLeft,
+                                  const Vec::Vec2D &bottomRight) override;
+
+  Series(int x1, int y1, int x2, int y2, int capacity_) : Shape(SERIES) {
+    addTag("series");
+    topLeft = {x1, y1};
+    bottomRight = {x2, y2};
+    maxCount = std::max(capacity_, 1);
+    span = maxCount;
+  }
+
+  private:
+    /*!
+     * \brief The rendered plot and the state of the series it shows. Only
+     * read and written by the thread that draws the series.
+     */
+    struct StripCache {
+#ifdef _WIN32
+      HDC dc = NULL;
+      HBITMAP bitmap = NULL;
+      HGDIOBJ oldBitmap = NULL;
+#endif
+      int width = 0;
+      int height = 0;
+      int penSize = 0;
+      std::string penColor;
+      std::string fillColor;
+      //! The `layout` the plot was drawn with
+      unsigned layout = 0;
+      //! The `appended` count when the plot was last drawn
+      long long drawn = -1;
+      //! Index of the rightmost pixel column, counted from x = 0
+      long long lastColumn = 0;
+      //! Cleared when the plot has to be drawn from scratch
+      bool isValid = false;
+
+      StripCache() {}
+#ifdef _WIN32
+      ~StripCache() {
+        release();
+      }
+      void release();
+#endif
+
+      private:
+        StripCache(const StripCache &);
+        StripCache &operator=(const StripCache &);
+    };
+
+    //! A copy starts with an empty one
+    std::shared_ptr<StripCache> strip;
+
+    int maxCount;
+    //! Number of samples ever appended
+    long long appended = 0;
+    //! Bumped when the plot has to be drawn again from scratch
+    unsigned layout = 0;
+
+    //! Returns the index of the first sample whose x value isn't less than \p x
+    int lowerBound(double x) const;
+
+#ifdef _WIN32
+    /*!
+     * \brief Draws pixel columns \p first to \p last into the cache.
+     * \p firstVisible is the column at the left edge of the bitmap.
+     */
+    void drawColumns(long long first,
+                     long long last,
+                     long long firstVisible,
+                     double columnWidth);
+#endif
+};
+
+/*!
+ * \class PointCloud
+ * \brief Holds a large number of points in one shape, e.g a scatter plot.
+ *
+ * The coordinates are kept in two float arrays and the optional colours in a
+ * third, so a point costs 8 bytes, or 12 with a colour, instead of a whole
+ * shape.
+ *
+ * The points are drawn as square markers `markerSize` pixels wide. Points
+ * falling in the same marker sized cell of the window are drawn as a single
+ * marker with the colour of the last one, so drawing depends on the area
+ * covered rather than the number of points.
+ */
+struct PointCloud : Shape {
+  std::vector<float> xs;
+  std::vector<float> ys;
+
+  //! Per point colours. Empty if all the points use the fill/pen colour.
+  std::vector<COLORREF> colors;
+
+  //! Width of the markers in pixels
+  int markerSize = 3;
+
+  /*!
+   * \brief Returns the index of the point closest to `(x, y)` within
+   * \p radius, or -1 if there isn't one.
+   *
+   * A grid of the points is built the first time it's called.
+   */
+  int pickPoint(float x, float y, float radius);
+
+  /*!
+   * \brief Returns how far from a point, in canvas units, the point can be
+   * picked in a view zoomed by \p zoom. It covers the marker, which keeps its
+   * size in pixels whatever the zoom, and one pixel more.
+   */
+  float pickRadius(float zoom) const;
+
+  //! Sets the per point colours. Returns __false__ if the sizes don't match.
+  bool pointColors(const std::vector<COLORREF> &colors_);
+
+  //! Recomputes the bounding box from the points
+  void updateBBoxCoords();
+
+  virtual Vec::Vec2D bottomRightCoord() const override;
+  virtual Vec::Vec2D topLeftCoord() const override;
+  //! Returns the sample closest to `(x, y)`
+  virtual Vec::Vec2D closestPointTo(float x, float y) override;
+  //! Tests the markers as drawn without zooming
+  virtual bool pointInShape(int x, int y) override;
+  virtual bool pointInView(int x, int y, float zoom) override;
+  virtual int pointsInView(const float *xs, const float *ys, int count,
+                           float zoom, unsigned char *inside) override;
+  virtual std::vector<POINT> coords() const override;
+  virtual void changeCoords(const std::vector<POINT> &coords) override;
+  virtual void move(int xAmount, int yAmount) override;
+  virtual void scale(float originX, float originY,
+                     float xScale, float yScale) override;
+  virtual void rotate(float centerX, float centerY, float angle) override;
+#ifdef _WIN32
+  virtual void draw(HDC paintDC) override;
+#endif
+  virtual std::shared_ptr<Shape> clone() const override;
+
+  virtual bool overlapsWithRegion(const Vec::Vec2D &topLeft,
+                                  const Vec::Vec2D &bottomRight) override;
+
+  virtual bool shapeInRegion(const Vec::Vec2D &topLeft,
+                             const Vec::Vec2D &bottomRight) override;
+
+  PointCloud(const std::vector<float> &xs_,
+             const std::vector<float> &ys_,
+             int markerSize_ = 3) : Shape(POINT_CLOUD) {
+    addTag("pointcloud");
+    size_t points = std::min(xs_.size(), ys_.size());
+    xs.assign(xs_.begin(), xs_.begin() + points);
+    ys.assign(ys_.begin(), ys_.begin() + points);
+    markerSize = std::max(markerSize_, 1);
+    updateBBoxCoords();
+  }
+
+  private:
+    //! Sorts the point indices into cells so pickPoint only visits nearby ones
+    void buildGrid();
+
+    //! Drops the grid. It's rebuilt on the next pickPoint.
+    void clearGrid();
+
+    //! Top left corner of the grid
+    float gridX = 0.0f, gridY = 0.0f;
+    float cellSize = 1.0f;
+    int columns = 0, rows = 0;
+
+    //! The points in cell `i` are `cellPoints[cellStart[i]..cellStart[i + 1]]`
+    std::vector<int> cellStart;
+    std::vector<int> cellPoints;
+
+    //! The marker cells, reused between draws
+    std::vector<COLORREF> bins;
 };
 
 /*!
@@ -756,6 +1627,248 @@ struct Box {
   }
 };
 
+/*!
+ * \struct Instance
+ * \brief Where and how an GS::Instances item draws its geometry once.
+ */
+struct Instance {
+  //! Where the geometry's origin is placed
+  float x, y;
+  //! Size relative to the geometry
+  float scale;
+  //! Fill colour. CLR_INVALID uses the item's fill colour.
+  COLORREF color;
+};
+
+/*!
+ * \class InstanceGrid
+ * \brief Files the instances of an GS::Instances item under the square cells
+ * their boxes cover, so that picking only tests the ones near the point.
+ *
+ * The cells are about as wide as the mean instance. An instance covering more
+ * than `MAX_CELLS` of them is kept in a list of its own that every query goes
+ * over. Built the first time an instance is picked and then kept up to date
+ * as single instances move.
+ */
+class InstanceGrid {
+  public:
+    /*!
+     * \brief Calls `func(i)` for every instance `i` whose box may hold the
+     * point, in no particular order.
+     */
+    template<typename Function>
+    void query(float x, float y, Function func) const {
+      auto cell = cells.find(cellKey(cellOf(x), cellOf(y)));
+      if (cell != cells.end()) {
+        for (int index : cell->second) {
+          func(index);
+        }
+      }
+      for (int index : oversized) {
+        func(index);
+      }
+    }
+
+    //! Files every instance, `boxes[i]` being the box of instance `i`
+    void build(const std::vector<Box> &boxes);
+
+    //! Files an instance under the cells \p box covers
+    void insert(int index, const Box &box);
+
+    //! Takes an instance out of the cells \p box, where it was filed, covers
+    void remove(int index, const Box &box);
+
+    //! Discards the cells. Called when all the instances change.
+    void clear();
+
+    bool built() const {
+      return isBuilt;
+    }
+
+    //! Instances covering more cells than this are kept in `oversized`
+    static const int MAX_CELLS = 16;
+
+  private:
+    int cellOf(float coordinate) const;
+    static unsigned long long cellKey(int column, int row);
+    //! Finds the cells the box covers. Returns __false__ if there are too many.
+    bool span(const Box &box, int *left, int *top, int *right,
+              int *bottom) const;
+
+    float inverseSize = 1.0f;
+    std::unordered_map<unsigned long long, std::vector<int>> cells;
+    std::vector<int> oversized;
+    bool isBuilt = false;
+};
+
+/*!
+ * \class Instances
+ * \brief Draws one shared geometry at many places, e.g the same polygon
+ * stamped thousands of times.
+ *
+ * The geometry's coordinates are relative to its own origin and each
+ * instance only stores its offset, scale and colour. Drawing, hit testing and
+ * region queries test every instance's bounding box first and then pass the
+ * point or region to the geometry in its own coordinates. Picking only tests
+ * the instances a GS::InstanceGrid files near the point.
+ */
+struct Instances : Shape {
+  //! The shape drawn for every instance. It isn't on the canvas itself.
+  std::shared_ptr<Shape> geometry;
+
+  std::vector<Instance> instances;
+
+  //! Adds an instance and returns its index
+  int add(const Instance &instance);
+
+  /*!
+   * \brief Moves and resizes an instance. Returns __false__ if there isn't
+   * one.
+   *
+   * The bounding box only grows to take the new place in, unless the
+   * instance was on its edge and left it, which has it computed again.
+   */
+  bool place(int index, float x, float y, float scale);
+
+  /*!
+   * \brief Changes the instances from \p first on to \p placements, colours
+   * included. Returns __false__ if some of them don't exist.
+   */
+  bool place(int first, const std::vector<Instance> &placements);
+
+  //! Returns the instance's bounding box
+  Box instanceBox(int index) const;
+
+  /*!
+   * \brief Returns the index of the topmost instance covering `(x, y)`, or
+   * -1 if there isn't one.
+   */
+  int pickInstance(float x, float y);
+
+  //! Recomputes the bounding box of all the instances
+  void updateBBoxCoords();
+
+  //! Files the instances in `grid` now, e.g so that copies never have to
+  void prepareGrid();
+
+  virtual Vec::Vec2D bottomRightCoord() const override;
+  virtual Vec::Vec2D topLeftCoord() const override;
+  //! Returns the closest point of all the instances' geometry
+  virtual Vec::Vec2D closestPointTo(float x, float y) override;
+  virtual bool pointInShape(int x, int y) override;
+
+  //! Returns the position of every instance
+  virtual std::vector<POINT> coords() const override;
+
+  //! Moves the instances to the points. Extra points are ignored.
+  virtual void changeCoords(const std::vector<POINT> &coords) override;
+
+  virtual void move(int xAmount, int yAmount) override;
+
+  //! The positions are scaled and the instances resized by the mean factor
+  virtual void scale(float originX, float originY,
+                     float xScale, float yScale) override;
+
+  //! Only the positions are rotated. The geometry keeps its orientation.
+  virtual void rotate(float centerX, float centerY, float angle) override;
+
+#ifdef _WIN32
+  virtual void draw(HDC paintDC) override;
+#endif
+  virtual std::shared_ptr<Shape> clone() const override;
+  //! Prepares the geometry the instances share and files the instances
+  virtual void prepareQueries() override;
+
+  virtual bool overlapsWithRegion(const Vec::Vec2D &topLeft,
+                                  const Vec::Vec2D &bottomRight) override;
+
+  virtual bool shapeInRegion(const Vec::Vec2D &topLeft,
+                             const Vec::Vec2D &bottomRight) override;
+
+  explicit Instances(const std::shared_ptr<Shape> &geometry_)
+    : Shape(INSTANCES) {
+    addTag("instances");
+    geometry = geometry_;
+  }
+
+  private:
+    //! Returns __true__ if instance \p index covers `(x, y)`
+    bool instanceHolds(int index, float x, float y);
+    //! Moves instance \p index, keeping the bounding box and `grid` in step
+    void relocate(int index, const Instance &instance);
+
+    InstanceGrid grid;
+};
+
+
+/*!
+ * \class Group
+ * \brief Owns a list of shapes that are moved, hidden and styled together.
+ *
+ * The union of the children's bounding boxes, each grown by half its pen
+ * width, is cached so the group can be placed in the canvas' spatial index
+ * as a single shape and region queries can skip all the children when the
+ * region misses the group. Moving the group shifts the cached box instead of
+ * computing it again.
+ *
+ * The children aren't on the canvas themselves, so they're reached through
+ * the group: a move, colour change or region query on the group covers all
+ * of them. Groups can contain other groups.
+ */
+struct Group : Shape {
+  //! The grouped shapes, bottom first
+  std::vector<std::shared_ptr<Shape>> children;
+
+  //! Recomputes the cached union of the children's bounding boxes and pens
+  void updateBBoxCoords();
+
+  virtual Vec::Vec2D bottomRightCoord() const override;
+  virtual Vec::Vec2D topLeftCoord() const override;
+  virtual Vec::Vec2D closestPointTo(float x, float y) override;
+  virtual bool pointInShape(int x, int y) override;
+  //! Passes the zoom on to the children
+  virtual bool pointInView(int x, int y, float zoom) override;
+  virtual int pointsInView(const float *xs, const float *ys, int count,
+                           float zoom, unsigned char *inside) override;
+
+  //! Moves the group so that its top left corner is at the first point
+  virtual void changeCoords(const std::vector<POINT> &coords) override;
+
+  virtual void move(int xAmount, int yAmount) override;
+  virtual void scale(float originX, float originY,
+                     float xScale, float yScale) override;
+  virtual void rotate(float centerX, float centerY, float angle) override;
+#ifdef _WIN32
+  virtual void draw(HDC paintDC) override;
+#endif
+  virtual std::shared_ptr<Shape> clone() const override;
+
+  //! Changes the fill colour of all the children
+  virtual void setFillColor(std::string fillColor_) override;
+
+  //! Changes the pen colour of all the children
+  virtual void setPenColor(std::string penColor_) override;
+
+  //! Prepares all the children
+  virtual void prepareQueries() override;
+
+  //! Hands each child the caches of the older copy's child with its id
+  virtual void reuseCaches(const Shape &older) override;
+
+  virtual bool overlapsWithRegion(const Vec::Vec2D &topLeft,
+                                  const Vec::Vec2D &bottomRight) override;
+
+  virtual bool shapeInRegion(const Vec::Vec2D &topLeft,
+                             const Vec::Vec2D &bottomRight) override;
+
+  explicit Group(const std::vector<std::shared_ptr<Shape>> &children_)
+    : Shape(GROUP) {
+    addTag("group");
+    children = children_;
+    updateBBoxCoords();
+  }
+};
+
 }
 
 #endif
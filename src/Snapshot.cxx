@@ -0,0 +1,154 @@
+/*!
+ * \file Snapshot.cxx
+ */
+
+#include <cfloat>
+#include <algorithm>
+#include "./Snapshot.h"
+
+using namespace GCanvas;
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~[ Snapshot ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::vector<int> Snapshot::findAll() const {
+  std::vector<int> items;
+  items.reserve(shapes.size());
+  for (const auto &shape : shapes) {
+    items.push_back(shape->shapeID);
+  }
+  return items;
+}
+
+template<typename Test>
+std::vector<int> Snapshot::findInRegion(int x1, int y1, int x2, int y2,
+                                        Test test) const {
+  Vec::Vec2D topLeft(std::min(x1, x2), std::min(y1, y2));
+  Vec::Vec2D bottomRight(std::max(x1, x2), std::max(y1, y2));
+  std::vector<std::pair<int, int>> found;
+  index.query(GShape::Box(topLeft.x, topLeft.y, bottomRight.x, bottomRight.y),
+  [&](GShape::Shape * shape) {
+    if (test(shape, topLeft, bottomRight)) {
+      found.push_back({byID.find(shape->shapeID)->second, shape->shapeID});
+    }
+  });
+  std::sort(found.begin(), found.end());
+  std::vector<int> items;
+  items.reserve(found.size());
+  for (const auto &item : found) {
+    items.push_back(item.second);
+  }
+  return items;
+}
+
+std::vector<int> Snapshot::findEnclosed(int x1, int y1, int x2, int y2) const {
+  return findInRegion(x1, y1, x2, y2, [](GShape::Shape * shape,
+                                         const Vec::Vec2D & topLeft,
+  const Vec::Vec2D & bottomRight) {
+    return shape->shapeInRegion(topLeft, bottomRight);
+  });
+}
+
+std::vector<int> Snapshot::findOverlapping(int x1,
+                                           int y1,
+                                           int x2,
+                                           int y2) const {
+  return findInRegion(x1, y1, x2, y2, [](GShape::Shape * shape,
+                                         const Vec::Vec2D & topLeft,
+  const Vec::Vec2D & bottomRight) {
+    return shape->overlapsWithRegion(topLeft, bottomRight);
+  });
+}
+
+GShape::Box Snapshot::BBox(const std::vector<int> &shapeIDs) const {
+  float smallestX = FLT_MAX,
+        smallestY = FLT_MAX;
+  float largestX = -FLT_MAX,
+        largestY = -FLT_MAX;
+  for (int id : shapeIDs) {
+    GShape::Shape *shape = find(id);
+    if (!shape) {
+      continue;
+    }
+    Vec::Vec2D topPoint(shape->topLeftCoord());
+    Vec::Vec2D bottomPoint(shape->bottomRightCoord());
+    smallestX = std::min(topPoint.x, smallestX);
+    smallestY = std::min(topPoint.y, smallestY);
+    largestX = std::max(bottomPoint.x, largestX);
+    largestY = std::max(bottomPoint.y, largestY);
+  }
+  return {smallestX, smallestY, largestX, largestY};
+}
+
+GShape::Box Snapshot::BBox(int shapeID) const {
+  return BBox(std::vector<int> {shapeID});
+}
+
+std::vector<POINT> Snapshot::coords(int shapeID) const {
+  GShape::Shape *shape = find(shapeID);
+  if (!shape) {
+    return {};
+  }
+  return shape->coords();
+}
+
+bool Snapshot::exists(int shapeID) const {
+  return find(shapeID) != NULL;
+}
+
+unsigned long Snapshot::version() const {
+  return number;
+}
+
+GShape::Shape *Snapshot::find(int shapeID) const {
+  auto found = byID.find(shapeID);
+  if (found == byID.end()) {
+    return NULL;
+  }
+  return shapes[found->second].get();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~[ SnapshotPublisher ]~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<const Snapshot> SnapshotPublisher::publish(
+  const std::vector<std::shared_ptr<GShape::Shape>> &shapes,
+  unsigned long number) {
+  publishes++;
+  std::shared_ptr<Snapshot> snapshot(new Snapshot);
+  snapshot->shapes.reserve(shapes.size());
+  snapshot->byID.reserve(shapes.size());
+  for (const auto &shape : shapes) {
+    Copy &entry = copies[shape->shapeID];
+    if (!entry.copy || (entry.revision != shape->revision)) {
+      if (entry.copy) {
+        index.remove(entry.copy.get());
+      }
+      entry.copy = shape->clone();
+      entry.revision = shape->revision;
+      // Readers must only read the copy
+      entry.copy->prepareQueries();
+      index.insert(entry.copy.get());
+    }
+    entry.seen = publishes;
+    snapshot->byID[shape->shapeID] = snapshot->shapes.size();
+    snapshot->shapes.push_back(entry.copy);
+  }
+  // The items deleted since the last snapshot
+  if (copies.size() > shapes.size()) {
+    for (auto iter = copies.begin(); iter != copies.end();) {
+      if (iter->second.seen != publishes) {
+        index.remove(iter->second.copy.get());
+        iter = copies.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+  }
+  snapshot->index = index;
+  snapshot->number = number;
+  return snapshot;
+}
+
+void SnapshotPublisher::clear() {
+  copies.clear();
+  index.clear();
+}
@@ -0,0 +1,133 @@
+/*!
+ * \file Snapshot.h
+ * \brief A frozen view of the canvas' items that other threads can query.
+ */
+
+#ifndef Snapshot_H_
+#define Snapshot_H_
+
+#include "./Platform.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "./Shapes.h"
+#include "./SpatialGrid.h"
+
+namespace GCanvas {
+
+/*!
+ * \class Snapshot
+ * \brief The canvas' items as they were at the end of one message, for
+ * queries from threads other than the window's.
+ *
+ * A snapshot is never changed once Canvas::snapshot() hands it out, so any
+ * number of threads can query it at once without locks while the window's
+ * thread goes on changing the items. It holds copies of the items. Those that
+ * didn't change are shared with the snapshot before it instead of being copied
+ * again, and a snapshot is freed by whichever thread lets go of it last.
+ *
+ * The queries match the Canvas methods of the same name but only take canvas
+ * coordinates. The region queries go through the snapshot's own copy of the
+ * grid index, so they only look at the items near the region.
+ * \code
+ *   // On a worker thread
+ *   std::shared_ptr<const GC::Snapshot> view = canv.snapshot();
+ *   for (int id : view->findOverlapping(0, 0, 100, 100)) {
+ *     GS::Box box = view->BBox(id);
+ *     ...
+ *   }
+ * \endcode
+ */
+class Snapshot {
+  public:
+    //! Returns ids of all the items, bottom to top
+    std::vector<int> findAll() const;
+
+    //! Finds all items that occur completely within region `{x1, y1, x2, y2}`
+    std::vector<int> findEnclosed(int x1, int y1, int x2, int y2) const;
+
+    //! Finds all items that share a point with region `{x1, y1, x2, y2}`
+    std::vector<int> findOverlapping(int x1, int y1, int x2, int y2) const;
+
+    /*!
+     * \brief Returns the box enclosing all the items with those ids.
+     *
+     * Returns {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX} if there are none
+     */
+    GShape::Box BBox(const std::vector<int> &shapes) const;
+
+    //! \overload BBox(const std::vector<int>& shapes) const
+    GShape::Box BBox(int shapeID) const;
+
+    //! Returns the item's coordinates, or none if there's no such item
+    std::vector<POINT> coords(int shapeID) const;
+
+    //! Returns \b true if there's an item with that id
+    bool exists(int shapeID) const;
+
+    //! Counts up with every snapshot a canvas publishes
+    unsigned long version() const;
+
+  private:
+    friend class SnapshotPublisher;
+
+    Snapshot() {}
+    Snapshot(const Snapshot &);
+    Snapshot &operator=(const Snapshot &);
+
+    //! Returns the copy of the item or NULL if there isn't one
+    GShape::Shape *find(int shapeID) const;
+
+    //! The ids of the items the test selects among those whose box meets the
+    //! region, bottom to top
+    template<typename Test>
+    std::vector<int> findInRegion(int x1, int y1, int x2, int y2,
+                                  Test test) const;
+
+    // Only read once the snapshot is handed out. The copies' hit test
+    // structures are built beforehand, \see GShape::Shape::prepareQueries
+    std::vector<std::shared_ptr<GShape::Shape>> shapes;
+    //! The position of each item in `shapes`
+    std::unordered_map<int, int> byID;
+    //! Files the copies in `shapes`
+    GShape::SpatialGrid index;
+    unsigned long number = 0;
+};
+
+/*!
+ * \class SnapshotPublisher
+ * \brief Makes the snapshots of a display list.
+ *
+ * The copies and their grid index are kept from one snapshot to the next, so
+ * only the items whose GShape::Shape::revision changed are copied and filed
+ * again.
+ */
+class SnapshotPublisher {
+  public:
+    /*!
+     * \brief Returns a snapshot of the items, which are listed bottom to top,
+     * numbered \p number.
+     */
+    std::shared_ptr<const Snapshot>
+    publish(const std::vector<std::shared_ptr<GShape::Shape>> &shapes,
+            unsigned long number);
+
+    //! Forgets the copies so the next snapshot copies every item
+    void clear();
+
+  private:
+    struct Copy {
+      unsigned revision;
+      std::shared_ptr<GShape::Shape> copy;
+      //! The last publish() that found the item
+      unsigned long seen;
+    };
+    std::unordered_map<int, Copy> copies;
+    //! Files the copies in `copies`
+    GShape::SpatialGrid index;
+    unsigned long publishes = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,107 @@
+/*!
+ * \file SpatialGrid.cxx
+ */
+
+#include "./SpatialGrid.h"
+
+using namespace GShape;
+
+void SpatialGrid::insert(Shape *shape) {
+  // Thick borders are drawn half outside the bounding box
+  float border = shape->penSize / 2.0f + 1.0f;
+  Vec::Vec2D topLeft = shape->topLeftCoord();
+  Vec::Vec2D bottomRight = shape->bottomRightCoord();
+  Entry entry;
+  entry.shape = shape;
+  entry.x1 = topLeft.x - border;
+  entry.y1 = topLeft.y - border;
+  entry.x2 = bottomRight.x + border;
+  entry.y2 = bottomRight.y + border;
+  CellRange range;
+  range.x1 = entry.cellX = cellIndex(entry.x1);
+  range.y1 = entry.cellY = cellIndex(entry.y1);
+  range.x2 = entry.cellX2 = cellIndex(entry.x2);
+  range.y2 = entry.cellY2 = cellIndex(entry.y2);
+  double cellCount = (double(range.x2) - range.x1 + 1) *
+                     (double(range.y2) - range.y1 + 1);
+  range.isOversized = cellCount > MAX_CELLS;
+  range.box = Box(entry.x1, entry.y1, entry.x2, entry.y2);
+  ranges[shape] = range;
+  if (range.isOversized) {
+    oversized.push_back(entry);
+    return;
+  }
+  minCellX = std::min(minCellX, range.x1);
+  minCellY = std::min(minCellY, range.y1);
+  maxCellX = std::max(maxCellX, range.x2);
+  maxCellY = std::max(maxCellY, range.y2);
+  for (int y = range.y1; y <= range.y2; y++) {
+    for (int x = range.x1; x <= range.x2; x++) {
+      cells[cellKey(x, y)].push_back(entry);
+    }
+  }
+}
+
+bool SpatialGrid::eraseEntry(std::vector<Entry> *entries,
+                             const Shape *shape) {
+  int count = entries->size();
+  for (int i = 0; i < count; i++) {
+    if ((*entries)[i].shape == shape) {
+      (*entries)[i] = entries->back();
+      entries->pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void SpatialGrid::remove(Shape *shape) {
+  auto rangeIter = ranges.find(shape);
+  if (rangeIter == ranges.end()) {
+    return;
+  }
+  CellRange range = rangeIter->second;
+  ranges.erase(rangeIter);
+  if (range.isOversized) {
+    eraseEntry(&oversized, shape);
+    return;
+  }
+  for (int y = range.y1; y <= range.y2; y++) {
+    for (int x = range.x1; x <= range.x2; x++) {
+      auto cell = cells.find(cellKey(x, y));
+      if (cell == cells.end()) {
+        continue;
+      }
+      eraseEntry(&cell->second, shape);
+      if (cell->second.empty()) {
+        cells.erase(cell);
+      }
+    }
+  }
+}
+
+void SpatialGrid::update(Shape *shape) {
+  remove(shape);
+  insert(shape);
+}
+
+bool SpatialGrid::bounds(const Shape *shape, Box *box) const {
+  auto iter = ranges.find(shape);
+  if (iter == ranges.end()) {
+    return false;
+  }
+  *box = iter->second.box;
+  return true;
+}
+
+void SpatialGrid::clear() {
+  cells.clear();
+  ranges.clear();
+  oversized.clear();
+  minCellX = minCellY = INT_MAX;
+  maxCellX = maxCellY = INT_MIN;
+}
+
+size_t SpatialGrid::size() {
+  return ranges.size();
+}
@@ -0,0 +1,305 @@
+/*!
+ * \file SpatialGrid.h
+ * \brief A uniform grid used to find the shapes in a region without visiting
+ * every shape on the canvas.
+ */
+
+#ifndef SpatialGrid_H_
+#define SpatialGrid_H_
+
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include "./Shapes.h"
+
+namespace GShape {
+
+//! A shape found by SpatialGrid::nearest and its distance from the point
+struct Neighbour {
+  Shape *shape;
+  float distance;
+};
+
+/*!
+ * \class SpatialGrid
+ * \brief Files every shape under the grid cells its bounding box covers.
+ *
+ * Region queries only visit the cells under the region, so their cost depends
+ * on the number of shapes there rather than on the number of shapes on the
+ * canvas. The grid only stores bounding boxes; the exact tests are left to the
+ * shapes themselves.
+ *
+ * \code
+ *   SpatialGrid grid;
+ *   grid.insert(shape);
+ *   grid.query(Box(0.0f, 0.0f, 100.0f, 100.0f), [](Shape *shape) {
+ *     printf("%d\n", shape->shapeID);
+ *   });
+ * \endcode
+ */
+class SpatialGrid {
+  public:
+    explicit SpatialGrid(float cellSize_ = 128.0f) {
+      cellSize = cellSize_;
+    }
+
+    //! Adds the shape using its current bounding box
+    void insert(Shape *shape);
+
+    //! Removes the shape. Does nothing if the shape isn't in the grid.
+    void remove(Shape *shape);
+
+    //! Refiles the shape after its bounding box or pen size has changed
+    void update(Shape *shape);
+
+    /*!
+     * \brief Sets \p box to the box the shape is filed under, its bounding box
+     * grown by half the pen size.
+     * \returns \b false if the shape isn't in the grid
+     */
+    bool bounds(const Shape *shape, Box *box) const;
+
+    //! Removes all the shapes
+    void clear();
+
+    //! Returns the number of shapes in the grid
+    size_t size();
+
+    /*!
+     * \brief Calls \p func exactly once for every shape whose bounding box
+     * shares a point with the region. The order is unspecified.
+     *
+     * The function must not add or remove shapes from the grid.
+     */
+    template<typename Function>
+    void query(const Box &region, Function func) const {
+      for (const Entry &entry : oversized) {
+        if (entry.overlaps(region)) {
+          func(entry.shape);
+        }
+      }
+      int x1 = cellIndex(region.x1);
+      int y1 = cellIndex(region.y1);
+      int x2 = cellIndex(region.x2);
+      int y2 = cellIndex(region.y2);
+      double cellCount = (double(x2) - x1 + 1) * (double(y2) - y1 + 1);
+      if (cellCount > cells.size()) {
+        // The region covers more cells than there are occupied ones. Walk the
+        // occupied cells instead and report each shape from its first cell.
+        for (const auto &cell : cells) {
+          for (const Entry &entry : cell.second) {
+            if ((entry.cellX == cellX(cell.first)) &&
+                (entry.cellY == cellY(cell.first)) && entry.overlaps(region)) {
+              func(entry.shape);
+            }
+          }
+        }
+        return;
+      }
+      for (int y = y1; y <= y2; y++) {
+        for (int x = x1; x <= x2; x++) {
+          auto iter = cells.find(cellKey(x, y));
+          if (iter == cells.end()) {
+            continue;
+          }
+          for (const Entry &entry : iter->second) {
+            // A shape spanning several cells is only reported from the first
+            // cell it shares with the region.
+            if ((std::max(entry.cellX, x1) == x) &&
+                (std::max(entry.cellY, y1) == y) && entry.overlaps(region)) {
+              func(entry.shape);
+            }
+          }
+        }
+      }
+    }
+
+    /*!
+     * \brief Finds up to \p count shapes nearest to \p point, nearest first.
+     *
+     * \p distance returns the exact distance from the point to a shape. It's
+     * only called for shapes whose bounding box is nearer than the farthest
+     * of the shapes kept so far, and the cells are visited in rings around
+     * the point until the next ring is farther than that.
+     *
+     * Distances up to \p halo count as 0, and shapes at the same distance are
+     * ordered from the top of the display list down. Shapes farther than
+     * \p maxDistance are left out.
+     */
+    template<typename Function>
+    void nearest(const Vec::Vec2D &point, int count, float halo,
+                 float maxDistance, Function distance,
+                 std::vector<Neighbour> *neighbours) const {
+      neighbours->clear();
+      if (count <= 0) {
+        return;
+      }
+      auto effective = [halo](float length) {
+        return (length <= halo) ? 0.0f : length;
+      };
+      auto before = [&effective](const Neighbour & first,
+      const Neighbour & second) {
+        float firstDistance = effective(first.distance);
+        float secondDistance = effective(second.distance);
+        if (firstDistance != secondDistance) {
+          return firstDistance < secondDistance;
+        }
+        return first.shape->stackOrder > second.shape->stackOrder;
+      };
+      // The distance a shape has to beat to be kept
+      auto cutoff = [&]() {
+        if (int(neighbours->size()) < count) {
+          return effective(maxDistance);
+        }
+        return effective(neighbours->back().distance);
+      };
+      auto consider = [&](const Entry & entry) {
+        float bound = entry.distanceTo(point);
+        if ((bound > maxDistance) || (effective(bound) > cutoff())) {
+          return;
+        }
+        Neighbour candidate = {entry.shape, distance(entry.shape)};
+        if (candidate.distance > maxDistance) {
+          return;
+        }
+        if ((int(neighbours->size()) == count) &&
+            !before(candidate, neighbours->back())) {
+          return;
+        }
+        neighbours->insert(std::upper_bound(neighbours->begin(),
+                                            neighbours->end(),
+                                            candidate, before), candidate);
+        if (int(neighbours->size()) > count) {
+          neighbours->pop_back();
+        }
+      };
+      for (const Entry &entry : oversized) {
+        consider(entry);
+      }
+      if (cells.empty()) {
+        return;
+      }
+      int centerX = cellIndex(point.x);
+      int centerY = cellIndex(point.y);
+      // A shape is only looked at from the cell of its range nearest to the
+      // center cell. That's also the first ring it's met in.
+      auto isHome = [centerX, centerY](const Entry & entry, int x, int y) {
+        return (std::min(std::max(centerX, entry.cellX), entry.cellX2) == x) &&
+               (std::min(std::max(centerY, entry.cellY), entry.cellY2) == y);
+      };
+      int lastRing = std::max(std::max(std::abs(centerX - minCellX),
+                                       std::abs(centerX - maxCellX)),
+                              std::max(std::abs(centerY - minCellY),
+                                       std::abs(centerY - maxCellY)));
+      for (int ring = 0; ring <= lastRing; ring++) {
+        if (ring > 0) {
+          // Every cell in the ring is at least this far from the point
+          float gap = std::min(
+                        std::min(point.x - (centerX - ring + 1) * cellSize,
+                                 (centerX + ring) * cellSize - point.x),
+                        std::min(point.y - (centerY - ring + 1) * cellSize,
+                                 (centerY + ring) * cellSize - point.y));
+          if ((gap > maxDistance) || (effective(gap) > cutoff())) {
+            break;
+          }
+        }
+        if ((ring > 0) && (8.0 * ring > cells.size())) {
+          // The ring has more cells than there are occupied ones. Walk the
+          // occupied cells instead and finish there.
+          for (const auto &cell : cells) {
+            int x = cellX(cell.first);
+            int y = cellY(cell.first);
+            if (std::max(std::abs(x - centerX), std::abs(y - centerY)) < ring) {
+              continue;
+            }
+            for (const Entry &entry : cell.second) {
+              if (isHome(entry, x, y)) {
+                consider(entry);
+              }
+            }
+          }
+          break;
+        }
+        for (int y = centerY - ring; y <= centerY + ring; y++) {
+          // Only the first and last rows are walked in full
+          bool isEdgeRow = (y == centerY - ring) || (y == centerY + ring);
+          int step = isEdgeRow ? 1 : std::max(2 * ring, 1);
+          for (int x = centerX - ring; x <= centerX + ring; x += step) {
+            auto iter = cells.find(cellKey(x, y));
+            if (iter == cells.end()) {
+              continue;
+            }
+            for (const Entry &entry : iter->second) {
+              if (isHome(entry, x, y)) {
+                consider(entry);
+              }
+            }
+          }
+        }
+      }
+    }
+
+  private:
+    //! A shape's bounding box and the cells it's filed under
+    struct Entry {
+      Shape *shape;
+      float x1, y1, x2, y2;
+      int cellX, cellY;
+      int cellX2, cellY2;
+      bool overlaps(const Box &region) const {
+        return (x1 <= region.x2) && (region.x1 <= x2) &&
+               (y1 <= region.y2) && (region.y1 <= y2);
+      }
+      //! Distance from the point to the box, 0 inside it
+      float distanceTo(const Vec::Vec2D &point) const {
+        float dx = std::max(std::max(x1 - point.x, point.x - x2), 0.0f);
+        float dy = std::max(std::max(y1 - point.y, point.y - y2), 0.0f);
+        return std::sqrt(dx * dx + dy * dy);
+      }
+    };
+
+    //! The cells a shape was filed under and the box it was filed with
+    struct CellRange {
+      int x1, y1, x2, y2;
+      bool isOversized;
+      Box box;
+    };
+
+    int cellIndex(float coord) const {
+      return static_cast<int>(std::floor(coord / cellSize));
+    }
+
+    //! Shifted as unsigned since shifting a negative number is undefined
+    static unsigned long long cellKey(int x, int y) {
+      return (static_cast<unsigned long long>(static_cast<unsigned>(x)) << 32) |
+             static_cast<unsigned>(y);
+    }
+
+    static int cellX(unsigned long long key) {
+      return static_cast<int>(static_cast<unsigned>(key >> 32));
+    }
+
+    static int cellY(unsigned long long key) {
+      return static_cast<int>(static_cast<unsigned>(key & 0xFFFFFFFF));
+    }
+
+    //! Swaps the shape's entry with the last one and pops it
+    static bool eraseEntry(std::vector<Entry> *entries, const Shape *shape);
+
+    //! Shapes covering more cells than this are kept in a separate list
+    static const int MAX_CELLS = 256;
+
+    float cellSize;
+    std::unordered_map<unsigned long long, std::vector<Entry>> cells;
+    std::unordered_map<const Shape *, CellRange> ranges;
+    std::vector<Entry> oversized;
+    //! The cells that have ever held a shape. Bounds the nearest() search.
+    int minCellX = INT_MAX, minCellY = INT_MAX;
+    int maxCellX = INT_MIN, maxCellY = INT_MIN;
+};
+
+}
+
+#endif
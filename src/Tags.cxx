@@ -0,0 +1,264 @@
+/*!
+ * \file Tags.cxx
+ */
+
+#include "./Tags.h"
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+using namespace GShape;
+
+namespace {
+
+//! Tag names to ids
+std::unordered_map<std::string, int> &tagTable() {
+  static std::unordered_map<std::string, int> table;
+  return table;
+}
+
+//! Guards tagTable(). Shapes and their tags may be created on any thread.
+std::mutex &tagTableLock() {
+  static std::mutex lock;
+  return lock;
+}
+
+//! Guards the compileTags() cache
+std::mutex &expressionLock() {
+  static std::mutex lock;
+  return lock;
+}
+
+const char OPERATOR_CHARS[] = "!&|^()";
+
+//! Returns \b true if the character can't be part of a tag in an expression
+bool isOperatorChar(char ch) {
+  return ch && std::string(OPERATOR_CHARS).find(ch) != std::string::npos;
+}
+
+//! Strips the spaces around a tag in an expression
+std::string trim(const std::string &text) {
+  size_t first = text.find_first_not_of(" \t");
+  if (first == std::string::npos) {
+    return "";
+  }
+  size_t last = text.find_last_not_of(" \t");
+  return text.substr(first, last - first + 1);
+}
+
+}
+
+int GShape::tagID(const std::string &tag) {
+  std::lock_guard<std::mutex> guard(tagTableLock());
+  auto &table = tagTable();
+  auto iter = table.find(tag);
+  if (iter != table.end()) {
+    return iter->second;
+  }
+  int id = table.size();
+  table[tag] = id;
+  return id;
+}
+
+void TagBits::set(int id) {
+  unsigned word = id / 64;
+  if (word >= words.size()) {
+    words.resize(word + 1, 0);
+  }
+  words[word] |= uint64_t(1) << (id % 64);
+}
+
+void TagBits::reset(int id) {
+  unsigned word = id / 64;
+  if (word < words.size()) {
+    words[word] &= ~(uint64_t(1) << (id % 64));
+  }
+}
+
+TagExpression::TagExpression(const std::string &text) {
+  if (text.find_first_of(OPERATOR_CHARS) == std::string::npos) {
+    // A plain tag, used as it is
+    if (!text.empty()) {
+      program.push_back({TAG, tagID(text)});
+      depth = 1;
+    }
+    return;
+  }
+  if (!compile(text)) {
+    program.clear();
+    depth = 0;
+  }
+}
+
+bool TagExpression::compile(const std::string &text) {
+  // Shunting-yard. Binary operators are left associative, `!` is unary.
+  auto precedence = [](OpCode op) {
+    switch (op) {
+      case NOT:
+        return 4;
+      case AND:
+        return 3;
+      case XOR:
+        return 2;
+      case OR:
+        return 1;
+      default:
+        return 0;
+    }
+  };
+  std::vector<OpCode> operators;
+  bool expectOperand = true;
+  size_t length = text.length();
+  size_t i = 0;
+  while (i < length) {
+    char ch = text[i];
+    if ((ch == ' ') || (ch == '\t')) {
+      i++;
+      continue;
+    }
+    if (!isOperatorChar(ch)) {
+      size_t end = i;
+      while ((end < length) && !isOperatorChar(text[end])) {
+        end++;
+      }
+      std::string tag = trim(text.substr(i, end - i));
+      if (!expectOperand) {
+        return false;
+      }
+      program.push_back({TAG, tagID(tag)});
+      expectOperand = false;
+      i = end;
+      continue;
+    }
+    if ((ch == '!') || (ch == '(')) {
+      if (!expectOperand) {
+        return false;
+      }
+      operators.push_back((ch == '!') ? NOT : OPEN_PAREN);
+      i++;
+      continue;
+    }
+    if (ch == ')') {
+      if (expectOperand) {
+        return false;
+      }
+      while (!operators.empty() && (operators.back() != OPEN_PAREN)) {
+        program.push_back({operators.back(), -1});
+        operators.pop_back();
+      }
+      if (operators.empty()) {
+        return false;
+      }
+      operators.pop_back();
+      i++;
+      continue;
+    }
+    OpCode op;
+    if (ch == '^') {
+      op = XOR;
+      i++;
+    } else if ((i + 1 < length) && (text[i + 1] == ch)) {
+      op = (ch == '&') ? AND : OR;
+      i += 2;
+    } else {
+      // A lone `&` or `|`
+      return false;
+    }
+    if (expectOperand) {
+      return false;
+    }
+    while (!operators.empty() && (operators.back() != OPEN_PAREN) &&
+           (precedence(operators.back()) >= precedence(op))) {
+      program.push_back({operators.back(), -1});
+      operators.pop_back();
+    }
+    operators.push_back(op);
+    expectOperand = true;
+  }
+  if (expectOperand) {
+    return false;
+  }
+  while (!operators.empty()) {
+    if (operators.back() == OPEN_PAREN) {
+      return false;
+    }
+    program.push_back({operators.back(), -1});
+    operators.pop_back();
+  }
+  int size = 0;
+  for (const Instruction &instruction : program) {
+    size += (instruction.op == TAG) ? 1 : ((instruction.op == NOT) ? 0 : -1);
+    depth = std::max(depth, size);
+  }
+  return true;
+}
+
+bool TagExpression::isValid() const {
+  return !program.empty();
+}
+
+bool TagExpression::matches(const TagBits &bits) const {
+  if (program.size() == 1) {
+    return bits.test(program[0].tag);
+  }
+  if (program.empty()) {
+    return false;
+  }
+  const int STACK_SIZE = 32;
+  char fixedStack[STACK_SIZE];
+  std::vector<char> bigStack;
+  char *stack = fixedStack;
+  if (depth > STACK_SIZE) {
+    bigStack.resize(depth);
+    stack = bigStack.data();
+  }
+  int top = -1;
+  for (const Instruction &instruction : program) {
+    switch (instruction.op) {
+      case TAG:
+        stack[++top] = bits.test(instruction.tag);
+        break;
+      case NOT:
+        stack[top] = !stack[top];
+        break;
+      case AND:
+        top--;
+        stack[top] = stack[top] && stack[top + 1];
+        break;
+      case XOR:
+        top--;
+        stack[top] = stack[top] != stack[top + 1];
+        break;
+      case OR:
+        top--;
+        stack[top] = stack[top] || stack[top + 1];
+        break;
+      case OPEN_PAREN:
+        break;
+    }
+  }
+  return stack[0];
+}
+
+std::shared_ptr<const TagExpression> GShape::compileTags(
+  const std::string &text) {
+  static std::unordered_map<std::string,
+                            std::shared_ptr<const TagExpression>> cache;
+  // Loops over the shapes test the same expression over and over
+  static std::string lastText;
+  static std::shared_ptr<const TagExpression> lastExpression;
+  std::lock_guard<std::mutex> guard(expressionLock());
+  if (lastExpression && (text == lastText)) {
+    return lastExpression;
+  }
+  auto iter = cache.find(text);
+  if (iter == cache.end()) {
+    if (cache.size() >= EXPRESSION_CACHE_SIZE) {
+      cache.clear();
+    }
+    iter = cache.emplace(text, std::make_shared<TagExpression>(text)).first;
+  }
+  lastText = text;
+  lastExpression = iter->second;
+  return lastExpression;
+}
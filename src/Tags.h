@@ -0,0 +1,111 @@
+/*!
+ * \file Tags.h
+ * \brief Interned tags and compiled tag expressions, e.g `a&&!b||c`.
+ */
+
+#ifndef Tags_H_
+#define Tags_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace GShape {
+
+//! The most expressions compileTags() keeps before it starts over
+const size_t EXPRESSION_CACHE_SIZE = 1024;
+
+/*!
+ * \brief Returns the tag's id, giving it one the first time it's seen.
+ *
+ * Ids are never given back, so the table holds every tag name used since the
+ * program started, including the ones only ever looked up. That's bounded by
+ * the program's set of tag names. Tags made up per item, e.g `"item" + id`,
+ * keep adding to it; the item's id does the same job without that.
+ */
+int tagID(const std::string &tag);
+
+/*!
+ * \class TagBits
+ * \brief The set of tags a shape has, one bit per tag id.
+ */
+class TagBits {
+  public:
+    void set(int id);
+    void reset(int id);
+
+    bool test(int id) const {
+      unsigned word = id / 64;
+      return (word < words.size()) && ((words[word] >> (id % 64)) & 1);
+    }
+
+  private:
+    std::vector<uint64_t> words;
+};
+
+/*!
+ * \class TagExpression
+ * \brief A tag expression compiled to postfix form so that testing a shape is
+ * a handful of bit tests.
+ *
+ * The operators are the same as Tk's: `!`, `&&`, `^` and `||` from the highest
+ * precedence to the lowest, and parentheses. A string without any of the
+ * characters `!&|^()` is taken to be a single tag so that existing tags with
+ * spaces or other punctuation keep working. A malformed expression doesn't
+ * match any shape.
+ *
+ * \code
+ *   auto expression = compileTags("piece&&!(captured||king)");
+ *   if (expression->matches(shape->tagBits)) { ... }
+ * \endcode
+ */
+class TagExpression {
+  public:
+    explicit TagExpression(const std::string &text);
+
+    //! Returns \b true if a shape with those tags is selected
+    bool matches(const TagBits &bits) const;
+
+    //! Returns \b false if the expression couldn't be parsed
+    bool isValid() const;
+
+  private:
+    enum OpCode {
+      TAG,
+      NOT,
+      AND,
+      XOR,
+      OR,
+      OPEN_PAREN
+    };
+
+    struct Instruction {
+      OpCode op;
+      int tag;
+    };
+
+    //! Parses the expression into `program`. Returns \b false on errors.
+    bool compile(const std::string &text);
+
+    std::vector<Instruction> program;
+
+    //! The deepest the evaluation stack gets
+    int depth = 0;
+};
+
+/*!
+ * \brief Returns the compiled form of the expression, compiling it the first
+ * time it's used.
+ *
+ * The cache is emptied once it holds EXPRESSION_CACHE_SIZE expressions, so
+ * texts made up per call, e.g `"item" + id + "&&moved"`, don't pile up.
+ * Whoever holds on to an expression, like a bound handler, keeps it alive
+ * after the cache lets go of it. It takes a lock, so callers testing many
+ * shapes compile once before the loop.
+ */
+std::shared_ptr<const TagExpression> compileTags(const std::string &text);
+
+}
+
+#endif
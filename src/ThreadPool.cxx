@@ -0,0 +1,143 @@
+/*!
+ * \file ThreadPool.cxx
+ */
+
+#include "./ThreadPool.h"
+
+using namespace GCanvas;
+
+namespace {
+
+// The pool and queue of the worker running on this thread, if any
+thread_local ThreadPool *currentPool = nullptr;
+thread_local int currentQueue = 0;
+
+}
+
+ThreadPool::ThreadPool(int threads) {
+  if (threads <= 0) {
+    threads = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+    threads = std::max(threads, 1);
+  }
+  for (int i = 0; i < threads; i++) {
+    queues.emplace_back(new Queue);
+  }
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back(&ThreadPool::work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(sleepLock);
+    stopping = true;
+  }
+  wakeUp.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::run(Task task) {
+  int index;
+  if (currentPool == this) {
+    index = currentQueue;
+  } else {
+    index = nextQueue.fetch_add(1) % queues.size();
+  }
+  {
+    std::lock_guard<std::mutex> guard(queues[index]->lock);
+    queues[index]->tasks.push_back(std::move(task));
+  }
+  pending.fetch_add(1);
+  {
+    // Taken so that a worker about to sleep can't miss the notification
+    std::lock_guard<std::mutex> guard(sleepLock);
+  }
+  wakeUp.notify_one();
+}
+
+void ThreadPool::parallelFor(int count,
+                             const std::function<void(int)> &func,
+                             int threads) {
+  // Shared with the helpers, which may only get to run after the loop is over
+  struct Loop {
+    std::atomic<int> next{0};
+    std::atomic<int> done{0};
+    std::mutex lock;
+    std::condition_variable finished;
+  };
+  std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+  const std::function<void(int)> *body = &func;
+  auto help = [loop, body, count]() {
+    int i;
+    // func is only used for an index that's still to be done, so it's alive
+    while ((i = loop->next.fetch_add(1)) < count) {
+      (*body)(i);
+      if (loop->done.fetch_add(1) + 1 == count) {
+        std::lock_guard<std::mutex> guard(loop->lock);
+        loop->finished.notify_all();
+      }
+    }
+  };
+  int helpers = std::min(count - 1, size());
+  if (threads > 0) {
+    helpers = std::min(helpers, threads - 1);
+  }
+  for (int i = 0; i < helpers; i++) {
+    run(help);
+  }
+  help();
+  std::unique_lock<std::mutex> lock(loop->lock);
+  loop->finished.wait(lock, [&loop, count] {
+    return loop->done.load() == count;
+  });
+}
+
+int ThreadPool::size() const {
+  return workers.size();
+}
+
+bool ThreadPool::take(int index, Task *task) {
+  {
+    Queue &own = *queues[index];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if (!own.tasks.empty()) {
+      *task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  int count = queues.size();
+  for (int i = 1; i < count; i++) {
+    Queue &victim = *queues[(index + i) % count];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.tasks.empty()) {
+      *task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::work(int index) {
+  currentPool = this;
+  currentQueue = index;
+  Task task;
+  while (true) {
+    if (take(index, &task)) {
+      pending.fetch_sub(1);
+      task();
+      task = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepLock);
+    wakeUp.wait(lock, [this] {
+      return stopping || (pending.load() > 0);
+    });
+    if (stopping && (pending.load() == 0)) {
+      return;
+    }
+  }
+}
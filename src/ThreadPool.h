@@ -0,0 +1,90 @@
+/*!
+ * \file ThreadPool.h
+ * \brief Worker threads for the work that would hold up the window.
+ */
+
+#ifndef ThreadPool_H_
+#define ThreadPool_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace GCanvas {
+
+/*!
+ * \class ThreadPool
+ * \brief A fixed set of worker threads that share out queued tasks by
+ * stealing them from each other.
+ *
+ * Every worker has a queue of its own. A task queued from a worker goes to
+ * the back of that worker's queue and the worker takes its newest task first,
+ * while it's still warm in the cache. Tasks queued from any other thread are
+ * dealt out to the queues in turn. A worker whose queue is empty steals the
+ * oldest task from the others before it goes to sleep.
+ */
+class ThreadPool {
+  public:
+    typedef std::function<void()> Task;
+
+    /*!
+     * \brief Starts \p threads workers. With 0 there's one for every core but
+     * the one the window runs on, and at least one.
+     */
+    explicit ThreadPool(int threads = 0);
+
+    //! Runs the tasks still queued and stops the workers
+    ~ThreadPool();
+
+    //! Queues the task. Safe to call from any thread, tasks included.
+    void run(Task task);
+
+    /*!
+     * \brief Calls `func(i)` for every \p i in `[0, count)` and returns once
+     * all the calls are done.
+     *
+     * The calling thread makes calls too, so the loop finishes even when the
+     * workers are all busy with other tasks. At most \p threads threads make
+     * calls, the calling one included, or all the workers and it with 0. The
+     * order of the calls isn't fixed.
+     */
+    void parallelFor(int count, const std::function<void(int)> &func,
+                     int threads = 0);
+
+    //! Returns the number of workers
+    int size() const;
+
+  private:
+    struct Queue {
+      std::mutex lock;
+      std::deque<Task> tasks;
+    };
+
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    //! A worker's loop
+    void work(int index);
+
+    //! Takes a task from the worker's own queue or steals one
+    bool take(int index, Task *task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    // Counts the queued tasks so that idle workers know when to wake up
+    std::atomic<int> pending{0};
+    std::atomic<unsigned> nextQueue{0};
+    std::mutex sleepLock;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+};
+
+}
+
+#endif
@@ -6,7 +6,7 @@
 #ifndef Vec2D_H_
 #define Vec2D_H_
 
-#include <windows.h>
+#include "./Platform.h"
 #include <cmath>
 #include <string>
 #include <cstdio>
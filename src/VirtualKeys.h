@@ -1,86 +1,231 @@
+/*!
+ * \file VirtualKeys.h
+ * \brief The key names event strings accept and their virtual key codes.
+ */
+
+#ifndef VirtualKeys_H_
+#define VirtualKeys_H_
+
 #include <windows.h>
-#include <map>
-#include <string>
-
-static std::map<std::string, int> virtualKeys = {
-  {"<hover>", 1}, // Means nothing. It's here for convenience
-  {"<timer>", 1}, // Means nothing. It's here for convenience
-  {"<1>", VK_LBUTTON},
-  {"<2>", VK_MBUTTON},
-  {"<3>", VK_RBUTTON},
-  {"backspace", VK_BACK},
-  {"tab", VK_TAB},
-  {"return", VK_RETURN},
-  {"esc", VK_ESCAPE},
-  {"escape", VK_ESCAPE},
-  {"space", VK_SPACE},
-  {"spacebar", VK_SPACE},
-  {"spaceup", VK_PRIOR},
-  {"spacedown", VK_NEXT},
+#include <cstddef>
+
+#if __cplusplus >= 201402L
+//! Marks the functions with loops that can be constexpr from C++14 on
+#define GDICANVAS_CONSTEXPR constexpr
+#else
+#define GDICANVAS_CONSTEXPR inline
+#endif
+
+namespace GCanvas {
+
+/*!
+ * \struct KeyName
+ * \brief A key's name in lower case and its virtual key code
+ */
+struct KeyName {
+  const char *name;
+  int code;
+};
+
+//! Returns the ASCII character in lower case
+constexpr char lowerCase(char ch) {
+  return ((ch >= 'A') && (ch <= 'Z')) ? static_cast<char>(ch - 'A' + 'a') : ch;
+}
+
+//! Returns the length of the NUL terminated string
+constexpr size_t nameLength(const char *name) {
+  return (*name == '\0') ? 0 : 1 + nameLength(name + 1);
+}
+
+/*!
+ * \brief Returns \b true if the first \p length characters of \p name are
+ * \p word ignoring case. \p word is in lower case.
+ */
+constexpr bool sameName(const char *name, size_t length, const char *word) {
+  return (length == 0) ? (*word == '\0') :
+         ((*word != '\0') && (lowerCase(*name) == *word) &&
+          sameName(name + 1, length - 1, word + 1));
+}
+
+//! FNV-1a hash of the name in lower case, starting from \p seed
+constexpr unsigned keyHash(const char *name, size_t length, unsigned seed) {
+  return (length == 0) ? seed :
+         keyHash(name + 1, length - 1,
+                 (seed ^ static_cast<unsigned char>(lowerCase(*name))) *
+                 16777619u);
+}
+
+const int KEY_BUCKETS = 16;
+const int KEY_SLOTS = 128;
+
+/*
+ * A perfect hash of the key names. The name's hash picks a bucket and the
+ * bucket's seed rehashes the name to its own slot in keySlots, so a lookup is
+ * one hash and one comparison. Both tables were generated together: adding a
+ * name means finding the seeds again, which keySlotsArePerfect() checks.
+ */
+constexpr unsigned keyDisplacements[KEY_BUCKETS] = {
+  2, 21, 7, 1, 1, 1, 1, 1, 3, 4, 1, 1, 1, 21, 47, 1
+};
+
+constexpr KeyName keySlots[KEY_SLOTS] = {
+  {"", 0},
+  {"f13", VK_F13},
+  {"7", 0x37},
+  {"", 0},
   {"home", VK_HOME},
-  {"end", VK_END},
+  {"", 0},
+  {"", 0},
+  {"", 0},
+  {"f3", VK_F3},
+  {"r", 0x52},
+  {"", 0},
+  {"", 0},
+  {"", 0},
+  {"f18", VK_F18},
+  {"f10", VK_F10},
   {"left", VK_LEFT},
-  {"right", VK_RIGHT},
-  {"up", VK_UP},
-  {"down", VK_DOWN},
-  {"0", 0x30},
   {"1", 0x31},
-  {"2", 0x32},
-  {"3", 0x33},
-  {"4", 0x34},
+  {"f21", VK_F21},
+  {"g", 0x47},
+  {"f24", VK_F24},
+  {"f12", VK_F12},
   {"5", 0x35},
-  {"6", 0x36},
-  {"7", 0x37},
-  {"8", 0x38},
-  {"9", 0x39},
+  {"", 0},
+  {"l", 0x4C},
+  {"backspace", VK_BACK},
+  {"right", VK_RIGHT},
+  {"", 0},
+  {"return", VK_RETURN},
+  {"s", 0x53},
+  {"", 0},
+  {"", 0},
+  {"f19", VK_F19},
   {"a", 0x41},
-  {"b", 0x42},
-  {"c", 0x43},
-  {"d", 0x44},
+  {"n", 0x4E},
+  {"escape", VK_ESCAPE},
+  {"0", 0x30},
+  {"", 0},
   {"e", 0x45},
-  {"f", 0x46},
-  {"g", 0x47},
-  {"h", 0x48},
-  {"i", 0x49},
-  {"j", 0x4A},
-  {"k", 0x4B},
-  {"l", 0x4C},
+  {"", 0},
+  {"f8", VK_F8},
+  {"9", 0x39},
+  {"", 0},
   {"m", 0x4D},
-  {"n", 0x4E},
-  {"o", 0x4F},
-  {"p", 0x50},
-  {"q", 0x51},
-  {"r", 0x52},
-  {"s", 0x53},
+  {"", 0},
+  {"", 0},
+  {"f6", VK_F6},
+  {"", 0},
   {"t", 0x54},
-  {"u", 0x55},
-  {"v", 0x56},
-  {"w", 0x57},
-  {"x", 0x58},
-  {"y", 0x59},
+  {"f5", VK_F5},
+  {"down", VK_DOWN},
+  {"", 0},
+  {"", 0},
+  {"", 0},
+  {"", 0},
+  {"6", 0x36},
+  {"f11", VK_F11},
+  {"i", 0x49},
+  {"", 0},
+  {"", 0},
+  {"8", 0x38},
+  {"", 0},
   {"z", 0x5A},
-  {"f1", VK_F1},
-  {"f2", VK_F2},
-  {"f3", VK_F3},
+  {"", 0},
+  {"up", VK_UP},
+  {"o", 0x4F},
+  {"space", VK_SPACE},
+  {"w", 0x57},
   {"f4", VK_F4},
-  {"f5", VK_F5},
-  {"f6", VK_F6},
-  {"f7", VK_F7},
-  {"f8", VK_F8},
+  {"", 0},
+  {"", 0},
+  {"f", 0x46},
+  {"", 0},
+  {"", 0},
+  {"2", 0x32},
+  {"f1", VK_F1},
+  {"h", 0x48},
+  {"", 0},
+  {"f17", VK_F17},
+  {"", 0},
   {"f9", VK_F9},
-  {"f10", VK_F10},
-  {"f11", VK_F11},
-  {"f12", VK_F12},
-  {"f13", VK_F13},
+  {"q", 0x51},
+  {"spaceup", VK_PRIOR},
+  {"", 0},
+  {"", 0},
+  {"", 0},
+  {"u", 0x55},
+  {"f7", VK_F7},
+  {"", 0},
   {"f14", VK_F14},
-  {"f15", VK_F15},
-  {"f16", VK_F16},
-  {"f17", VK_F17},
-  {"f18", VK_F18},
-  {"f18", VK_F19},
+  {"b", 0x42},
+  {"", 0},
+  {"", 0},
+  {"3", 0x33},
+  {"", 0},
+  {"k", 0x4B},
   {"f20", VK_F20},
-  {"f21", VK_F21},
+  {"", 0},
+  {"f2", VK_F2},
+  {"", 0},
+  {"p", 0x50},
+  {"", 0},
+  {"", 0},
+  {"end", VK_END},
+  {"", 0},
+  {"y", 0x59},
+  {"", 0},
   {"f22", VK_F22},
+  {"f15", VK_F15},
+  {"c", 0x43},
+  {"j", 0x4A},
+  {"spacebar", VK_SPACE},
+  {"4", 0x34},
+  {"", 0},
+  {"spacedown", VK_NEXT},
   {"f23", VK_F23},
-  {"f24", VK_F24}
+  {"", 0},
+  {"", 0},
+  {"", 0},
+  {"v", 0x56},
+  {"", 0},
+  {"tab", VK_TAB},
+  {"", 0},
+  {"", 0},
+  {"x", 0x58},
+  {"esc", VK_ESCAPE},
+  {"", 0},
+  {"f16", VK_F16},
+  {"d", 0x44}
 };
+
+//! Returns the slot in keySlots the name would be in
+constexpr int keySlot(const char *name, size_t length) {
+  return keyHash(name, length,
+                 keyDisplacements[keyHash(name, length, 2166136261u) %
+                                  KEY_BUCKETS]) % KEY_SLOTS;
+}
+
+/*!
+ * \brief Returns the virtual key code of the key named by the first \p length
+ * characters of \p name, e.g "f5" or "Return", or 0 if there's no such key.
+ */
+constexpr int virtualKey(const char *name, size_t length) {
+  return sameName(name, length, keySlots[keySlot(name, length)].name) ?
+         keySlots[keySlot(name, length)].code : 0;
+}
+
+//! Returns \b true if every name in keySlots is in the slot its hash picks
+constexpr bool keySlotsArePerfect(int slot = 0) {
+  return (slot == KEY_SLOTS) ||
+         (((*keySlots[slot].name == '\0') ||
+           (keySlot(keySlots[slot].name,
+                    nameLength(keySlots[slot].name)) == slot)) &&
+          keySlotsArePerfect(slot + 1));
+}
+
+static_assert(keySlotsArePerfect(), "The key seeds need to be found again");
+
+}
+
+#endif
@@ -0,0 +1,104 @@
+/*!
+ * \file CommandQueueStress.cxx
+ * \brief Pushes commands from several threads while another one drains them.
+ *
+ * Checks that every command runs exactly once, that each producer's commands
+ * run in the order it pushed them and that a drain stops at the commands
+ * queued when it started. Only needs CommandQueue, so it
+ * builds and runs on any platform, e.g under ThreadSanitizer on Linux with
+ * `make TSAN=1 portable-tests`.
+ */
+
+#include <cstdio>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <CommandQueue.h>
+
+namespace {
+
+const int PRODUCERS = 8;
+const int COMMANDS = 20000;
+const int ROUNDS = 5;
+
+//! Runs one round. Returns the number of problems found.
+int stress(int producers, int commands) {
+  GCanvas::CommandQueue queue;
+  // Only touched by the commands, which all run on the consumer
+  std::vector<int> last(producers, -1);
+  long long total = 0;
+  int outOfOrder = 0;
+
+  std::atomic<int> finished(0);
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([&, p]() {
+      for (int i = 0; i < commands; i++) {
+        queue.push([&, p, i]() {
+          if (last[p] != i - 1) {
+            outOfOrder++;
+          }
+          last[p] = i;
+          total++;
+        });
+      }
+      finished++;
+    });
+  }
+
+  // Drains while the producers are still pushing
+  bool complete = true;
+  while ((finished < producers) || !queue.empty() || !complete) {
+    queue.drain(&complete);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  queue.drain(&complete);
+
+  int problems = outOfOrder;
+  if ((total != (long long) producers * commands) || !complete ||
+      !queue.empty()) {
+    problems++;
+  }
+  printf("%d producers: %lld of %lld commands run, %d out of order\n",
+         producers, total, (long long) producers * commands, outOfOrder);
+  return problems;
+}
+
+/*!
+ * A command that pushes itself again must only run once per drain, or a
+ * producer that's as fast as the consumer would keep it draining for ever.
+ * Returns the number of problems found.
+ */
+int bounded() {
+  GCanvas::CommandQueue queue;
+  int runs = 0;
+  std::function<void()> again = [&]() {
+    runs++;
+    queue.push(again);
+  };
+  queue.push(again);
+  queue.push(again);
+  int problems = 0;
+  for (int batch = 1; batch <= 3; batch++) {
+    bool complete = true;
+    if ((queue.drain(&complete) != 2) || complete || (runs != 2 * batch)) {
+      problems++;
+    }
+  }
+  printf("Commands pushed by commands: %d problems\n", problems);
+  return problems;
+}
+
+}  // namespace
+
+int main() {
+  int problems = 0;
+  for (int round = 0; round < ROUNDS; round++) {
+    problems += stress(1 + round * (PRODUCERS - 1) / (ROUNDS - 1), COMMANDS);
+  }
+  problems += bounded();
+  return problems ? 1 : 0;
+}
@@ -0,0 +1,292 @@
+/*!
+ * \file EllipseHits.cxx
+ * \brief Checks the ovals', pies', chords' and arcs' hit tests at random points
+ * against the angle based tests they replaced, and the batch tests against the
+ * single point ones.
+ *
+ * The old tests worked out each point's angle with `atan()` and the chord's
+ * ends with `tan()`, so the two only have to agree away from the sector's
+ * edges, the chord and the ellipse's outline, where rounding decides. The
+ * batch tests have to agree with the single point ones everywhere.
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <Shapes.h>
+
+namespace {
+
+const int SHAPES = 400;
+const int POINTS = 2000;
+//! Distance in pixels from an edge within which the tests may disagree
+const float EDGE = 1.5f;
+//! Difference in the ellipse's equation within which the tests may disagree
+const float LEVEL_EDGE = 0.03f;
+
+std::mt19937 generator(37);
+
+int randomInt(int low, int high) {
+  return low + generator() % (high - low + 1);
+}
+
+/*!
+ * \class OldArc
+ * \brief The hit tests as they were before the ellipse and the sector were
+ * kept as parameters, with the box's sides always even as the old tests
+ * halved them as integers.
+ */
+struct OldArc {
+  float x1, y1, x2, y2;
+  float tiltAngle, pieSize;
+
+  Vec::Vec2D center() const {
+    return Vec::Vec2D((x1 + x2) / 2.0f, (y1 + y2) / 2.0f);
+  }
+
+  float level(int x, int y) const {
+    Vec::Vec2D middle = center();
+    int radiusX = std::abs(x2 - x1) / 2;
+    int radiusY = std::abs(y2 - y1) / 2;
+    float a = std::pow((x - middle.x), 2.0f) / std::pow(radiusX, 2.0f);
+    float b = std::pow((y - middle.y), 2.0f) / std::pow(radiusY, 2.0f);
+    return a + b;
+  }
+
+  float angleFromCoord(float x, float y) const {
+    Vec::Vec2D middle = center();
+    float gradient = (middle.y - y) / (middle.x - x);
+    float angleBetween = std::atan(gradient) * 180.0f / PI;
+    if (x == middle.x) {
+      return (y < middle.y) ? 90.0f : 270.0f;
+    } else if (middle.y == y) {
+      return (x < middle.x) ? 180.0f : 0.0f;
+    }
+    if (angleBetween > 0.0f) {
+      return (y < middle.y) ? 180.0f - angleBetween : 360.0f - angleBetween;
+    } else {
+      return (y < middle.y) ? -angleBetween : 180.0f - angleBetween;
+    }
+  }
+
+  Vec::Vec2D coordFromAngle(float angle) const {
+    float r1 = std::abs(x2 - x1) / 2;
+    float r2 = std::abs(y2 - y1) / 2;
+    Vec::Vec2D middle(x1 + r1, y1 + r2);
+    while (angle > 360.0f) {
+      angle -= 360.0f;
+    }
+    if ((angle != 90.0f) && (angle != 270.0f)) {
+      angle = 360.0f - angle;
+    }
+    float radians = angle * PI / 180.0f;
+    float x = (r1 * r2) / (std::sqrt((r2 * r2) +
+                                     (r1 * r1 * std::pow(std::tan(radians),
+                                                         2.0f))));
+    float y = x * std::tan(radians);
+    if (((angle > 90.0f) && (angle <= 180.0f)) ||
+        ((angle >= 180.0f) && (angle <= 270.0f))) {
+      x = -x;
+      y = -y;
+    }
+    return Vec::Vec2D(x + middle.x, y + middle.y);
+  }
+
+  bool withinSector(int x, int y) const {
+    float angle = angleFromCoord(x, y);
+    float endAngle = pieSize + tiltAngle;
+    if (endAngle <= 360.0f) {
+      return (angle >= tiltAngle) && (angle <= endAngle);
+    }
+    endAngle -= 360.0f;
+    return (angle >= tiltAngle) || (angle <= endAngle);
+  }
+
+  static float sign(const Vec::Vec2D &p1, const Vec::Vec2D &p2,
+                    const Vec::Vec2D &p3) {
+    return (p1.x - p3.x) * (p2.y - p3.y) - (p2.x - p3.x) * (p1.y - p3.y);
+  }
+
+  bool pointInEllipse(int x, int y) const {
+    return level(x, y) <= 1.0f;
+  }
+
+  bool pointOnArc(int x, int y) const {
+    return withinSector(x, y) && (std::abs(level(x, y) - 1.0f) < 0.02f);
+  }
+
+  bool pointInPie(int x, int y) const {
+    return withinSector(x, y) && pointInEllipse(x, y);
+  }
+
+  bool pointInChord(int x, int y) const {
+    Vec::Vec2D point(x, y);
+    Vec::Vec2D middle = center();
+    Vec::Vec2D tiltPos = coordFromAngle(tiltAngle);
+    Vec::Vec2D endPos = coordFromAngle(tiltAngle + pieSize);
+    bool b1 = sign(point, middle, tiltPos) < 0.0f;
+    bool b2 = sign(point, tiltPos, endPos) < 0.0f;
+    bool b3 = sign(point, endPos, middle) < 0.0f;
+    bool inTriangle = (b1 == b2) && (b2 == b3);
+    if (pieSize > 180.0f) {
+      return pointInPie(x, y) || inTriangle;
+    }
+    return pointInPie(x, y) && !inTriangle;
+  }
+};
+
+//! Distance from `(dx, dy)` to the segment from the origin to `(toX, toY)`
+float segmentDistance(float dx, float dy, float toX, float toY) {
+  float length2 = toX * toX + toY * toY;
+  float t = (length2 > 0.0f) ? (dx * toX + dy * toY) / length2 : 0.0f;
+  t = std::max(0.0f, std::min(1.0f, t));
+  return std::hypot(dx - t * toX, dy - t * toY);
+}
+
+//! Distance from `(dx, dy)` to the line through the two points
+float lineDistance(float dx, float dy, float fromX, float fromY,
+                   float toX, float toY) {
+  float length = std::hypot(toX - fromX, toY - fromY);
+  if (length == 0.0f) {
+    return std::hypot(dx - fromX, dy - fromY);
+  }
+  return std::abs((toX - fromX) * (dy - fromY) -
+                  (toY - fromY) * (dx - fromX)) / length;
+}
+
+//! Returns \b true if the old and new tests may disagree at the point
+bool nearEdge(const OldArc &old, GShape::ArcType arcType, int x, int y) {
+  Vec::Vec2D middle = old.center();
+  float dx = x - middle.x;
+  float dy = middle.y - y;
+  float level = old.level(x, y);
+  if (std::abs(level - 1.0f) < LEVEL_EDGE) {
+    return true;
+  }
+  if ((arcType == GShape::ARC) &&
+      (std::abs(std::abs(level - 1.0f) - 0.02f) < LEVEL_EDGE)) {
+    return true;
+  }
+  float radius = std::max(old.x2 - old.x1, old.y2 - old.y1);
+  float start = old.tiltAngle * PI / 180.0f;
+  float end = (old.tiltAngle + old.pieSize) * PI / 180.0f;
+  if ((segmentDistance(dx, dy, radius * std::cos(start),
+                       radius * std::sin(start)) < EDGE) ||
+      (segmentDistance(dx, dy, radius * std::cos(end),
+                       radius * std::sin(end)) < EDGE)) {
+    return true;
+  }
+  if (arcType == GShape::CHORD) {
+    Vec::Vec2D from = old.coordFromAngle(old.tiltAngle);
+    Vec::Vec2D to = old.coordFromAngle(old.tiltAngle + old.pieSize);
+    return lineDistance(dx, dy, from.x - middle.x, middle.y - from.y,
+                        to.x - middle.x, middle.y - to.y) < EDGE;
+  }
+  return false;
+}
+
+struct Counts {
+  int compared = 0, skipped = 0, differ = 0, batchDiffer = 0;
+};
+
+//! Tests random points in and around the shape's box with both tests
+template<typename OldTest>
+void check(GShape::Shape &shape, const OldArc &old, GShape::ArcType arcType,
+           OldTest oldTest, Counts *counts) {
+  std::vector<float> xs(POINTS), ys(POINTS);
+  std::vector<unsigned char> inside(POINTS);
+  int margin = 4;
+  for (int i = 0; i < POINTS; i++) {
+    xs[i] = randomInt(old.x1 - margin, old.x2 + margin);
+    ys[i] = randomInt(old.y1 - margin, old.y2 + margin);
+  }
+  shape.prepareQueries();
+  int total = shape.pointsInShape(xs.data(), ys.data(), POINTS, inside.data());
+  int expectedTotal = 0;
+  for (int i = 0; i < POINTS; i++) {
+    int x = xs[i];
+    int y = ys[i];
+    bool isInside = shape.pointInShape(x, y);
+    expectedTotal += isInside;
+    if (isInside != bool(inside[i])) {
+      counts->batchDiffer++;
+    }
+    if (nearEdge(old, arcType, x, y)) {
+      counts->skipped++;
+      continue;
+    }
+    counts->compared++;
+    if (isInside != oldTest(x, y)) {
+      counts->differ++;
+    }
+  }
+  if (total != expectedTotal) {
+    counts->batchDiffer++;
+  }
+}
+
+//! A box with even sides somewhere around the origin
+OldArc randomBox() {
+  OldArc old;
+  old.x1 = randomInt(-200, 200);
+  old.y1 = randomInt(-200, 200);
+  old.x2 = old.x1 + 2 * randomInt(2, 120);
+  old.y2 = old.y1 + 2 * randomInt(2, 120);
+  old.tiltAngle = 0.0f;
+  old.pieSize = 360.0f;
+  return old;
+}
+
+//! Returns the number of problems found
+int report(const char *name, const Counts &counts) {
+  printf("%s: %d of %d points differ, %d near an edge, %d differ in batches\n",
+         name, counts.differ, counts.compared, counts.skipped,
+         counts.batchDiffer);
+  return counts.differ + counts.batchDiffer;
+}
+
+}  // namespace
+
+int main() {
+  Counts ovals;
+  for (int i = 0; i < SHAPES; i++) {
+    OldArc old = randomBox();
+    GShape::Oval oval(old.x1, old.y1, old.x2, old.y2);
+    check(oval, old, GShape::PIE, [&](int x, int y) {
+      return old.pointInEllipse(x, y);
+    }, &ovals);
+  }
+  int problems = report("Ovals", ovals);
+
+  const GShape::ArcType TYPES[] = {GShape::PIE, GShape::CHORD, GShape::ARC};
+  const char *NAMES[] = {"Pies", "Chords", "Arcs"};
+  for (int type = 0; type < 3; type++) {
+    GShape::ArcType arcType = TYPES[type];
+    Counts counts;
+    for (int i = 0; i < SHAPES; i++) {
+      OldArc old = randomBox();
+      // Whole degrees mostly, so that the sweep often starts or ends on an
+      // axis, where the old tests had to special case the angles
+      old.tiltAngle = randomInt(0, 359) + (randomInt(0, 3) ? 0.0f : 0.5f);
+      old.pieSize = randomInt(0, 7) ? randomInt(1, 359)
+                                    : 90.0f * randomInt(1, 4);
+      GShape::LineArc arc(old.x1, old.y1, old.x2, old.y2, arcType,
+                          old.pieSize, old.tiltAngle);
+      check(arc, old, arcType, [&](int x, int y) {
+        switch (arcType) {
+          case GShape::PIE:
+            return old.pointInPie(x, y);
+          case GShape::CHORD:
+            return old.pointInChord(x, y);
+          case GShape::ARC:
+            return old.pointOnArc(x, y);
+        }
+        return false;
+      }, &counts);
+    }
+    problems += report(NAMES[type], counts);
+  }
+  return problems ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+/*!
+ * \file EventLogRoundTrip.cxx
+ * \brief Writes random events to a log, reads them back and checks that they
+ * come out the same, then checks that damaged logs are refused.
+ *
+ * The values cover the whole range each field is stored in, negative
+ * positions, wheel deltas and keys included.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#include <EventLog.h>
+
+namespace {
+
+const int EVENTS = 5000;
+const char *PATH = "EventLogRoundTrip.gcir";
+
+std::mt19937 generator(43);
+
+int randomInt(int low, int high) {
+  return low + static_cast<int>(generator() % (static_cast<unsigned>(high) -
+                                               low + 1));
+}
+
+//! A number that fits in a signed 16 bit field
+int randomShort() {
+  return randomInt(-32768, 32767);
+}
+
+GCanvas::LoggedEvent randomEvent() {
+  GCanvas::LoggedEvent event;
+  event.time = generator();
+  event.type = randomInt(0, 255);
+  event.key = static_cast<int>(generator());
+  event.x = randomShort();
+  event.y = randomShort();
+  event.xRoot = randomShort();
+  event.yRoot = randomShort();
+  event.dx = randomShort();
+  event.dy = randomShort();
+  event.wheelDelta = randomShort();
+  event.state = randomInt(0, 255);
+  return event;
+}
+
+bool same(const GCanvas::LoggedEvent &a, const GCanvas::LoggedEvent &b) {
+  return (a.time == b.time) && (a.type == b.type) && (a.key == b.key) &&
+         (a.x == b.x) && (a.y == b.y) && (a.xRoot == b.xRoot) &&
+         (a.yRoot == b.yRoot) && (a.dx == b.dx) && (a.dy == b.dy) &&
+         (a.wheelDelta == b.wheelDelta) && (a.state == b.state);
+}
+
+//! Reads the whole file as bytes
+std::string contents() {
+  std::ifstream file(PATH, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+}
+
+void overwrite(const std::string &bytes) {
+  std::ofstream file(PATH, std::ios::binary | std::ios::trunc);
+  file.write(bytes.data(), bytes.size());
+}
+
+//! Returns 1 if the file at PATH is read when it shouldn't be, or the other
+//! way around
+int expectRead(bool readable, size_t count, const char *what) {
+  std::vector<GCanvas::LoggedEvent> events(3);
+  bool read = GCanvas::readEventLog(PATH, &events);
+  bool failed = (read != readable) || (events.size() != count);
+  printf("%s: %s\n", what, failed ? "failed" : "ok");
+  return failed;
+}
+
+}  // namespace
+
+int main() {
+  std::vector<GCanvas::LoggedEvent> written;
+  GCanvas::EventLogWriter writer;
+  // The second open has to drop what the first one wrote
+  if (!writer.open(PATH)) {
+    printf("Can't write %s\n", PATH);
+    return 1;
+  }
+  writer.write(randomEvent());
+  if (!writer.open(PATH)) {
+    printf("Can't write %s\n", PATH);
+    return 1;
+  }
+  for (int i = 0; i < EVENTS; i++) {
+    written.push_back(randomEvent());
+    writer.write(written.back());
+  }
+  writer.close();
+
+  int problems = 0;
+  std::vector<GCanvas::LoggedEvent> events;
+  if (!GCanvas::readEventLog(PATH, &events) ||
+      (events.size() != written.size())) {
+    problems++;
+  } else {
+    for (size_t i = 0; i < events.size(); i++) {
+      problems += !same(events[i], written[i]);
+    }
+  }
+  printf("%d events: %d problems\n", EVENTS, problems);
+
+  std::string log = contents();
+  const size_t HEADER = log.size() -
+                        EVENTS * GCanvas::EventLogWriter::RECORD_SIZE;
+  overwrite(log.substr(0, HEADER));
+  problems += expectRead(true, 0, "Header alone");
+  overwrite(log.substr(0, log.size() - 1));
+  problems += expectRead(false, 0, "Last record cut short");
+  overwrite(log.substr(0, HEADER - 1));
+  problems += expectRead(false, 0, "Header cut short");
+  std::string damaged = log;
+  damaged[0] = 'X';
+  overwrite(damaged);
+  problems += expectRead(false, 0, "Wrong magic");
+  damaged = log;
+  damaged[4] = GCanvas::EventLogWriter::VERSION + 1;
+  overwrite(damaged);
+  problems += expectRead(false, 0, "Newer version");
+  std::remove(PATH);
+  problems += expectRead(false, 0, "Missing file");
+  return problems ? 1 : 0;
+}
@@ -0,0 +1,206 @@
+/*!
+ * \file EventStrings.cxx
+ * \brief Checks parseEvent() on every kind of event string and on malformed
+ * ones, and virtualKey() on every key name, in any case, and on random names
+ * against a plain lookup.
+ *
+ * The key names are the ones the old std::map held, with "f19" in place of the
+ * second "f18", so a name the perfect hash drops or wrongly accepts shows up.
+ */
+
+#include <cstdio>
+#include <cctype>
+#include <map>
+#include <random>
+#include <string>
+#include <Canvas.h>
+
+namespace {
+
+const int RANDOM_NAMES = 200000;
+
+const std::map<std::string, int> KEYS = {
+  {"backspace", VK_BACK}, {"tab", VK_TAB}, {"return", VK_RETURN},
+  {"esc", VK_ESCAPE}, {"escape", VK_ESCAPE}, {"space", VK_SPACE},
+  {"spacebar", VK_SPACE}, {"spaceup", VK_PRIOR}, {"spacedown", VK_NEXT},
+  {"home", VK_HOME}, {"end", VK_END}, {"left", VK_LEFT}, {"right", VK_RIGHT},
+  {"up", VK_UP}, {"down", VK_DOWN},
+  {"0", 0x30}, {"1", 0x31}, {"2", 0x32}, {"3", 0x33}, {"4", 0x34},
+  {"5", 0x35}, {"6", 0x36}, {"7", 0x37}, {"8", 0x38}, {"9", 0x39},
+  {"a", 0x41}, {"b", 0x42}, {"c", 0x43}, {"d", 0x44}, {"e", 0x45},
+  {"f", 0x46}, {"g", 0x47}, {"h", 0x48}, {"i", 0x49}, {"j", 0x4A},
+  {"k", 0x4B}, {"l", 0x4C}, {"m", 0x4D}, {"n", 0x4E}, {"o", 0x4F},
+  {"p", 0x50}, {"q", 0x51}, {"r", 0x52}, {"s", 0x53}, {"t", 0x54},
+  {"u", 0x55}, {"v", 0x56}, {"w", 0x57}, {"x", 0x58}, {"y", 0x59},
+  {"z", 0x5A},
+  {"f1", VK_F1}, {"f2", VK_F2}, {"f3", VK_F3}, {"f4", VK_F4}, {"f5", VK_F5},
+  {"f6", VK_F6}, {"f7", VK_F7}, {"f8", VK_F8}, {"f9", VK_F9},
+  {"f10", VK_F10}, {"f11", VK_F11}, {"f12", VK_F12}, {"f13", VK_F13},
+  {"f14", VK_F14}, {"f15", VK_F15}, {"f16", VK_F16}, {"f17", VK_F17},
+  {"f18", VK_F18}, {"f19", VK_F19}, {"f20", VK_F20}, {"f21", VK_F21},
+  {"f22", VK_F22}, {"f23", VK_F23}, {"f24", VK_F24}
+};
+
+struct Case {
+  const char *spec;
+  GC::EventType type;
+  unsigned modifiers;
+  int key;
+};
+
+const unsigned CTRL = GC::CTRL_HELD;
+const unsigned ALT = GC::ALT_HELD;
+const unsigned SHIFT = GC::SHIFT_HELD;
+
+const Case VALID[] = {
+  {"<timer>", GC::TIMER, 0, 1},
+  {"<Hover>", GC::HOVER, 0, 1},
+  {"<MOTION>", GC::MOTION, 0, 1},
+  {"<B1-Motion>", GC::LEFT_DRAG, 0, 1},
+  {"<b2-motion>", GC::RIGHT_DRAG, 0, 1},
+  {"<ButtonRelease-1>", GC::LEFT_RELEASE, 0, VK_LBUTTON},
+  {"<ButtonRelease-2>", GC::RIGHT_RELEASE, 0, VK_RBUTTON},
+  {"<Mouse-1>", GC::LEFT_CLICK, 0, VK_LBUTTON},
+  {"<Ctrl-Mouse-1>", GC::CTRL_LEFT_CLICK, CTRL, VK_LBUTTON},
+  {"<Alt-Mouse-1>", GC::ALT_LEFT_CLICK, ALT, VK_LBUTTON},
+  {"<Mouse-2>", GC::RIGHT_CLICK, 0, VK_RBUTTON},
+  {"<Wheel-Roll>", GC::WHEEL_ROLL, 0, VK_MBUTTON},
+  {"<Wheel-Click>", GC::WHEEL_CLICK, 0, VK_MBUTTON},
+  {"<Key-Q>", GC::BARE_KEY, 0, 'Q'},
+  {"<key-esc>", GC::BARE_KEY, 0, VK_ESCAPE},
+  {"<Key-SpaceDown>", GC::BARE_KEY, 0, VK_NEXT},
+  {"<Ctrl-S>", GC::CTRL_KEY, CTRL, 'S'},
+  {"<Ctrl-F19>", GC::CTRL_KEY, CTRL, VK_F19},
+  {"<Ctrl-Shift-S>", GC::CTRL_SHIFT_KEY, CTRL | SHIFT, 'S'},
+  {"<Shift-Ctrl-S>", GC::CTRL_SHIFT_KEY, CTRL | SHIFT, 'S'},
+  {"<Alt-W>", GC::ALT_KEY, ALT, 'W'},
+  {"<Alt-Shift-R>", GC::ALT_SHIFT_KEY, ALT | SHIFT, 'R'},
+  {"<SHIFT-alt-Return>", GC::ALT_SHIFT_KEY, ALT | SHIFT, VK_RETURN}
+};
+
+const char *INVALID[] = {
+  "", "<", "<>", "timer", "<timer", "timer>", "<Ctrl-S", "<-S>", "<Key->",
+  "<Key-Nothing>", "<Key-F25>", "<Key-Q-W>", "<q>", "<Shift-S>",
+  "<Ctrl-Ctrl-S>", "<Ctrl-Alt-S>", "<Alt-Ctrl-Shift-S>", "<Ctrl-Key-Q>",
+  "<Ctrl-Timer>", "<Shift-Hover>", "<Ctrl-Mouse-2>", "<Shift-Mouse-1>",
+  "<Ctrl-Shift-Mouse-1>", "<Mouse-3>", "<Mouse>", "<B3-Motion>",
+  "<B1-Motion-1>", "<ButtonRelease-3>", "<Wheel-Spin>", "<a-b-c-d-e-f>",
+  "<Ctrl-Shift-Alt-Shift-Ctrl-S>"
+};
+
+//! Returns \b true if the descriptors made from \p spec match \p expected
+bool parsesTo(const std::string &spec, const Case &expected) {
+  GC::EventDesc desc = GC::parseEvent(spec);
+  GC::EventDesc fromChars = GC::parseEvent(spec.c_str(), spec.length());
+  return (desc.type == expected.type) &&
+         (desc.modifiers == expected.modifiers) && (desc.key == expected.key) &&
+         (fromChars.type == desc.type) &&
+         (fromChars.modifiers == desc.modifiers) && (fromChars.key == desc.key);
+}
+
+//! The code the plain lookup finds for the name in any case
+int expectedKey(std::string name) {
+  for (char &ch : name) {
+    ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+  }
+  auto found = KEYS.find(name);
+  return (found == KEYS.end()) ? 0 : found->second;
+}
+
+int virtualKey(const std::string &name) {
+  return GC::virtualKey(name.c_str(), name.length());
+}
+
+//! Returns the number of key names looked up wrongly
+int checkKeys() {
+  int problems = 0, names = 0;
+  for (const auto &key : KEYS) {
+    std::string upper = key.first, mixed = key.first;
+    for (size_t i = 0; i < upper.size(); i++) {
+      upper[i] = static_cast<char>(std::toupper(upper[i]));
+      if (i % 2 == 0) {
+        mixed[i] = upper[i];
+      }
+    }
+    problems += (virtualKey(key.first) != key.second) +
+                (virtualKey(upper) != key.second) +
+                (virtualKey(mixed) != key.second);
+    names += 3;
+    // The names one character short or long of a key name
+    for (size_t length = 0; length < key.first.size(); length++) {
+      std::string prefix = key.first.substr(0, length);
+      problems += (virtualKey(prefix) != expectedKey(prefix));
+      names++;
+    }
+    for (char ch = ' '; ch <= '~'; ch++) {
+      std::string longer = key.first + ch;
+      problems += (virtualKey(longer) != expectedKey(longer));
+      names++;
+    }
+  }
+  // Random names, mostly made of the letters and digits the key names use
+  std::mt19937 generator(50);
+  const std::string LETTERS = "abcdefnoprstuwxyABCDEFNOPRSTUWXY0123456789-<>";
+  for (int i = 0; i < RANDOM_NAMES; i++) {
+    std::string name(1 + generator() % 9, ' ');
+    for (char &ch : name) {
+      ch = LETTERS[generator() % LETTERS.size()];
+    }
+    problems += (virtualKey(name) != expectedKey(name));
+    names++;
+  }
+  printf("Key names: %d of %d looked up wrongly\n", problems, names);
+  return problems;
+}
+
+//! Returns the number of event strings parsed wrongly
+int checkEvents() {
+  int problems = 0, strings = 0;
+  for (const Case &valid : VALID) {
+    bool parsed = parsesTo(valid.spec, valid);
+    if (!parsed) {
+      printf("%s parsed wrongly\n", valid.spec);
+    }
+    problems += !parsed;
+    strings++;
+  }
+  // Every key name as a bare key and with each set of modifiers
+  const struct {
+    const char *prefix;
+    GC::EventType type;
+    unsigned modifiers;
+  } KEY_EVENTS[] = {
+    {"<Key-", GC::BARE_KEY, 0},
+    {"<Ctrl-", GC::CTRL_KEY, CTRL},
+    {"<Ctrl-Shift-", GC::CTRL_SHIFT_KEY, CTRL | SHIFT},
+    {"<Alt-", GC::ALT_KEY, ALT},
+    {"<Shift-Alt-", GC::ALT_SHIFT_KEY, ALT | SHIFT}
+  };
+  for (const auto &keyEvent : KEY_EVENTS) {
+    for (const auto &key : KEYS) {
+      std::string spec = keyEvent.prefix + key.first + ">";
+      Case expected = {"", keyEvent.type, keyEvent.modifiers, key.second};
+      problems += !parsesTo(spec, expected);
+      strings++;
+    }
+  }
+  for (const char *invalid : INVALID) {
+    bool rejected = (GC::parseEvent(std::string(invalid)).type ==
+                     GC::INVALID_EVENT);
+    if (!rejected) {
+      printf("%s wasn't rejected\n", invalid);
+    }
+    problems += !rejected;
+    strings++;
+  }
+  printf("Event strings: %d of %d parsed wrongly\n", problems, strings);
+  return problems;
+}
+
+}  // namespace
+
+int main() {
+  int problems = checkKeys();
+  problems += checkEvents();
+  return problems ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+/*!
+ * \file InstancesPick.cxx
+ * \brief Adds, places, moves and scales random instances and checks the
+ * instance picked at random points, and the item's bounding box, against the
+ * ones found by going over every instance.
+ *
+ * Picking files the instances in a grid that single placements keep up to
+ * date and the bounding box only grows unless an instance leaves its edge, so
+ * this checks both after every kind of change. Copies, as the snapshots take
+ * them, are checked as well.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+#include <Shapes.h>
+
+namespace {
+
+const int STEPS = 3000;
+const int PICKS = 40;
+
+std::mt19937 generator(2026);
+
+int randomInt(int low, int high) {
+  return low + generator() % (high - low + 1);
+}
+
+GShape::Instance randomInstance() {
+  // Now and then a large one that covers many cells of the grid
+  float scale = randomInt(0, 20) ? randomInt(1, 8) * 0.25f : randomInt(10, 30);
+  return GShape::Instance {static_cast<float>(randomInt(-300, 300)),
+                           static_cast<float>(randomInt(-300, 300)), scale,
+                           CLR_INVALID};
+}
+
+//! The topmost instance holding the point, worked out instance by instance
+int expectedPick(GShape::Instances &item, float x, float y) {
+  for (int i = item.instances.size() - 1; i >= 0; i--) {
+    GShape::Box box = item.instanceBox(i);
+    const GShape::Instance &instance = item.instances[i];
+    if ((x < box.x1) || (x > box.x2) || (y < box.y1) || (y > box.y2) ||
+        (instance.scale == 0.0f)) {
+      continue;
+    }
+    float localX = (x - instance.x) / instance.scale;
+    float localY = (y - instance.y) / instance.scale;
+    if (item.geometry->pointInShape(std::floor(localX + 0.5f),
+                                    std::floor(localY + 0.5f))) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+//! Returns the number of problems with the item's bounding box
+int checkBounds(GShape::Instances &item) {
+  GShape::Box bounds = item.instanceBox(0);
+  for (size_t i = 1; i < item.instances.size(); i++) {
+    GShape::Box box = item.instanceBox(i);
+    bounds.x1 = std::min(bounds.x1, box.x1);
+    bounds.y1 = std::min(bounds.y1, box.y1);
+    bounds.x2 = std::max(bounds.x2, box.x2);
+    bounds.y2 = std::max(bounds.y2, box.y2);
+  }
+  Vec::Vec2D topLeft = item.topLeftCoord();
+  Vec::Vec2D bottomRight = item.bottomRightCoord();
+  return (topLeft.x != bounds.x1) || (topLeft.y != bounds.y1) ||
+         (bottomRight.x != bounds.x2) || (bottomRight.y != bounds.y2);
+}
+
+//! Returns the number of points picked differently
+int checkPicks(GShape::Instances &item, GShape::Instances &reference) {
+  int differ = 0;
+  for (int i = 0; i < PICKS; i++) {
+    // Mostly near an instance so that something gets picked
+    float x, y;
+    if (randomInt(0, 3)) {
+      const GShape::Instance &instance =
+        reference.instances[randomInt(0, reference.instances.size() - 1)];
+      x = instance.x + randomInt(-12, 12) * 0.5f;
+      y = instance.y + randomInt(-12, 12) * 0.5f;
+    } else {
+      x = randomInt(-700, 700) * 0.5f;
+      y = randomInt(-700, 700) * 0.5f;
+    }
+    if (item.pickInstance(x, y) != expectedPick(reference, x, y)) {
+      differ++;
+    }
+  }
+  return differ;
+}
+
+//! Returns the number of problems found
+int check(const std::shared_ptr<GShape::Shape> &geometry, const char *name) {
+  GShape::Instances item(geometry);
+  for (int i = 0; i < 200; i++) {
+    item.add(randomInstance());
+  }
+  int problems = 0, picks = 0;
+  for (int step = 0; step < STEPS; step++) {
+    int count = item.instances.size();
+    switch (randomInt(0, 9)) {
+      case 0:
+        item.add(randomInstance());
+        break;
+      case 1: {
+        int first = randomInt(0, count - 1);
+        std::vector<GShape::Instance> placements(randomInt(1,
+                                                           count - first));
+        for (GShape::Instance &instance : placements) {
+          instance = randomInstance();
+        }
+        item.place(first, placements);
+        break;
+      }
+      case 2:
+        item.move(randomInt(-5, 5), randomInt(-5, 5));
+        break;
+      case 3:
+        if (step % 7 == 0) {
+          item.scale(0.0f, 0.0f, 0.5f, 0.5f);
+          item.scale(0.0f, 0.0f, 2.0f, 2.0f);
+        }
+        break;
+      default: {
+        // Mostly small moves, which keep the instance in the same cells
+        int index = randomInt(0, count - 1);
+        GShape::Instance instance = item.instances[index];
+        if (randomInt(0, 2)) {
+          instance.x += randomInt(-4, 4);
+          instance.y += randomInt(-4, 4);
+        } else {
+          instance = randomInstance();
+        }
+        item.place(index, instance.x, instance.y, instance.scale);
+        break;
+      }
+    }
+    problems += checkBounds(item);
+    problems += checkPicks(item, item);
+    picks += PICKS;
+    if (step % 500 == 0) {
+      // A copy picks from the grid it was given, without building its own
+      std::shared_ptr<GShape::Shape> copy = item.clone();
+      copy->prepareQueries();
+      problems += checkPicks(*static_cast<GShape::Instances *>(copy.get()),
+                             item);
+      picks += PICKS;
+    }
+  }
+  printf("%s: %d problems in %d picks\n", name, problems, picks);
+  return problems;
+}
+
+}  // namespace
+
+int main() {
+  int problems = check(std::make_shared<GShape::Oval>(-10, -6, 10, 6), "Ovals");
+  std::vector<POINT> arrow = {{0, -10}, {8, 10}, {0, 5}, {-8, 10}};
+  problems += check(std::make_shared<GShape::Poly>(arrow), "Arrows");
+  return problems ? 1 : 0;
+}
@@ -0,0 +1,359 @@
+/*!
+ * \file NearestProperty.cxx
+ * \brief Checks the closest points of lines, polygons, rectangles, ovals and
+ * arcs against densely sampled outlines, and the nearest shapes the spatial
+ * grid finds against sorting every shape by its distance. Then times the
+ * grid's search in a scene of 100000 shapes.
+ *
+ * The outlines are sampled from the definitions of the shapes rather than
+ * from their code: an arc covers the points of its ellipse whose angle from
+ * the center, anticlockwise as seen on the screen, lies between `tiltAngle`
+ * and `tiltAngle + pieSize`.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cfloat>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+#include <SpatialGrid.h>
+
+namespace {
+
+const int SHAPES = 150;
+const int POINTS_PER_SHAPE = 40;
+const int OUTLINE_SAMPLES = 4000;
+const float TOLERANCE = 0.05f;
+const int SCENE_QUERIES = 500;
+const int LARGE_SCENE = 100000;
+
+std::mt19937 generator(2026);
+
+int randomInt(int low, int high) {
+  return low + generator() % (high - low + 1);
+}
+
+float randomFloat(float low, float high) {
+  return low + (high - low) * (generator() / 4294967296.0f);
+}
+
+struct Point {
+  double x, y;
+};
+
+double segmentDistance(const Point &point, const Point &start,
+                       const Point &end) {
+  double dx = end.x - start.x, dy = end.y - start.y;
+  double length = dx * dx + dy * dy;
+  double t = (length == 0.0) ? 0.0 :
+             ((point.x - start.x) * dx + (point.y - start.y) * dy) / length;
+  t = std::min(std::max(t, 0.0), 1.0);
+  double ex = start.x + t * dx - point.x, ey = start.y + t * dy - point.y;
+  return std::sqrt(ex * ex + ey * ey);
+}
+
+//! What the test knows of a shape: its outline and its inside
+struct Reference {
+  //! Pieces of the outline as polylines, or single points
+  std::vector<std::vector<Point>> pieces;
+  //! Returns true if the point is inside a shape with an interior
+  std::function<bool(double, double)> contains;
+
+  double distance(double x, double y) const {
+    if (contains && contains(x, y)) {
+      return 0.0;
+    }
+    Point point = {x, y};
+    double least = 1e30;
+    for (const auto &piece : pieces) {
+      if (piece.size() == 1) {
+        least = std::min(least, std::hypot(x - piece[0].x, y - piece[0].y));
+      }
+      for (size_t i = 1; i < piece.size(); i++) {
+        least = std::min(least, segmentDistance(point, piece[i - 1],
+                                                piece[i]));
+      }
+    }
+    return least;
+  }
+};
+
+//! Even-odd rule, written out again
+bool insidePolygon(const std::vector<Point> &points, double x, double y) {
+  bool inside = false;
+  for (size_t i = 0, j = points.size() - 1; i < points.size(); j = i++) {
+    if (((points[i].y > y) != (points[j].y > y)) &&
+        (x < (points[j].x - points[i].x) * (y - points[i].y) /
+         (points[j].y - points[i].y) + points[i].x)) {
+      inside = !inside;
+    }
+  }
+  return inside;
+}
+
+std::vector<POINT> toPOINTs(const std::vector<Point> &points) {
+  std::vector<POINT> converted;
+  for (const Point &point : points) {
+    converted.push_back({LONG(point.x), LONG(point.y)});
+  }
+  return converted;
+}
+
+std::vector<Point> randomPoints(int count, int x, int y) {
+  std::vector<Point> points;
+  for (int i = 0; i < count; i++) {
+    points.push_back({double(x + randomInt(-60, 60)),
+                      double(y + randomInt(-60, 60))});
+  }
+  return points;
+}
+
+//! The reference for an arc, or for an oval when \p pieSize is 360
+void makeEllipse(int x1, int y1, int x2, int y2, GShape::ArcType type,
+                 float pieSize, float tiltAngle, Reference *reference) {
+  double cx = (x1 + x2) / 2.0, cy = (y1 + y2) / 2.0;
+  double rx = (x2 - x1) / 2.0, ry = (y2 - y1) / 2.0;
+  auto inEllipse = [ = ](double px, double py) {
+    double u = (px - cx) / rx, v = (py - cy) / ry;
+    return u * u + v * v <= 1.0;
+  };
+  // The point of the ellipse at an angle from the center
+  auto atAngle = [ = ](double degrees) {
+    double radians = degrees * PI / 180.0;
+    double t = std::atan2(rx * std::sin(radians), ry * std::cos(radians));
+    return Point {cx + rx * std::cos(t), cy - ry * std::sin(t)};
+  };
+  // Sampled by angle so that no part of the sweep is missed
+  std::vector<Point> arc;
+  for (int i = 0; i <= OUTLINE_SAMPLES; i++) {
+    arc.push_back(atAngle(tiltAngle + double(pieSize) * i / OUTLINE_SAMPLES));
+  }
+  reference->pieces.push_back(arc);
+  if (pieSize >= 360.0f) {
+    reference->contains = inEllipse;
+    return;
+  }
+  Point start = arc.front(), end = arc.back();
+  if (type == GShape::PIE) {
+    reference->pieces.push_back({start, {cx, cy}, end});
+    reference->contains = [ = ](double px, double py) {
+      double degrees = std::atan2(cy - py, px - cx) * 180.0 / PI;
+      return inEllipse(px, py) &&
+             (((px == cx) && (py == cy)) ||
+              (std::fmod(degrees - tiltAngle + 720.0, 360.0) <= pieSize));
+    };
+  } else if (type == GShape::CHORD) {
+    reference->pieces.push_back({start, end});
+    auto side = [ = ](double px, double py) {
+      return (end.x - start.x) * (py - start.y) -
+             (end.y - start.y) * (px - start.x);
+    };
+    Point middle = atAngle(tiltAngle + pieSize / 2.0);
+    double arcSide = side(middle.x, middle.y);
+    reference->contains = [ = ](double px, double py) {
+      return inEllipse(px, py) && (side(px, py) * arcSide >= 0.0);
+    };
+  }
+}
+
+//! Makes a random shape around `(x, y)`, and the reference for it unless
+//! \p reference is NULL
+std::shared_ptr<GShape::Shape> randomShape(int x, int y, Reference *reference) {
+  int kind = randomInt(0, 5);
+  if (kind <= 1) {
+    std::vector<Point> points = randomPoints(randomInt(2 + kind, 8), x, y);
+    if (reference) {
+      std::vector<Point> outline = points;
+      if (kind == 1) {
+        outline.push_back(points[0]);
+        reference->contains = [points](double px, double py) {
+          return insidePolygon(points, px, py);
+        };
+      }
+      reference->pieces.push_back(outline);
+    }
+    if (kind == 0) {
+      return std::make_shared<GShape::Line>(toPOINTs(points));
+    }
+    return std::make_shared<GShape::Poly>(toPOINTs(points));
+  }
+  int x1 = x - randomInt(1, 60), y1 = y - randomInt(1, 60);
+  int x2 = x + randomInt(1, 60), y2 = y + randomInt(1, 60);
+  if (kind == 2) {
+    if (reference) {
+      reference->pieces.push_back({{double(x1), double(y1)},
+        {double(x2), double(y1)}, {double(x2), double(y2)},
+        {double(x1), double(y2)}, {double(x1), double(y1)}
+      });
+      reference->contains = [ = ](double px, double py) {
+        return (px >= x1) && (px <= x2) && (py >= y1) && (py <= y2);
+      };
+    }
+    return std::make_shared<GShape::Rect>(x1, y1, x2, y2);
+  }
+  if (kind == 3) {
+    if (reference) {
+      makeEllipse(x1, y1, x2, y2, GShape::CHORD, 360.0f, 0.0f, reference);
+    }
+    return std::make_shared<GShape::Oval>(x1, y1, x2, y2);
+  }
+  GShape::ArcType type = (kind == 4) ? GShape::ARC :
+                         (randomInt(0, 1) ? GShape::PIE : GShape::CHORD);
+  float pieSize = randomInt(1, 359);
+  float tiltAngle = randomInt(-360, 360);
+  if (reference) {
+    makeEllipse(x1, y1, x2, y2, type, pieSize, tiltAngle, reference);
+  }
+  return std::make_shared<GShape::LineArc>(x1, y1, x2, y2, type, pieSize,
+                                           tiltAngle);
+}
+
+//! Returns the number of points whose closest point is off
+int checkClosestPoints() {
+  const char *NAMES[] = {"lines", "polygons", "rectangles", "ovals", "arcs"};
+  int differ[5] = {}, tested[5] = {};
+  for (int i = 0; i < SHAPES; i++) {
+    Reference reference;
+    std::shared_ptr<GShape::Shape> shape = randomShape(0, 0, &reference);
+    const GShape::ShapeType TYPES[] = {GShape::LINE, GShape::POLYGON,
+                                       GShape::RECTANGLE, GShape::OVAL
+                                      };
+    int kind = std::find(TYPES, TYPES + 4, shape->shapeType) - TYPES;
+    for (int j = 0; j < POINTS_PER_SHAPE; j++) {
+      float x = randomFloat(-90.0f, 90.0f), y = randomFloat(-90.0f, 90.0f);
+      Vec::Vec2D closest = shape->closestPointTo(x, y);
+      double found = std::hypot(closest.x - x, closest.y - y);
+      tested[kind]++;
+      if (std::fabs(found - reference.distance(x, y)) > TOLERANCE) {
+        differ[kind]++;
+      }
+    }
+  }
+  int total = 0;
+  for (int kind = 0; kind < 5; kind++) {
+    printf("Closest points on %s: %d of %d differ\n", NAMES[kind],
+           differ[kind], tested[kind]);
+    total += differ[kind];
+  }
+  return total;
+}
+
+typedef std::vector<std::shared_ptr<GShape::Shape>> Scene;
+
+Scene makeScene(int count, int size, GShape::SpatialGrid *grid) {
+  Scene scene;
+  for (int i = 0; i < count; i++) {
+    scene.push_back(randomShape(randomInt(0, size), randomInt(0, size), NULL));
+    scene.back()->stackOrder = i;
+    scene.back()->penSize = randomInt(0, 4);
+    grid->insert(scene.back().get());
+  }
+  return scene;
+}
+
+//! The nearest shapes found by sorting them all, in the grid's order
+std::vector<int> sortedNearest(const Scene &scene, float x, float y, int count,
+                               float halo, float maxDistance) {
+  std::vector<GShape::Neighbour> all;
+  for (const auto &shape : scene) {
+    float distance = shape->distanceTo(x, y);
+    if (distance <= maxDistance) {
+      all.push_back({shape.get(), distance});
+    }
+  }
+  auto effective = [halo](float length) {
+    return (length <= halo) ? 0.0f : length;
+  };
+  std::sort(all.begin(), all.end(),
+  [&](const GShape::Neighbour & first, const GShape::Neighbour & second) {
+    if (effective(first.distance) != effective(second.distance)) {
+      return effective(first.distance) < effective(second.distance);
+    }
+    return first.shape->stackOrder > second.shape->stackOrder;
+  });
+  std::vector<int> ids;
+  for (int i = 0; i < std::min(count, int(all.size())); i++) {
+    ids.push_back(all[i].shape->shapeID);
+  }
+  return ids;
+}
+
+std::vector<int> gridNearest(const GShape::SpatialGrid &grid, float x, float y,
+                             int count, float halo, float maxDistance) {
+  std::vector<GShape::Neighbour> neighbours;
+  grid.nearest(Vec::Vec2D(x, y), count, halo, maxDistance,
+  [x, y](GShape::Shape * shape) {
+    return shape->distanceTo(x, y);
+  }, &neighbours);
+  std::vector<int> ids;
+  for (const GShape::Neighbour &neighbour : neighbours) {
+    ids.push_back(neighbour.shape->shapeID);
+  }
+  return ids;
+}
+
+//! Returns the number of queries whose answers differ
+int checkNearest() {
+  GShape::SpatialGrid grid;
+  Scene scene = makeScene(3000, 4000, &grid);
+  int differ = 0;
+  for (int i = 0; i < SCENE_QUERIES; i++) {
+    // Some of them far outside the scene
+    float x = randomFloat(-1000.0f, 5000.0f), y = randomFloat(-1000.0f, 5000.0f);
+    int count = randomInt(1, 6);
+    float halo = randomInt(0, 2) ? 0.0f : randomFloat(0.0f, 30.0f);
+    float maxDistance = randomInt(0, 2) ? FLT_MAX : randomFloat(0.0f, 200.0f);
+    if (gridNearest(grid, x, y, count, halo, maxDistance) !=
+        sortedNearest(scene, x, y, count, halo, maxDistance)) {
+      differ++;
+    }
+  }
+  printf("Nearest shapes: %d of %d queries differ\n", differ, SCENE_QUERIES);
+  return differ;
+}
+
+//! Prints how long the searches take in a large scene. Only the answers
+//! count towards the result.
+int timeNearest() {
+  GShape::SpatialGrid grid;
+  Scene scene = makeScene(LARGE_SCENE, 40000, &grid);
+  const int QUERIES = 2000;
+  const int SORTED_QUERIES = 3;
+  typedef std::chrono::steady_clock Clock;
+  std::vector<float> xs, ys;
+  for (int i = 0; i < QUERIES; i++) {
+    xs.push_back(randomFloat(0.0f, 40000.0f));
+    ys.push_back(randomFloat(0.0f, 40000.0f));
+  }
+  std::vector<std::vector<int>> answers;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < QUERIES; i++) {
+    answers.push_back(gridNearest(grid, xs[i], ys[i], 1, 0.0f, FLT_MAX));
+  }
+  double gridTime = std::chrono::duration<double, std::micro>(
+                      Clock::now() - start).count() / QUERIES;
+  int differ = 0;
+  start = Clock::now();
+  for (int i = 0; i < SORTED_QUERIES; i++) {
+    differ += (sortedNearest(scene, xs[i], ys[i], 1, 0.0f, FLT_MAX) !=
+               answers[i]);
+  }
+  double sortedTime = std::chrono::duration<double, std::micro>(
+                        Clock::now() - start).count() / SORTED_QUERIES;
+  printf("%d shapes: %.1f us a query with the grid, %.0f us going over all "
+         "of them, %d differ\n", LARGE_SCENE, gridTime, sortedTime, differ);
+  return differ;
+}
+
+}  // namespace
+
+int main() {
+  int problems = checkClosestPoints();
+  problems += checkNearest();
+  problems += timeNearest();
+  return problems ? 1 : 0;
+}
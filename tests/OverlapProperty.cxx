@@ -0,0 +1,239 @@
+/*!
+ * \file OverlapProperty.cxx
+ * \brief Checks the overlap tests against slow but obviously correct
+ * references on random inputs.
+ *
+ * The coordinates are small integers so that touching corners, shared ends,
+ * collinear segments and segments running along a region's side come up
+ * often. The references only use integer arithmetic, so they are exact.
+ */
+
+#include <cstdio>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <Shapes.h>
+
+namespace {
+
+const int CASES = 200000;
+const int RANGE = 24;
+
+struct Segment {
+  POINT start, end;
+};
+
+struct Region {
+  POINT topLeft, bottomRight;
+};
+
+std::mt19937 generator(2026);
+
+int coordinate() {
+  return generator() % RANGE;
+}
+
+POINT randomPoint() {
+  return {coordinate(), coordinate()};
+}
+
+Region randomRegion() {
+  POINT a = randomPoint(), b = randomPoint();
+  return {{std::min(a.x, b.x), std::min(a.y, b.y)},
+          {std::max(a.x, b.x), std::max(a.y, b.y)}};
+}
+
+std::vector<POINT> randomPoints(int count) {
+  std::vector<POINT> points;
+  for (int i = 0; i < count; i++) {
+    points.push_back(randomPoint());
+  }
+  return points;
+}
+
+bool inRegion(const POINT &point, const Region &region) {
+  return (point.x >= region.topLeft.x) && (point.x <= region.bottomRight.x) &&
+         (point.y >= region.topLeft.y) && (point.y <= region.bottomRight.y);
+}
+
+long long cross(long long ax, long long ay, long long bx, long long by) {
+  return ax * by - ay * bx;
+}
+
+//! Visits every lattice point of the first region
+bool referenceRegionsOverlap(const Region &first, const Region &second) {
+  for (LONG y = first.topLeft.y; y <= first.bottomRight.y; y++) {
+    for (LONG x = first.topLeft.x; x <= first.bottomRight.x; x++) {
+      if (inRegion({x, y}, second)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+//! Whether `numerator / denominator` lies in [0, 1]
+bool unitFraction(long long numerator, long long denominator) {
+  if (denominator < 0) {
+    numerator = -numerator;
+    denominator = -denominator;
+  }
+  return (numerator >= 0) && (numerator <= denominator);
+}
+
+//! Solves for the parameters of the crossing point, falling back to
+//! overlapping extents when the segments are parallel
+bool referenceLinesIntersect(const Segment &first, const Segment &second) {
+  long long dx1 = first.end.x - first.start.x,
+            dy1 = first.end.y - first.start.y;
+  long long dx2 = second.end.x - second.start.x,
+            dy2 = second.end.y - second.start.y;
+  long long ox = second.start.x - first.start.x,
+            oy = second.start.y - first.start.y;
+  long long denominator = cross(dx1, dy1, dx2, dy2);
+  if (denominator != 0) {
+    return unitFraction(cross(ox, oy, dx2, dy2), denominator) &&
+           unitFraction(cross(ox, oy, dx1, dy1), denominator);
+  }
+  // Parallel, so they only meet if they're on the same line
+  if ((cross(dx1, dy1, ox, oy) != 0) || (cross(dx2, dy2, ox, oy) != 0)) {
+    return false;
+  }
+  return (std::max(first.start.x, first.end.x) >=
+          std::min(second.start.x, second.end.x)) &&
+         (std::max(second.start.x, second.end.x) >=
+          std::min(first.start.x, first.end.x)) &&
+         (std::max(first.start.y, first.end.y) >=
+          std::min(second.start.y, second.end.y)) &&
+         (std::max(second.start.y, second.end.y) >=
+          std::min(first.start.y, first.end.y));
+}
+
+//! An end inside the region or a crossing with one of its four sides
+bool referenceSegmentOverlapsRegion(const Segment &segment,
+                                    const Region &region) {
+  if (inRegion(segment.start, region) || inRegion(segment.end, region)) {
+    return true;
+  }
+  POINT corners[] = {
+    region.topLeft, {region.bottomRight.x, region.topLeft.y},
+    region.bottomRight, {region.topLeft.x, region.bottomRight.y}
+  };
+  for (int i = 0, j = 3; i < 4; j = i++) {
+    if (referenceLinesIntersect(segment, {corners[j], corners[i]})) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//! The even-odd crossing count, with the division multiplied out
+bool referencePointInPolygon(const POINT &point,
+                             const std::vector<POINT> &points) {
+  bool inside = false;
+  int vertices = points.size();
+  for (int i = 0, j = vertices - 1; i < vertices; j = i++) {
+    const POINT &a = points[i], &b = points[j];
+    if ((a.y > point.y) == (b.y > point.y)) {
+      continue;
+    }
+    // point.x < a.x + (b.x - a.x) * (point.y - a.y) / (b.y - a.y)
+    long long height = b.y - a.y;
+    long long left = static_cast<long long>(point.x - a.x) * height;
+    long long right = static_cast<long long>(b.x - a.x) * (point.y - a.y);
+    if ((height > 0) ? (left < right) : (left > right)) {
+      inside = !inside;
+    }
+  }
+  return inside;
+}
+
+bool referencePolygonOverlapsRegion(const std::vector<POINT> &points,
+                                    const Region &region) {
+  int vertices = points.size();
+  for (int i = 0, j = vertices - 1; i < vertices; j = i++) {
+    if (referenceSegmentOverlapsRegion({points[j], points[i]}, region)) {
+      return true;
+    }
+  }
+  // No edge touches the region so its corner isn't on the outline
+  return referencePointInPolygon(region.topLeft, points);
+}
+
+bool referenceLineOverlapsRegion(const std::vector<POINT> &points,
+                                 const Region &region) {
+  if (points.size() == 1) {
+    return inRegion(points[0], region);
+  }
+  for (size_t i = 0; i + 1 < points.size(); i++) {
+    if (referenceSegmentOverlapsRegion({points[i], points[i + 1]}, region)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//! Tallies the cases where a test disagrees with its reference
+struct Property {
+  const char *name;
+  int mismatches;
+  void check(bool actual, bool expected) {
+    if (actual != expected) {
+      mismatches++;
+    }
+  }
+  int report() const {
+    printf("%s: %d of %d cases differ\n", name, mismatches, CASES);
+    return mismatches;
+  }
+};
+
+}  // namespace
+
+int main() {
+  Property regions = {"regionsOverlap", 0};
+  Property lines = {"linesIntersect", 0};
+  Property segments = {"segmentOverlapsRegion", 0};
+  Property polygons = {"Poly::overlapsWithRegion", 0};
+  Property polylines = {"Line::overlapsWithRegion", 0};
+
+  for (int i = 0; i < CASES; i++) {
+    Region first = randomRegion(), second = randomRegion();
+    regions.check(GShape::regionsOverlap(first.topLeft, first.bottomRight,
+                                         second.topLeft, second.bottomRight),
+                  referenceRegionsOverlap(first, second));
+
+    Segment one = {randomPoint(), randomPoint()};
+    Segment other = {randomPoint(), randomPoint()};
+    lines.check(GShape::linesIntersect(one.start, one.end,
+                                       other.start, other.end),
+                referenceLinesIntersect(one, other));
+
+    segments.check(GShape::segmentOverlapsRegion(one.start, one.end,
+                                                 first.topLeft,
+                                                 first.bottomRight),
+                   referenceSegmentOverlapsRegion(one, first));
+
+    // Now and then large enough to be tested through the slabs
+    int vertices = (i % 16) ? 3 + i % 8
+                            : GShape::EdgeSlabs::MIN_POINTS + i % 32;
+    std::vector<POINT> points = randomPoints(vertices);
+    GShape::Poly polygon(points);
+    polygons.check(polygon.overlapsWithRegion(first.topLeft,
+                                              first.bottomRight),
+                   referencePolygonOverlapsRegion(points, first));
+
+    // And through the segment tree
+    int count = (i % 16) ? 1 + i % 12
+                         : GShape::SegmentTree::MIN_POINTS + i % 32;
+    points = randomPoints(count);
+    GShape::Line line(points);
+    polylines.check(line.overlapsWithRegion(first.topLeft,
+                                            first.bottomRight),
+                    referenceLineOverlapsRegion(points, first));
+  }
+
+  int mismatches = regions.report() + lines.report() + segments.report() +
+                   polygons.report() + polylines.report();
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+/*!
+ * \file ParallelScene.cxx
+ * \brief Recolours, tags and takes the bounding boxes of a scene large enough
+ * to be split among threads, with 1, 2, 4 and 8 threads, and checks that all
+ * of them leave the items the same and return the same boxes.
+ */
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <Canvas.h>
+
+namespace {
+
+const int ITEMS = 5 * GC::Canvas::PARALLEL_ITEMS;
+const int THREADS[] = {1, 2, 4, 8};
+
+//! What the operations leave behind
+struct Outcome {
+  std::vector<bool> returned;
+  std::vector<GS::Box> boxes;
+  std::vector<std::string> fills, pens;
+  std::vector<std::vector<std::string>> tags;
+
+  bool operator==(const Outcome &other) const {
+    if ((returned != other.returned) || (fills != other.fills) ||
+        (pens != other.pens) || (tags != other.tags) ||
+        (boxes.size() != other.boxes.size())) {
+      return false;
+    }
+    for (size_t i = 0; i < boxes.size(); i++) {
+      const GS::Box &box = boxes[i], &otherBox = other.boxes[i];
+      if ((box.x1 != otherBox.x1) || (box.y1 != otherBox.y1) ||
+          (box.x2 != otherBox.x2) || (box.y2 != otherBox.y2)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+//! Gives every canvas the same random scene. Returns the ids, bottom to top.
+std::vector<int> populate(GC::Canvas &canv) {
+  std::mt19937 generator(2026);
+  auto coordinate = [&generator]() {
+    return static_cast<int>(generator() % 2000);
+  };
+  std::vector<int> items;
+  for (int i = 0; i < ITEMS; i++) {
+    int x = coordinate(), y = coordinate();
+    int size = 1 + generator() % 40;
+    int id;
+    switch (i % 4) {
+      case 0:
+        id = canv.rectangle(x, y, x + size, y + size / 2);
+        break;
+      case 1:
+        id = canv.oval(x, y, x + size / 2, y + size);
+        break;
+      case 2:
+        id = canv.line({{x, y}, {x + size, y + size}, {x, y + size}});
+        break;
+      default:
+        id = canv.polygon({{x, y}, {x + size, y}, {x + size / 2, y + size}});
+        break;
+    }
+    items.push_back(id);
+  }
+  // Tagged through the handles as looking an item up by id goes over them all
+  int i = 0;
+  for (GC::ShapeRef shape : canv.withTag("all")) {
+    shape.addTag((i++ % 3) ? "even" : "odd");
+    if (generator() % 5 == 0) {
+      shape.addTag("marked");
+    }
+  }
+  return items;
+}
+
+Outcome run(int threads) {
+  GC::Canvas canv(0, 0, 600, 600);
+  canv.parallelism(threads);
+  std::vector<int> items = populate(canv);
+
+  Outcome outcome;
+  outcome.returned.push_back(canv.fillColor("odd", "red"));
+  outcome.returned.push_back(canv.penColor("marked&&!odd", "blue"));
+  outcome.returned.push_back(canv.fillColor("nothing", "green"));
+  outcome.returned.push_back(canv.tagEnclosed("inside", 200, 300, 1400, 900));
+  GS::Box strip(900.0f, 100.0f, 1100.0f, 1900.0f);
+  outcome.returned.push_back(canv.tagOverlapping("touching", strip));
+  outcome.returned.push_back(canv.tagOverlapping("outside", -90, -90, -50, -50));
+  outcome.boxes.push_back(canv.BBox(std::vector<std::string> {"odd"}));
+  outcome.boxes.push_back(canv.BBox(std::vector<std::string> {"inside"}));
+  outcome.boxes.push_back(canv.BBox(std::vector<std::string> {"touching"}));
+  outcome.boxes.push_back(canv.BBox(std::vector<std::string> {"outside"}));
+  outcome.boxes.push_back(canv.BBox(items));
+  for (GC::ShapeRef shape : canv.withTag("all")) {
+    outcome.fills.push_back(shape.fillColor());
+    outcome.pens.push_back(shape.penColor());
+    outcome.tags.push_back(shape.get()->tags());
+  }
+  return outcome;
+}
+
+}  // namespace
+
+int main() {
+  Outcome single = run(1);
+  int differ = 0;
+  for (int threads : THREADS) {
+    bool same = (run(threads) == single);
+    printf("%d threads: %s\n", threads, same ? "same" : "different");
+    differ += !same;
+  }
+  return differ ? 1 : 0;
+}
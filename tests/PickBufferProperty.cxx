@@ -0,0 +1,199 @@
+/*!
+ * \file PickBufferProperty.cxx
+ * \brief Moves, hides and raises random discs and rings, pans and zooms the
+ * view, and checks every pixel of the pick raster against the topmost item
+ * found by testing them all.
+ *
+ * The raster is only told about the changes the way Canvas tells it, so this
+ * checks the damage tracking and scrolling as well as the filling. Centres,
+ * radii, zooms and pans are picked so that all the float arithmetic is exact.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <PickBuffer.h>
+
+namespace {
+
+const int STEPS = 2000;
+const int ITEMS = 60;
+const int WIDTH = 64;
+const int HEIGHT = 48;
+const float ZOOMS[] = {0.5f, 1.0f, 2.0f, 4.0f};
+
+std::mt19937 generator(2026);
+
+int randomInt(int low, int high) {
+  return low + generator() % (high - low + 1);
+}
+
+//! A disc, or a ring when `inner` isn't negative
+struct Item {
+  int id;
+  int x, y, outer, inner;
+  bool hidden;
+
+  GShape::PickItem pickItem() {
+    // One more all round as Canvas does for the pen
+    return {id, float(x - outer - 1), float(y - outer - 1),
+            float(x + outer + 1), float(y + outer + 1), this};
+  }
+
+  bool covers(float px, float py) const {
+    float dx = px - x, dy = py - y;
+    float distance = dx * dx + dy * dy;
+    return (distance <= outer * outer) &&
+           ((inner < 0) || (distance >= inner * inner));
+  }
+};
+
+struct Scene {
+  //! Bottom to top
+  std::vector<Item *> items;
+  GShape::PickView view;
+  GShape::PickBuffer buffer;
+
+  void randomize(Item *item) {
+    item->x = randomInt(-20, 60);
+    item->y = randomInt(-20, 50);
+    item->outer = randomInt(0, 12);
+    item->inner = randomInt(0, 2) ? -1 : randomInt(0, item->outer);
+  }
+
+  //! Changes an item, damaging the raster before and after like Canvas does
+  void mutate() {
+    Item *item = items[randomInt(0, items.size() - 1)];
+    buffer.damage(item->pickItem(), view);
+    switch (randomInt(0, 3)) {
+      case 0:
+        randomize(item);
+        break;
+      case 1:
+        item->x += randomInt(-3, 3);
+        item->y += randomInt(-3, 3);
+        break;
+      case 2:
+        item->hidden = !item->hidden;
+        break;
+      default:
+        // Raised to the top
+        items.erase(std::find(items.begin(), items.end(), item));
+        items.push_back(item);
+        break;
+    }
+    buffer.damage(item->pickItem(), view);
+  }
+
+  void moveView() {
+    if (randomInt(0, 3)) {
+      int columns = randomInt(-20, 20), rows = randomInt(-20, 20);
+      // Kept over the items
+      if (std::abs(view.x + columns / view.zoom) > 60) {
+        columns = -columns;
+      }
+      if (std::abs(view.y + rows / view.zoom) > 60) {
+        rows = -rows;
+      }
+      view.x += columns / view.zoom;
+      view.y += rows / view.zoom;
+      buffer.scroll(columns, rows);
+    } else {
+      view.zoom = ZOOMS[randomInt(0, 3)];
+      buffer.damageAll();
+    }
+  }
+
+  void update() {
+    buffer.update(view,
+    [this](float x1, float y1, float x2, float y2,
+    std::vector<GShape::PickItem> *found) {
+      for (Item *item : items) {
+        GShape::PickItem box = item->pickItem();
+        if (!item->hidden && (box.x1 <= x2) && (box.x2 >= x1) &&
+            (box.y1 <= y2) && (box.y2 >= y1)) {
+          found->push_back(box);
+        }
+      }
+    },
+    [](const GShape::PickItem & box, const float *xs, const float *ys, int count,
+    unsigned char *inside) {
+      const Item *item = static_cast<const Item *>(box.item);
+      int covered = 0;
+      for (int i = 0; i < count; i++) {
+        inside[i] = item->covers(xs[i], ys[i]);
+        covered += inside[i];
+      }
+      return covered;
+    });
+  }
+
+  //! The topmost visible item whose box holds the pixel's canvas point and
+  //! which covers that point once rounded
+  int expected(int x, int y) {
+    float xCanvas = view.x + x / view.zoom;
+    float yCanvas = view.y + y / view.zoom;
+    float xRounded = std::floor(xCanvas + 0.5f);
+    float yRounded = std::floor(yCanvas + 0.5f);
+    for (auto item = items.rbegin(); item != items.rend(); ++item) {
+      GShape::PickItem box = (*item)->pickItem();
+      if (!(*item)->hidden && (xCanvas >= box.x1) && (xCanvas <= box.x2) &&
+          (yCanvas >= box.y1) && (yCanvas <= box.y2) &&
+          (*item)->covers(xRounded, yRounded)) {
+        return (*item)->id;
+      }
+    }
+    return GShape::PickBuffer::NO_SHAPE;
+  }
+
+  //! Returns the number of pixels that differ
+  int compare() {
+    int differ = 0;
+    for (int y = 0; y < buffer.height(); y++) {
+      for (int x = 0; x < buffer.width(); x++) {
+        if (buffer.at(x, y) != expected(x, y)) {
+          differ++;
+        }
+      }
+    }
+    return differ;
+  }
+};
+
+}  // namespace
+
+int main() {
+  std::vector<Item> storage(ITEMS);
+  Scene scene;
+  scene.view = {0.0f, 0.0f, 1.0f};
+  scene.buffer.resize(WIDTH, HEIGHT);
+  for (int i = 0; i < ITEMS; i++) {
+    storage[i].id = i;
+    storage[i].hidden = false;
+    scene.randomize(&storage[i]);
+    scene.items.push_back(&storage[i]);
+  }
+
+  int problems = 0, pixels = 0;
+  for (int step = 0; step < STEPS; step++) {
+    // Now and then more changes than the raster keeps rectangles for
+    int changes = (step % 50) ? randomInt(1, 4) : 40;
+    for (int i = 0; i < changes; i++) {
+      scene.mutate();
+    }
+    if (step % 3 == 0) {
+      scene.moveView();
+    }
+    if (step % 500 == 499) {
+      scene.buffer.resize(randomInt(1, WIDTH), randomInt(1, HEIGHT));
+    }
+    scene.update();
+    problems += scene.compare();
+    pixels += scene.buffer.width() * scene.buffer.height();
+  }
+  printf("%d of %d pixels differ\n", problems, pixels);
+  return problems ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+/*!
+ * \file ReplayDrag.cxx
+ * \brief Replays a drag from one rectangle onto another, read from a log file,
+ * and checks that the drag and release handlers stay on the rectangle it
+ * started on and that the replay leaves the mouse alone.
+ *
+ * The window is created but never shown, so the replay runs next to a window
+ * it could take the mouse capture from.
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <Canvas.h>
+
+namespace {
+
+const char *PATH = "ReplayDrag.gcir";
+
+struct Counter : GC::EventHandler {
+  int *count;
+  explicit Counter(int *count_) : count(count_) {}
+  virtual void handle(GC::Mouse) override {
+    (*count)++;
+  }
+};
+
+GC::LoggedEvent logged(GC::EventType type, int x, int y, unsigned state,
+                       unsigned time) {
+  GC::LoggedEvent event;
+  event.time = time;
+  event.type = type;
+  event.key = (type == GC::LEFT_DRAG) ? 0 : VK_LBUTTON;
+  event.x = event.xRoot = x;
+  event.y = event.yRoot = y;
+  event.state = state;
+  return event;
+}
+
+int expect(const char *what, int count, int expected) {
+  printf("%s: %d, expected %d\n", what, count, expected);
+  return count != expected;
+}
+
+}  // namespace
+
+int main() {
+  GC::Canvas canv(400, 400, "Replay drag");
+  canv.init();
+  int first = canv.rectangle(100, 100, 200, 200);
+  int second = canv.rectangle(250, 250, 350, 350);
+  int firstDrags = 0, secondDrags = 0, firstReleases = 0, secondReleases = 0;
+  canv.bind("<B1-Motion>", Counter(&firstDrags), first);
+  canv.bind("<B1-Motion>", Counter(&secondDrags), second);
+  canv.bind("<ButtonRelease-1>", Counter(&firstReleases), first);
+  canv.bind("<ButtonRelease-1>", Counter(&secondReleases), second);
+
+  // Pressed on the first rectangle and let go over the second
+  std::vector<GC::LoggedEvent> press = {
+    logged(GC::LEFT_CLICK, 150, 150, GC::LEFT_BUTTON_HELD, 0),
+    logged(GC::LEFT_DRAG, 220, 220, GC::LEFT_BUTTON_HELD, 20),
+    logged(GC::LEFT_DRAG, 300, 300, GC::LEFT_BUTTON_HELD, 40)
+  };
+  GC::EventLogWriter writer;
+  if (!writer.open(PATH)) {
+    printf("Can't write %s\n", PATH);
+    return 1;
+  }
+  for (const GC::LoggedEvent &event : press) {
+    writer.write(event);
+  }
+  writer.close();
+
+  std::vector<GC::EventTiming> timings;
+  int problems = 0;
+  if (!canv.replay(PATH, &timings) || (timings.size() != press.size())) {
+    printf("The log wasn't replayed\n");
+    problems++;
+  }
+  std::remove(PATH);
+  problems += expect("Captured by the replay", GetCapture() == canv.handle(),
+                     0);
+
+  canv.replay({logged(GC::LEFT_RELEASE, 300, 300, 0, 60)}, &timings);
+  problems += expect("Drags on the first rectangle", firstDrags, 2);
+  problems += expect("Drags on the second rectangle", secondDrags, 0);
+  problems += expect("Releases on the first rectangle", firstReleases, 1);
+  problems += expect("Releases on the second rectangle", secondReleases, 0);
+
+  DestroyWindow(canv.handle());
+  return problems ? 1 : 0;
+}
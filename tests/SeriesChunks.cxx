@@ -0,0 +1,76 @@
+/*!
+ * \file SeriesChunks.cxx
+ * \brief Appends to series of several capacities and checks the samples they
+ * keep, and those of copies taken along the way, against a plain deque.
+ *
+ * The copies share the full chunks with the series, so this also checks that
+ * appending never changes a sample a copy can see.
+ */
+
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <Shapes.h>
+
+namespace {
+
+const int APPENDS = 20000;
+const int COPY_EVERY = 777;
+
+typedef std::deque<Vec::Vec2D> Samples;
+
+//! Returns the number of samples that differ from the expected ones
+int compare(const GShape::Series &series, const Samples &expected) {
+  if (series.count != int(expected.size())) {
+    return 1;
+  }
+  int differ = 0;
+  for (int i = 0; i < series.count; i++) {
+    Vec::Vec2D sample = series.sample(i);
+    if ((sample.x != expected[i].x) || (sample.y != expected[i].y)) {
+      differ++;
+    }
+  }
+  return differ;
+}
+
+//! Returns the number of problems found
+int check(int capacity) {
+  GShape::Series series(0, 0, 100, 100, capacity);
+  Samples expected;
+  std::vector<std::pair<std::shared_ptr<GShape::Shape>, Samples>> copies;
+  int problems = 0;
+  for (int i = 0; i < APPENDS; i++) {
+    Vec::Vec2D sample(static_cast<float>(i), i * 0.5f);
+    series.append(sample.x, sample.y);
+    expected.push_back(sample);
+    if (int(expected.size()) > capacity) {
+      expected.pop_front();
+    }
+    if (i % COPY_EVERY == 0) {
+      copies.push_back(std::make_pair(series.clone(), expected));
+      problems += compare(series, expected);
+    }
+  }
+  problems += compare(series, expected);
+  for (const auto &copy : copies) {
+    problems += compare(*static_cast<GShape::Series *>(copy.first.get()),
+                        copy.second);
+  }
+  printf("Capacity %d: %d problems\n", capacity, problems);
+  return problems;
+}
+
+}  // namespace
+
+int main() {
+  int problems = 0;
+  const int CHUNK = GShape::Series::CHUNK_SIZE;
+  const int CAPACITIES[] = {1, 7, CHUNK - 1, CHUNK, CHUNK + 1, 5 * CHUNK};
+  for (int capacity : CAPACITIES) {
+    problems += check(capacity);
+  }
+  return problems ? 1 : 0;
+}
@@ -0,0 +1,215 @@
+/*!
+ * \file SnapshotStress.cxx
+ * \brief Queries snapshots from several threads while the main thread keeps
+ * changing the items and publishing new snapshots.
+ *
+ * The ovals, arcs, polygons and lines, including the ones inside instanced
+ * items and groups, are never moved, so their copies are shared by all the
+ * snapshots and every reader runs its hit tests on the same objects. Each
+ * reader compares its answers with the ones worked out before the threads
+ * started. Build with `TSAN=1` (`-DGDICANVAS_TSAN=ON` with CMake) to have
+ * ThreadSanitizer report any hit test that still writes to a shared copy.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <Snapshot.h>
+
+namespace {
+
+const int READERS = 4;
+const int ROUNDS = 2000;
+
+struct Region {
+  int x1, y1, x2, y2;
+};
+
+//! Regions that fall inside the bounding boxes of the fixed items but not
+//! always inside the items themselves
+const Region REGIONS[] = {
+  {45, 20, 55, 30},      // Middle of the oval
+  {2, 2, 6, 6},          // Corner of the oval's box
+  {160, 60, 170, 70},    // Inside the pie
+  {110, 10, 114, 14},    // Corner of the pie's box
+  {250, 50, 252, 52},    // On the chord's flat side
+  {330, 25, 334, 29},    // On the arc line
+  {20, 220, 24, 224},    // In an instanced oval
+  {38, 202, 40, 204},    // Between the instanced ovals
+  {210, 210, 214, 214},  // In the grouped pie
+  {110, 300, 114, 304},  // On the line
+  {150, 150, 400, 400},  // Around most of the group
+  {0, 495, 195, 515},    // Over some of the moving rectangles
+};
+const int REGION_COUNT = sizeof(REGIONS) / sizeof(REGIONS[0]);
+
+typedef std::vector<std::shared_ptr<GShape::Shape>> Scene;
+
+//! Makes the items, bottom to top. Returns the positions of the ones that keep
+//! being moved.
+std::vector<int> populate(Scene *scene) {
+  using namespace GShape;
+  scene->emplace_back(new Oval(0, 0, 100, 50));
+  scene->emplace_back(new LineArc(100, 0, 200, 100, PIE, 90.0f, 0.0f));
+  scene->emplace_back(new LineArc(200, 0, 300, 100, CHORD, 120.0f, 30.0f));
+  scene->emplace_back(new LineArc(300, 0, 400, 100, ARC, 200.0f, 320.0f));
+  scene->emplace_back(new Circle(500, 50, 40));
+
+  std::shared_ptr<Shape> herd(new Instances(
+                                std::make_shared<Oval>(-10, -5, 10, 5)));
+  for (int i = 0; i < 10; i++) {
+    static_cast<Instances *>(herd.get())->add({20.0f + 30 * i, 220.0f,
+                                               1.0f + 0.1f * i, CLR_INVALID});
+  }
+  scene->push_back(herd);
+  std::vector<POINT> star;
+  for (int i = 0; i < 200; i++) {
+    float angle = i * 2 * 3.14159f / 200;
+    float radius = (i % 2) ? 30.0f : 60.0f;
+    star.push_back({LONG(450 + radius * std::cos(angle)),
+                    LONG(350 + radius * std::sin(angle))});
+  }
+  scene->emplace_back(new Group({
+    std::make_shared<LineArc>(180, 180, 280, 280, PIE, 270.0f, 45.0f),
+    std::make_shared<Oval>(300, 200, 380, 260),
+    std::make_shared<Poly>(star)
+  }));
+
+  std::vector<POINT> wave;
+  for (int x = 0; x < 600; x += 2) {
+    wave.push_back({x, LONG(320 + 20 * std::sin(x * 0.05f))});
+  }
+  scene->emplace_back(new Line(wave));
+
+  std::vector<int> movers;
+  for (int i = 0; i < 20; i++) {
+    movers.push_back(scene->size());
+    scene->emplace_back(new Rect(20 * i, 500, 20 * i + 10, 510));
+  }
+  return movers;
+}
+
+//! The positions of the items the test selects, worked out one by one
+template<typename Test>
+std::vector<int> expected(const Scene &scene, const Region &region, Test test) {
+  Vec::Vec2D topLeft(region.x1, region.y1);
+  Vec::Vec2D bottomRight(region.x2, region.y2);
+  std::vector<int> positions;
+  for (size_t i = 0; i < scene.size(); i++) {
+    if (test(scene[i].get(), topLeft, bottomRight)) {
+      positions.push_back(i);
+    }
+  }
+  return positions;
+}
+
+}  // namespace
+
+int main() {
+  // The answers are worked out on a second scene so that none of the hit
+  // tests on the first one have run before the snapshots are taken. The
+  // moving rectangles are only ever one pixel off their starting place when
+  // a snapshot is taken, which these regions don't tell apart.
+  Scene reference;
+  populate(&reference);
+  Scene scene;
+  std::vector<int> movers = populate(&scene);
+  std::vector<int> ids;
+  std::unordered_map<int, int> positions;
+  for (size_t i = 0; i < scene.size(); i++) {
+    ids.push_back(scene[i]->shapeID);
+    positions[ids[i]] = i;
+  }
+  auto toPositions = [&](const std::vector<int> &items) {
+    std::vector<int> translated;
+    for (int id : items) {
+      translated.push_back(positions.at(id));
+    }
+    return translated;
+  };
+
+  std::vector<std::vector<int>> overlapping(REGION_COUNT);
+  std::vector<std::vector<int>> enclosed(REGION_COUNT);
+  for (int i = 0; i < REGION_COUNT; i++) {
+    overlapping[i] = expected(reference, REGIONS[i],
+    [](GShape::Shape * shape, const Vec::Vec2D & topLeft,
+    const Vec::Vec2D & bottomRight) {
+      return shape->overlapsWithRegion(topLeft, bottomRight);
+    });
+    enclosed[i] = expected(reference, REGIONS[i],
+    [](GShape::Shape * shape, const Vec::Vec2D & topLeft,
+    const Vec::Vec2D & bottomRight) {
+      return shape->shapeInRegion(topLeft, bottomRight);
+    });
+  }
+
+  GCanvas::SnapshotPublisher publisher;
+  unsigned long published = 0;
+  std::shared_ptr<const GCanvas::Snapshot> latest =
+    publisher.publish(scene, ++published);
+
+  // Only relaxed operations are shared between the readers so that they
+  // don't order each other's hit tests
+  std::atomic<bool> stop(false);
+  std::atomic<int> arrived(0);
+  std::atomic<int> failures(0);
+  std::atomic<long> queries(0);
+  std::vector<std::thread> readers;
+  for (int r = 0; r < READERS; r++) {
+    readers.emplace_back([&, r]() {
+      std::shared_ptr<const GCanvas::Snapshot> snapshot = std::atomic_load(
+                                                           &latest);
+      arrived.fetch_add(1, std::memory_order_relaxed);
+      while (arrived.load(std::memory_order_relaxed) < READERS) {
+        std::this_thread::yield();
+      }
+      for (int i = r; !stop.load(std::memory_order_relaxed);
+           i = (i + 1) % REGION_COUNT) {
+        const Region &box = REGIONS[i];
+        if ((toPositions(snapshot->findOverlapping(box.x1, box.y1,
+                                                   box.x2, box.y2)) !=
+             overlapping[i]) ||
+            (toPositions(snapshot->findEnclosed(box.x1, box.y1,
+                                                box.x2, box.y2)) !=
+             enclosed[i])) {
+          failures.fetch_add(1, std::memory_order_relaxed);
+        }
+        for (int position : overlapping[i]) {
+          snapshot->coords(ids[position]);
+        }
+        queries.fetch_add(1, std::memory_order_relaxed);
+        if (i == r) {
+          snapshot = std::atomic_load(&latest);
+        }
+      }
+    });
+  }
+
+  // Moved on every round so that new copies keep being made. The items are
+  // only changed here, as only the window's thread changes them on a canvas.
+  for (int round = 0; round < ROUNDS; round++) {
+    int step = (round % 2) ? -1 : 1;
+    for (int position : movers) {
+      scene[position]->move(step, 0);
+      scene[position]->revision++;
+    }
+    std::atomic_store(&latest, publisher.publish(scene, ++published));
+  }
+  // Let the readers go through the last snapshot a few times
+  while (queries.load(std::memory_order_relaxed) <
+         READERS * REGION_COUNT * 4) {
+    std::this_thread::yield();
+  }
+  stop.store(true, std::memory_order_relaxed);
+  for (auto &reader : readers) {
+    reader.join();
+  }
+
+  printf("%ld queries, %d failures\n", queries.load(), failures.load());
+  return failures ? 1 : 0;
+}
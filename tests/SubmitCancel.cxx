@@ -0,0 +1,126 @@
+/*!
+ * \file SubmitCancel.cxx
+ * \brief Submits work tied to items and takes the items off the canvas
+ * before and while the work runs, then checks that the tasks that hadn't
+ * started are skipped and that no continuation of a cancelled task runs.
+ *
+ * The canvas has one worker, which the test keeps busy to hold tasks back.
+ * There's no window, so the continuations only run when the test calls
+ * runCommands().
+ */
+
+#include <cstdio>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <Canvas.h>
+
+namespace {
+
+//! Lets a task through once opened
+struct Gate {
+  std::atomic<bool> reached{false};
+  std::atomic<bool> open{false};
+
+  void pass() {
+    reached.store(true);
+    while (!open.load()) {
+      std::this_thread::yield();
+    }
+  }
+
+  void waitReached() {
+    while (!reached.load()) {
+      std::this_thread::yield();
+    }
+  }
+};
+
+//! Waits for the worker to let go of the task holding \p sentinel, after which
+//! its continuation, if any, has been posted
+void waitDone(const std::weak_ptr<int> &sentinel) {
+  while (!sentinel.expired()) {
+    std::this_thread::yield();
+  }
+}
+
+int expect(const char *what, int count, int expected) {
+  printf("%s: %d, expected %d\n", what, count, expected);
+  return count != expected;
+}
+
+}  // namespace
+
+int main() {
+  GC::Canvas canv(0, 0, 400, 400);
+  // The window's thread and one worker
+  canv.parallelism(2);
+  int removed = canv.rectangle(10, 10, 50, 50);
+  int grouped = canv.rectangle(60, 10, 100, 50);
+  int instanced = canv.oval(110, 10, 150, 50);
+  int kept = canv.oval(160, 10, 200, 50);
+  int problems = 0;
+
+  // Taken off while the task runs: the task finishes, the result is dropped
+  Gate running;
+  int continued = 0;
+  std::shared_ptr<int> sentinel = std::make_shared<int>(0);
+  std::weak_ptr<int> first = sentinel;
+  canv.submit([sentinel, &running]() {
+    running.pass();
+    return 7;
+  }, [&continued](int) {
+    continued++;
+  }, removed);
+  sentinel.reset();
+  running.waitReached();
+  canv.removeShape(removed);
+  running.open.store(true);
+  waitDone(first);
+  canv.runCommands();
+  problems += expect("Continuations after removing the item", continued, 0);
+
+  // Held back behind a busy worker until the items are grouped or instanced
+  Gate busy;
+  canv.submit([&busy]() {
+    busy.pass();
+  }, []() {});
+  busy.waitReached();
+  std::atomic<int> started(0);
+  sentinel = std::make_shared<int>(0);
+  std::weak_ptr<int> second = sentinel;
+  canv.submit([sentinel, &started]() {
+    started.fetch_add(1);
+  }, [&continued]() {
+    continued++;
+  }, grouped);
+  sentinel = std::make_shared<int>(0);
+  std::weak_ptr<int> third = sentinel;
+  canv.submit([sentinel, &started]() {
+    started.fetch_add(1);
+    return 8;
+  }, [&continued](int) {
+    continued++;
+  }, instanced);
+  sentinel = std::make_shared<int>(0);
+  std::weak_ptr<int> fourth = sentinel;
+  int result = 0;
+  canv.submit([sentinel]() {
+    return 9;
+  }, [&result](int value) {
+    result = value;
+  }, kept);
+  sentinel.reset();
+  canv.group({grouped});
+  canv.instances(instanced);
+  busy.open.store(true);
+  waitDone(second);
+  waitDone(third);
+  waitDone(fourth);
+  canv.runCommands();
+  problems += expect("Tasks started after grouping or instancing", started, 0);
+  problems += expect("Continuations after grouping or instancing", continued,
+                     0);
+  problems += expect("Result for the item left alone", result, 9);
+  return problems ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+/*!
+ * \file ThreadPoolSteal.cxx
+ * \brief Queues tasks on a ThreadPool from outside and from its own workers
+ * and checks that every task runs exactly once, that the tasks a worker
+ * queues for itself are stolen by the idle ones, and that parallelFor() calls
+ * every index once on no more threads than it was given.
+ *
+ * Build with `TSAN=1` (`-DGDICANVAS_TSAN=ON` with CMake) to have
+ * ThreadSanitizer check the queues as well.
+ */
+
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include <ThreadPool.h>
+
+namespace {
+
+const int WORKERS = 4;
+const int CHILDREN = 64;
+const int TASKS = 20000;
+const int INDICES = 5000;
+
+//! Counts the threads that show up
+class Threads {
+  public:
+    void add() {
+      std::lock_guard<std::mutex> guard(lock);
+      ids.insert(std::this_thread::get_id());
+    }
+
+    int count() {
+      std::lock_guard<std::mutex> guard(lock);
+      return ids.size();
+    }
+
+  private:
+    std::mutex lock;
+    std::set<std::thread::id> ids;
+};
+
+//! A task queues its children on its own worker, the others have to steal
+//! them. Returns the number of problems found.
+int checkStealing() {
+  std::atomic<int> ran(0);
+  Threads threads;
+  {
+    GCanvas::ThreadPool pool(WORKERS);
+    std::atomic<bool> queued(false);
+    pool.run([&]() {
+      for (int i = 0; i < CHILDREN; i++) {
+        pool.run([&]() {
+          threads.add();
+          std::this_thread::sleep_for(std::chrono::milliseconds(2));
+          ran.fetch_add(1);
+        });
+      }
+      queued.store(true);
+    });
+    while (!queued.load() || (ran.load() < CHILDREN)) {
+      std::this_thread::yield();
+    }
+  }
+  bool failed = (ran.load() != CHILDREN) || (threads.count() < 2);
+  printf("Stealing: %d of %d children run on %d threads\n", ran.load(),
+         CHILDREN, threads.count());
+  return failed;
+}
+
+//! Tasks queued from outside and from the tasks, half of them still waiting
+//! when the pool is destroyed. Returns the number of problems found.
+int checkEveryTaskRuns() {
+  std::vector<std::atomic<int>> runs(2 * TASKS);
+  for (std::atomic<int> &count : runs) {
+    count.store(0);
+  }
+  {
+    GCanvas::ThreadPool pool(WORKERS);
+    for (int i = 0; i < TASKS; i++) {
+      pool.run([&pool, &runs, i]() {
+        runs[i].fetch_add(1);
+        pool.run([&runs, i]() {
+          runs[TASKS + i].fetch_add(1);
+        });
+      });
+    }
+  }
+  int problems = 0;
+  for (std::atomic<int> &count : runs) {
+    problems += (count.load() != 1);
+  }
+  printf("Every task: %d of %d run other than once\n", problems, 2 * TASKS);
+  return problems;
+}
+
+//! Returns the number of problems found
+int checkParallelFor() {
+  GCanvas::ThreadPool pool(WORKERS);
+  int problems = 0;
+  for (int threads = 0; threads <= WORKERS + 2; threads++) {
+    std::vector<std::atomic<int>> calls(INDICES);
+    for (std::atomic<int> &count : calls) {
+      count.store(0);
+    }
+    Threads seen;
+    pool.parallelFor(INDICES, [&](int i) {
+      seen.add();
+      calls[i].fetch_add(1);
+      if (i % 50 == 0) {
+        // Slow enough now and then for the helpers to join in
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+      }
+    }, threads);
+    int wrong = 0;
+    for (std::atomic<int> &count : calls) {
+      wrong += (count.load() != 1);
+    }
+    int allowed = threads ? threads : WORKERS + 1;
+    printf("parallelFor on %d threads: %d of %d indices called other than "
+           "once, %d threads used\n", threads, wrong, INDICES, seen.count());
+    problems += wrong + (seen.count() > allowed);
+  }
+  // Loops started from the workers, which have to finish even with every
+  // worker waiting on one
+  std::atomic<int> total(0);
+  std::atomic<int> finished(0);
+  for (int i = 0; i < 2 * WORKERS; i++) {
+    pool.run([&]() {
+      pool.parallelFor(INDICES, [&](int) {
+        total.fetch_add(1);
+      });
+      finished.fetch_add(1);
+    });
+  }
+  while (finished.load() < 2 * WORKERS) {
+    std::this_thread::yield();
+  }
+  printf("Nested parallelFor: %d of %d calls\n", total.load(),
+         2 * WORKERS * INDICES);
+  problems += (total.load() != 2 * WORKERS * INDICES);
+  return problems;
+}
+
+}  // namespace
+
+int main() {
+  int problems = checkStealing();
+  problems += checkEveryTaskRuns();
+  problems += checkParallelFor();
+  return problems ? 1 : 0;
+}